@@ -26,8 +26,6 @@
 namespace arch {
 namespace arm64 {
 namespace disassembler {
-#ifdef __KERNEL__
-
 bool initialized = false;
 
 size_t handle_arm64{};
@@ -242,7 +240,7 @@ xnu::mach::VmAddress DisassembleNthInstruction(xnu::mach::VmAddress address, arm
     size_t counter = 0;
 
     while (offset < lookup_size) {
-        size_t disasm_size = min(0x28, lookup_size);
+        size_t disasm_size = lookup_size < 0x28 ? lookup_size : 0x28;
 
         size_t disassembled =
             arch::arm64::disassembler::Disassemble(address + offset, disasm_size, &result);
@@ -283,8 +281,6 @@ xnu::mach::VmAddress DisassembleSignature(xnu::mach::VmAddress address,
                                           size_t lookup_size) {
     return 0;
 }
-
-#endif
 } // namespace Disassembler
 } // namespace arm64
 } // namespace arch
\ No newline at end of file
@@ -18,7 +18,7 @@
 
 #include <types.h>
 
-#include "machO.h"
+#include "macho.h"
 
 class MachO;
 
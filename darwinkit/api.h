@@ -28,7 +28,11 @@
 #include <stdint.h>
 #include <string.h>
 
+#ifdef __APPLE__
 #include <machine/limits.h>
+#else
+#include <limits.h>
+#endif
 
 enum kIOKernelDarwinKitOperation {
     kIOKernelDarwinKitHookKernelFunction,
@@ -68,6 +72,9 @@ enum kIOKernelDarwinKitOperation {
     kIOKernelDarwinKitCopyOut,
     kIOKernelDarwinKitCreateSharedMemory,
     kIOKernelDarwinKitMapSharedMemory,
+    kIOKernelDarwinKitKernelBatch,
+    kIOKernelDarwinKitSharedMemoryDoorbell,
+    kIOKernelDarwinKitSharedMemoryWait,
 };
 
 #define xStringify(a) Stringify(a)
@@ -86,6 +93,11 @@ extern void* kern_os_calloc(size_t num, size_t size);
 extern void* kern_os_realloc(void* addr, size_t nsize);
 extern void kern_os_free(void* addr);
 
+#if defined(__KERNEL__) || defined(__APPLE__)
+
+// other hosts get these from their own libc headers
 extern void* memmem(const void* h0, size_t k, const void* n0, size_t l);
 extern void* memchr(const void* src, int c, size_t n);
 extern void qsort(void* a, size_t n, size_t es, int (*cmp)(const void*, const void*));
+
+#endif
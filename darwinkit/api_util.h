@@ -16,9 +16,11 @@
 
 #pragma once
 
+#include <types.h>
+
 #include "log.h"
 
-#ifdef __USER__
+#if defined(__USER__) && defined(__APPLE__)
 
 #include <IOKit/IOKitLib.h>
 
@@ -40,9 +42,13 @@ extern "C" {
 
 #endif
 
+#ifdef __APPLE__
+
 #include <mach/mach_types.h>
 #include <mach/vm_types.h>
 
+#endif
+
 namespace xnu {
 class Kernel;
 }
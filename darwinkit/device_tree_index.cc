@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "device_tree_index.h"
+
+#include <string.h>
+
+namespace xnu {
+
+static inline UInt32 HashString(const char* string) {
+    UInt32 hash = 0x811C9DC5;
+
+    while (*string) {
+        hash ^= (UInt8)*string++;
+        hash *= 0x01000193;
+    }
+
+    return hash;
+}
+
+static inline UInt32 HashProperty(UInt32 node_index, const char* name) {
+    return HashString(name) ^ (node_index * 0x9E3779B1);
+}
+
+static inline UInt32 TableCapacity(UInt32 count) {
+    UInt32 capacity = 16;
+
+    // keep the load factor at or below one half
+    while (capacity < count * 2)
+        capacity <<= 1;
+
+    return capacity;
+}
+
+static inline bool IsTerminated(char* string, UInt32 size) {
+    for (UInt32 i = 0; i < size; i++) {
+        if (string[i] == '\0')
+            return true;
+    }
+
+    return false;
+}
+
+DeviceTreeIndex::DeviceTreeIndex(UInt8* buffer, Size size)
+    : buffer(buffer), size(size), nodes(nullptr), node_count(0), property_offsets(nullptr),
+      property_count(0), paths(nullptr), paths_size(0), path_table(nullptr), name_table(nullptr),
+      node_table_mask(0), property_table(nullptr), property_table_mask(0) {}
+
+DeviceTreeIndex::~DeviceTreeIndex() {
+    Reset();
+}
+
+void DeviceTreeIndex::Reset() {
+    if (nodes)
+        delete[] nodes;
+
+    if (property_offsets)
+        delete[] property_offsets;
+
+    if (paths)
+        delete[] paths;
+
+    if (path_table)
+        delete[] path_table;
+
+    if (name_table)
+        delete[] name_table;
+
+    if (property_table)
+        delete[] property_table;
+
+    nodes = nullptr;
+    property_offsets = nullptr;
+    paths = nullptr;
+    path_table = nullptr;
+    name_table = nullptr;
+    property_table = nullptr;
+
+    node_count = 0;
+    property_count = 0;
+    paths_size = 0;
+    node_table_mask = 0;
+    property_table_mask = 0;
+}
+
+bool DeviceTreeIndex::Parse() {
+    Reset();
+
+    if (!buffer || size < sizeof(DeviceTreeNode))
+        return false;
+
+    // first walk validates the blob and sizes the arrays, the second one fills them in
+    if (!Walk(false)) {
+        Reset();
+
+        return false;
+    }
+
+    nodes = new DeviceTreeIndexNode[node_count];
+    property_offsets = new UInt32[property_count ? property_count : 1];
+    paths = new char[paths_size];
+
+    if (!nodes || !property_offsets || !paths || !Walk(true) || !BuildTables()) {
+        Reset();
+
+        return false;
+    }
+
+    return true;
+}
+
+bool DeviceTreeIndex::ParseNode(Offset* offset, DeviceTreeIndexNode* node, bool record) {
+    DeviceTreeNode* header;
+
+    Offset start = *offset;
+    Offset p = start;
+
+    if (size - p < sizeof(DeviceTreeNode))
+        return false;
+
+    header = reinterpret_cast<DeviceTreeNode*>(buffer + p);
+
+    node->node = header;
+    node->name = nullptr;
+    node->first_property = property_count;
+    node->n_properties = header->n_properties;
+    node->n_children = header->n_children;
+    node->offset = start;
+
+    p += sizeof(DeviceTreeNode);
+
+    for (UInt32 i = 0; i < header->n_properties; i++) {
+        DeviceTreeProperty* property;
+
+        Offset property_offset = p;
+
+        UInt32 property_size;
+        UInt32 padded_size;
+
+        if (size - p < sizeof(DeviceTreeProperty))
+            return false;
+
+        property = reinterpret_cast<DeviceTreeProperty*>(buffer + p);
+
+        if (property->name[DT_KEY_LEN - 1] != '\0')
+            return false;
+
+        property_size = GetPropertySize(property);
+        padded_size = (property_size + 0x3) & ~0x3;
+
+        p += sizeof(DeviceTreeProperty);
+
+        if (size - p < property_size)
+            return false;
+
+        // the very last property of a blob is allowed to be unpadded
+        p += size - p < padded_size ? property_size : padded_size;
+
+        if (record)
+            property_offsets[property_count] = (UInt32)property_offset;
+
+        if (!node->name && strcmp(property->name, "name") == 0 &&
+            IsTerminated(property->val, property_size))
+            node->name = property->val;
+
+        property_count++;
+    }
+
+    node->size = p - start;
+
+    *offset = p;
+
+    return true;
+}
+
+bool DeviceTreeIndex::Walk(bool record) {
+    struct {
+        UInt32 index;
+        UInt32 remaining;
+
+        Size path_length;
+    } stack[kDeviceTreeMaxDepth];
+
+    DeviceTreeIndexNode scratch;
+
+    Offset offset = 0;
+
+    Size path_offset = 0;
+
+    UInt32 depth = 0;
+
+    node_count = 0;
+    property_count = 0;
+
+    // every node takes up at least its header, so the walk is bounded by the size of the blob
+    do {
+        DeviceTreeIndexNode* node = record ? &nodes[node_count] : &scratch;
+
+        Size prefix_length;
+        Size name_length;
+        Size path_length;
+
+        if (depth == kDeviceTreeMaxDepth)
+            return false;
+
+        node->parent = depth ? stack[depth - 1].index : kDeviceTreeNoParent;
+        node->depth = depth;
+
+        if (!ParseNode(&offset, node, record))
+            return false;
+
+        if (depth)
+            stack[depth - 1].remaining--;
+
+        // the root is "/", its children "/name" and everything further down "/parent/name"
+        prefix_length = depth > 1 ? stack[depth - 1].path_length : 0;
+        name_length = node->name ? strlen(node->name) : 0;
+        path_length = depth ? prefix_length + 1 + name_length : 1;
+
+        if (record) {
+            char* path = paths + path_offset;
+
+            if (prefix_length)
+                memcpy(path, nodes[node->parent].path, prefix_length);
+
+            path[prefix_length] = '/';
+
+            if (name_length)
+                memcpy(path + prefix_length + 1, node->name, name_length);
+
+            path[path_length] = '\0';
+
+            node->path = path;
+        }
+
+        path_offset += path_length + 1;
+
+        stack[depth].index = node_count;
+        stack[depth].remaining = node->n_children;
+        stack[depth].path_length = path_length;
+
+        depth++;
+        node_count++;
+
+        while (depth && !stack[depth - 1].remaining)
+            depth--;
+    } while (depth);
+
+    paths_size = path_offset;
+
+    return true;
+}
+
+bool DeviceTreeIndex::BuildTables() {
+    UInt32 node_capacity = TableCapacity(node_count);
+    UInt32 property_capacity = TableCapacity(property_count);
+
+    path_table = new UInt32[node_capacity];
+    name_table = new UInt32[node_capacity];
+    property_table = new UInt32[property_capacity];
+
+    if (!path_table || !name_table || !property_table)
+        return false;
+
+    memset(path_table, 0, node_capacity * sizeof(UInt32));
+    memset(name_table, 0, node_capacity * sizeof(UInt32));
+    memset(property_table, 0, property_capacity * sizeof(UInt32));
+
+    node_table_mask = node_capacity - 1;
+    property_table_mask = property_capacity - 1;
+
+    for (UInt32 i = 0; i < node_count; i++) {
+        DeviceTreeIndexNode* node = &nodes[i];
+
+        InsertNode(path_table, node->path, i, true);
+
+        if (node->name)
+            InsertNode(name_table, node->name, i, false);
+
+        for (UInt32 j = 0; j < node->n_properties; j++)
+            InsertProperty(i, node->first_property + j);
+    }
+
+    return true;
+}
+
+void DeviceTreeIndex::InsertNode(UInt32* table, const char* key, UInt32 index, bool by_path) {
+    UInt32 slot = HashString(key) & node_table_mask;
+
+    // names and even paths can repeat, the first node in tree order wins like it did for the
+    // recursive walk
+    while (table[slot]) {
+        DeviceTreeIndexNode* node = &nodes[table[slot] - 1];
+
+        if (strcmp(by_path ? node->path : node->name, key) == 0)
+            return;
+
+        slot = (slot + 1) & node_table_mask;
+    }
+
+    table[slot] = index + 1;
+}
+
+DeviceTreeIndexNode* DeviceTreeIndex::LookupNode(UInt32* table, const char* key, bool by_path) {
+    UInt32 slot;
+
+    if (!table || !key)
+        return nullptr;
+
+    slot = HashString(key) & node_table_mask;
+
+    while (table[slot]) {
+        DeviceTreeIndexNode* node = &nodes[table[slot] - 1];
+
+        if (strcmp(by_path ? node->path : node->name, key) == 0)
+            return node;
+
+        slot = (slot + 1) & node_table_mask;
+    }
+
+    return nullptr;
+}
+
+void DeviceTreeIndex::InsertProperty(UInt32 node_index, UInt32 property_index) {
+    DeviceTreeIndexNode* node = &nodes[node_index];
+
+    DeviceTreeProperty* property =
+        reinterpret_cast<DeviceTreeProperty*>(buffer + property_offsets[property_index]);
+
+    UInt32 slot = HashProperty(node_index, property->name) & property_table_mask;
+
+    while (property_table[slot]) {
+        UInt32 existing = property_table[slot] - 1;
+
+        if (existing >= node->first_property &&
+            existing < node->first_property + node->n_properties &&
+            strcmp(reinterpret_cast<DeviceTreeProperty*>(buffer + property_offsets[existing])->name,
+                   property->name) == 0)
+            return;
+
+        slot = (slot + 1) & property_table_mask;
+    }
+
+    property_table[slot] = property_index + 1;
+}
+
+DeviceTreeIndexNode* DeviceTreeIndex::FindNodeByPath(const char* path) {
+    return LookupNode(path_table, path, true);
+}
+
+DeviceTreeIndexNode* DeviceTreeIndex::FindNodeByName(const char* name) {
+    return LookupNode(name_table, name, false);
+}
+
+DeviceTreeIndexNode* DeviceTreeIndex::FindNode(const char* path_or_name) {
+    if (!path_or_name)
+        return nullptr;
+
+    return path_or_name[0] == '/' ? FindNodeByPath(path_or_name) : FindNodeByName(path_or_name);
+}
+
+DeviceTreeProperty* DeviceTreeIndex::FindProperty(DeviceTreeIndexNode* node, const char* name) {
+    UInt32 node_index;
+    UInt32 slot;
+
+    if (!node || !name || !property_table)
+        return nullptr;
+
+    node_index = node - nodes;
+
+    slot = HashProperty(node_index, name) & property_table_mask;
+
+    while (property_table[slot]) {
+        UInt32 index = property_table[slot] - 1;
+
+        if (index >= node->first_property && index < node->first_property + node->n_properties) {
+            DeviceTreeProperty* property =
+                reinterpret_cast<DeviceTreeProperty*>(buffer + property_offsets[index]);
+
+            if (strcmp(property->name, name) == 0)
+                return property;
+        }
+
+        slot = (slot + 1) & property_table_mask;
+    }
+
+    return nullptr;
+}
+
+DeviceTreeProperty* DeviceTreeIndex::FindProperty(const char* path_or_name, const char* name) {
+    return FindProperty(FindNode(path_or_name), name);
+}
+
+}; // namespace xnu
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+namespace xnu {
+
+#define DT_KEY_LEN 0x20
+
+#define DT_PROPERTY_SIZE_MASK 0x7FFFFFFF
+
+struct DeviceTreeNode {
+    UInt32 n_properties;
+    UInt32 n_children;
+};
+
+struct DeviceTreeProperty {
+    char name[DT_KEY_LEN];
+    UInt32 size;
+
+    char val[0];
+};
+
+static constexpr UInt32 kDeviceTreeMaxDepth = 64;
+
+static constexpr UInt32 kDeviceTreeNoParent = 0xFFFFFFFF;
+
+/**
+ *  A node of the flattened device tree as seen by DeviceTreeIndex.
+ *
+ *  The node, its name and its properties all point into the original device tree buffer,
+ *  only the path is owned by the index.
+ */
+struct DeviceTreeIndexNode {
+    DeviceTreeNode* node;
+
+    char* name;
+    char* path;
+
+    UInt32 parent;
+    UInt32 depth;
+
+    UInt32 first_property;
+    UInt32 n_properties;
+    UInt32 n_children;
+
+    Offset offset;
+
+    // header and properties only, children follow right after
+    Size size;
+};
+
+/**
+ *  Zero-copy index over a flattened device tree blob.
+ *
+ *  Parse() walks the blob once to validate and size it and once more to record every node and
+ *  the offset of each of its properties. Afterwards nodes are found by path ("/", "/chosen",
+ *  "/arm-io/uart0") or by name, and properties by node and name, through open-addressed hash
+ *  tables instead of re-walking the tree from the root. Nothing from the blob is copied, so the
+ *  buffer has to outlive the index.
+ *
+ *  This file is shared with the kernel build and does not use the STL, it builds on the host
+ *  as well so that device tree dumps can be inspected and tested off-device.
+ */
+class DeviceTreeIndex {
+public:
+    explicit DeviceTreeIndex(UInt8* buffer, Size size);
+
+    ~DeviceTreeIndex();
+
+    bool Parse();
+
+    UInt8* GetBuffer() {
+        return buffer;
+    }
+
+    Size GetSize() {
+        return size;
+    }
+
+    UInt32 GetNodeCount() {
+        return node_count;
+    }
+
+    UInt32 GetPropertyCount() {
+        return property_count;
+    }
+
+    DeviceTreeIndexNode* GetRoot() {
+        return node_count ? &nodes[0] : nullptr;
+    }
+
+    DeviceTreeIndexNode* GetNode(UInt32 index) {
+        return index < node_count ? &nodes[index] : nullptr;
+    }
+
+    DeviceTreeIndexNode* GetParent(DeviceTreeIndexNode* node) {
+        return GetNode(node->parent);
+    }
+
+    DeviceTreeProperty* GetProperty(DeviceTreeIndexNode* node, UInt32 index) {
+        return index < node->n_properties
+                   ? reinterpret_cast<DeviceTreeProperty*>(
+                         buffer + property_offsets[node->first_property + index])
+                   : nullptr;
+    }
+
+    static UInt32 GetPropertySize(DeviceTreeProperty* property) {
+        return property->size & DT_PROPERTY_SIZE_MASK;
+    }
+
+    DeviceTreeIndexNode* FindNodeByPath(const char* path);
+
+    DeviceTreeIndexNode* FindNodeByName(const char* name);
+
+    DeviceTreeIndexNode* FindNode(const char* path_or_name);
+
+    DeviceTreeProperty* FindProperty(DeviceTreeIndexNode* node, const char* name);
+
+    DeviceTreeProperty* FindProperty(const char* path_or_name, const char* name);
+
+private:
+    UInt8* buffer;
+    Size size;
+
+    DeviceTreeIndexNode* nodes;
+    UInt32 node_count;
+
+    UInt32* property_offsets;
+    UInt32 property_count;
+
+    char* paths;
+    Size paths_size;
+
+    UInt32* path_table;
+    UInt32* name_table;
+    UInt32 node_table_mask;
+
+    UInt32* property_table;
+    UInt32 property_table_mask;
+
+    void Reset();
+
+    bool Walk(bool record);
+
+    bool ParseNode(Offset* offset, DeviceTreeIndexNode* node, bool record);
+
+    bool BuildTables();
+
+    void InsertNode(UInt32* table, const char* key, UInt32 index, bool by_path);
+
+    DeviceTreeIndexNode* LookupNode(UInt32* table, const char* key, bool by_path);
+
+    void InsertProperty(UInt32 node_index, UInt32 property_index);
+};
+
+}; // namespace xnu
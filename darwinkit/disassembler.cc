@@ -34,8 +34,6 @@ enum DisassemblerType Disassembler::GetDisassemblerFromArch() {
 
 void Disassembler::InitDisassembler() {
     switch (architecture) {
-#ifdef __KERNEL__
-
     case ARCH_x86_64:
         arch::x86_64::disassembler::Init();
 
@@ -44,7 +42,6 @@ void Disassembler::InitDisassembler() {
         arch::arm64::disassembler::Init();
 
         break;
-#endif
     default:
         break;
     }
@@ -71,9 +68,34 @@ Size Disassembler::Disassemble(xnu::mach::VmAddress address, Size size, cs_insn*
     return 0;
 }
 
+#ifdef __USER__
+
+Size Disassembler::CopyInstructions(xnu::mach::VmAddress address, Size min, UInt8* code) {
+    Size size = min + kMaxInstructionSize;
+
+    if (size > kInstructionWindowSize)
+        return 0;
+
+    // the function may end right at the edge of a mapping, so fall back to exactly min bytes
+    if (task->Read(address, code, size))
+        return size;
+
+    return task->Read(address, code, min) ? min : 0;
+}
+
+#endif
+
 Size Disassembler::QuickInstructionSize(xnu::mach::VmAddress address, Size min) {
+#ifdef __USER__
+    UInt8 code[kInstructionWindowSize] = {};
+
+    if (!CopyInstructions(address, min, code))
+        return 0;
+
+    address = reinterpret_cast<xnu::mach::VmAddress>(code);
+#endif
+
     switch (architecture) {
-#ifdef __KERNEL__
     case ARCH_x86_64:
         return arch::x86_64::disassembler::QuickInstructionSize(address, min);
 
@@ -82,7 +104,6 @@ Size Disassembler::QuickInstructionSize(xnu::mach::VmAddress address, Size min)
         return arch::arm64::disassembler::QuickInstructionSize(address, min);
 
         break;
-#endif
     default:
         break;
     }
@@ -91,8 +112,16 @@ Size Disassembler::QuickInstructionSize(xnu::mach::VmAddress address, Size min)
 }
 
 Size Disassembler::InstructionSize(xnu::mach::VmAddress address, Size min) {
+#ifdef __USER__
+    UInt8 code[kInstructionWindowSize] = {};
+
+    if (!CopyInstructions(address, min, code))
+        return 0;
+
+    address = reinterpret_cast<xnu::mach::VmAddress>(code);
+#endif
+
     switch (architecture) {
-#ifdef __KERNEL__
     case ARCH_x86_64:
         return arch::x86_64::disassembler::InstructionSize(address, min);
 
@@ -101,7 +130,6 @@ Size Disassembler::InstructionSize(xnu::mach::VmAddress address, Size min) {
         return arch::arm64::disassembler::InstructionSize(address, min);
 
         break;
-#endif
     default:
         break;
     }
@@ -55,6 +55,12 @@ enum DisassemblerType {
     DisassemblerType_None,
 };
 
+// longest instruction on any architecture we disassemble
+static constexpr Size kMaxInstructionSize = 15;
+
+// bytes copied out of the task to size the instructions at an address in user builds
+static constexpr Size kInstructionWindowSize = 128;
+
 class Disassembler {
 public:
     explicit Disassembler(xnu::Task* task);
@@ -100,4 +106,9 @@ private:
     xnu::Task* task;
 
     enum DisassemblerType GetDisassemblerFromArch();
+
+#ifdef __USER__
+    // the arch disassemblers decode host memory, so user builds decode a copy of the task's bytes
+    Size CopyInstructions(xnu::mach::VmAddress address, Size min, UInt8* code);
+#endif
 };
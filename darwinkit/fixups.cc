@@ -0,0 +1,1281 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fixups.h"
+
+#include <string.h>
+
+namespace darwin {
+namespace dyld {
+
+static inline Int64 SignExtend(UInt64 value, UInt32 bits) {
+    return (Int64)(value << (64 - bits)) >> (64 - bits);
+}
+
+static inline bool ReadUleb128(UInt8** p, UInt8* end, UInt64* value) {
+    UInt64 result = 0;
+
+    UInt32 bit = 0;
+
+    do {
+        if (*p >= end || bit >= 64)
+            return false;
+
+        result |= (UInt64)(**p & 0x7F) << bit;
+
+        bit += 7;
+    } while (*(*p)++ & 0x80);
+
+    *value = result;
+
+    return true;
+}
+
+static inline bool ReadSleb128(UInt8** p, UInt8* end, Int64* value) {
+    Int64 result = 0;
+
+    UInt32 bit = 0;
+
+    UInt8 byte;
+
+    do {
+        if (*p >= end || bit >= 64)
+            return false;
+
+        byte = *(*p)++;
+
+        result |= (Int64)(byte & 0x7F) << bit;
+
+        bit += 7;
+    } while (byte & 0x80);
+
+    if ((byte & 0x40) && bit < 64)
+        result |= -((Int64)1 << bit);
+
+    *value = result;
+
+    return true;
+}
+
+FixupDecoder::FixupDecoder(UInt8* buffer, Size size)
+    : buffer(buffer), size(size), base(0), segments(nullptr), segment_count(0),
+      chained_fixups(nullptr), chained_fixups_size(0), thread_starts(nullptr),
+      thread_starts_count(0), dyld_info(nullptr), batch_count(0), stopped(false) {}
+
+FixupDecoder::~FixupDecoder() {
+    if (segments)
+        delete[] segments;
+}
+
+bool FixupDecoder::Parse() {
+    struct mach_header_64* header;
+
+    UInt8* q;
+    UInt8* end;
+
+    UInt32 nsegments;
+
+    if (!buffer || size < sizeof(struct mach_header_64))
+        return false;
+
+    header = reinterpret_cast<struct mach_header_64*>(buffer);
+
+    if (header->magic != MH_MAGIC_64 ||
+        sizeof(struct mach_header_64) + (Size)header->sizeofcmds > size)
+        return false;
+
+    end = buffer + sizeof(struct mach_header_64) + header->sizeofcmds;
+
+    nsegments = 0;
+
+    q = buffer + sizeof(struct mach_header_64);
+
+    for (UInt32 i = 0; i < header->ncmds; i++) {
+        struct load_command* load_cmd = reinterpret_cast<struct load_command*>(q);
+
+        if (q + sizeof(struct load_command) > end || load_cmd->cmdsize < sizeof(struct load_command) ||
+            q + load_cmd->cmdsize > end)
+            return false;
+
+        if (load_cmd->cmd == LC_SEGMENT_64)
+            nsegments++;
+
+        q += load_cmd->cmdsize;
+    }
+
+    if (segments)
+        delete[] segments;
+
+    segments = nsegments ? new FixupSegment[nsegments] : nullptr;
+    segment_count = 0;
+
+    q = buffer + sizeof(struct mach_header_64);
+
+    for (UInt32 i = 0; i < header->ncmds; i++) {
+        struct load_command* load_cmd = reinterpret_cast<struct load_command*>(q);
+
+        switch (load_cmd->cmd) {
+        case LC_SEGMENT_64: {
+            struct segment_command_64* segment = reinterpret_cast<struct segment_command_64*>(q);
+
+            FixupSegment* fixup_segment = &segments[segment_count++];
+
+            fixup_segment->vmaddr = segment->vmaddr;
+            fixup_segment->vmsize = segment->vmsize;
+            fixup_segment->fileoff = segment->fileoff;
+            fixup_segment->filesize = segment->filesize;
+
+            if (!base && segment->fileoff == 0 && segment->filesize)
+                base = segment->vmaddr;
+
+            if (strncmp(segment->segname, "__TEXT", sizeof(segment->segname)) != 0)
+                break;
+
+            for (UInt32 j = 0; j < segment->nsects; j++) {
+                struct section_64* section = reinterpret_cast<struct section_64*>(
+                    q + sizeof(struct segment_command_64) + sizeof(struct section_64) * j);
+
+                if (reinterpret_cast<UInt8*>(section + 1) > q + load_cmd->cmdsize)
+                    break;
+
+                if (strncmp(section->sectname, "__thread_starts", sizeof(section->sectname)) ==
+                        0 &&
+                    section->offset + section->size <= size && section->size >= sizeof(UInt32)) {
+                    thread_starts = reinterpret_cast<UInt32*>(buffer + section->offset);
+                    thread_starts_count = section->size / sizeof(UInt32);
+                }
+            }
+
+            break;
+        }
+        case LC_DYLD_CHAINED_FIXUPS: {
+            struct linkedit_data_command* data =
+                reinterpret_cast<struct linkedit_data_command*>(q);
+
+            if ((UInt64)data->dataoff + data->datasize <= size &&
+                data->datasize >= sizeof(struct dyld_chained_fixups_header)) {
+                chained_fixups =
+                    reinterpret_cast<struct dyld_chained_fixups_header*>(buffer + data->dataoff);
+                chained_fixups_size = data->datasize;
+            }
+
+            break;
+        }
+        case LC_DYLD_INFO:
+        case LC_DYLD_INFO_ONLY:
+            dyld_info = reinterpret_cast<struct dyld_info_command*>(q);
+
+            break;
+        }
+
+        q += load_cmd->cmdsize;
+    }
+
+    return true;
+}
+
+Size FixupDecoder::ChainStride(UInt16 pointer_format) {
+    switch (pointer_format) {
+    case kThreadedPointerFormat:
+    case DYLD_CHAINED_PTR_ARM64E:
+    case DYLD_CHAINED_PTR_ARM64E_KERNEL:
+    case DYLD_CHAINED_PTR_ARM64E_USERLAND:
+    case DYLD_CHAINED_PTR_ARM64E_USERLAND24:
+        return 8;
+    case DYLD_CHAINED_PTR_64:
+    case DYLD_CHAINED_PTR_64_OFFSET:
+    case DYLD_CHAINED_PTR_64_KERNEL_CACHE:
+        return 4;
+    case DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+void FixupDecoder::RebasePointers(UInt64* pointers, Size count, Int64 slide) {
+    for (Size i = 0; i < count; i++)
+        pointers[i] += slide;
+}
+
+void FixupDecoder::RebaseChainedPointers(UInt16 pointer_format, UInt64* pointers, Size count,
+                                         xnu::mach::VmAddress base, Int64 slide) {
+    // every loop below is free of branches so that the compiler can vectorize it,
+    // binds are left untouched for the caller to resolve
+    switch (pointer_format) {
+    case kThreadedPointerFormat:
+        for (Size i = 0; i < count; i++) {
+            UInt64 v = pointers[i];
+
+            UInt64 plain = (UInt64)SignExtend(v, 51) + slide;
+            UInt64 auth = (v & 0xFFFFFFFF) + base + slide;
+
+            UInt64 rebased = (v >> 63) ? auth : plain;
+
+            pointers[i] = ((v >> 62) & 1) ? v : rebased;
+        }
+
+        break;
+    case DYLD_CHAINED_PTR_ARM64E:
+    case DYLD_CHAINED_PTR_ARM64E_KERNEL:
+    case DYLD_CHAINED_PTR_ARM64E_USERLAND:
+    case DYLD_CHAINED_PTR_ARM64E_USERLAND24: {
+        UInt64 plain_base = pointer_format == DYLD_CHAINED_PTR_ARM64E ? 0 : base;
+
+        for (Size i = 0; i < count; i++) {
+            UInt64 v = pointers[i];
+
+            UInt64 high8 = (v >> 43) & 0xFF;
+
+            UInt64 plain = (high8 << 56) | ((v & 0x7FFFFFFFFFFULL) + plain_base + slide);
+            UInt64 auth = (v & 0xFFFFFFFF) + base + slide;
+
+            UInt64 rebased = (v >> 63) ? auth : plain;
+
+            pointers[i] = ((v >> 62) & 1) ? v : rebased;
+        }
+
+        break;
+    }
+    case DYLD_CHAINED_PTR_64:
+    case DYLD_CHAINED_PTR_64_OFFSET: {
+        UInt64 plain_base = pointer_format == DYLD_CHAINED_PTR_64_OFFSET ? base : 0;
+
+        for (Size i = 0; i < count; i++) {
+            UInt64 v = pointers[i];
+
+            UInt64 high8 = (v >> 36) & 0xFF;
+
+            UInt64 plain = (high8 << 56) | ((v & 0xFFFFFFFFFULL) + plain_base + slide);
+
+            pointers[i] = (v >> 63) ? v : plain;
+        }
+
+        break;
+    }
+    case DYLD_CHAINED_PTR_64_KERNEL_CACHE:
+    case DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE:
+        for (Size i = 0; i < count; i++)
+            pointers[i] = (pointers[i] & 0x3FFFFFFF) + base + slide;
+
+        break;
+    }
+}
+
+struct dyld_chained_starts_in_segment* FixupDecoder::GetChainedStarts(UInt32 segment_index) {
+    struct dyld_chained_starts_in_image* starts_in_image;
+    struct dyld_chained_starts_in_segment* starts;
+
+    UInt32 seg_info_offset;
+
+    if (!chained_fixups ||
+        (UInt64)chained_fixups->starts_offset + sizeof(struct dyld_chained_starts_in_image) >
+            chained_fixups_size)
+        return nullptr;
+
+    starts_in_image = reinterpret_cast<struct dyld_chained_starts_in_image*>(
+        reinterpret_cast<UInt8*>(chained_fixups) + chained_fixups->starts_offset);
+
+    if (segment_index >= starts_in_image->seg_count ||
+        chained_fixups->starts_offset + sizeof(struct dyld_chained_starts_in_image) +
+                (UInt64)(segment_index + 1) * sizeof(UInt32) >
+            chained_fixups_size)
+        return nullptr;
+
+    seg_info_offset = starts_in_image->seg_info_offset[segment_index];
+
+    if (!seg_info_offset || (UInt64)chained_fixups->starts_offset + seg_info_offset +
+                                    offsetof(struct dyld_chained_starts_in_segment, page_start) >
+                                chained_fixups_size)
+        return nullptr;
+
+    starts = reinterpret_cast<struct dyld_chained_starts_in_segment*>(
+        reinterpret_cast<UInt8*>(starts_in_image) + seg_info_offset);
+
+    if ((UInt64)chained_fixups->starts_offset + seg_info_offset +
+            offsetof(struct dyld_chained_starts_in_segment, page_start) +
+            (UInt64)starts->page_count * sizeof(UInt16) >
+        chained_fixups_size)
+        return nullptr;
+
+    return starts;
+}
+
+FixupSegment* FixupDecoder::SegmentForFileOffset(Offset offset) {
+    for (UInt32 i = 0; i < segment_count; i++) {
+        FixupSegment* segment = &segments[i];
+
+        if (offset >= segment->fileoff && offset < segment->fileoff + segment->filesize)
+            return segment;
+    }
+
+    return nullptr;
+}
+
+bool FixupDecoder::SegmentOffsetToFileOffset(UInt32 segment_index, UInt64 segment_offset,
+                                             Offset* offset) {
+    FixupSegment* segment;
+
+    if (segment_index >= segment_count)
+        return false;
+
+    segment = &segments[segment_index];
+
+    if (segment_offset + sizeof(UInt64) > segment->filesize ||
+        segment->fileoff + segment_offset + sizeof(UInt64) > size)
+        return false;
+
+    *offset = segment->fileoff + segment_offset;
+
+    return true;
+}
+
+void FixupDecoder::Begin() {
+    batch_count = 0;
+
+    stopped = false;
+}
+
+bool FixupDecoder::End(bool ok, FixupCallback callback, void* context) {
+    if (!ok) {
+        batch_count = 0;
+
+        return false;
+    }
+
+    return Flush(callback, context);
+}
+
+bool FixupDecoder::Emit(Fixup* fixup, FixupCallback callback, void* context) {
+    batch[batch_count++] = *fixup;
+
+    if (batch_count == kFixupBatchSize)
+        return Flush(callback, context);
+
+    return true;
+}
+
+bool FixupDecoder::Flush(FixupCallback callback, void* context) {
+    Size count = batch_count;
+
+    batch_count = 0;
+
+    if (count && !callback(context, batch, count)) {
+        stopped = true;
+
+        return false;
+    }
+
+    return true;
+}
+
+bool FixupDecoder::ResolveChainedImport(UInt32 ordinal, Fixup* fixup) {
+    UInt8* imports;
+
+    char* symbols;
+
+    UInt32 name_offset;
+
+    Size import_size;
+
+    fixup->target = ordinal;
+
+    if (!chained_fixups || ordinal >= chained_fixups->imports_count)
+        return true;
+
+    switch (chained_fixups->imports_format) {
+    case DYLD_CHAINED_IMPORT:
+        import_size = sizeof(struct dyld_chained_import);
+
+        break;
+    case DYLD_CHAINED_IMPORT_ADDEND:
+        import_size = sizeof(struct dyld_chained_import_addend);
+
+        break;
+    case DYLD_CHAINED_IMPORT_ADDEND64:
+        import_size = sizeof(struct dyld_chained_import_addend64);
+
+        break;
+    default:
+        return true;
+    }
+
+    if ((UInt64)chained_fixups->imports_offset + (UInt64)(ordinal + 1) * import_size >
+        chained_fixups_size)
+        return true;
+
+    imports = reinterpret_cast<UInt8*>(chained_fixups) + chained_fixups->imports_offset;
+
+    switch (chained_fixups->imports_format) {
+    case DYLD_CHAINED_IMPORT: {
+        struct dyld_chained_import* import =
+            reinterpret_cast<struct dyld_chained_import*>(imports) + ordinal;
+
+        fixup->library_ordinal = (Int8)import->lib_ordinal;
+
+        name_offset = import->name_offset;
+
+        break;
+    }
+    case DYLD_CHAINED_IMPORT_ADDEND: {
+        struct dyld_chained_import_addend* import =
+            reinterpret_cast<struct dyld_chained_import_addend*>(imports) + ordinal;
+
+        fixup->library_ordinal = (Int8)import->lib_ordinal;
+        fixup->addend += import->addend;
+
+        name_offset = import->name_offset;
+
+        break;
+    }
+    default: {
+        struct dyld_chained_import_addend64* import =
+            reinterpret_cast<struct dyld_chained_import_addend64*>(imports) + ordinal;
+
+        fixup->library_ordinal = (Int16)import->lib_ordinal;
+        fixup->addend += import->addend;
+
+        name_offset = import->name_offset;
+
+        break;
+    }
+    }
+
+    if ((UInt64)chained_fixups->symbols_offset + name_offset < chained_fixups_size) {
+        symbols = reinterpret_cast<char*>(chained_fixups) + chained_fixups->symbols_offset;
+
+        fixup->symbol = symbols + name_offset;
+    }
+
+    return true;
+}
+
+bool FixupDecoder::DecodeChainedPointer(UInt16 pointer_format, UInt64 raw, Fixup* fixup,
+                                        UInt32* next) {
+    switch (pointer_format) {
+    case DYLD_CHAINED_PTR_ARM64E:
+    case DYLD_CHAINED_PTR_ARM64E_KERNEL:
+    case DYLD_CHAINED_PTR_ARM64E_USERLAND:
+    case DYLD_CHAINED_PTR_ARM64E_USERLAND24: {
+        bool bind = (raw >> 62) & 1;
+
+        fixup->auth = (raw >> 63) & 1;
+
+        *next = (raw >> 51) & 0x7FF;
+
+        if (fixup->auth) {
+            fixup->diversity = (raw >> 32) & 0xFFFF;
+            fixup->addr_div = (raw >> 48) & 1;
+            fixup->key = (raw >> 49) & 3;
+        }
+
+        if (bind) {
+            UInt32 ordinal = pointer_format == DYLD_CHAINED_PTR_ARM64E_USERLAND24
+                                 ? raw & 0xFFFFFF
+                                 : raw & 0xFFFF;
+
+            fixup->kind = kFixupBind;
+
+            if (!fixup->auth)
+                fixup->addend = SignExtend((raw >> 32) & 0x7FFFF, 19);
+
+            return ResolveChainedImport(ordinal, fixup);
+        }
+
+        fixup->kind = kFixupRebase;
+
+        if (fixup->auth) {
+            fixup->target = base + (raw & 0xFFFFFFFF);
+        } else {
+            UInt64 high8 = (raw >> 43) & 0xFF;
+
+            fixup->target = raw & 0x7FFFFFFFFFFULL;
+
+            if (pointer_format != DYLD_CHAINED_PTR_ARM64E)
+                fixup->target += base;
+
+            fixup->target |= high8 << 56;
+        }
+
+        return true;
+    }
+    case DYLD_CHAINED_PTR_64:
+    case DYLD_CHAINED_PTR_64_OFFSET: {
+        *next = (raw >> 51) & 0xFFF;
+
+        if (raw >> 63) {
+            fixup->kind = kFixupBind;
+            fixup->addend = (raw >> 24) & 0xFF;
+
+            return ResolveChainedImport(raw & 0xFFFFFF, fixup);
+        }
+
+        fixup->kind = kFixupRebase;
+        fixup->target = raw & 0xFFFFFFFFFULL;
+
+        if (pointer_format == DYLD_CHAINED_PTR_64_OFFSET)
+            fixup->target += base;
+
+        fixup->target |= ((raw >> 36) & 0xFF) << 56;
+
+        return true;
+    }
+    case DYLD_CHAINED_PTR_64_KERNEL_CACHE:
+    case DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE:
+        *next = (raw >> 51) & 0xFFF;
+
+        fixup->kind = kFixupRebase;
+        fixup->target = base + (raw & 0x3FFFFFFF);
+        fixup->diversity = (raw >> 32) & 0xFFFF;
+        fixup->addr_div = (raw >> 48) & 1;
+        fixup->key = (raw >> 49) & 3;
+        fixup->auth = (raw >> 63) & 1;
+
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool FixupDecoder::DecodeThreadedPointer(UInt64 raw, Fixup* fixup, UInt32* next) {
+    fixup->auth = (raw >> 63) & 1;
+
+    *next = (raw >> 51) & 0x7FF;
+
+    if (fixup->auth) {
+        fixup->diversity = (raw >> 32) & 0xFFFF;
+        fixup->addr_div = (raw >> 48) & 1;
+        fixup->key = (raw >> 49) & 3;
+    }
+
+    if ((raw >> 62) & 1) {
+        // the ordinal indexes the table built by BIND_OPCODE_THREADED
+        fixup->kind = kFixupBind;
+        fixup->target = raw & 0xFFFF;
+
+        return true;
+    }
+
+    fixup->kind = kFixupRebase;
+    fixup->target = fixup->auth ? base + (raw & 0xFFFFFFFF) : (UInt64)SignExtend(raw, 51);
+
+    return true;
+}
+
+bool FixupDecoder::WalkChain(Offset offset, UInt16 pointer_format, Size stride,
+                             FixupCallback callback, void* context) {
+    FixupSegment* segment = SegmentForFileOffset(offset);
+
+    for (;;) {
+        Fixup fixup;
+
+        UInt64 raw;
+
+        UInt32 next;
+
+        if (offset < 0 || offset + sizeof(UInt64) > size)
+            return false;
+
+        if (!segment || offset < segment->fileoff ||
+            offset >= segment->fileoff + segment->filesize)
+            segment = SegmentForFileOffset(offset);
+
+        memcpy(&raw, buffer + offset, sizeof(raw));
+
+        memset(&fixup, 0, sizeof(fixup));
+
+        if (pointer_format == kThreadedPointerFormat) {
+            if (!DecodeThreadedPointer(raw, &fixup, &next))
+                return false;
+        } else if (!DecodeChainedPointer(pointer_format, raw, &fixup, &next)) {
+            return false;
+        }
+
+        fixup.offset = offset;
+        fixup.address = segment ? segment->vmaddr + (offset - segment->fileoff) : 0;
+
+        if (!Emit(&fixup, callback, context))
+            return false;
+
+        if (!next)
+            return true;
+
+        offset += next * stride;
+    }
+}
+
+bool FixupDecoder::WalkChainedPage(UInt32 segment_index, UInt32 page_index,
+                                   FixupCallback callback, void* context) {
+    struct dyld_chained_starts_in_segment* starts = GetChainedStarts(segment_index);
+
+    UInt16 start;
+
+    Size stride;
+
+    if (!starts || page_index >= starts->page_count)
+        return true;
+
+    start = starts->page_start[page_index];
+
+    // multiple starts per page are only used by the 32-bit formats
+    if (start == DYLD_CHAINED_PTR_START_NONE || (start & DYLD_CHAINED_PTR_START_MULTI))
+        return true;
+
+    stride = ChainStride(starts->pointer_format);
+
+    if (!stride || segment_index >= segment_count)
+        return false;
+
+    return WalkChain(segments[segment_index].fileoff + (Offset)page_index * starts->page_size +
+                         start,
+                     starts->pointer_format, stride, callback, context);
+}
+
+bool FixupDecoder::WalkChainedFixups(FixupCallback callback, void* context) {
+    for (UInt32 i = 0; i < segment_count; i++) {
+        struct dyld_chained_starts_in_segment* starts = GetChainedStarts(i);
+
+        if (!starts)
+            continue;
+
+        for (UInt32 j = 0; j < starts->page_count; j++) {
+            if (!WalkChainedPage(i, j, callback, context))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool FixupDecoder::WalkThreadStarts(FixupCallback callback, void* context) {
+    Size stride;
+
+    if (!thread_starts)
+        return true;
+
+    stride = (thread_starts[0] & 1) ? 8 : 4;
+
+    for (Size i = 1; i < thread_starts_count; i++) {
+        if (thread_starts[i] == 0xFFFFFFFF)
+            break;
+
+        if (!WalkChain(thread_starts[i], kThreadedPointerFormat, stride, callback, context))
+            return false;
+    }
+
+    return true;
+}
+
+bool FixupDecoder::WalkRebaseOpcodes(FixupCallback callback, void* context, Int64 slide,
+                                     Size* rebased) {
+    UInt8* p;
+    UInt8* end;
+
+    UInt8 type;
+
+    UInt32 segment_index;
+    UInt64 segment_offset;
+
+    if (!dyld_info || !dyld_info->rebase_size)
+        return true;
+
+    if ((UInt64)dyld_info->rebase_off + dyld_info->rebase_size > size)
+        return false;
+
+    p = buffer + dyld_info->rebase_off;
+    end = p + dyld_info->rebase_size;
+
+    type = 0;
+
+    segment_index = 0;
+    segment_offset = 0;
+
+    // handles count rebases step bytes apart and moves past them, a run is checked as a whole
+    // so that applying one can slide it in a single pass
+    auto rebase = [&](UInt64 count, UInt64 step) -> bool {
+        Offset offset;
+        Offset last;
+
+        UInt64 start;
+
+        if (!count)
+            return true;
+
+        if (count - 1 > (~0ULL - segment_offset) / step ||
+            !SegmentOffsetToFileOffset(segment_index, segment_offset, &offset) ||
+            !SegmentOffsetToFileOffset(segment_index, segment_offset + (count - 1) * step, &last))
+            return false;
+
+        start = segment_offset;
+
+        segment_offset += count * step;
+
+        if (type != REBASE_TYPE_POINTER)
+            return true;
+
+        if (rebased) {
+            if (step == sizeof(UInt64) && (offset & (sizeof(UInt64) - 1)) == 0) {
+                RebasePointers(reinterpret_cast<UInt64*>(buffer + offset), count, slide);
+            } else {
+                for (UInt64 i = 0; i < count; i++) {
+                    UInt64 value;
+
+                    memcpy(&value, buffer + offset + i * step, sizeof(value));
+
+                    value += slide;
+
+                    memcpy(buffer + offset + i * step, &value, sizeof(value));
+                }
+            }
+
+            *rebased += count;
+
+            return true;
+        }
+
+        for (UInt64 i = 0; i < count; i++) {
+            Fixup fixup;
+
+            memset(&fixup, 0, sizeof(fixup));
+
+            fixup.kind = kFixupRebase;
+            fixup.offset = offset + i * step;
+            fixup.address = segments[segment_index].vmaddr + start + i * step;
+
+            memcpy(&fixup.target, buffer + fixup.offset, sizeof(fixup.target));
+
+            if (!Emit(&fixup, callback, context))
+                return false;
+        }
+
+        return true;
+    };
+
+    while (p < end) {
+        UInt8 immediate = *p & REBASE_IMMEDIATE_MASK;
+        UInt8 opcode = *p & REBASE_OPCODE_MASK;
+
+        UInt64 count;
+        UInt64 skip;
+
+        p++;
+
+        switch (opcode) {
+        case REBASE_OPCODE_DONE:
+            return true;
+        case REBASE_OPCODE_SET_TYPE_IMM:
+            type = immediate;
+
+            break;
+        case REBASE_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB:
+            segment_index = immediate;
+
+            if (!ReadUleb128(&p, end, &segment_offset))
+                return false;
+
+            break;
+        case REBASE_OPCODE_ADD_ADDR_ULEB:
+            if (!ReadUleb128(&p, end, &skip))
+                return false;
+
+            segment_offset += skip;
+
+            break;
+        case REBASE_OPCODE_ADD_ADDR_IMM_SCALED:
+            segment_offset += immediate * sizeof(UInt64);
+
+            break;
+        case REBASE_OPCODE_DO_REBASE_IMM_TIMES:
+        case REBASE_OPCODE_DO_REBASE_ULEB_TIMES:
+            count = immediate;
+
+            if (opcode == REBASE_OPCODE_DO_REBASE_ULEB_TIMES && !ReadUleb128(&p, end, &count))
+                return false;
+
+            if (!rebase(count, sizeof(UInt64)))
+                return false;
+
+            break;
+        case REBASE_OPCODE_DO_REBASE_ADD_ADDR_ULEB:
+            if (!rebase(1, sizeof(UInt64)) || !ReadUleb128(&p, end, &skip))
+                return false;
+
+            segment_offset += skip;
+
+            break;
+        case REBASE_OPCODE_DO_REBASE_ULEB_TIMES_SKIPPING_ULEB:
+            if (!ReadUleb128(&p, end, &count) || !ReadUleb128(&p, end, &skip))
+                return false;
+
+            if (skip > ~0ULL - sizeof(UInt64) || !rebase(count, skip + sizeof(UInt64)))
+                return false;
+
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FixupDecoder::WalkBindStream(UInt8* p, UInt8* end, bool lazy, FixupCallback callback,
+                                  void* context) {
+    char* symbol;
+
+    UInt8 type;
+
+    Int32 library_ordinal;
+
+    Int64 addend;
+
+    UInt32 segment_index;
+    UInt64 segment_offset;
+
+    symbol = nullptr;
+
+    type = BIND_TYPE_POINTER;
+
+    library_ordinal = 0;
+
+    addend = 0;
+
+    segment_index = 0;
+    segment_offset = 0;
+
+    // emits one bind and steps past it
+    auto bind = [&]() -> bool {
+        Fixup fixup;
+
+        Offset offset;
+
+        if (!SegmentOffsetToFileOffset(segment_index, segment_offset, &offset))
+            return false;
+
+        if (type == BIND_TYPE_POINTER) {
+            memset(&fixup, 0, sizeof(fixup));
+
+            fixup.kind = kFixupBind;
+            fixup.offset = offset;
+            fixup.address = segments[segment_index].vmaddr + segment_offset;
+            fixup.symbol = symbol;
+            fixup.library_ordinal = library_ordinal;
+            fixup.addend = addend;
+
+            if (!Emit(&fixup, callback, context))
+                return false;
+        }
+
+        return true;
+    };
+
+    while (p < end) {
+        UInt8 immediate = *p & BIND_IMMEDIATE_MASK;
+        UInt8 opcode = *p & BIND_OPCODE_MASK;
+
+        UInt64 value;
+        UInt64 count;
+        UInt64 skip;
+
+        p++;
+
+        switch (opcode) {
+        case BIND_OPCODE_DONE:
+            // lazy binding info separates every entry with a DONE opcode
+            if (!lazy)
+                return true;
+
+            break;
+        case BIND_OPCODE_SET_DYLIB_ORDINAL_IMM:
+            library_ordinal = immediate;
+
+            break;
+        case BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB:
+            if (!ReadUleb128(&p, end, &value))
+                return false;
+
+            library_ordinal = (Int32)value;
+
+            break;
+        case BIND_OPCODE_SET_DYLIB_SPECIAL_IMM:
+            library_ordinal = immediate ? (Int8)(BIND_OPCODE_MASK | immediate) : 0;
+
+            break;
+        case BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM:
+            symbol = reinterpret_cast<char*>(p);
+
+            p += strnlen(symbol, end - p) + 1;
+
+            break;
+        case BIND_OPCODE_SET_TYPE_IMM:
+            type = immediate;
+
+            break;
+        case BIND_OPCODE_SET_ADDEND_SLEB:
+            if (!ReadSleb128(&p, end, &addend))
+                return false;
+
+            break;
+        case BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB:
+            segment_index = immediate;
+
+            if (!ReadUleb128(&p, end, &segment_offset))
+                return false;
+
+            break;
+        case BIND_OPCODE_ADD_ADDR_ULEB:
+            if (!ReadUleb128(&p, end, &skip))
+                return false;
+
+            segment_offset += skip;
+
+            break;
+        case BIND_OPCODE_DO_BIND:
+            if (!bind())
+                return false;
+
+            segment_offset += sizeof(UInt64);
+
+            break;
+        case BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB:
+            if (!bind() || !ReadUleb128(&p, end, &skip))
+                return false;
+
+            segment_offset += skip + sizeof(UInt64);
+
+            break;
+        case BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED:
+            if (!bind())
+                return false;
+
+            segment_offset += (immediate + 1) * sizeof(UInt64);
+
+            break;
+        case BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB:
+            if (!ReadUleb128(&p, end, &count) || !ReadUleb128(&p, end, &skip))
+                return false;
+
+            for (UInt64 i = 0; i < count; i++) {
+                if (!bind())
+                    return false;
+
+                segment_offset += skip + sizeof(UInt64);
+            }
+
+            break;
+        case BIND_OPCODE_THREADED:
+            // threaded binds are resolved through the chains in __thread_starts
+            if (immediate == BIND_SUBOPCODE_THREADED_SET_BIND_ORDINAL_TABLE_SIZE_ULEB &&
+                !ReadUleb128(&p, end, &value))
+                return false;
+
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FixupDecoder::WalkBindOpcodes(FixupCallback callback, void* context) {
+    if (!dyld_info)
+        return true;
+
+    if ((UInt64)dyld_info->bind_off + dyld_info->bind_size > size ||
+        (UInt64)dyld_info->lazy_bind_off + dyld_info->lazy_bind_size > size)
+        return false;
+
+    if (dyld_info->bind_size &&
+        !WalkBindStream(buffer + dyld_info->bind_off,
+                        buffer + dyld_info->bind_off + dyld_info->bind_size, false, callback,
+                        context))
+        return false;
+
+    if (dyld_info->lazy_bind_size &&
+        !WalkBindStream(buffer + dyld_info->lazy_bind_off,
+                        buffer + dyld_info->lazy_bind_off + dyld_info->lazy_bind_size, true,
+                        callback, context))
+        return false;
+
+    return true;
+}
+
+bool FixupDecoder::DecodeAll(FixupCallback callback, void* context) {
+    bool ok;
+
+    Begin();
+
+    ok = WalkChainedFixups(callback, context) && WalkThreadStarts(callback, context) &&
+         WalkRebaseOpcodes(callback, context) && WalkBindOpcodes(callback, context);
+
+    return End(ok, callback, context);
+}
+
+bool FixupDecoder::DecodeChainedFixups(FixupCallback callback, void* context) {
+    Begin();
+
+    return End(WalkChainedFixups(callback, context), callback, context);
+}
+
+bool FixupDecoder::DecodeChainedPage(UInt32 segment_index, UInt32 page_index,
+                                     FixupCallback callback, void* context) {
+    Begin();
+
+    return End(WalkChainedPage(segment_index, page_index, callback, context), callback, context);
+}
+
+bool FixupDecoder::DecodeThreadStarts(FixupCallback callback, void* context) {
+    Begin();
+
+    return End(WalkThreadStarts(callback, context), callback, context);
+}
+
+bool FixupDecoder::DecodeRebaseOpcodes(FixupCallback callback, void* context) {
+    Begin();
+
+    return End(WalkRebaseOpcodes(callback, context), callback, context);
+}
+
+bool FixupDecoder::DecodeBindOpcodes(FixupCallback callback, void* context) {
+    Begin();
+
+    return End(WalkBindOpcodes(callback, context), callback, context);
+}
+
+struct FindFixupContext {
+    xnu::mach::VmAddress address;
+
+    Fixup* fixup;
+
+    bool found;
+};
+
+static bool FindFixupInBatch(void* context, Fixup* fixups, Size count) {
+    FindFixupContext* find = reinterpret_cast<FindFixupContext*>(context);
+
+    for (Size i = 0; i < count; i++) {
+        if (fixups[i].address == find->address) {
+            *find->fixup = fixups[i];
+
+            find->found = true;
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FixupDecoder::FindFixup(xnu::mach::VmAddress address, Fixup* fixup) {
+    FindFixupContext find = {address, fixup, false};
+
+    if (chained_fixups) {
+        // chains never cross a page, so only the page holding the address has to be walked
+        for (UInt32 i = 0; i < segment_count; i++) {
+            struct dyld_chained_starts_in_segment* starts;
+
+            FixupSegment* segment = &segments[i];
+
+            if (address < segment->vmaddr || address >= segment->vmaddr + segment->vmsize)
+                continue;
+
+            starts = GetChainedStarts(i);
+
+            if (!starts || !starts->page_size)
+                return false;
+
+            DecodeChainedPage(i, (address - segment->vmaddr) / starts->page_size,
+                              FindFixupInBatch, &find);
+
+            return find.found;
+        }
+
+        return false;
+    }
+
+    DecodeAll(FindFixupInBatch, &find);
+
+    return find.found;
+}
+
+// links checked at once when a chain looks like a run of evenly spaced pointers
+static constexpr Size kChainBlock = 8;
+
+Size FixupDecoder::RebaseChain(Offset offset, UInt16 pointer_format, Size stride, Int64 slide) {
+    Size rebased = 0;
+
+    // kept in locals, the stores into the chain arrays would otherwise force reloads
+    UInt8* image = buffer;
+    Size image_size = size;
+
+    Offset* offsets = chain_offsets;
+    UInt64* values = chain_values;
+
+    UInt64 next_mask;
+
+    bool done = false;
+
+    switch (pointer_format) {
+    case DYLD_CHAINED_PTR_64:
+    case DYLD_CHAINED_PTR_64_OFFSET:
+    case DYLD_CHAINED_PTR_64_KERNEL_CACHE:
+    case DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE:
+        next_mask = 0xFFF;
+
+        break;
+    default:
+        next_mask = 0x7FF;
+
+        break;
+    }
+
+    while (!done) {
+        Size count = 0;
+
+        // walking the chain is inherently serial, so only collect the links here
+        while (count < kFixupBatchSize) {
+            UInt64 raw;
+
+            UInt64 next;
+            UInt64 delta;
+
+            UInt64 mismatch;
+
+            if (offset < 0 || offset + sizeof(UInt64) > image_size) {
+                done = true;
+
+                break;
+            }
+
+            memcpy(&raw, image + offset, sizeof(raw));
+
+            offsets[count] = offset;
+            values[count] = raw;
+
+            count++;
+
+            next = (raw >> 51) & next_mask;
+
+            if (!next) {
+                done = true;
+
+                break;
+            }
+
+            delta = next * stride;
+
+            offset += delta;
+
+            // chains are mostly runs of links the same distance apart, so guess the next blocks
+            // of them and check each afterwards instead of waiting on one load after another
+            mismatch = 0;
+
+            while (!mismatch && count + kChainBlock <= kFixupBatchSize && offset >= 0 &&
+                   offset + (kChainBlock - 1) * delta + sizeof(UInt64) <= image_size) {
+                for (Size i = 0; i < kChainBlock; i++) {
+                    memcpy(&raw, image + offset + i * delta, sizeof(raw));
+
+                    offsets[count + i] = offset + i * delta;
+                    values[count + i] = raw;
+
+                    mismatch |= ((raw >> 51) & next_mask) ^ next;
+                }
+
+                if (!mismatch) {
+                    count += kChainBlock;
+
+                    offset += kChainBlock * delta;
+                }
+            }
+        }
+
+        RebaseChainedPointers(pointer_format, values, count, base, slide);
+
+        for (Size i = 0; i < count; i++)
+            memcpy(image + offsets[i], &values[i], sizeof(UInt64));
+
+        rebased += count;
+    }
+
+    return rebased;
+}
+
+Size FixupDecoder::ApplyChainedRebases(Int64 slide) {
+    Size rebased = 0;
+
+    for (UInt32 i = 0; i < segment_count; i++) {
+        struct dyld_chained_starts_in_segment* starts = GetChainedStarts(i);
+
+        Size stride;
+
+        if (!starts)
+            continue;
+
+        stride = ChainStride(starts->pointer_format);
+
+        if (!stride)
+            continue;
+
+        for (UInt32 j = 0; j < starts->page_count; j++) {
+            UInt16 start = starts->page_start[j];
+
+            if (start == DYLD_CHAINED_PTR_START_NONE || (start & DYLD_CHAINED_PTR_START_MULTI))
+                continue;
+
+            rebased += RebaseChain(segments[i].fileoff + (Offset)j * starts->page_size + start,
+                                   starts->pointer_format, stride, slide);
+        }
+    }
+
+    return rebased;
+}
+
+Size FixupDecoder::ApplyThreadedRebases(Int64 slide) {
+    Size rebased = 0;
+
+    Size stride;
+
+    if (!thread_starts)
+        return 0;
+
+    stride = (thread_starts[0] & 1) ? 8 : 4;
+
+    for (Size i = 1; i < thread_starts_count; i++) {
+        if (thread_starts[i] == 0xFFFFFFFF)
+            break;
+
+        rebased += RebaseChain(thread_starts[i], kThreadedPointerFormat, stride, slide);
+    }
+
+    return rebased;
+}
+
+Size FixupDecoder::ApplyRebaseOpcodes(Int64 slide) {
+    Size rebased = 0;
+
+    // runs of adjacent pointers are slid in place instead of going through fixup batches
+    WalkRebaseOpcodes(nullptr, nullptr, slide, &rebased);
+
+    return rebased;
+}
+
+Size FixupDecoder::ApplyRebases(Int64 slide) {
+    return ApplyChainedRebases(slide) + ApplyThreadedRebases(slide) + ApplyRebaseOpcodes(slide);
+}
+
+} // namespace dyld
+} // namespace darwin
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+extern "C" {
+#include <mach-o.h>
+}
+
+#include <types.h>
+
+namespace darwin {
+namespace dyld {
+
+enum FixupKind : UInt8 {
+    kFixupRebase,
+    kFixupBind,
+};
+
+/**
+ *  A single decoded fixup, either a rebase to an unslid target address or a bind to an import.
+ */
+struct Fixup {
+    Offset offset;
+
+    xnu::mach::VmAddress address;
+
+    UInt64 target;
+
+    Int64 addend;
+
+    char* symbol;
+    Int32 library_ordinal;
+
+    UInt16 diversity;
+    UInt8 key;
+
+    bool addr_div;
+    bool auth;
+
+    FixupKind kind;
+};
+
+struct FixupSegment {
+    xnu::mach::VmAddress vmaddr;
+    Size vmsize;
+
+    Offset fileoff;
+    Size filesize;
+};
+
+static constexpr Size kFixupBatchSize = 128;
+
+// chains found through __TEXT,__thread_starts rather than LC_DYLD_CHAINED_FIXUPS
+static constexpr UInt16 kThreadedPointerFormat = DYLD_CHAINED_PTR_NONE;
+
+/**
+ *  Receives decoded fixups in batches of up to kFixupBatchSize.
+ *  Returning false stops the decoder.
+ */
+using FixupCallback = bool (*)(void* context, Fixup* fixups, Size count);
+
+/**
+ *  Streaming decoder for every fixup format found in 64-bit Mach-O images.
+ *
+ *  Handles LC_DYLD_CHAINED_FIXUPS page starts, the __TEXT,__thread_starts chains of older
+ *  arm64e kernelcaches and the classic LC_DYLD_INFO rebase/bind opcode streams. Fixups are
+ *  decoded straight out of the image buffer and handed out in batches, so nothing is allocated
+ *  per fixup. This file is shared with the kernel build and does not use the STL.
+ *
+ *  A decoder keeps its batch in the object, so a single instance must not be used from more
+ *  than one thread at a time.
+ */
+class FixupDecoder {
+public:
+    explicit FixupDecoder(UInt8* buffer, Size size);
+
+    ~FixupDecoder();
+
+    bool Parse();
+
+    UInt8* GetBuffer() {
+        return buffer;
+    }
+
+    Size GetSize() {
+        return size;
+    }
+
+    xnu::mach::VmAddress GetBase() {
+        return base;
+    }
+
+    FixupSegment* GetSegments() {
+        return segments;
+    }
+
+    UInt32 GetSegmentCount() {
+        return segment_count;
+    }
+
+    bool HasChainedFixups() {
+        return chained_fixups != nullptr;
+    }
+
+    bool HasThreadStarts() {
+        return thread_starts != nullptr;
+    }
+
+    bool HasDyldInfo() {
+        return dyld_info != nullptr;
+    }
+
+    static Size ChainStride(UInt16 pointer_format);
+
+    static void RebasePointers(UInt64* pointers, Size count, Int64 slide);
+
+    static void RebaseChainedPointers(UInt16 pointer_format, UInt64* pointers, Size count,
+                                      xnu::mach::VmAddress base, Int64 slide);
+
+    bool DecodeAll(FixupCallback callback, void* context);
+
+    bool DecodeChainedFixups(FixupCallback callback, void* context);
+
+    bool DecodeChainedPage(UInt32 segment_index, UInt32 page_index, FixupCallback callback,
+                           void* context);
+
+    bool DecodeThreadStarts(FixupCallback callback, void* context);
+
+    bool DecodeRebaseOpcodes(FixupCallback callback, void* context);
+
+    bool DecodeBindOpcodes(FixupCallback callback, void* context);
+
+    bool FindFixup(xnu::mach::VmAddress address, Fixup* fixup);
+
+    Size ApplyRebases(Int64 slide);
+
+    Size ApplyChainedRebases(Int64 slide);
+
+    Size ApplyThreadedRebases(Int64 slide);
+
+    Size ApplyRebaseOpcodes(Int64 slide);
+
+private:
+    UInt8* buffer;
+    Size size;
+
+    xnu::mach::VmAddress base;
+
+    FixupSegment* segments;
+    UInt32 segment_count;
+
+    struct dyld_chained_fixups_header* chained_fixups;
+    Size chained_fixups_size;
+
+    UInt32* thread_starts;
+    Size thread_starts_count;
+
+    struct dyld_info_command* dyld_info;
+
+    Fixup batch[kFixupBatchSize];
+    Size batch_count;
+
+    bool stopped;
+
+    Offset chain_offsets[kFixupBatchSize];
+    UInt64 chain_values[kFixupBatchSize];
+
+    struct dyld_chained_starts_in_segment* GetChainedStarts(UInt32 segment_index);
+
+    FixupSegment* SegmentForFileOffset(Offset offset);
+
+    bool SegmentOffsetToFileOffset(UInt32 segment_index, UInt64 segment_offset, Offset* offset);
+
+    void Begin();
+
+    bool End(bool ok, FixupCallback callback, void* context);
+
+    bool Emit(Fixup* fixup, FixupCallback callback, void* context);
+
+    bool Flush(FixupCallback callback, void* context);
+
+    bool DecodeChainedPointer(UInt16 pointer_format, UInt64 raw, Fixup* fixup, UInt32* next);
+
+    bool DecodeThreadedPointer(UInt64 raw, Fixup* fixup, UInt32* next);
+
+    bool ResolveChainedImport(UInt32 ordinal, Fixup* fixup);
+
+    bool WalkChain(Offset offset, UInt16 pointer_format, Size stride, FixupCallback callback,
+                   void* context);
+
+    bool WalkChainedPage(UInt32 segment_index, UInt32 page_index, FixupCallback callback,
+                         void* context);
+
+    bool WalkChainedFixups(FixupCallback callback, void* context);
+
+    bool WalkThreadStarts(FixupCallback callback, void* context);
+
+    bool WalkRebaseOpcodes(FixupCallback callback, void* context, Int64 slide = 0,
+                           Size* rebased = nullptr);
+
+    bool WalkBindStream(UInt8* p, UInt8* end, bool lazy, FixupCallback callback, void* context);
+
+    bool WalkBindOpcodes(FixupCallback callback, void* context);
+
+    Size RebaseChain(Offset offset, UInt16 pointer_format, Size stride, Int64 slide);
+};
+
+} // namespace dyld
+} // namespace darwin
@@ -16,12 +16,13 @@
 
 #include "hook.h"
 
+#include "hook_batch.h"
+#include "hook_trace.h"
 #include "patcher.h"
 #include "payload.h"
 
 #include "disassembler.h"
 
-#include "kernel.h"
 #include "task.h"
 
 #include "arch.h"
@@ -49,19 +50,14 @@ Hook::Hook(Patcher* patcher, enum HookType hooktype, Task* task, xnu::mach::VmAd
 Hook* Hook::CreateHookForFunction(Task* task, Patcher* patcher, xnu::mach::VmAddress address) {
     Hook* hook;
 
-    std::vector<Hook*>& hooks = patcher->GetHooks();
-
 #ifdef __KERNEL__
     address |= kBaseKernelAddress;
 #endif
 
-    for (int i = 0; i < hooks.size(); i++) {
-        hook = hooks.at(i);
+    hook = patcher->GetHookRegistry().Find(address, kHookTypeInstrumentFunction);
 
-        if (hook->GetFrom() == address && hook->GetHookType() == kHookTypeInstrumentFunction) {
-            return hook;
-        }
-    }
+    if (hook)
+        return hook;
 
     hook = new Hook(patcher, kHookTypeInstrumentFunction);
 
@@ -86,19 +82,14 @@ Hook* Hook::CreateHookForFunction(void* target, xnu::Task* task, darwin::Patcher
 Hook* Hook::CreateBreakpointForAddress(Task* task, Patcher* patcher, xnu::mach::VmAddress address) {
     Hook* hook;
 
-    std::vector<Hook*>& hooks = patcher->GetHooks();
-
 #ifdef __KERNEL__
     address |= kBaseKernelAddress;
 #endif
 
-    for (int i = 0; i < hooks.size(); i++) {
-        hook = hooks.at(i);
+    hook = patcher->GetHookRegistry().Find(address, kHookTypeBreakpoint);
 
-        if (hook->GetFrom() == address && hook->GetHookType() == kHookTypeBreakpoint) {
-            return hook;
-        }
-    }
+    if (hook)
+        return hook;
 
     hook = new Hook(patcher, kHookTypeBreakpoint);
 
@@ -188,11 +179,41 @@ Payload* Hook::PrepareTrampoline() {
 
     payload = new Payload(GetTask(), this, VM_PROT_READ | VM_PROT_WRITE | VM_PROT_EXECUTE);
 
-    payload->Prepare();
+    if (!payload->Prepare(hooktype == kHookTypeBreakpoint ? kBreakpointTrampolineSize
+                                                          : kFunctionTrampolineSize)) {
+        delete payload;
+
+        payload = nullptr;
+    }
 
     return payload;
 }
 
+bool Hook::ReadCode(xnu::mach::VmAddress address, void* data, Size size) {
+    HookBatch* batch = patcher ? patcher->GetActiveBatch() : nullptr;
+
+    return batch ? batch->Read(task, address, data, size) : task->Read(address, data, size);
+}
+
+bool Hook::WriteCode(xnu::mach::VmAddress address, void* data, Size size) {
+    HookBatch* batch = patcher ? patcher->GetActiveBatch() : nullptr;
+
+    bool success;
+
+    // staged until the batch is committed
+    if (batch)
+        return batch->Write(task, address, data, size);
+
+    success = task->Write(address, data, size);
+
+#ifdef __USER__
+    // tasks that override Write() do not drop their cached copies of the patched pages
+    task->InvalidateCaches(address, size);
+#endif
+
+    return success;
+}
+
 void Hook::RegisterHook(struct HookPatch* patch) {
     hooks.push_back(patch);
 }
@@ -213,7 +234,18 @@ void Hook::HookFunction(xnu::mach::VmAddress to, enum HookType hooktype) {
 
     Patcher* patcher = GetPatcher();
 
-    PrepareTrampoline();
+    // where a failed patch rolls the trampoline back to
+    Offset payload_offset = payload ? payload->GetCurrentOffset() : -1;
+
+    bool written;
+
+    if (!PrepareTrampoline()) {
+        DARWIN_KIT_LOG("Cannot hook! Out of trampoline memory!\n");
+
+        delete hook;
+
+        return;
+    }
 
     struct HookPatch* chain = GetLatestRegisteredHook();
 
@@ -244,6 +276,11 @@ void Hook::HookFunction(xnu::mach::VmAddress to, enum HookType hooktype) {
 
     if (!min) {
         DARWIN_KIT_LOG("Cannot hook! Capstone failed!\n");
+
+        delete hook;
+
+        DiscardPatches(hooks.size(), payload_offset);
+
         return;
     }
 
@@ -252,9 +289,8 @@ void Hook::HookFunction(xnu::mach::VmAddress to, enum HookType hooktype) {
 
     original_opcodes = new UInt8[min];
 
-    task->Read(chain_addr, (void*)original_opcodes, min);
-
-    payload->WriteBytes(original_opcodes, min);
+    written = ReadCode(chain_addr, (void*)original_opcodes, min) &&
+              payload->WriteBytes(original_opcodes, min);
 
     union Branch to_hook_function;
 
@@ -273,11 +309,23 @@ void Hook::HookFunction(xnu::mach::VmAddress to, enum HookType hooktype) {
     architecture->MakeBranch(&to_original_function, chain_addr + min,
                              payload->GetAddress() + payload->GetCurrentOffset());
 
-    payload->WriteBytes((UInt8*)&to_original_function, branch_size);
+    written = written && payload->WriteBytes((UInt8*)&to_original_function, branch_size);
 
-    task->Write(chain_addr, (void*)&to_hook_function, branch_size);
+    // the trampoline is staged in the payload, it has to be in place before the branch is
+    written = written && payload->Commit();
 
-    payload->Commit();
+    if (!written || !WriteCode(chain_addr, (void*)&to_hook_function, branch_size)) {
+        DARWIN_KIT_LOG("Cannot hook! Failed to write the trampoline!\n");
+
+        delete[] original_opcodes;
+        delete[] replace_opcodes;
+
+        delete hook;
+
+        DiscardPatches(hooks.size(), payload_offset);
+
+        return;
+    }
 
     hook->from = chain_addr;
     hook->to = to;
@@ -295,6 +343,56 @@ void Hook::HookFunction(xnu::mach::VmAddress to, enum HookType hooktype) {
 }
 
 void Hook::UninstallHook() {
+    // newest patch first, each one saved the instructions that the previous one left behind
+    for (int i = (int)hooks.size() - 1; i >= 0; i--) {
+        struct HookPatch* patch = hooks.at(i);
+
+        task->Write(patch->from, (void*)patch->original, patch->patch_size);
+
+        delete[] patch->original;
+        delete[] patch->replace;
+
+        delete patch;
+    }
+
+    hooks.clear();
+
+    // returns the trampoline's slot to the patcher's pool
+    if (payload) {
+        delete payload;
+
+        payload = nullptr;
+    }
+
+    trampoline = 0;
+}
+
+void Hook::DiscardPatches(UInt32 count, Offset payload_offset) {
+    // forgets patches that were planned but never written, see HookBatch::Abort()
+    while (hooks.size() > count) {
+        struct HookPatch* patch = hooks.at((int)(hooks.size() - 1));
+
+        hooks.erase(std::remove(hooks.begin(), hooks.end(), patch), hooks.end());
+
+        delete[] patch->original;
+        delete[] patch->replace;
+
+        delete patch;
+    }
+
+    if (!count)
+        trampoline = 0;
+
+    if (!payload)
+        return;
+
+    if (payload_offset < 0) {
+        delete payload;
+
+        payload = nullptr;
+    } else {
+        payload->SetCurrentOffset(payload_offset);
+    }
 }
 
 void Hook::AddBreakpoint(xnu::mach::VmAddress breakpoint_hook, enum HookType hooktype) {
@@ -306,7 +404,18 @@ void Hook::AddBreakpoint(xnu::mach::VmAddress breakpoint_hook, enum HookType hoo
 
     Patcher* patcher = GetPatcher();
 
-    PrepareTrampoline();
+    // where a failed patch rolls the trampoline back to
+    Offset payload_offset = payload ? payload->GetCurrentOffset() : -1;
+
+    bool written;
+
+    if (!PrepareTrampoline()) {
+        DARWIN_KIT_LOG("Cannot set breakpoint! Out of trampoline memory!\n");
+
+        delete hook;
+
+        return;
+    }
 
     xnu::mach::VmAddress tramp;
 
@@ -321,12 +430,22 @@ void Hook::AddBreakpoint(xnu::mach::VmAddress breakpoint_hook, enum HookType hoo
 
     min = disassembler->InstructionSize(chain_addr, branch_size);
 
+    if (!min) {
+        DARWIN_KIT_LOG("Cannot set breakpoint! Capstone failed!\n");
+
+        delete hook;
+
+        DiscardPatches(hooks.size(), payload_offset);
+
+        return;
+    }
+
     UInt8* original_opcodes;
     UInt8* replace_opcodes;
 
     original_opcodes = new UInt8[min];
 
-    task->Read(chain_addr, (void*)original_opcodes, min);
+    written = ReadCode(chain_addr, (void*)original_opcodes, min);
 
     union Branch to_trampoline;
 
@@ -348,53 +467,72 @@ void Hook::AddBreakpoint(xnu::mach::VmAddress breakpoint_hook, enum HookType hoo
 
         Size call_size = architecture->GetCallSize();
 
-        payload->WriteBytes((UInt8*)push_registers,
-                            (Size)((UInt8*)push_registers_end - (UInt8*)push_registers));
-        payload->WriteBytes((UInt8*)set_argument,
-                            (Size)((UInt8*)set_argument_end - (UInt8*)set_argument));
+        written = written &&
+                  payload->WriteBytes((UInt8*)push_registers,
+                                      (Size)((UInt8*)push_registers_end - (UInt8*)push_registers));
+        written = written &&
+                  payload->WriteBytes((UInt8*)set_argument,
+                                      (Size)((UInt8*)set_argument_end - (UInt8*)set_argument));
 
         architecture->MakeCall(&call_breakpoint_hook, breakpoint_hook,
                                payload->GetAddress() + payload->GetCurrentOffset());
 
-        payload->WriteBytes((UInt8*)&call_breakpoint_hook, call_size);
+        written = written && payload->WriteBytes((UInt8*)&call_breakpoint_hook, call_size);
 
-        payload->WriteBytes((UInt8*)check_breakpoint,
-                            (Size)((UInt8*)check_breakpoint_end - (UInt8*)check_breakpoint));
+        written = written && payload->WriteBytes((UInt8*)check_breakpoint,
+                                                 (Size)((UInt8*)check_breakpoint_end -
+                                                        (UInt8*)check_breakpoint));
 
         architecture->MakeBreakpoint(&breakpoint);
 
-        payload->WriteBytes((UInt8*)&breakpoint, breakpoint_size);
+        written = written && payload->WriteBytes((UInt8*)&breakpoint, breakpoint_size);
 
-        payload->WriteBytes((UInt8*)pop_registers,
-                            (Size)((UInt8*)pop_registers_end - (UInt8*)pop_registers));
+        written = written &&
+                  payload->WriteBytes((UInt8*)pop_registers,
+                                      (Size)((UInt8*)pop_registers_end - (UInt8*)pop_registers));
     } else {
         // Breaks regardless
         union Breakpoint breakpoint;
 
-        payload->WriteBytes((UInt8*)push_registers,
-                            (Size)((UInt8*)push_registers_end - (UInt8*)push_registers));
+        written = written &&
+                  payload->WriteBytes((UInt8*)push_registers,
+                                      (Size)((UInt8*)push_registers_end - (UInt8*)push_registers));
 
         architecture->MakeBreakpoint(&breakpoint);
 
-        payload->WriteBytes((UInt8*)&breakpoint, breakpoint_size);
+        written = written && payload->WriteBytes((UInt8*)&breakpoint, breakpoint_size);
 
-        payload->WriteBytes((UInt8*)pop_registers,
-                            (Size)((UInt8*)pop_registers_end - (UInt8*)pop_registers));
+        written = written &&
+                  payload->WriteBytes((UInt8*)pop_registers,
+                                      (Size)((UInt8*)pop_registers_end - (UInt8*)pop_registers));
     }
 
     union Branch to_original_function;
 
     // Builds the FunctionPatch branch/jmp instruction from trampoline to original function
-    payload->WriteBytes(original_opcodes, min);
+    written = written && payload->WriteBytes(original_opcodes, min);
 
     architecture->MakeBranch(&to_original_function, chain_addr + min,
                              payload->GetAddress() + payload->GetCurrentOffset());
 
-    payload->WriteBytes((UInt8*)&to_original_function, branch_size);
+    written = written && payload->WriteBytes((UInt8*)&to_original_function, branch_size);
+
+    // the trampoline is staged in the payload, it has to be in place before the branch is
+    written = written && payload->Commit();
+
+    // a slot that ran out of room must never be branched to, the patch is dropped instead
+    if (!written || !WriteCode(chain_addr, (void*)replace_opcodes, branch_size)) {
+        DARWIN_KIT_LOG("Cannot set breakpoint! Failed to write the trampoline!\n");
+
+        delete[] original_opcodes;
+        delete[] replace_opcodes;
 
-    task->Write(chain_addr, (void*)replace_opcodes, branch_size);
+        delete hook;
 
-    payload->Commit();
+        DiscardPatches(hooks.size(), payload_offset);
+
+        return;
+    }
 
     hook->from = chain_addr;
     hook->to = tramp;
@@ -412,7 +550,14 @@ void Hook::AddBreakpoint(xnu::mach::VmAddress breakpoint_hook, enum HookType hoo
 }
 
 void Hook::RemoveBreakpoint() {
+    UninstallHook();
+}
+
+void Hook::Trace(const UInt64* arguments, UInt32 argument_count) {
+    HookTrace* trace = patcher ? patcher->GetHookTrace() : nullptr;
 
+    if (trace)
+        trace->Record(trace_id, arguments, argument_count);
 }
 
 }
\ No newline at end of file
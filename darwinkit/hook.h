@@ -16,9 +16,13 @@
 
 #pragma once
 
+#ifdef __KERNEL__
 #include "kernel.h"
+#endif
+
 #include "patcher.h"
 #include "arch.h"
+#include "disassembler.h"
 #include "vector.h"
 
 #include <types.h>
@@ -128,6 +132,10 @@ public:
         return trampoline;
     }
 
+    darwin::Payload* GetPayload() {
+        return payload;
+    }
+
     xnu::mach::VmAddress GetTrampolineFromChain(xnu::mach::VmAddress address);
 
     HookArray<struct HookPatch*>& GetHooks() {
@@ -144,6 +152,14 @@ public:
 
     enum HookType GetHookTypeForCallback(xnu::mach::VmAddress callback);
 
+    UInt32 GetTraceId() {
+        return trace_id;
+    }
+
+    void SetTraceId(UInt32 id) {
+        trace_id = id;
+    }
+
     void SetTarget(void* targ) {
         target = targ;
     }
@@ -187,12 +203,25 @@ public:
 
     void UninstallHook();
 
+    void DiscardPatches(UInt32 count, Offset payload_offset);
+
     void AddBreakpoint(xnu::mach::VmAddress breakpoint_hook,
                        enum HookType hooktype = kHookTypeBreakpoint);
 
     void RemoveBreakpoint();
 
+    /**
+     *  Records a hit of this hook and its arguments in the patcher's HookTrace, when there is
+     *  one. Instrumentation callbacks call this instead of logging, it never blocks and never
+     *  takes a lock, so it is safe on hot functions.
+     */
+    void Trace(const UInt64* arguments, UInt32 argument_count);
+
 private:
+    bool ReadCode(xnu::mach::VmAddress address, void* data, Size size);
+
+    bool WriteCode(xnu::mach::VmAddress address, void* data, Size size);
+
     void* target;
 
     darwin::Patcher* patcher;
@@ -207,6 +236,8 @@ private:
 
     bool kernelHook = false;
 
+    UInt32 trace_id = 0;
+
     xnu::mach::VmAddress from;
     xnu::mach::VmAddress trampoline;
 
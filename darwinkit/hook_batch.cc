@@ -0,0 +1,549 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hook_batch.h"
+
+#include <string.h>
+
+#ifdef __KERNEL__
+#include <libkern/libkern.h>
+#endif
+
+#include "hook.h"
+#include "patcher.h"
+#include "payload.h"
+#include "task.h"
+#include "trampoline_allocator.h"
+
+namespace darwin {
+
+// writes are grouped by page, the same unit the trampoline allocator and the MMU work in
+static constexpr Size kHookBatchPageSize = kTrampolinePageSize;
+
+template <typename T>
+static bool GrowArray(T** array, UInt32* capacity, UInt32 needed) {
+    T* grown;
+
+    UInt32 n = *capacity ? *capacity : 16;
+
+    if (needed <= *capacity)
+        return true;
+
+    while (n < needed)
+        n *= 2;
+
+    grown = new T[n];
+
+    if (!grown)
+        return false;
+
+    if (*array) {
+        memcpy(grown, *array, *capacity * sizeof(T));
+
+        delete[] *array;
+    }
+
+    *array = grown;
+    *capacity = n;
+
+    return true;
+}
+
+static inline UInt32 HashPage(xnu::Task* task, xnu::mach::VmAddress page) {
+    UInt64 hash = ((page / kHookBatchPageSize) ^ reinterpret_cast<UInt64>(task)) *
+                  0x9E3779B97F4A7C15ULL;
+
+    return (UInt32)(hash >> 32);
+}
+
+HookBatch::HookBatch(Patcher* patcher)
+    : patcher(patcher), failed(false), hooks(nullptr), hook_count(0), hook_capacity(0),
+      writes(nullptr), write_count(0), write_capacity(0), pages(nullptr), page_count(0),
+      page_mask(0), regions(nullptr), region_count(0), region_capacity(0), data(nullptr),
+      data_size(0), data_capacity(0) {}
+
+HookBatch::~HookBatch() {
+    Abort();
+
+    if (hooks)
+        delete[] hooks;
+
+    if (writes)
+        delete[] writes;
+
+    if (pages)
+        delete[] pages;
+
+    if (regions)
+        delete[] regions;
+
+    if (data)
+        delete[] data;
+}
+
+void HookBatch::Reset() {
+    if (pages)
+        memset(pages, 0, (page_mask + 1) * sizeof(HookBatchPage));
+
+    hook_count = 0;
+    write_count = 0;
+    page_count = 0;
+    region_count = 0;
+    data_size = 0;
+
+    failed = false;
+}
+
+HookBatchHook* HookBatch::Track(Hook* hook) {
+    HookBatchHook* entry;
+
+    if (!GrowArray(&hooks, &hook_capacity, hook_count + 1))
+        return nullptr;
+
+    entry = &hooks[hook_count++];
+
+    // a hook added more than once is rolled back to its oldest snapshot, they are undone last
+    entry->hook = hook;
+    entry->patch_count = (UInt32)hook->GetHooks().size();
+    entry->payload_offset = hook->GetPayload() ? hook->GetPayload()->GetCurrentOffset() : -1;
+
+    return entry;
+}
+
+bool HookBatch::AddHook(Hook* hook, xnu::mach::VmAddress to) {
+    HookBatchHook* entry;
+
+    if (failed || !hook || hook->GetPatcher() != patcher)
+        return false;
+
+    entry = Track(hook);
+
+    if (!entry) {
+        failed = true;
+
+        return false;
+    }
+
+    patcher->SetActiveBatch(this);
+
+    hook->HookFunction(to);
+
+    patcher->SetActiveBatch(nullptr);
+
+    // HookFunction() only registers a patch when it got all the way through
+    if (hook->GetHooks().size() == entry->patch_count)
+        failed = true;
+
+    return !failed;
+}
+
+bool HookBatch::AddBreakpoint(Hook* hook, xnu::mach::VmAddress breakpoint_hook) {
+    HookBatchHook* entry;
+
+    if (failed || !hook || hook->GetPatcher() != patcher)
+        return false;
+
+    entry = Track(hook);
+
+    if (!entry) {
+        failed = true;
+
+        return false;
+    }
+
+    patcher->SetActiveBatch(this);
+
+    hook->AddBreakpoint(breakpoint_hook);
+
+    patcher->SetActiveBatch(nullptr);
+
+    if (hook->GetHooks().size() == entry->patch_count)
+        failed = true;
+
+    return !failed;
+}
+
+bool HookBatch::GrowPages() {
+    HookBatchPage* old_pages = pages;
+
+    UInt32 old_capacity = pages ? page_mask + 1 : 0;
+    UInt32 capacity = old_capacity ? old_capacity * 2 : 64;
+
+    pages = new HookBatchPage[capacity];
+
+    if (!pages) {
+        pages = old_pages;
+
+        return false;
+    }
+
+    memset(pages, 0, capacity * sizeof(HookBatchPage));
+
+    page_mask = capacity - 1;
+
+    for (UInt32 i = 0; i < old_capacity; i++) {
+        UInt32 slot;
+
+        if (!old_pages[i].task)
+            continue;
+
+        slot = HashPage(old_pages[i].task, old_pages[i].page) & page_mask;
+
+        while (pages[slot].task)
+            slot = (slot + 1) & page_mask;
+
+        pages[slot] = old_pages[i];
+    }
+
+    if (old_pages)
+        delete[] old_pages;
+
+    return true;
+}
+
+HookBatchPage* HookBatch::LookupPage(xnu::Task* task, xnu::mach::VmAddress page, bool create) {
+    UInt32 slot;
+
+    if (!pages) {
+        if (!create || !GrowPages())
+            return nullptr;
+    }
+
+    slot = HashPage(task, page) & page_mask;
+
+    while (pages[slot].task) {
+        if (pages[slot].task == task && pages[slot].page == page)
+            return &pages[slot];
+
+        slot = (slot + 1) & page_mask;
+    }
+
+    if (!create)
+        return nullptr;
+
+    // keep the load factor at or below one half
+    if ((page_count + 1) * 2 > page_mask + 1) {
+        if (!GrowPages())
+            return nullptr;
+
+        return LookupPage(task, page, create);
+    }
+
+    pages[slot].task = task;
+    pages[slot].page = page;
+    pages[slot].first = kHookBatchNone;
+    pages[slot].last = kHookBatchNone;
+
+    page_count++;
+
+    return &pages[slot];
+}
+
+bool HookBatch::Reserve(UInt32 size, UInt32* offset) {
+    if (!GrowArray(&data, &data_capacity, data_size + size))
+        return false;
+
+    *offset = data_size;
+
+    data_size += size;
+
+    return true;
+}
+
+bool HookBatch::StageWrite(xnu::Task* task, xnu::mach::VmAddress address, UInt8* bytes,
+                           UInt32 size) {
+    HookBatchPage* page;
+    HookBatchWrite* write;
+
+    UInt32 offset;
+
+    page = LookupPage(task, address & ~(kHookBatchPageSize - 1), true);
+
+    if (!page || !Reserve(size, &offset) ||
+        !GrowArray(&writes, &write_capacity, write_count + 1))
+        return false;
+
+    memcpy(data + offset, bytes, size);
+
+    write = &writes[write_count];
+
+    write->task = task;
+    write->address = address;
+    write->size = size;
+    write->data = offset;
+    write->next = kHookBatchNone;
+
+    if (page->last == kHookBatchNone)
+        page->first = write_count;
+    else
+        writes[page->last].next = write_count;
+
+    page->last = write_count;
+
+    write_count++;
+
+    return true;
+}
+
+bool HookBatch::Write(xnu::Task* task, xnu::mach::VmAddress address, void* bytes, Size size) {
+    UInt8* source = reinterpret_cast<UInt8*>(bytes);
+
+    if (failed)
+        return false;
+
+    while (size) {
+        Size page_end = kHookBatchPageSize - (address & (kHookBatchPageSize - 1));
+        Size chunk = size < page_end ? size : page_end;
+
+        if (!StageWrite(task, address, source, (UInt32)chunk)) {
+            failed = true;
+
+            return false;
+        }
+
+        address += chunk;
+        source += chunk;
+        size -= chunk;
+    }
+
+    return true;
+}
+
+bool HookBatch::Read(xnu::Task* task, xnu::mach::VmAddress address, void* bytes, Size size) {
+    if (!task->Read(address, bytes, size))
+        return false;
+
+    ApplyStaged(task, address, reinterpret_cast<UInt8*>(bytes), size);
+
+    return true;
+}
+
+void HookBatch::ApplyStaged(xnu::Task* task, xnu::mach::VmAddress address, UInt8* bytes,
+                            Size size) {
+    xnu::mach::VmAddress end = address + size;
+    xnu::mach::VmAddress page;
+
+    // later writes land on top of earlier ones, exactly as they will when committed
+    for (page = address & ~(kHookBatchPageSize - 1); page < end; page += kHookBatchPageSize) {
+        HookBatchPage* entry = LookupPage(task, page, false);
+
+        for (UInt32 i = entry ? entry->first : kHookBatchNone; i != kHookBatchNone;
+             i = writes[i].next) {
+            HookBatchWrite* write = &writes[i];
+
+            xnu::mach::VmAddress start = write->address > address ? write->address : address;
+            xnu::mach::VmAddress stop =
+                write->address + write->size < end ? write->address + write->size : end;
+
+            if (start < stop)
+                memcpy(bytes + (start - address), data + write->data + (start - write->address),
+                       stop - start);
+        }
+    }
+}
+
+bool HookBatch::AddRegion(xnu::Task* task, xnu::mach::VmAddress address, UInt32 size) {
+    HookBatchRegion* region;
+
+    UInt32 original;
+    UInt32 replacement;
+
+    if (!GrowArray(&regions, &region_capacity, region_count + 1) || !Reserve(size, &original) ||
+        !Reserve(size, &replacement))
+        return false;
+
+    // the bytes being replaced are what a rollback puts back
+    if (!task->Read(address, data + original, size))
+        return false;
+
+    region = &regions[region_count++];
+
+    region->task = task;
+    region->address = address;
+    region->size = size;
+    region->original = original;
+    region->replacement = replacement;
+    region->trampoline = patcher->GetTrampolineAllocator().IsTrampoline(task, address);
+    region->written = false;
+
+    // the replacement is the original with the staged writes on top, no need to read it twice
+    memcpy(data + replacement, data + original, size);
+
+    ApplyStaged(task, address, data + replacement, size);
+
+    return true;
+}
+
+bool HookBatch::BuildRegions() {
+    UInt32* order = nullptr;
+    UInt32 order_capacity = 0;
+
+    bool success = true;
+
+    for (UInt32 p = 0; success && pages && p <= page_mask; p++) {
+        HookBatchPage* page = &pages[p];
+
+        UInt32 n = 0;
+
+        if (!page->task)
+            continue;
+
+        for (UInt32 i = page->first; i != kHookBatchNone; i = writes[i].next) {
+            if (!GrowArray(&order, &order_capacity, n + 1)) {
+                success = false;
+
+                break;
+            }
+
+            order[n++] = i;
+        }
+
+        // pages see a few writes per hook, an insertion sort by address is plenty
+        for (UInt32 i = 1; i < n; i++) {
+            UInt32 index = order[i];
+            UInt32 j = i;
+
+            while (j > 0 && writes[order[j - 1]].address > writes[index].address) {
+                order[j] = order[j - 1];
+
+                j--;
+            }
+
+            order[j] = index;
+        }
+
+        for (UInt32 i = 0; success && i < n;) {
+            xnu::mach::VmAddress start = writes[order[i]].address;
+            xnu::mach::VmAddress end = start + writes[order[i]].size;
+
+            // overlapping and adjacent writes become a single region
+            for (i++; i < n && writes[order[i]].address <= end; i++) {
+                if (writes[order[i]].address + writes[order[i]].size > end)
+                    end = writes[order[i]].address + writes[order[i]].size;
+            }
+
+            success = AddRegion(page->task, start, (UInt32)(end - start));
+        }
+    }
+
+    if (order)
+        delete[] order;
+
+    return success;
+}
+
+bool HookBatch::WriteRegions(bool trampolines) {
+    TrampolineAllocator& allocator = patcher->GetTrampolineAllocator();
+
+    for (UInt32 i = 0; i < region_count; i++) {
+        HookBatchRegion* region = &regions[i];
+
+        if (region->trampoline != trampolines)
+            continue;
+
+        xnu::mach::VmAddress address = region->address;
+
+        // trampoline pages stay executable, they are written through their alias
+        if (trampolines &&
+            !(address = allocator.GetWritableAddress(region->task, region->address, region->size)))
+            return false;
+
+        if (!region->task->Write(address, data + region->replacement, region->size))
+            return false;
+
+        region->written = true;
+    }
+
+    return true;
+}
+
+void HookBatch::RestoreRegions() {
+    TrampolineAllocator& allocator = patcher->GetTrampolineAllocator();
+
+    for (UInt32 i = region_count; i > 0; i--) {
+        HookBatchRegion* region = &regions[i - 1];
+
+        if (!region->written)
+            continue;
+
+        xnu::mach::VmAddress address = region->address;
+
+        if (region->trampoline)
+            address = allocator.GetWritableAddress(region->task, region->address, region->size);
+
+        region->task->Write(address, data + region->original, region->size);
+
+#ifdef __USER__
+        region->task->InvalidateCaches(region->address, region->size);
+#endif
+
+        region->written = false;
+    }
+}
+
+void HookBatch::SyncInstructionCache() {
+#if defined(__KERNEL__) && defined(__arm64__)
+    for (UInt32 i = 0; i < region_count; i++) {
+        flush_dcache64((addr64_t)regions[i].address, regions[i].size, false);
+        invalidate_icache64((addr64_t)regions[i].address, regions[i].size, false);
+    }
+#endif
+
+#ifdef __USER__
+    // tasks that override Write() do not drop their cached copies of the patched pages
+    for (UInt32 i = 0; i < region_count; i++)
+        regions[i].task->InvalidateCaches(regions[i].address, regions[i].size);
+#endif
+}
+
+bool HookBatch::Commit() {
+    bool success;
+
+    if (failed || !BuildRegions()) {
+        Abort();
+
+        return false;
+    }
+
+    // trampolines have to be in place before anything branches to them
+    success = WriteRegions(true) && WriteRegions(false);
+
+    if (!success) {
+        RestoreRegions();
+
+        Abort();
+
+        return false;
+    }
+
+    SyncInstructionCache();
+
+    for (UInt32 i = 0; i < hook_count; i++)
+        patcher->RegisterHook(hooks[i].hook);
+
+    Reset();
+
+    return true;
+}
+
+void HookBatch::Abort() {
+    for (UInt32 i = hook_count; i > 0; i--)
+        hooks[i - 1].hook->DiscardPatches(hooks[i - 1].patch_count, hooks[i - 1].payload_offset);
+
+    Reset();
+}
+
+} // namespace darwin
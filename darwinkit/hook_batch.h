@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+namespace xnu {
+class Task;
+}; // namespace xnu
+
+namespace darwin {
+class Hook;
+class Patcher;
+
+static constexpr UInt32 kHookBatchNone = 0xFFFFFFFF;
+
+/**
+ *  A write staged by a HookBatch. Writes never cross a page boundary, longer ones are split,
+ *  and the writes to a page are chained in the order they were made.
+ */
+struct HookBatchWrite {
+    xnu::Task* task;
+
+    xnu::mach::VmAddress address;
+
+    UInt32 size;
+
+    // offset of the bytes in the batch's data buffer
+    UInt32 data;
+
+    UInt32 next;
+};
+
+struct HookBatchPage {
+    xnu::Task* task;
+
+    xnu::mach::VmAddress page;
+
+    UInt32 first;
+    UInt32 last;
+};
+
+/**
+ *  A contiguous run of bytes written back by HookBatch::Commit(), along with the bytes it
+ *  replaced so that the batch can be rolled back.
+ */
+struct HookBatchRegion {
+    xnu::Task* task;
+
+    xnu::mach::VmAddress address;
+
+    UInt32 size;
+
+    UInt32 original;
+    UInt32 replacement;
+
+    bool trampoline;
+    bool written;
+};
+
+struct HookBatchHook {
+    darwin::Hook* hook;
+
+    // state of the hook before the batch touched it
+    UInt32 patch_count;
+
+    // -1 when the hook had no trampoline yet
+    Offset payload_offset;
+};
+
+/**
+ *  Installs many hooks as one transaction.
+ *
+ *  AddHook() and AddBreakpoint() run the usual Hook code, but while they do every write to
+ *  the task, trampolines and branch patches alike, is staged in host memory and every read
+ *  sees the staged bytes. Nothing touches the task until Commit(), which merges the staged
+ *  writes into contiguous regions per page, saves the bytes they replace and writes each
+ *  region once: trampolines first, then the branches into them. Trampolines are written through
+ *  the read/write aliases of their pages and on arm64 kernels the instruction cache is synced
+ *  in one pass at the end.
+ *
+ *  If planning any hook or writing any region fails, the regions already written are restored,
+ *  the hooks are returned to the state they were in before the batch and nothing is
+ *  registered with the patcher. A batch that is destroyed without being committed is aborted.
+ */
+class HookBatch {
+public:
+    explicit HookBatch(darwin::Patcher* patcher);
+
+    ~HookBatch();
+
+    darwin::Patcher* GetPatcher() {
+        return patcher;
+    }
+
+    UInt32 GetHookCount() {
+        return hook_count;
+    }
+
+    UInt32 GetWriteCount() {
+        return write_count;
+    }
+
+    UInt32 GetRegionCount() {
+        return region_count;
+    }
+
+    bool AddHook(darwin::Hook* hook, xnu::mach::VmAddress to);
+
+    bool AddBreakpoint(darwin::Hook* hook, xnu::mach::VmAddress breakpoint_hook);
+
+    bool Commit();
+
+    void Abort();
+
+    bool Read(xnu::Task* task, xnu::mach::VmAddress address, void* data, Size size);
+
+    bool Write(xnu::Task* task, xnu::mach::VmAddress address, void* data, Size size);
+
+private:
+    darwin::Patcher* patcher;
+
+    bool failed;
+
+    HookBatchHook* hooks;
+    UInt32 hook_count;
+    UInt32 hook_capacity;
+
+    HookBatchWrite* writes;
+    UInt32 write_count;
+    UInt32 write_capacity;
+
+    HookBatchPage* pages;
+    UInt32 page_count;
+    UInt32 page_mask;
+
+    HookBatchRegion* regions;
+    UInt32 region_count;
+    UInt32 region_capacity;
+
+    UInt8* data;
+    UInt32 data_size;
+    UInt32 data_capacity;
+
+    HookBatchHook* Track(darwin::Hook* hook);
+
+    HookBatchPage* LookupPage(xnu::Task* task, xnu::mach::VmAddress page, bool create);
+
+    bool GrowPages();
+
+    bool Reserve(UInt32 size, UInt32* offset);
+
+    bool StageWrite(xnu::Task* task, xnu::mach::VmAddress address, UInt8* bytes, UInt32 size);
+
+    void ApplyStaged(xnu::Task* task, xnu::mach::VmAddress address, UInt8* bytes, Size size);
+
+    bool BuildRegions();
+
+    bool AddRegion(xnu::Task* task, xnu::mach::VmAddress address, UInt32 size);
+
+    bool WriteRegions(bool trampolines);
+
+    void RestoreRegions();
+
+    void SyncInstructionCache();
+
+    void Reset();
+};
+
+} // namespace darwin
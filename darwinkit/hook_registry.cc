@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hook_registry.h"
+
+#include <string.h>
+
+#ifdef __KERNEL__
+#include <libkern/libkern.h>
+#else
+#include <stdlib.h>
+#endif
+
+namespace darwin {
+
+static constexpr UInt32 kHookRegistryMinCapacity = 64;
+
+static inline UInt32 HashHook(xnu::mach::VmAddress from, UInt32 type) {
+    UInt64 hash = (from ^ ((UInt64)type << 59)) * 0x9E3779B97F4A7C15ULL;
+
+    // the upper bits mix in every bit of the address, hooks are often only a few bytes apart
+    return (UInt32)(hash >> 32);
+}
+
+static int CompareEntries(const void* a, const void* b) {
+    const HookRegistryEntry* left = reinterpret_cast<const HookRegistryEntry*>(a);
+    const HookRegistryEntry* right = reinterpret_cast<const HookRegistryEntry*>(b);
+
+    if (left->from != right->from)
+        return left->from < right->from ? -1 : 1;
+
+    if (left->type != right->type)
+        return left->type < right->type ? -1 : 1;
+
+    return 0;
+}
+
+HookRegistry::HookRegistry()
+    : table(nullptr), table_mask(0), count(0), sorted(nullptr), sorted_capacity(0),
+      sorted_dirty(false) {}
+
+HookRegistry::~HookRegistry() {
+    if (table)
+        delete[] table;
+
+    if (sorted)
+        delete[] sorted;
+}
+
+void HookRegistry::Clear() {
+    if (table)
+        memset(table, 0, (table_mask + 1) * sizeof(HookRegistryEntry));
+
+    count = 0;
+
+    sorted_dirty = false;
+}
+
+bool HookRegistry::Grow() {
+    HookRegistryEntry* old_table = table;
+    UInt32 old_capacity = table ? table_mask + 1 : 0;
+
+    UInt32 capacity = old_capacity ? old_capacity * 2 : kHookRegistryMinCapacity;
+
+    table = new HookRegistryEntry[capacity];
+
+    if (!table) {
+        table = old_table;
+
+        return false;
+    }
+
+    memset(table, 0, capacity * sizeof(HookRegistryEntry));
+
+    table_mask = capacity - 1;
+
+    for (UInt32 i = 0; i < old_capacity; i++) {
+        HookRegistryEntry* entry = &old_table[i];
+
+        if (!entry->hook)
+            continue;
+
+        UInt32 slot = HashHook(entry->from, entry->type) & table_mask;
+
+        while (table[slot].hook)
+            slot = (slot + 1) & table_mask;
+
+        table[slot] = *entry;
+    }
+
+    if (old_table)
+        delete[] old_table;
+
+    return true;
+}
+
+HookRegistryEntry* HookRegistry::Lookup(xnu::mach::VmAddress from, UInt32 type) {
+    UInt32 slot;
+
+    if (!count)
+        return nullptr;
+
+    slot = HashHook(from, type) & table_mask;
+
+    while (table[slot].hook) {
+        if (table[slot].from == from && table[slot].type == type)
+            return &table[slot];
+
+        slot = (slot + 1) & table_mask;
+    }
+
+    return nullptr;
+}
+
+bool HookRegistry::Insert(xnu::mach::VmAddress from, UInt32 type, Hook* hook) {
+    UInt32 slot;
+
+    if (!hook || Lookup(from, type))
+        return false;
+
+    // keep the load factor at or below one half
+    if ((count + 1) * 2 > (table ? table_mask + 1 : 0) && !Grow())
+        return false;
+
+    slot = HashHook(from, type) & table_mask;
+
+    while (table[slot].hook)
+        slot = (slot + 1) & table_mask;
+
+    table[slot].from = from;
+    table[slot].type = type;
+    table[slot].hook = hook;
+
+    // a clean range index is patched in place, bulk installs just rebuild it on the next query
+    if (!sorted_dirty && count < sorted_capacity) {
+        UInt32 position = SortedPosition(from, type);
+
+        memmove(&sorted[position + 1], &sorted[position],
+                (count - position) * sizeof(HookRegistryEntry));
+
+        sorted[position] = table[slot];
+    } else {
+        sorted_dirty = true;
+    }
+
+    count++;
+
+    return true;
+}
+
+bool HookRegistry::Remove(xnu::mach::VmAddress from, UInt32 type) {
+    HookRegistryEntry* entry = Lookup(from, type);
+
+    UInt32 hole;
+    UInt32 slot;
+
+    if (!entry)
+        return false;
+
+    hole = (UInt32)(entry - table);
+    slot = hole;
+
+    // shift later members of the probe sequence back so that lookups never stop early
+    while (true) {
+        UInt32 home;
+
+        slot = (slot + 1) & table_mask;
+
+        if (!table[slot].hook)
+            break;
+
+        home = HashHook(table[slot].from, table[slot].type) & table_mask;
+
+        if (((slot - home) & table_mask) >= ((slot - hole) & table_mask)) {
+            table[hole] = table[slot];
+
+            hole = slot;
+        }
+    }
+
+    memset(&table[hole], 0, sizeof(HookRegistryEntry));
+
+    if (!sorted_dirty) {
+        UInt32 position = SortedPosition(from, type);
+
+        memmove(&sorted[position], &sorted[position + 1],
+                (count - position - 1) * sizeof(HookRegistryEntry));
+    }
+
+    count--;
+
+    return true;
+}
+
+Hook* HookRegistry::Find(xnu::mach::VmAddress from, UInt32 type) {
+    HookRegistryEntry* entry = Lookup(from, type);
+
+    return entry ? entry->hook : nullptr;
+}
+
+bool HookRegistry::BuildRangeIndex() {
+    UInt32 n = 0;
+
+    if (count > sorted_capacity) {
+        HookRegistryEntry* entries = new HookRegistryEntry[table_mask + 1];
+
+        if (!entries)
+            return false;
+
+        if (sorted)
+            delete[] sorted;
+
+        sorted = entries;
+        sorted_capacity = table_mask + 1;
+    }
+
+    for (UInt32 i = 0; count && i <= table_mask; i++) {
+        if (table[i].hook)
+            sorted[n++] = table[i];
+    }
+
+    if (n > 1)
+        qsort(sorted, n, sizeof(HookRegistryEntry), CompareEntries);
+
+    sorted_dirty = false;
+
+    return true;
+}
+
+UInt32 HookRegistry::LowerBound(xnu::mach::VmAddress address) {
+    UInt32 low = 0;
+    UInt32 high = count;
+
+    while (low < high) {
+        UInt32 mid = low + (high - low) / 2;
+
+        if (sorted[mid].from < address)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+UInt32 HookRegistry::SortedPosition(xnu::mach::VmAddress from, UInt32 type) {
+    UInt32 position = LowerBound(from);
+
+    while (position < count && sorted[position].from == from && sorted[position].type < type)
+        position++;
+
+    return position;
+}
+
+HookRegistryEntry* HookRegistry::FindInRange(xnu::mach::VmAddress start,
+                                             xnu::mach::VmAddress end, UInt32* found) {
+    UInt32 first;
+    UInt32 last;
+
+    *found = 0;
+
+    if (!count || start >= end)
+        return nullptr;
+
+    if (sorted_dirty && !BuildRangeIndex())
+        return nullptr;
+
+    first = LowerBound(start);
+    last = LowerBound(end);
+
+    *found = last - first;
+
+    return *found ? &sorted[first] : nullptr;
+}
+
+} // namespace darwin
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+namespace darwin {
+class Hook;
+
+struct HookRegistryEntry {
+    xnu::mach::VmAddress from;
+
+    // a HookType, kept as an integer so that the registry does not depend on hook.h
+    UInt32 type;
+
+    darwin::Hook* hook;
+};
+
+/**
+ *  Hooks indexed by the address they were placed at and their type.
+ *
+ *  Exact lookups go through an open-addressed hash table keyed by (from, type) with linear
+ *  probing and backward shift deletion, so no tombstones build up as hooks come and go. Range
+ *  queries ("is anything hooked within [start, end)") use a copy of the entries sorted by
+ *  address. Once built, that index is kept up to date by insertions and removals; after a bulk
+ *  install it is rebuilt in one go by the first range query instead.
+ *
+ *  The registry does not own the hooks. This file is shared with the kernel build and does not
+ *  use the STL.
+ */
+class HookRegistry {
+public:
+    explicit HookRegistry();
+
+    ~HookRegistry();
+
+    UInt32 GetCount() {
+        return count;
+    }
+
+    bool Insert(xnu::mach::VmAddress from, UInt32 type, darwin::Hook* hook);
+
+    bool Remove(xnu::mach::VmAddress from, UInt32 type);
+
+    void Clear();
+
+    darwin::Hook* Find(xnu::mach::VmAddress from, UInt32 type);
+
+    /**
+     *  Returns the entries whose address lies within [start, end), ordered by address and then
+     *  type. The entries live in the range index and stay valid until the registry is modified.
+     */
+    HookRegistryEntry* FindInRange(xnu::mach::VmAddress start, xnu::mach::VmAddress end,
+                                   UInt32* found);
+
+    bool IsRangeHooked(xnu::mach::VmAddress start, xnu::mach::VmAddress end) {
+        UInt32 found;
+
+        FindInRange(start, end, &found);
+
+        return found != 0;
+    }
+
+private:
+    HookRegistryEntry* table;
+    UInt32 table_mask;
+
+    UInt32 count;
+
+    HookRegistryEntry* sorted;
+    UInt32 sorted_capacity;
+
+    bool sorted_dirty;
+
+    bool Grow();
+
+    HookRegistryEntry* Lookup(xnu::mach::VmAddress from, UInt32 type);
+
+    bool BuildRangeIndex();
+
+    UInt32 LowerBound(xnu::mach::VmAddress address);
+
+    UInt32 SortedPosition(xnu::mach::VmAddress from, UInt32 type);
+};
+
+} // namespace darwin
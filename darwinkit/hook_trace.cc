@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hook_trace.h"
+
+#include <string.h>
+
+#ifdef __KERNEL__
+#include <kern/clock.h>
+#include <kern/cpu_number.h>
+#include <libkern/libkern.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#include <pthread.h>
+#else
+#include <sched.h>
+#include <time.h>
+#endif
+
+namespace darwin {
+
+struct HookTraceSlot {
+    // position + 1 once the record is published, position + capacity once it is drained
+    UInt64 sequence;
+
+    HookTraceRecord record;
+};
+
+// head and tail sit on cache lines of their own, the drainer never slows down the CPU tracing
+struct HookTraceBuffer {
+    UInt64 head;
+
+    UInt8 padding0[128 - sizeof(UInt64)];
+
+    UInt64 dropped;
+
+    UInt8 padding1[128 - sizeof(UInt64)];
+
+    // only touched by the drainer
+    UInt64 tail;
+    UInt64 reported_dropped;
+
+    UInt8 padding2[128 - 2 * sizeof(UInt64)];
+};
+
+UInt32 HookTrace::GetCurrentCpu() {
+#ifdef __KERNEL__
+    return cpu_number();
+#elif defined(__APPLE__)
+    size_t cpu = 0;
+
+    pthread_cpu_number_np(&cpu);
+
+    return (UInt32)cpu;
+#else
+    int cpu = sched_getcpu();
+
+    return cpu < 0 ? 0 : (UInt32)cpu;
+#endif
+}
+
+UInt64 HookTrace::GetTimestamp() {
+#if defined(__KERNEL__) || defined(__APPLE__)
+    return mach_absolute_time();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (UInt64)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+HookTrace::HookTrace(UInt32 cpu_count, UInt32 records_per_cpu)
+    : buffers(nullptr), slots(nullptr), cpu_count(cpu_count), capacity(2), next_cpu(0),
+      draining(0) {
+    if (!cpu_count || cpu_count > kHookTraceMaxCpus || !records_per_cpu)
+        return;
+
+    while (capacity < records_per_cpu && capacity < (1U << 24))
+        capacity *= 2;
+
+    buffers = new HookTraceBuffer[cpu_count];
+    slots = new HookTraceSlot[(Size)cpu_count * capacity];
+
+    if (!buffers || !slots) {
+        if (buffers)
+            delete[] buffers;
+
+        if (slots)
+            delete[] slots;
+
+        buffers = nullptr;
+        slots = nullptr;
+
+        return;
+    }
+
+    memset(buffers, 0, sizeof(HookTraceBuffer) * cpu_count);
+
+    for (UInt32 cpu = 0; cpu < cpu_count; cpu++) {
+        for (UInt32 i = 0; i < capacity; i++)
+            slots[(Size)cpu * capacity + i].sequence = i;
+    }
+}
+
+HookTrace::~HookTrace() {
+    if (buffers)
+        delete[] buffers;
+
+    if (slots)
+        delete[] slots;
+}
+
+bool HookTrace::Record(UInt32 hook_id, const UInt64* arguments, UInt32 argument_count) {
+    return RecordOnCpu(GetCurrentCpu(), GetTimestamp(), hook_id, arguments, argument_count);
+}
+
+bool HookTrace::RecordOnCpu(UInt32 cpu, UInt64 timestamp, UInt32 hook_id,
+                            const UInt64* arguments, UInt32 argument_count) {
+    HookTraceBuffer* buffer;
+    HookTraceSlot* cpu_slots;
+    HookTraceSlot* slot;
+
+    UInt64 position;
+
+    if (!buffers)
+        return false;
+
+    cpu %= cpu_count;
+
+    if (argument_count > kHookTraceMaxArguments)
+        argument_count = kHookTraceMaxArguments;
+
+    buffer = &buffers[cpu];
+
+    cpu_slots = &slots[(Size)cpu * capacity];
+
+    position = __atomic_load_n(&buffer->head, __ATOMIC_RELAXED);
+
+    // only a hook that preempted or interrupted another one on this CPU ever retries
+    while (true) {
+        Int64 difference;
+
+        slot = &cpu_slots[position & (capacity - 1)];
+
+        difference = (Int64)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&buffer->head, &position, position + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (difference < 0) {
+            __atomic_fetch_add(&buffer->dropped, 1, __ATOMIC_RELAXED);
+
+            return false;
+        } else {
+            position = __atomic_load_n(&buffer->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->record.timestamp = timestamp;
+    slot->record.hook_id = hook_id;
+    slot->record.cpu = (UInt16)cpu;
+    slot->record.argument_count = (UInt8)argument_count;
+    slot->record.flags = 0;
+
+    for (UInt32 i = 0; i < kHookTraceMaxArguments; i++)
+        slot->record.arguments[i] = i < argument_count ? arguments[i] : 0;
+
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+Size HookTrace::Drain(HookTraceRecord* records, Size max_records) {
+    Size drained = 0;
+
+    UInt32 idle = 0;
+
+    if (!buffers || !records || !max_records)
+        return 0;
+
+    if (!__atomic_compare_exchange_n(&draining, &idle, 1, false, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED))
+        return 0;
+
+    for (UInt32 i = 0; i < cpu_count && drained < max_records; i++) {
+        UInt32 cpu = (next_cpu + i) % cpu_count;
+
+        HookTraceBuffer* buffer = &buffers[cpu];
+
+        HookTraceSlot* cpu_slots = &slots[(Size)cpu * capacity];
+
+        UInt64 dropped = __atomic_load_n(&buffer->dropped, __ATOMIC_RELAXED);
+
+        if (dropped != buffer->reported_dropped) {
+            HookTraceRecord* record = &records[drained++];
+
+            memset(record, 0, sizeof(HookTraceRecord));
+
+            record->timestamp = GetTimestamp();
+            record->cpu = (UInt16)cpu;
+            record->argument_count = 1;
+            record->flags = kHookTraceFlagDropped;
+            record->arguments[0] = dropped - buffer->reported_dropped;
+
+            buffer->reported_dropped = dropped;
+        }
+
+        while (drained < max_records) {
+            HookTraceSlot* slot = &cpu_slots[buffer->tail & (capacity - 1)];
+
+            if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != buffer->tail + 1)
+                break;
+
+            records[drained++] = slot->record;
+
+            // hands the slot back to the producers for the next lap around the buffer
+            __atomic_store_n(&slot->sequence, buffer->tail + capacity, __ATOMIC_RELEASE);
+
+            buffer->tail++;
+        }
+    }
+
+    next_cpu = (next_cpu + 1) % cpu_count;
+
+    __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+
+    return drained;
+}
+
+Size HookTrace::DrainEncoded(UInt8* out, Size out_size) {
+    HookTraceEncoder encoder;
+
+    HookTraceRecord* records;
+
+    Size max_records;
+    Size count;
+    Size size;
+
+    if (!out || out_size < HookTraceEncodedSize(1))
+        return 0;
+
+    max_records = (out_size - HookTraceEncodedSize(0)) / kHookTraceMaxEncodedSize;
+
+    // every record encodes to at most kHookTraceMaxEncodedSize bytes, so the encoder never
+    // catches up with a record it has not read yet
+    records = reinterpret_cast<HookTraceRecord*>(
+        ((UIntPtr)(out + out_size) - max_records * sizeof(HookTraceRecord)) &
+        ~(UIntPtr)(alignof(HookTraceRecord) - 1));
+
+    count = Drain(records, max_records);
+
+    if (!count)
+        return 0;
+
+    size = encoder.EncodeHeader(cpu_count, records[0].timestamp, out, out_size);
+
+    for (Size i = 0; i < count; i++)
+        size += encoder.Encode(&records[i], &out[size], out_size - size);
+
+    return size;
+}
+
+UInt64 HookTrace::GetDroppedCount() {
+    UInt64 dropped = 0;
+
+    if (!buffers)
+        return 0;
+
+    for (UInt32 cpu = 0; cpu < cpu_count; cpu++)
+        dropped += __atomic_load_n(&buffers[cpu].dropped, __ATOMIC_RELAXED);
+
+    return dropped;
+}
+
+static Size EncodeVarint(UInt64 value, UInt8* out) {
+    Size size = 0;
+
+    while (value >= 0x80) {
+        out[size++] = (UInt8)(value | 0x80);
+
+        value >>= 7;
+    }
+
+    out[size++] = (UInt8)value;
+
+    return size;
+}
+
+HookTraceEncoder::HookTraceEncoder() : previous_timestamp(0) {}
+
+Size HookTraceEncoder::EncodeHeader(UInt32 cpu_count, UInt64 base_timestamp, UInt8* out,
+                                    Size out_size) {
+    HookTraceFileHeader header;
+
+    if (!out || out_size < sizeof(HookTraceFileHeader) || cpu_count > kHookTraceMaxCpus)
+        return 0;
+
+    header.magic = kHookTraceMagic;
+    header.version = kHookTraceVersion;
+    header.cpu_count = (UInt16)cpu_count;
+    header.base_timestamp = base_timestamp;
+
+    memcpy(out, &header, sizeof(header));
+
+    previous_timestamp = base_timestamp;
+
+    return sizeof(header);
+}
+
+Size HookTraceEncoder::Encode(const HookTraceRecord* record, UInt8* out, Size out_size) {
+    UInt8 encoded[kHookTraceMaxEncodedSize];
+
+    Size size = 0;
+
+    // read before out is written, DrainEncoded() encodes over the records
+    UInt64 timestamp = record->timestamp;
+
+    Int64 delta = (Int64)(timestamp - previous_timestamp);
+
+    UInt32 argument_count = record->argument_count;
+
+    if (argument_count > kHookTraceMaxArguments)
+        argument_count = kHookTraceMaxArguments;
+
+    encoded[size++] = (UInt8)((argument_count << 4) | (record->flags & 0xF));
+
+    size += EncodeVarint(((UInt64)delta << 1) ^ (UInt64)(delta >> 63), &encoded[size]);
+    size += EncodeVarint(record->hook_id, &encoded[size]);
+    size += EncodeVarint(record->cpu, &encoded[size]);
+
+    for (UInt32 i = 0; i < argument_count; i++)
+        size += EncodeVarint(record->arguments[i], &encoded[size]);
+
+    if (!out || size > out_size)
+        return 0;
+
+    memcpy(out, encoded, size);
+
+    previous_timestamp = timestamp;
+
+    return size;
+}
+
+} // namespace darwin
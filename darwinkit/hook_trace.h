@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+namespace darwin {
+
+static constexpr UInt32 kHookTraceMagic = 0x524B5448;
+
+static constexpr UInt16 kHookTraceVersion = 1;
+
+static constexpr UInt32 kHookTraceMaxArguments = 6;
+
+static constexpr UInt32 kHookTraceDefaultRecords = 1024;
+
+static constexpr UInt32 kHookTraceMaxCpus = 256;
+
+// a flag byte, three varints for timestamp, hook id and CPU, and one per argument
+static constexpr Size kHookTraceMaxEncodedSize = 1 + 10 * (3 + kHookTraceMaxArguments);
+
+enum HookTraceFlags {
+    // hook_id is 0 and arguments[0] holds how many records the CPU dropped since the last drain
+    kHookTraceFlagDropped = 1 << 0,
+};
+
+struct HookTraceRecord {
+    // mach_absolute_time() in the kernel
+    UInt64 timestamp;
+
+    UInt32 hook_id;
+
+    UInt16 cpu;
+
+    UInt8 argument_count;
+    UInt8 flags;
+
+    UInt64 arguments[kHookTraceMaxArguments];
+};
+
+static_assert(sizeof(HookTraceRecord) == 64);
+
+/**
+ *  Header of the compact trace format. Every record after it starts with a byte holding the
+ *  argument count in the high nibble and the flags in the low one, followed by LEB128 varints
+ *  for the zigzag encoded timestamp delta to the previous record, the hook id, the CPU and each
+ *  argument. Records are written in drain order, so the deltas can be negative.
+ */
+struct HookTraceFileHeader {
+    UInt32 magic;
+
+    UInt16 version;
+    UInt16 cpu_count;
+
+    // timestamp the first delta is taken from
+    UInt64 base_timestamp;
+};
+
+static_assert(sizeof(HookTraceFileHeader) == 16);
+
+// bytes HookTrace::DrainEncoded() needs to drain up to records records in one go
+static constexpr Size HookTraceEncodedSize(Size records) {
+    return sizeof(HookTraceFileHeader) + alignof(HookTraceRecord) +
+           records * kHookTraceMaxEncodedSize;
+}
+
+struct HookTraceSlot;
+struct HookTraceBuffer;
+
+/**
+ *  Per-CPU buffers that instrumentation hooks record into without taking a lock.
+ *
+ *  Each CPU owns a bounded buffer of fixed-size slots and a hook only touches the buffer of the
+ *  CPU it runs on, so CPUs never contend on a cache line while tracing. A slot is claimed with a
+ *  compare and swap on the buffer's head and published by its sequence number, which keeps
+ *  the buffer consistent when a hook is preempted or interrupted by another hook on the same
+ *  CPU. A full buffer drops the record and counts it rather than stall the traced function.
+ *
+ *  Drain() hands the published records of every CPU to one consumer at a time, along with a
+ *  kHookTraceFlagDropped record for each CPU that lost records since the last drain.
+ */
+class HookTrace {
+public:
+    explicit HookTrace(UInt32 cpu_count, UInt32 records_per_cpu = kHookTraceDefaultRecords);
+
+    ~HookTrace();
+
+    bool IsValid() {
+        return buffers != nullptr;
+    }
+
+    UInt32 GetCpuCount() {
+        return cpu_count;
+    }
+
+    UInt32 GetRecordsPerCpu() {
+        return capacity;
+    }
+
+    bool Record(UInt32 hook_id, const UInt64* arguments, UInt32 argument_count);
+
+    bool RecordOnCpu(UInt32 cpu, UInt64 timestamp, UInt32 hook_id, const UInt64* arguments,
+                     UInt32 argument_count);
+
+    // returns how many records were copied out, 0 while another thread is draining
+    Size Drain(darwin::HookTraceRecord* records, Size max_records);
+
+    /**
+     *  Drains as many records as fit into out as one trace in the compact format, header
+     *  included, so every piece of a stream decodes on its own. The records are drained into the
+     *  end of out and encoded towards its start, which leaves the kernel without a scratch
+     *  buffer. Returns the bytes written, 0 if nothing was drained.
+     */
+    Size DrainEncoded(UInt8* out, Size out_size);
+
+    UInt64 GetDroppedCount();
+
+    static UInt32 GetCurrentCpu();
+
+    static UInt64 GetTimestamp();
+
+private:
+    darwin::HookTraceBuffer* buffers;
+
+    darwin::HookTraceSlot* slots;
+
+    UInt32 cpu_count;
+
+    // slots per CPU, a power of two
+    UInt32 capacity;
+
+    // CPU the next drain starts with, so a busy CPU cannot starve the others
+    UInt32 next_cpu;
+
+    // set while a drain runs, the buffers have a single consumer
+    UInt32 draining;
+};
+
+/**
+ *  Writes HookTraceRecords in the compact trace format. Kernel safe, the caller owns the output
+ *  buffer and can stream the trace out in as many pieces as it likes.
+ */
+class HookTraceEncoder {
+public:
+    explicit HookTraceEncoder();
+
+    ~HookTraceEncoder() = default;
+
+    // bytes written, 0 if out_size is too small
+    Size EncodeHeader(UInt32 cpu_count, UInt64 base_timestamp, UInt8* out, Size out_size);
+
+    // bytes written, 0 if the record does not fit, at most kHookTraceMaxEncodedSize
+    Size Encode(const darwin::HookTraceRecord* record, UInt8* out, Size out_size);
+
+private:
+    UInt64 previous_timestamp;
+};
+
+} // namespace darwin
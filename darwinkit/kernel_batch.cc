@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernel_batch.h"
+
+#include <string.h>
+
+#ifdef __KERNEL__
+#include <libkern/libkern.h>
+#endif
+
+namespace darwin {
+
+static inline Size Align8(Size size) {
+    return (size + 7) & ~(Size)7;
+}
+
+static inline bool IsRead(UInt32 type) {
+    return type == kKernelBatchRead || type == kKernelBatchPhysicalRead;
+}
+
+static inline bool IsWrite(UInt32 type) {
+    return type == kKernelBatchWrite || type == kKernelBatchPhysicalWrite;
+}
+
+static inline Size GetStatusSize(UInt32 count) {
+    return Align8(count);
+}
+
+template <typename T>
+static bool GrowBuffer(T** buffer, Size* capacity, Size needed) {
+    T* grown;
+
+    Size n = *capacity ? *capacity : 16;
+
+    if (needed <= *capacity)
+        return true;
+
+    while (n < needed)
+        n *= 2;
+
+    grown = new T[n];
+
+    if (!grown)
+        return false;
+
+    if (*buffer) {
+        memcpy(grown, *buffer, *capacity * sizeof(T));
+
+        delete[] *buffer;
+    }
+
+    *buffer = grown;
+    *capacity = n;
+
+    return true;
+}
+
+Size GetKernelBatchResponseSize(const UInt8* request, Size request_size) {
+    const KernelBatchHeader* header = reinterpret_cast<const KernelBatchHeader*>(request);
+    const KernelBatchOperation* operations;
+
+    Size data_offset;
+    Size response_size;
+
+    if (!request || request_size < sizeof(KernelBatchHeader) ||
+        request_size > kKernelBatchMaxBufferSize)
+        return 0;
+
+    if (header->magic != kKernelBatchMagic || header->version != kKernelBatchVersion ||
+        header->size != request_size || header->operation_count > kKernelBatchMaxOperations)
+        return 0;
+
+    data_offset = sizeof(KernelBatchHeader) + header->operation_count * sizeof(KernelBatchOperation);
+
+    if (data_offset > request_size)
+        return 0;
+
+    operations = reinterpret_cast<const KernelBatchOperation*>(header + 1);
+
+    response_size = sizeof(KernelBatchHeader) + GetStatusSize(header->operation_count);
+
+    // the write bytes have to account for the rest of the request exactly
+    for (UInt32 i = 0; i < header->operation_count; i++) {
+        const KernelBatchOperation* operation = &operations[i];
+
+        if (!operation->size || operation->size > kKernelBatchMaxOperationSize)
+            return 0;
+
+        if (IsRead(operation->type))
+            response_size += Align8(operation->size);
+        else if (IsWrite(operation->type))
+            data_offset += Align8(operation->size);
+        else
+            return 0;
+
+        if (data_offset > request_size || response_size > kKernelBatchMaxBufferSize)
+            return 0;
+    }
+
+    return data_offset == request_size ? response_size : 0;
+}
+
+bool ExecuteKernelBatch(KernelBatchBackend* backend, const UInt8* request, Size request_size,
+                        UInt8* response, Size response_size) {
+    const KernelBatchHeader* header = reinterpret_cast<const KernelBatchHeader*>(request);
+    const KernelBatchOperation* operations;
+
+    KernelBatchHeader* result;
+
+    UInt8* status;
+
+    Size needed = GetKernelBatchResponseSize(request, request_size);
+
+    Size data_offset;
+    Size read_offset;
+
+    UInt32 failed = 0;
+
+    if (!backend || !needed || !response || response_size < needed)
+        return false;
+
+    operations = reinterpret_cast<const KernelBatchOperation*>(header + 1);
+
+    status = response + sizeof(KernelBatchHeader);
+
+    data_offset = sizeof(KernelBatchHeader) + header->operation_count * sizeof(KernelBatchOperation);
+    read_offset = sizeof(KernelBatchHeader) + GetStatusSize(header->operation_count);
+
+    memset(response, 0, needed);
+
+    for (UInt32 i = 0; i < header->operation_count; i++) {
+        const KernelBatchOperation* operation = &operations[i];
+
+        bool success = false;
+
+        switch (operation->type) {
+        case kKernelBatchRead:
+            success = backend->Read(operation->address, response + read_offset, operation->size);
+
+            break;
+        case kKernelBatchPhysicalRead:
+            success = backend->PhysicalRead(operation->address, response + read_offset,
+                                            operation->size);
+
+            break;
+        case kKernelBatchWrite:
+            success = backend->Write(operation->address,
+                                     const_cast<UInt8*>(request + data_offset), operation->size);
+
+            break;
+        case kKernelBatchPhysicalWrite:
+            success = backend->PhysicalWrite(operation->address,
+                                             const_cast<UInt8*>(request + data_offset),
+                                             operation->size);
+
+            break;
+        default:
+            break;
+        }
+
+        if (IsRead(operation->type))
+            read_offset += Align8(operation->size);
+        else
+            data_offset += Align8(operation->size);
+
+        status[i] = success;
+
+        if (!success)
+            failed++;
+    }
+
+    result = reinterpret_cast<KernelBatchHeader*>(response);
+
+    result->magic = kKernelBatchMagic;
+    result->version = kKernelBatchVersion;
+    result->operation_count = header->operation_count;
+    result->failed_count = failed;
+    result->size = needed;
+
+    return true;
+}
+
+KernelBatch::KernelBatch()
+    : operations(nullptr), destinations(nullptr), count(0), capacity(0), data(nullptr),
+      data_size(0), data_capacity(0), read_size(0), request(nullptr), request_size(0),
+      request_capacity(0), response(nullptr), response_size(0), response_capacity(0),
+      failed_count(0), decoded(false) {}
+
+KernelBatch::~KernelBatch() {
+    if (operations)
+        delete[] operations;
+
+    if (destinations)
+        delete[] destinations;
+
+    if (data)
+        delete[] data;
+
+    if (request)
+        delete[] request;
+
+    if (response)
+        delete[] response;
+}
+
+void KernelBatch::Reset() {
+    count = 0;
+
+    data_size = 0;
+    read_size = 0;
+
+    request_size = 0;
+    response_size = 0;
+
+    failed_count = 0;
+
+    decoded = false;
+}
+
+bool KernelBatch::Add(UInt32 type, UInt64 address, void* destination, const void* bytes,
+                      Size size) {
+    Size operation_capacity = capacity;
+
+    Size padded = Align8(size);
+
+    if (!size || size > kKernelBatchMaxOperationSize || count >= kKernelBatchMaxOperations)
+        return false;
+
+    // both buffers have to stay within what the kext accepts
+    if (sizeof(KernelBatchHeader) + (count + 1) * sizeof(KernelBatchOperation) + data_size +
+                (bytes ? padded : 0) >
+            kKernelBatchMaxBufferSize ||
+        sizeof(KernelBatchHeader) + GetStatusSize(count + 1) + read_size +
+                (bytes ? 0 : padded) >
+            kKernelBatchMaxBufferSize)
+        return false;
+
+    if (!GrowBuffer(&operations, &operation_capacity, count + 1))
+        return false;
+
+    operation_capacity = capacity;
+
+    if (!GrowBuffer(&destinations, &operation_capacity, count + 1))
+        return false;
+
+    capacity = (UInt32)operation_capacity;
+
+    if (bytes) {
+        if (!GrowBuffer(&data, &data_capacity, data_size + padded))
+            return false;
+
+        memcpy(data + data_size, bytes, size);
+        memset(data + data_size + size, 0, padded - size);
+
+        data_size += padded;
+    } else {
+        read_size += padded;
+    }
+
+    operations[count].address = address;
+    operations[count].type = type;
+    operations[count].size = (UInt32)size;
+
+    destinations[count] = destination;
+
+    count++;
+
+    request_size = 0;
+    response_size = 0;
+
+    decoded = false;
+
+    return true;
+}
+
+bool KernelBatch::AddRead(xnu::mach::VmAddress address, void* data, Size size) {
+    return data && Add(kKernelBatchRead, address, data, nullptr, size);
+}
+
+bool KernelBatch::AddWrite(xnu::mach::VmAddress address, const void* data, Size size) {
+    return data && Add(kKernelBatchWrite, address, nullptr, data, size);
+}
+
+bool KernelBatch::AddPhysicalRead(UInt64 paddr, void* data, Size size) {
+    return data && Add(kKernelBatchPhysicalRead, paddr, data, nullptr, size);
+}
+
+bool KernelBatch::AddPhysicalWrite(UInt64 paddr, const void* data, Size size) {
+    return data && Add(kKernelBatchPhysicalWrite, paddr, nullptr, data, size);
+}
+
+bool KernelBatch::Build() {
+    KernelBatchHeader* header;
+
+    Size operations_size = count * sizeof(KernelBatchOperation);
+
+    Size needed_request = sizeof(KernelBatchHeader) + operations_size + data_size;
+    Size needed_response = sizeof(KernelBatchHeader) + GetStatusSize(count) + read_size;
+
+    if (!count)
+        return false;
+
+    if (!GrowBuffer(&request, &request_capacity, needed_request) ||
+        !GrowBuffer(&response, &response_capacity, needed_response))
+        return false;
+
+    header = reinterpret_cast<KernelBatchHeader*>(request);
+
+    header->magic = kKernelBatchMagic;
+    header->version = kKernelBatchVersion;
+    header->operation_count = count;
+    header->failed_count = 0;
+    header->size = needed_request;
+
+    memcpy(request + sizeof(KernelBatchHeader), operations, operations_size);
+
+    if (data_size)
+        memcpy(request + sizeof(KernelBatchHeader) + operations_size, data, data_size);
+
+    request_size = needed_request;
+    response_size = needed_response;
+
+    failed_count = 0;
+
+    decoded = false;
+
+    return true;
+}
+
+bool KernelBatch::Decode() {
+    KernelBatchHeader* header = reinterpret_cast<KernelBatchHeader*>(response);
+
+    UInt8* status;
+
+    Size read_offset;
+
+    if (!response_size || header->magic != kKernelBatchMagic ||
+        header->operation_count != count || header->size != response_size)
+        return false;
+
+    status = response + sizeof(KernelBatchHeader);
+
+    read_offset = sizeof(KernelBatchHeader) + GetStatusSize(count);
+
+    failed_count = 0;
+
+    for (UInt32 i = 0; i < count; i++) {
+        if (!status[i])
+            failed_count++;
+
+        if (!IsRead(operations[i].type))
+            continue;
+
+        if (status[i])
+            memcpy(destinations[i], response + read_offset, operations[i].size);
+
+        read_offset += Align8(operations[i].size);
+    }
+
+    decoded = true;
+
+    return failed_count == 0;
+}
+
+bool KernelBatch::Succeeded(UInt32 index) {
+    if (!decoded || index >= count)
+        return false;
+
+    return response[sizeof(KernelBatchHeader) + index] != 0;
+}
+
+} // namespace darwin
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+namespace darwin {
+
+static constexpr UInt32 kKernelBatchMagic = 0x444B5257;
+
+static constexpr UInt32 kKernelBatchVersion = 1;
+
+static constexpr UInt32 kKernelBatchMaxOperations = 4096;
+
+static constexpr UInt32 kKernelBatchMaxOperationSize = 0x10000;
+
+// bound on either buffer, checked before the kernel maps anything
+static constexpr Size kKernelBatchMaxBufferSize = 0x400000;
+
+enum KernelBatchOperationType {
+    kKernelBatchRead = 1,
+    kKernelBatchWrite,
+    kKernelBatchPhysicalRead,
+    kKernelBatchPhysicalWrite,
+};
+
+/**
+ *  A request is a KernelBatchHeader, operation_count KernelBatchOperations and the bytes of
+ *  every write, each padded to 8 bytes, in the order of the operations.
+ *
+ *  The response is a KernelBatchHeader, one status byte per operation padded to 8 bytes and
+ *  the bytes of every read, again padded to 8 bytes and in order. Reads that fail keep their
+ *  place in the response, so the layout only depends on the request.
+ */
+struct KernelBatchHeader {
+    UInt32 magic;
+    UInt32 version;
+
+    UInt32 operation_count;
+
+    // operations that failed, only set in responses
+    UInt32 failed_count;
+
+    // of the whole request or response
+    UInt64 size;
+};
+
+struct KernelBatchOperation {
+    UInt64 address;
+
+    UInt32 type;
+    UInt32 size;
+};
+
+static_assert(sizeof(KernelBatchHeader) == 24);
+static_assert(sizeof(KernelBatchOperation) == 16);
+
+/**
+ *  Where ExecuteKernelBatch() sends the operations, the kernel itself in the kext and a stand-in
+ *  in tests and benchmarks.
+ */
+class KernelBatchBackend {
+public:
+    virtual bool Read(xnu::mach::VmAddress address, void* data, Size size) = 0;
+
+    virtual bool Write(xnu::mach::VmAddress address, void* data, Size size) = 0;
+
+    virtual bool PhysicalRead(UInt64 paddr, void* data, Size size) = 0;
+
+    virtual bool PhysicalWrite(UInt64 paddr, void* data, Size size) = 0;
+};
+
+/**
+ *  Returns the size of the response to a request, or 0 if the request is malformed.
+ */
+Size GetKernelBatchResponseSize(const UInt8* request, Size request_size);
+
+/**
+ *  Validates the whole request first and only then runs its operations in order. Returns false
+ *  without running anything when the request is malformed or the response buffer is too
+ *  small. Operations that fail are recorded in the response and do not stop the batch.
+ */
+bool ExecuteKernelBatch(darwin::KernelBatchBackend* backend, const UInt8* request,
+                        Size request_size, UInt8* response, Size response_size);
+
+/**
+ *  Collects kernel and physical memory accesses into one request for the batch selector, so that
+ *  walking a kernel data structure costs one call into the kext instead of one per pointer.
+ *
+ *  Reads land in the buffers passed to AddRead() and AddPhysicalRead() once Decode() has run on
+ *  the response. The bytes of a write are copied when it is added. The encoder does not use the
+ *  STL, so the format can be produced and parsed on either side of the user client.
+ */
+class KernelBatch {
+public:
+    explicit KernelBatch();
+
+    ~KernelBatch();
+
+    UInt32 GetOperationCount() {
+        return count;
+    }
+
+    bool AddRead(xnu::mach::VmAddress address, void* data, Size size);
+
+    bool AddWrite(xnu::mach::VmAddress address, const void* data, Size size);
+
+    bool AddPhysicalRead(UInt64 paddr, void* data, Size size);
+
+    bool AddPhysicalWrite(UInt64 paddr, const void* data, Size size);
+
+    // lays out the request and sizes the response buffer, both valid until the batch changes
+    bool Build();
+
+    UInt8* GetRequest() {
+        return request;
+    }
+
+    Size GetRequestSize() {
+        return request_size;
+    }
+
+    UInt8* GetResponse() {
+        return response;
+    }
+
+    Size GetResponseSize() {
+        return response_size;
+    }
+
+    // copies the reads out of the response, true when every operation succeeded
+    bool Decode();
+
+    bool Succeeded(UInt32 index);
+
+    UInt32 GetFailedCount() {
+        return failed_count;
+    }
+
+    void Reset();
+
+private:
+    KernelBatchOperation* operations;
+
+    // where the bytes of each read go, nullptr for writes
+    void** destinations;
+
+    UInt32 count;
+    UInt32 capacity;
+
+    // bytes of the writes, laid out as they are in the request
+    UInt8* data;
+    Size data_size;
+    Size data_capacity;
+
+    Size read_size;
+
+    UInt8* request;
+    Size request_size;
+    Size request_capacity;
+
+    UInt8* response;
+    Size response_size;
+    Size response_capacity;
+
+    UInt32 failed_count;
+
+    bool decoded;
+
+    bool Add(UInt32 type, UInt64 address, void* destination, const void* bytes, Size size);
+};
+
+} // namespace darwin
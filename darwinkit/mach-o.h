@@ -4,10 +4,20 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef __APPLE__
+
 #include <architecture/byte_order.h>
 
 #include <sys/_types/_uuid_t.h>
 
+#else
+
+typedef unsigned char uuid_t[16];
+
+enum NXByteOrder { NX_UnknownByteOrder, NX_LittleEndian, NX_BigEndian };
+
+#endif
+
 #ifdef __USER__
 
 typedef uint32_t mach_port_t;
@@ -30,12 +40,14 @@ typedef uint32_t mach_port_t;
 #define LC_SEGMENT_64 0x00000019
 #define LC_UUID 0x0000001b
 #define LC_CODE_SIGNATURE 0x0000001d
+#define LC_SEGMENT_SPLIT_INFO 0x0000001e
 #define LC_ENCRYPTION_INFO 0x00000021
 #define LC_DYLD_INFO 0x00000022
 #define LC_DYLD_INFO_ONLY (0x00000022 | LC_REQ_DYLD)
 #define LC_FUNCTION_STARTS 0x00000026
 #define LC_MAIN (0x28 | LC_REQ_DYLD)
 #define LC_DATA_IN_CODE 0x00000029
+#define LC_DYLD_EXPORTS_TRIE (0x00000033 | LC_REQ_DYLD)
 #define LC_DYLD_CHAINED_FIXUPS (0x00000034 | LC_REQ_DYLD)
 #define LC_FILESET_ENTRY (0x00000035 | LC_REQ_DYLD)
 
@@ -125,6 +137,7 @@ typedef uint32_t mach_port_t;
 
 #define HASH_TYPE_SHA1 0x01
 #define HASH_TYPE_SHA256 0x02
+#define HASH_TYPE_SHA256_TRUNCATED 0x03
 
 struct fat_header {
     uint32_t magic;
@@ -225,6 +238,9 @@ struct dysymtab_command {
     uint32_t nlocrel;
 };
 
+#define INDIRECT_SYMBOL_LOCAL 0x80000000
+#define INDIRECT_SYMBOL_ABS 0x40000000
+
 struct relocation_info {
     int32_t r_address;
     uint32_t r_symbolnum : 24, r_pcrel : 1, r_length : 2, r_extern : 1, r_type : 4;
@@ -347,10 +363,25 @@ typedef union {
 } pacptr_t;
 
 enum dyld_fixup_t {
-    DYLD_CHAINED_PTR_NONE = 0,            // pacptr.raw
-    DYLD_CHAINED_PTR_ARM64E = 1,          // pacptr.pac
-    DYLD_CHAINED_PTR_ARM64E_KERNEL = 7,   // pacptr.cache, virt offset from kernel base
-    DYLD_CHAINED_PTR_64_KERNEL_CACHE = 8, // pacptr.cache, file offset
+    DYLD_CHAINED_PTR_NONE = 0,                 // pacptr.raw
+    DYLD_CHAINED_PTR_ARM64E = 1,               // pacptr.pac
+    DYLD_CHAINED_PTR_64 = 2,                   // target is vmaddr
+    DYLD_CHAINED_PTR_64_OFFSET = 6,            // target is vm offset
+    DYLD_CHAINED_PTR_ARM64E_KERNEL = 7,        // pacptr.cache, virt offset from kernel base
+    DYLD_CHAINED_PTR_64_KERNEL_CACHE = 8,      // pacptr.cache, file offset
+    DYLD_CHAINED_PTR_ARM64E_USERLAND = 9,      // pacptr.pac, target is vm offset
+    DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE = 11, // pacptr.cache, 1 byte stride
+    DYLD_CHAINED_PTR_ARM64E_USERLAND24 = 12,   // pacptr.pac, 24-bit bind ordinals
+};
+
+#define DYLD_CHAINED_PTR_START_NONE 0xFFFF
+#define DYLD_CHAINED_PTR_START_MULTI 0x8000
+#define DYLD_CHAINED_PTR_START_LAST 0x8000
+
+enum dyld_chained_import_format_t {
+    DYLD_CHAINED_IMPORT = 1,
+    DYLD_CHAINED_IMPORT_ADDEND = 2,
+    DYLD_CHAINED_IMPORT_ADDEND64 = 3,
 };
 
 struct dyld_chained_fixups_header {
@@ -382,6 +413,16 @@ struct dyld_chained_import {
     uint32_t lib_ordinal : 8, weak_import : 1, name_offset : 23;
 };
 
+struct dyld_chained_import_addend {
+    uint32_t lib_ordinal : 8, weak_import : 1, name_offset : 23;
+    int32_t addend;
+};
+
+struct dyld_chained_import_addend64 {
+    uint64_t lib_ordinal : 16, weak_import : 1, reserved : 15, name_offset : 32;
+    uint64_t addend;
+};
+
 enum dyld_image_mode { dyld_image_adding = 0, dyld_image_removing = 1 };
 
 struct dyld_image_info {
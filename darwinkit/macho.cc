@@ -51,7 +51,7 @@ Size MachO::GetSize() {
             UInt64 filesize = segment_command->filesize;
 
             if (vmsize > 0) {
-                file_size = max(file_size, fileoff + filesize);
+                file_size = file_size > fileoff + filesize ? file_size : fileoff + filesize;
             }
         }
 
@@ -32,13 +32,6 @@ extern "C" {
 
 #include "log.h"
 
-#ifdef __USER__
-
-#define max(x, y) (x > y ? x : y)
-#define min(x, y) (x > y ? y : x)
-
-#endif
-
 class MachO : public binary::BinaryFormat {
 public:
     explicit MachO(char *buffer, xnu::macho::Header64 *header,
@@ -27,88 +27,53 @@ void Patcher::OnKextLoad(void* kext, kmod_info_t* kmod) {
 }
 
 void Patcher::RouteFunction(Hook* hook) {
+    RegisterHook(hook);
+}
+
+void Patcher::RegisterHook(Hook* hook) {
+    // the registry only holds one hook per address, another one there may be this hook's twin
+    if (std::find(hooks.begin(), hooks.end(), hook) != hooks.end())
+        return;
+
+    if (!hook->GetTraceId())
+        hook->SetTraceId(++next_trace_id);
+
     hooks.push_back(hook);
+
+    // a different hook already placed at the same address keeps its entry
+    registry.Insert(hook->GetFrom(), hook->GetHookType(), hook);
 }
 
 bool Patcher::IsFunctionHooked(xnu::mach::VmAddress address) {
-    for (int i = 0; i < GetHooks().size(); i++) {
-        Hook* hook = GetHooks().at(i);
-
-        if (hook->GetHookType() == kHookTypeInstrumentFunction ||
-            hook->GetHookType() == kHookTypeReplaceFunction) {
-            if (hook->GetFrom() == address) {
-                return true;
-            }
-        }
-    }
-
-    return false;
+    return HookForFunction(address) != nullptr;
 }
 
 bool Patcher::IsBreakpointAtInstruction(xnu::mach::VmAddress address) {
-    for (int i = 0; i < GetHooks().size(); i++) {
-        Hook* hook = GetHooks().at(i);
-
-        if (hook->GetHookType() == kHookTypeBreakpoint) {
-            if (hook->GetFrom() == address) {
-                return true;
-            }
-        }
-    }
-
-    return false;
+    return BreakpointForAddress(address) != nullptr;
 }
 
 Hook* Patcher::HookForFunction(xnu::mach::VmAddress address) {
-    Hook* hook = nullptr;
-
-    if (!IsFunctionHooked(address))
-        return nullptr;
+    Hook* hook = registry.Find(address, kHookTypeInstrumentFunction);
 
-    for (int i = 0; i < GetHooks().size(); i++) {
-        Hook* h = GetHooks().at(i);
-
-        if (h->GetHookType() == kHookTypeInstrumentFunction ||
-            h->GetHookType() == kHookTypeReplaceFunction) {
-            if (hook->GetFrom() == address) {
-                hook = h;
-            }
-        }
-    }
-
-    return hook;
+    return hook ? hook : registry.Find(address, kHookTypeReplaceFunction);
 }
 
 Hook* Patcher::BreakpointForAddress(xnu::mach::VmAddress address) {
-    Hook* hook = nullptr;
-
-    if (!IsBreakpointAtInstruction(address))
-        return nullptr;
-
-    for (int i = 0; i < GetHooks().size(); i++) {
-        Hook* h = GetHooks().at(i);
-
-        if (h->GetHookType() == kHookTypeBreakpoint) {
-            if (hook->GetFrom() == address) {
-                hook = h;
-            }
-        }
-    }
-
-    return hook;
+    return registry.Find(address, kHookTypeBreakpoint);
 }
 
 void Patcher::InstallHook(Hook* hook, xnu::mach::VmAddress hooked) {
     hook->HookFunction(hooked);
 
-    if (std::find(hooks.begin(), hooks.end(), hook) != hooks.end()) {
-        hooks.push_back(hook);
-    }
+    RegisterHook(hook);
 }
 
 void Patcher::RemoveHook(Hook* hook) {
     hook->UninstallHook();
 
+    if (registry.Find(hook->GetFrom(), hook->GetHookType()) == hook)
+        registry.Remove(hook->GetFrom(), hook->GetHookType());
+
     hooks.erase(std::remove(hooks.begin(), hooks.end(), hook), hooks.end());
 
     delete hook;
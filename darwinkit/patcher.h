@@ -18,17 +18,19 @@
 
 #include <types.h>
 
-#include <mach/kmod.h>
-
+#include "hook_registry.h"
 #include "pair.h"
+#include "trampoline_allocator.h"
 #include "vector.h"
 
 namespace darwin {
 class Hook;
+class HookBatch;
+class HookTrace;
 
 class Patcher {
 public:
-    explicit Patcher() {}
+    explicit Patcher() : active_batch(nullptr), trace(nullptr), next_trace_id(0) {}
 
     ~Patcher() = default;
 
@@ -43,6 +45,32 @@ public:
         return hooks;
     }
 
+    darwin::HookRegistry& GetHookRegistry() {
+        return registry;
+    }
+
+    darwin::TrampolineAllocator& GetTrampolineAllocator() {
+        return trampolines;
+    }
+
+    // the batch staging writes for the hook being planned, see HookBatch
+    darwin::HookBatch* GetActiveBatch() {
+        return active_batch;
+    }
+
+    void SetActiveBatch(darwin::HookBatch* batch) {
+        active_batch = batch;
+    }
+
+    // where Hook::Trace() records hook hits, tracing is off while this is nullptr
+    darwin::HookTrace* GetHookTrace() {
+        return trace;
+    }
+
+    void SetHookTrace(darwin::HookTrace* hook_trace) {
+        trace = hook_trace;
+    }
+
     darwin::Hook* HookForFunction(xnu::mach::VmAddress address);
 
     darwin::Hook* BreakpointForAddress(xnu::mach::VmAddress address);
@@ -51,12 +79,33 @@ public:
 
     bool IsBreakpointAtInstruction(xnu::mach::VmAddress address);
 
+    bool IsRangeHooked(xnu::mach::VmAddress start, xnu::mach::VmAddress end) {
+        return registry.IsRangeHooked(start, end);
+    }
+
     void InstallHook(darwin::Hook* hook, xnu::mach::VmAddress hooked);
 
     void RemoveHook(darwin::Hook* hook);
 
 private:
+    friend class darwin::HookBatch;
+
     std::vector<darwin::Hook*> hooks;
+
+    // indexes the hooks above by address and type, see HookRegistry
+    darwin::HookRegistry registry;
+
+    // trampolines of all hooks installed through this patcher
+    darwin::TrampolineAllocator trampolines;
+
+    darwin::HookBatch* active_batch;
+
+    darwin::HookTrace* trace;
+
+    // hooks get their trace id when they are registered, 0 is never handed out
+    UInt32 next_trace_id;
+
+    void RegisterHook(darwin::Hook* hook);
 };
 
 } // namespace darwin
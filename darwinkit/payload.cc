@@ -16,12 +16,26 @@
 
 #include "payload.h"
 
+#include <string.h>
+
 #include "hook.h"
+#include "hook_batch.h"
+#include "patcher.h"
+#include "task.h"
 
 using namespace xnu;
 
 namespace darwin {
 
+Payload::~Payload() {
+    // the slot goes back to the pool for the next hook
+    if (allocator && address)
+        allocator->Free(task, address, size);
+
+    if (buffer)
+        delete[] buffer;
+}
+
 bool Payload::ReadBytes(UInt8* bytes, Size sz) {
     bool success;
 
@@ -30,14 +44,49 @@ bool Payload::ReadBytes(UInt8* bytes, Size sz) {
     return success;
 }
 
+void Payload::SetCurrentOffset(Offset offset) {
+    current_offset = offset;
+
+    // staged bytes past the offset belong to a trampoline that was given up on
+    if (dirty_end > offset)
+        dirty_end = offset > dirty_start ? offset : dirty_start;
+
+    if (dirty_start == dirty_end) {
+        dirty_start = 0;
+        dirty_end = 0;
+    }
+}
+
+HookBatch* Payload::GetBatch() {
+    return hook && hook->GetPatcher() ? hook->GetPatcher()->GetActiveBatch() : nullptr;
+}
+
 bool Payload::ReadBytes(Offset offset, UInt8* bytes, Size sz) {
     bool success;
 
+    HookBatch* batch = GetBatch();
+
     xnu::mach::VmAddress addr = address + offset;
 
-    success = GetTask()->Read(addr, (void*)bytes, sz);
+    Offset start;
+    Offset end;
 
-    return success;
+    if (batch)
+        success = batch->Read(GetTask(), addr, (void*)bytes, sz);
+    else
+        success = GetTask()->Read(addr, (void*)bytes, sz);
+
+    if (!success)
+        return false;
+
+    // bytes that are still only staged locally
+    start = offset > dirty_start ? offset : dirty_start;
+    end = offset + (Offset)sz < dirty_end ? offset + (Offset)sz : dirty_end;
+
+    if (start < end)
+        memcpy(bytes + (start - offset), buffer + start, end - start);
+
+    return true;
 }
 
 bool Payload::WriteBytes(UInt8* bytes, Size sz) {
@@ -53,66 +102,110 @@ bool Payload::WriteBytes(UInt8* bytes, Size sz) {
 }
 
 bool Payload::WriteBytes(Offset offset, UInt8* bytes, Size sz) {
-    bool success;
+    Offset end = offset + (Offset)sz;
 
-    xnu::mach::VmAddress addr = address + offset;
+    // the neighbouring slots belong to other hooks
+    if (!buffer || offset < 0 || offset + sz > size)
+        return false;
 
-    success = GetTask()->Write(addr, (void*)bytes, sz);
+    if (!sz)
+        return true;
+
+    // writes that leave a hole after the staged bytes pull the hole in from the task, so that
+    // Flush() can always write one contiguous run
+    if (dirty_start == dirty_end) {
+        dirty_start = offset;
+        dirty_end = offset;
+    } else if (offset > dirty_end) {
+        if (!ReadBytes(dirty_end, buffer + dirty_end, offset - dirty_end))
+            return false;
+    } else if (end < dirty_start) {
+        if (!ReadBytes(end, buffer + end, dirty_start - end))
+            return false;
+    }
 
-#ifdef __KERNEL__
+    memcpy(buffer + offset, bytes, sz);
 
-    if (addr >= (xnu::mach::VmAddress)Kernel::GetExecutableMemory() &&
-        addr < (xnu::mach::VmAddress)Kernel::GetExecutableMemory() +
-                      Kernel::GetExecutableMemorySize()) {
-        Kernel::SetExecutableMemoryOffset(Kernel::GetExecutableMemoryOffset() + sz);
-    }
+    dirty_start = offset < dirty_start ? offset : dirty_start;
+    dirty_end = end > dirty_end ? end : dirty_end;
 
-#endif
+    write_count++;
 
-    return success;
+    return true;
 }
 
-bool Payload::Prepare() {
+bool Payload::Flush() {
     bool success;
 
+    HookBatch* batch = GetBatch();
+
+    xnu::mach::VmAddress addr = address + dirty_start;
+
+    Size sz = dirty_end - dirty_start;
+
+    if (!sz)
+        return true;
+
+    // the batch writes the trampoline through its page's alias when it is committed
+    if (batch) {
+        success = batch->Write(GetTask(), addr, (void*)(buffer + dirty_start), sz);
+    } else {
+        xnu::mach::VmAddress writable = allocator->GetWritableAddress(GetTask(), addr, sz);
+
+        success = writable && GetTask()->Write(writable, (void*)(buffer + dirty_start), sz);
+
+#ifdef __USER__
+        // the task only dropped its cached copy of the alias
+        if (success)
+            GetTask()->InvalidateCaches(addr, sz);
+#endif
+    }
+
+    if (!success)
+        return false;
+
+    dirty_start = 0;
+    dirty_end = 0;
+
+    remote_write_count++;
+
+    return true;
+}
+
+bool Payload::Prepare(Size sz) {
     xnu::mach::VmAddress tramp;
 
-    Task* task = GetTask();
+    if (address)
+        return true;
+
+    if (!hook || !hook->GetPatcher())
+        return false;
 
-#if defined(__x86_64__) || (defined(__arm64__) && defined(__USER__))
+    allocator = &hook->GetPatcher()->GetTrampolineAllocator();
 
-    tramp =
-        task->VmAllocate(Payload::expectedSize, VM_FLAGS_ANYWHERE, VM_PROT_READ | VM_PROT_EXECUTE);
+    tramp = allocator->Allocate(GetTask(), sz);
 
     if (!tramp) {
         return false;
     }
 
-/*#elif defined(__arm64__) && defined(__KERNEL__)*/
-#else
+    buffer = new UInt8[sz];
 
-    tramp = Kernel::GetExecutableMemory() + Kernel::GetExecutableMemoryOffset();
+    if (!buffer) {
+        allocator->Free(GetTask(), tramp, sz);
 
-#endif
+        return false;
+    }
 
     address = tramp;
+    size = sz;
 
     return true;
 }
 
-void Payload::SetWritable() {
-    task->VmProtect(address, Payload::expectedSize, VM_PROT_READ | VM_PROT_WRITE);
-}
-
-void Payload::SetExecutable() {
-    task->VmProtect(address, Payload::expectedSize, VM_PROT_READ | VM_PROT_EXECUTE);
-}
-
 bool Payload::Commit() {
-#if defined(__x86_64__) || (defined(__arm64__) && defined(__USER__))
-    SetExecutable();
-#endif
-    return true;
+    // the page is executable all along, nothing is left to do once the bytes are out
+    return allocator && Flush();
 }
 
-}
\ No newline at end of file
+}
@@ -21,12 +21,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#include <mach/mach_types.h>
-#include <mach/vm_types.h>
-
 #include "hook.h"
 
 #include "arch.h"
+#include "trampoline_allocator.h"
 
 namespace xnu {
 class Kernel;
@@ -36,15 +34,16 @@ class Task;
 using namespace xnu;
 
 namespace darwin {
-class Payload {
-    static constexpr UInt32 expectedSize = arch::GetPageSize<arch::GetCurrentArchitecture()>();
+class HookBatch;
 
+class Payload {
 public:
     explicit Payload(Task* task, Hook* hook, xnu::mach::VmProtection protection)
-             : task(task), hook(hook),
-               prot(protection), current_offset(0) {}
+             : task(task), hook(hook), allocator(nullptr), address(0), size(0),
+               prot(protection), current_offset(0), buffer(nullptr), dirty_start(0),
+               dirty_end(0), write_count(0), remote_write_count(0) {}
 
-    ~Payload() = default;
+    ~Payload();
 
     Hook* GetHook() {
         return hook;
@@ -78,14 +77,29 @@ public:
     bool WriteBytes(UInt8* bytes, Size size);
     bool WriteBytes(Offset offset, UInt8* bytes, Size size);
 
-    void SetWritable();
-    void SetExecutable();
+    // reserves size bytes in a page shared with the trampolines of other hooks
+    bool Prepare(Size size = kFunctionTrampolineSize);
 
-    bool Prepare();
+    bool Flush();
 
     bool Commit();
 
+    UInt32 GetWriteCount() {
+        return write_count;
+    }
+
+    UInt32 GetRemoteWriteCount() {
+        return remote_write_count;
+    }
+
+    // Task::Write() calls that staging the trampoline locally avoided
+    UInt32 GetSavedWriteCount() {
+        return write_count > remote_write_count ? write_count - remote_write_count : 0;
+    }
+
 private:
+    darwin::HookBatch* GetBatch();
+
     xnu::Task* task;
 
     xnu::mach::VmAddress address;
@@ -94,10 +108,21 @@ private:
 
     Hook* hook;
 
+    darwin::TrampolineAllocator* allocator;
+
     bool kernelPayload = false;
 
     Size size;
 
     xnu::mach::VmProtection prot;
+
+    // local copy of the slot, bytes in [dirty_start, dirty_end) have not reached the task yet
+    UInt8* buffer;
+
+    Offset dirty_start;
+    Offset dirty_end;
+
+    UInt32 write_count;
+    UInt32 remote_write_count;
 };
 }; // namespace darwin
@@ -21,7 +21,6 @@
 extern "C" {
 #include <mach-o.h>
 
-#include <mach/mach_types.h>
 #include <sys/types.h>
 
 #include <string.h>
@@ -35,7 +34,7 @@ public:
         : section(section), address(section->addr), offset(section->offset), size(section->size) {
         name = new char[strlen(section->sectname) + 1];
 
-        strlcpy(name, section->sectname, strlen(section->sectname) + 1);
+        memcpy(name, section->sectname, strlen(section->sectname) + 1);
     }
 
     ~Section() {
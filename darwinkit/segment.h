@@ -21,7 +21,6 @@
 extern "C" {
 #include <mach-o.h>
 
-#include <mach/mach_types.h>
 
 #include <sys/types.h>
 }
@@ -38,7 +37,7 @@ public:
           size(segment_command->vmsize), fileoffset(segment_command->fileoff),
           filesize(segment_command->filesize) {
         name = new char[strlen(segment_command->segname) + 1];
-        strlcpy(name, segment_command->segname, strlen(segment_command->segname) + 1);
+        memcpy(name, segment_command->segname, strlen(segment_command->segname) + 1);
         PopulateSections();
     }
 
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shared_ring.h"
+
+#include <string.h>
+
+#ifdef __KERNEL__
+#include <libkern/libkern.h>
+#endif
+
+namespace darwin {
+
+static inline UInt64 AlignRecord(UInt64 size) {
+    return (size + kSharedRingRecordAlignment - 1) & ~(UInt64)(kSharedRingRecordAlignment - 1);
+}
+
+static inline UInt64 LoadAcquire(UInt64* index) {
+    return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static inline void StoreRelease(UInt64* index, UInt64 value) {
+    __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+// records start on 16 byte boundaries, an index anywhere else did not come from this code
+static inline bool IsAligned(UInt64 index) {
+    return !(index & (kSharedRingRecordAlignment - 1));
+}
+
+SharedRing::SharedRing()
+    : header(nullptr), records(nullptr), capacity(0), producer_head(0), cached_tail(0),
+      reserved_size(0), reserved_record(nullptr), reserved_payload(0), consumer_tail(0),
+      cached_head(0), peeked_size(0), broken(false) {}
+
+bool SharedRing::Setup(void* memory) {
+    header = reinterpret_cast<SharedRingHeader*>(memory);
+
+    records = reinterpret_cast<UInt8*>(memory) + sizeof(SharedRingHeader);
+
+    capacity = header->capacity;
+
+    producer_head = LoadAcquire(&header->head);
+    consumer_tail = LoadAcquire(&header->tail);
+
+    cached_head = producer_head;
+    cached_tail = consumer_tail;
+
+    reserved_size = 0;
+    reserved_record = nullptr;
+    reserved_payload = 0;
+
+    peeked_size = 0;
+
+    broken = producer_head - consumer_tail > capacity || !IsAligned(producer_head) ||
+             !IsAligned(consumer_tail);
+
+    return !broken;
+}
+
+bool SharedRing::Create(void* memory, Size size) {
+    SharedRingHeader* ring = reinterpret_cast<SharedRingHeader*>(memory);
+
+    UInt64 ring_capacity = kSharedRingMinimumCapacity;
+
+    if (!memory || size < sizeof(SharedRingHeader) + kSharedRingMinimumCapacity)
+        return false;
+
+    while (ring_capacity * 2 <= size - sizeof(SharedRingHeader) && ring_capacity < (1U << 31))
+        ring_capacity *= 2;
+
+    memset(ring, 0, sizeof(SharedRingHeader));
+
+    ring->magic = kSharedRingMagic;
+    ring->version = kSharedRingVersion;
+    ring->capacity = (UInt32)ring_capacity;
+
+    return Setup(memory);
+}
+
+bool SharedRing::Attach(void* memory, Size size) {
+    SharedRingHeader* ring = reinterpret_cast<SharedRingHeader*>(memory);
+
+    UInt32 ring_capacity;
+
+    if (!memory || size < sizeof(SharedRingHeader))
+        return false;
+
+    ring_capacity = ring->capacity;
+
+    if (ring->magic != kSharedRingMagic || ring->version != kSharedRingVersion)
+        return false;
+
+    if (ring_capacity < kSharedRingMinimumCapacity || (ring_capacity & (ring_capacity - 1)) ||
+        ring_capacity > size - sizeof(SharedRingHeader))
+        return false;
+
+    if (!Setup(memory)) {
+        header = nullptr;
+
+        return false;
+    }
+
+    return true;
+}
+
+void SharedRing::Detach() {
+    header = nullptr;
+    records = nullptr;
+
+    capacity = 0;
+}
+
+void* SharedRing::Reserve(UInt16 type, UInt64 id, Size size) {
+    SharedRingRecord* record;
+
+    UInt64 position;
+    UInt64 contiguous;
+    UInt64 total;
+    UInt64 needed;
+
+    if (!header || broken || reserved_size || size > GetMaxRecordSize())
+        return nullptr;
+
+    position = producer_head & (capacity - 1);
+    contiguous = capacity - position;
+
+    total = AlignRecord(sizeof(SharedRingRecord) + size);
+
+    // a record that would wrap goes to the start of the ring behind a padding record
+    needed = total > contiguous ? contiguous + total : total;
+
+    if (producer_head + needed - cached_tail > capacity) {
+        cached_tail = LoadAcquire(&header->tail);
+
+        // tail comes from the other side, it can never pass head or fall behind by more than
+        // the capacity
+        if (producer_head - cached_tail > capacity || !IsAligned(cached_tail)) {
+            broken = true;
+
+            return nullptr;
+        }
+
+        if (producer_head + needed - cached_tail > capacity)
+            return nullptr;
+    }
+
+    if (total > contiguous) {
+        record = reinterpret_cast<SharedRingRecord*>(records + position);
+
+        record->size = (UInt32)(contiguous - sizeof(SharedRingRecord));
+        record->type = kSharedRingPadding;
+        record->flags = 0;
+        record->id = 0;
+
+        position = 0;
+    }
+
+    record = reinterpret_cast<SharedRingRecord*>(records + position);
+
+    record->size = (UInt32)size;
+    record->type = type;
+    record->flags = 0;
+    record->id = id;
+
+    reserved_size = needed;
+
+    reserved_record = record;
+    reserved_payload = size;
+
+    return record + 1;
+}
+
+bool SharedRing::Commit(bool* doorbell) {
+    UInt64 previous_head = producer_head;
+
+    if (!reserved_size)
+        return false;
+
+    producer_head += reserved_size;
+
+    reserved_size = 0;
+
+    StoreRelease(&header->head, producer_head);
+
+    // pairs with the fence in PrepareToWait(), either the consumer sees the new head before it
+    // sleeps or this sees the tail it left behind and rings the doorbell
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    cached_tail = LoadAcquire(&header->tail);
+
+    if (doorbell)
+        *doorbell = cached_tail == previous_head;
+
+    return true;
+}
+
+bool SharedRing::Truncate(Size size) {
+    UInt64 unused;
+
+    if (!reserved_size || size > reserved_payload)
+        return false;
+
+    unused = AlignRecord(sizeof(SharedRingRecord) + reserved_payload) -
+             AlignRecord(sizeof(SharedRingRecord) + size);
+
+    reserved_record->size = (UInt32)size;
+
+    reserved_size -= unused;
+    reserved_payload = size;
+
+    return true;
+}
+
+bool SharedRing::Push(UInt16 type, UInt64 id, const void* data, Size size, bool* doorbell) {
+    void* payload = Reserve(type, id, size);
+
+    if (!payload)
+        return false;
+
+    if (size)
+        memcpy(payload, data, size);
+
+    return Commit(doorbell);
+}
+
+SharedRingRecord* SharedRing::Peek(UInt32* size) {
+    SharedRingRecord* record;
+
+    UInt64 position;
+    UInt64 available;
+    UInt64 total;
+
+    UInt32 payload;
+
+    if (!header || broken)
+        return nullptr;
+
+    while (true) {
+        if (consumer_tail == cached_head) {
+            cached_head = LoadAcquire(&header->head);
+
+            if (cached_head - consumer_tail > capacity || !IsAligned(cached_head)) {
+                broken = true;
+
+                return nullptr;
+            }
+
+            if (consumer_tail == cached_head)
+                return nullptr;
+        }
+
+        position = consumer_tail & (capacity - 1);
+        available = cached_head - consumer_tail;
+
+        if (available < sizeof(SharedRingRecord) ||
+            position + sizeof(SharedRingRecord) > capacity) {
+            broken = true;
+
+            return nullptr;
+        }
+
+        record = reinterpret_cast<SharedRingRecord*>(records + position);
+
+        // the size is read once, whatever the producer does to it afterwards
+        payload = __atomic_load_n(&record->size, __ATOMIC_RELAXED);
+
+        total = AlignRecord(sizeof(SharedRingRecord) + payload);
+
+        if (total > available || total > capacity - position) {
+            broken = true;
+
+            return nullptr;
+        }
+
+        if (record->type != kSharedRingPadding) {
+            peeked_size = total;
+
+            if (size)
+                *size = payload;
+
+            return record;
+        }
+
+        consumer_tail += total;
+
+        StoreRelease(&header->tail, consumer_tail);
+    }
+}
+
+void SharedRing::Pop() {
+    if (!peeked_size)
+        return;
+
+    consumer_tail += peeked_size;
+
+    peeked_size = 0;
+
+    StoreRelease(&header->tail, consumer_tail);
+}
+
+bool SharedRing::IsEmpty() {
+    if (!header)
+        return true;
+
+    if (consumer_tail != cached_head)
+        return false;
+
+    cached_head = LoadAcquire(&header->head);
+
+    return consumer_tail == cached_head;
+}
+
+bool SharedRing::PrepareToWait() {
+    if (!header || broken)
+        return false;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    return IsEmpty();
+}
+
+bool SharedRing::IsDrained() {
+    if (!header)
+        return true;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    return LoadAcquire(&header->tail) == producer_head;
+}
+
+bool CreateSharedRings(void* memory, Size size) {
+    SharedRingRegionHeader* region = reinterpret_cast<SharedRingRegionHeader*>(memory);
+
+    SharedRing ring;
+
+    UInt64 offset;
+    UInt64 quarter;
+
+    if (!memory || size < kSharedRingMinimumRegionSize || size > kSharedRingMaximumRegionSize)
+        return false;
+
+    // a quarter each for commands and results, the rest for events
+    quarter = ((size - kSharedRingCacheLineSize) / 4) & ~(UInt64)(kSharedRingCacheLineSize - 1);
+
+    memset(region, 0, sizeof(SharedRingRegionHeader));
+
+    region->magic = kSharedRingMagic;
+    region->version = kSharedRingVersion;
+    region->ring_count = kSharedRingCount;
+
+    region->ring_sizes[kSharedRingCommands] = quarter;
+    region->ring_sizes[kSharedRingResults] = quarter;
+    region->ring_sizes[kSharedRingEvents] = quarter * 2;
+
+    offset = kSharedRingCacheLineSize;
+
+    for (UInt32 i = 0; i < kSharedRingCount; i++) {
+        region->ring_offsets[i] = offset;
+
+        if (!ring.Create(reinterpret_cast<UInt8*>(memory) + offset, region->ring_sizes[i]))
+            return false;
+
+        offset += region->ring_sizes[i];
+    }
+
+    return true;
+}
+
+bool OpenSharedRing(void* memory, Size size, UInt32 index, SharedRing* ring) {
+    SharedRingRegionHeader* region = reinterpret_cast<SharedRingRegionHeader*>(memory);
+
+    UInt64 offset;
+    UInt64 ring_size;
+
+    if (!memory || !ring || size < kSharedRingCacheLineSize || index >= kSharedRingCount)
+        return false;
+
+    if (region->magic != kSharedRingMagic || region->version != kSharedRingVersion ||
+        region->ring_count != kSharedRingCount)
+        return false;
+
+    offset = region->ring_offsets[index];
+    ring_size = region->ring_sizes[index];
+
+    if (offset < kSharedRingCacheLineSize || offset > size || ring_size > size - offset ||
+        offset % kSharedRingCacheLineSize)
+        return false;
+
+    return ring->Attach(reinterpret_cast<UInt8*>(memory) + offset, ring_size);
+}
+
+} // namespace darwin
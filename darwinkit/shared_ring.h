@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+namespace darwin {
+
+static constexpr UInt32 kSharedRingMagic = 0x52494E47;
+
+static constexpr UInt32 kSharedRingVersion = 1;
+
+// Apple silicon has 128 byte cache lines, keep head and tail on lines of their own everywhere
+static constexpr Size kSharedRingCacheLineSize = 128;
+
+static constexpr Size kSharedRingRecordAlignment = 16;
+
+static constexpr Size kSharedRingMinimumCapacity = 0x1000;
+
+// bounds on the region the kext shares with the user tool
+static constexpr Size kSharedRingMinimumRegionSize = 0x10000;
+static constexpr Size kSharedRingMaximumRegionSize = 0x1000000;
+
+enum SharedRingRecordType {
+    // fills the end of the ring when a record does not fit before it wraps
+    kSharedRingPadding = 0,
+
+    // a KernelBatch request as a command, its response as a result
+    kSharedRingKernelBatch,
+
+    // a hook trace in the compact format of hook_trace.h, header included
+    kSharedRingHookHit,
+    kSharedRingBreakpoint,
+    kSharedRingCoverage,
+};
+
+enum SharedRingIndex {
+    // user tool to kext
+    kSharedRingCommands = 0,
+
+    // kext to user tool
+    kSharedRingResults,
+    kSharedRingEvents,
+
+    kSharedRingCount,
+};
+
+struct SharedRingRecord {
+    // of the payload that follows, without padding
+    UInt32 size;
+
+    UInt16 type;
+    UInt16 flags;
+
+    // ties a result to its command
+    UInt64 id;
+};
+
+/**
+ *  head and tail count bytes since the ring was created and only ever grow, the position in the
+ *  ring is the count modulo the capacity. Only the producer stores to head and only the consumer
+ *  stores to tail.
+ *
+ *  The padding is spelled out rather than left to alignas, so the layout is the same for the kext
+ *  and the user tool whatever packing is in effect where the header is included.
+ */
+struct SharedRingHeader {
+    UInt32 magic;
+    UInt32 version;
+
+    UInt32 capacity;
+    UInt32 reserved;
+
+    UInt8 padding0[kSharedRingCacheLineSize - 16];
+
+    UInt64 head;
+
+    UInt8 padding1[kSharedRingCacheLineSize - sizeof(UInt64)];
+
+    UInt64 tail;
+
+    UInt8 padding2[kSharedRingCacheLineSize - sizeof(UInt64)];
+};
+
+struct SharedRingRegionHeader {
+    UInt32 magic;
+    UInt32 version;
+
+    UInt32 ring_count;
+    UInt32 reserved;
+
+    UInt64 ring_offsets[kSharedRingCount];
+    UInt64 ring_sizes[kSharedRingCount];
+};
+
+static_assert(sizeof(SharedRingRecord) == kSharedRingRecordAlignment);
+static_assert(sizeof(SharedRingHeader) == 3 * kSharedRingCacheLineSize);
+static_assert(sizeof(SharedRingRegionHeader) <= kSharedRingCacheLineSize);
+
+/**
+ *  One side of a lock-free single producer, single consumer ring of variable sized records laid
+ *  out in memory shared between the kext and the user tool.
+ *
+ *  Each side attaches its own SharedRing to the same memory and keeps a private copy of the
+ *  index it does not own, so the producer only reads tail when its copy says the ring is full
+ *  and the consumer only reads head when its copy says the ring is empty. Records are published
+ *  with a release store to head and retired with a release store to tail, nothing is locked.
+ *
+ *  Commit() reports a doorbell only when the consumer had drained the ring before the record went
+ *  in. A consumer that is busy keeps finding records without being woken, so a stream of events
+ *  costs one wakeup per burst instead of one per event. A consumer calls PrepareToWait() before
+ *  it sleeps, which together with the fence in Commit() makes sure a record is either seen
+ *  there or rings the doorbell.
+ *
+ *  The other side of the ring is not trusted. Indices and record sizes read from shared memory
+ *  are checked before they are used, a ring that fails the checks is marked broken and stays
+ *  empty. The payload of a record can still change while the consumer looks at it, so the kext
+ *  copies what it acts on.
+ */
+class SharedRing {
+public:
+    explicit SharedRing();
+
+    ~SharedRing() = default;
+
+    // lays out an empty ring in memory, the capacity is the largest power of two that fits
+    bool Create(void* memory, Size size);
+
+    // attaches to a ring created by the other side
+    bool Attach(void* memory, Size size);
+
+    void Detach();
+
+    bool IsAttached() {
+        return header != nullptr;
+    }
+
+    bool IsBroken() {
+        return broken;
+    }
+
+    UInt32 GetCapacity() {
+        return capacity;
+    }
+
+    // a record never takes more than a quarter of the ring, so a full ring never stalls for long
+    Size GetMaxRecordSize() {
+        return capacity ? capacity / 4 - sizeof(SharedRingRecord) : 0;
+    }
+
+    /**
+     *  Producer side. Reserve() returns where size bytes of payload go, or nullptr if the ring
+     *  is full. Nothing is visible to the consumer until Commit().
+     */
+    void* Reserve(UInt16 type, UInt64 id, Size size);
+
+    bool Commit(bool* doorbell);
+
+    // shrinks the reserved record to size bytes of payload, for producers that reserve the most
+    // they might write
+    bool Truncate(Size size);
+
+    // drops the reserved record, nothing past head was ever visible to the consumer
+    void Cancel() {
+        reserved_size = 0;
+    }
+
+    bool Push(UInt16 type, UInt64 id, const void* data, Size size, bool* doorbell);
+
+    /**
+     *  Consumer side. Peek() returns the oldest record, its payload follows it, or nullptr if
+     *  the ring is empty. Pop() retires the record Peek() returned.
+     *
+     *  size gets the payload size Peek() checked against the ring. The producer can still
+     *  rewrite record->size afterwards, so only that copy may be used to bound the payload.
+     */
+    SharedRingRecord* Peek(UInt32* size = nullptr);
+
+    void Pop();
+
+    bool IsEmpty();
+
+    // true when it is safe to sleep until the doorbell
+    bool PrepareToWait();
+
+    // producer side, true once the consumer has retired every record, for whoever sleeps on its
+    // behalf
+    bool IsDrained();
+
+private:
+    SharedRingHeader* header;
+
+    UInt8* records;
+
+    UInt32 capacity;
+
+    // producer side, its own head and its last look at tail
+    UInt64 producer_head;
+    UInt64 cached_tail;
+
+    // ring bytes the reserved record takes, padding included
+    UInt64 reserved_size;
+
+    SharedRingRecord* reserved_record;
+
+    Size reserved_payload;
+
+    // consumer side, its own tail and its last look at head
+    UInt64 consumer_tail;
+    UInt64 cached_head;
+
+    // ring bytes taken by the record returned from Peek()
+    UInt64 peeked_size;
+
+    bool broken;
+
+    bool Setup(void* memory);
+};
+
+/**
+ *  Splits a region into the command, result and event rings. The event ring gets half of the
+ *  region, as events arrive at a far higher rate than commands.
+ */
+bool CreateSharedRings(void* memory, Size size);
+
+// attaches ring to ring index of a region set up by CreateSharedRings()
+bool OpenSharedRing(void* memory, Size size, UInt32 index, darwin::SharedRing* ring);
+
+} // namespace darwin
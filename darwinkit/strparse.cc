@@ -16,6 +16,20 @@
 
 #include "strparse.h"
 
+// Kexts can't touch vector registers and use the 64-bit SWAR blocks instead, defining
+// STRPARSE_SWAR selects them in userspace too so the tests cover that path.
+#if !defined(__KERNEL__) && !defined(STRPARSE_SWAR)
+
+#if defined(__SSE2__)
+#define STRPARSE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define STRPARSE_NEON
+#include <arm_neon.h>
+#endif
+
+#endif
+
 #ifdef __KERNEL__
 
 int isspace(int c) {
@@ -24,6 +38,115 @@ int isspace(int c) {
 
 #endif
 
+// The searches below compare a block of bytes at once and turn the result into a mask with
+// 1 << kStrLaneShift bits per byte, so the same loops work for every block type.
+#ifdef STRPARSE_SSE2
+
+#define STRPARSE_SIMD
+
+typedef __m128i strblock;
+
+static constexpr Size kStrBlockSize = 16;
+static constexpr UInt32 kStrLaneShift = 0;
+
+static inline strblock strblock_load(const char* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static inline strblock strblock_splat(char ch) {
+    return _mm_set1_epi8(ch);
+}
+
+static inline UInt64 strblock_eq(strblock a, strblock b) {
+    return (UInt64)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+}
+
+static inline UInt64 strblock_nonspace(strblock a) {
+    // '\t' through '\r' as an unsigned range check, SSE2 only compares signed bytes
+    __m128i control = _mm_cmplt_epi8(_mm_add_epi8(a, _mm_set1_epi8(128 - '\t')),
+                                     _mm_set1_epi8(-128 + 5));
+
+    __m128i space = _mm_or_si128(control, _mm_cmpeq_epi8(a, _mm_set1_epi8(' ')));
+
+    return (UInt64)_mm_movemask_epi8(space) ^ 0xFFFF;
+}
+
+#elif defined(STRPARSE_NEON)
+
+#define STRPARSE_SIMD
+
+typedef uint8x16_t strblock;
+
+static constexpr Size kStrBlockSize = 16;
+static constexpr UInt32 kStrLaneShift = 2;
+
+static inline strblock strblock_load(const char* p) {
+    return vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+}
+
+static inline strblock strblock_splat(char ch) {
+    return vdupq_n_u8((uint8_t)ch);
+}
+
+static inline UInt64 strblock_mask(uint8x16_t matches) {
+    // NEON has no movemask, narrowing keeps a nibble per byte instead
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+}
+
+static inline UInt64 strblock_eq(strblock a, strblock b) {
+    return strblock_mask(vceqq_u8(a, b));
+}
+
+static inline UInt64 strblock_nonspace(strblock a) {
+    uint8x16_t control = vcltq_u8(vsubq_u8(a, vdupq_n_u8('\t')), vdupq_n_u8(5));
+
+    return strblock_mask(vmvnq_u8(vorrq_u8(control, vceqq_u8(a, vdupq_n_u8(' ')))));
+}
+
+#else
+
+typedef UInt64 strblock;
+
+static constexpr Size kStrBlockSize = 8;
+static constexpr UInt32 kStrLaneShift = 3;
+
+static inline strblock strblock_load(const char* p) {
+    strblock block;
+
+    memcpy(&block, p, sizeof(block));
+
+    return block;
+}
+
+static inline strblock strblock_splat(char ch) {
+    return 0x0101010101010101ULL * (UInt8)ch;
+}
+
+static inline UInt64 strblock_eq(strblock a, strblock b) {
+    UInt64 x = a ^ b;
+
+    // exact, unlike the usual haszero() trick a match never flags the bytes above it
+    return ~(((x & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | x | 0x7F7F7F7F7F7F7F7FULL);
+}
+
+#endif
+
+static inline UInt32 strblock_first(UInt64 mask) {
+    return __builtin_ctzll(mask) >> kStrLaneShift;
+}
+
+static inline UInt32 strblock_last(UInt64 mask) {
+    return (63 - __builtin_clzll(mask)) >> kStrLaneShift;
+}
+
+static inline UInt64 strblock_clear(UInt64 mask, UInt32 lane) {
+    return mask & ~((((UInt64)2 << ((1 << kStrLaneShift) - 1)) - 1) << (lane << kStrLaneShift));
+}
+
+static inline bool strparse_isspace(char c) {
+    return c == ' ' || (UInt8)(c - '\t') < 5;
+}
+
 static UInt32 log2(UInt64 value) {
     UInt32 shift = 0;
 
@@ -44,18 +167,254 @@ int hex_digit(char ch) {
     return -1;
 }
 
-char* strnchar(char* str, UInt32 len, char ch) {
-    char* s = str;
-    char* end = str + len;
+// 8 ASCII characters loaded little endian, the first character in the lowest byte. Every
+// helper below expects the high bit of each byte to be clear, which swar_ascii() checks.
+static inline bool swar_ascii(UInt64 x) {
+    return !(x & 0x8080808080808080ULL);
+}
+
+// 0x80 in every byte that is >= n, n must be between 1 and 0x80
+static inline UInt64 swar_ge(UInt64 x, UInt8 n) {
+    return (x + 0x0101010101010101ULL * (0x80 - n)) & 0x8080808080808080ULL;
+}
+
+static inline bool swar_is_hex(UInt64 x) {
+    UInt64 lower = x | 0x2020202020202020ULL;
+
+    UInt64 digit = swar_ge(x, '0') & ~swar_ge(x, '9' + 1);
+    UInt64 alpha = swar_ge(lower, 'a') & ~swar_ge(lower, 'f' + 1);
+
+    return swar_ascii(x) && (digit | alpha) == 0x8080808080808080ULL;
+}
+
+static inline bool swar_is_decimal(UInt64 x) {
+    return swar_ascii(x) && (swar_ge(x, '0') & ~swar_ge(x, '9' + 1)) == 0x8080808080808080ULL;
+}
+
+// 8 valid hex characters to the 4 bytes they spell, in memory order
+static inline UInt32 swar_hex_to_bytes(UInt64 x) {
+    // '0'-'9' keep their low nibble, 'A'-'F' and 'a'-'f' have 0x40 set and need 9 more
+    UInt64 nibbles = (x & 0x0F0F0F0F0F0F0F0FULL) + ((x & 0x4040404040404040ULL) >> 6) * 9;
+
+    UInt64 bytes = ((nibbles << 4) | (nibbles >> 8)) & 0x00FF00FF00FF00FFULL;
+
+    bytes = (bytes | (bytes >> 8)) & 0x0000FFFF0000FFFFULL;
+
+    return (UInt32)(bytes | (bytes >> 16));
+}
+
+// 8 valid decimal digits to their value
+static inline UInt32 swar_decimal_value(UInt64 x) {
+    x -= 0x3030303030303030ULL;
+    x = (x * 10) + (x >> 8);
+
+    return (UInt32)(((x & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)) +
+                     ((x >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >>
+                    32);
+}
+
+static inline UInt64 swar_load(const char* p) {
+    UInt64 x;
+
+    memcpy(&x, p, sizeof(x));
+
+    return x;
+}
+
+#ifdef STRPARSE_SSE2
+
+// 16 hex characters to their digit values, false if any of them is not hex
+static inline bool hex_digits_sse2(const char* p, __m128i* digits) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+
+    // bytes >= 0x80 are negative and fail both ranges
+    __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                     _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                     _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+    if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xFFFF)
+        return false;
+
+    *digits = _mm_or_si128(_mm_and_si128(is_digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+                           _mm_andnot_si128(is_digit,
+                                            _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+
+    return true;
+}
+
+// even digits are the high nibbles, the low byte of each 16-bit lane
+static inline __m128i hex_pack_sse2(__m128i digits) {
+    return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(digits, _mm_set1_epi16(0xFF)), 4),
+                        _mm_srli_epi16(digits, 8));
+}
+
+#endif
+
+Size hextobytes(char* str, Size len, UInt8* data, Size size) {
+    Size pairs = len / 2 < size ? len / 2 : size;
+
+    Size i = 0;
+
+#ifdef STRPARSE_SSE2
+    for (; i + 16 <= pairs; i += 16) {
+        __m128i low;
+        __m128i high;
+
+        if (!hex_digits_sse2(str + i * 2, &low) || !hex_digits_sse2(str + i * 2 + 16, &high))
+            break;
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i),
+                         _mm_packus_epi16(hex_pack_sse2(low), hex_pack_sse2(high)));
+    }
+#elif defined(STRPARSE_NEON)
+    for (; i + 16 <= pairs; i += 16) {
+        uint8x16_t digits[2];
+
+        bool valid = true;
+
+        for (int half = 0; half < 2; half++) {
+            uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(str + i * 2 + half * 16));
+
+            uint8x16_t digit = vsubq_u8(v, vdupq_n_u8('0'));
+            uint8x16_t alpha = vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+
+            uint8x16_t is_digit = vcltq_u8(digit, vdupq_n_u8(10));
+            uint8x16_t is_alpha = vcltq_u8(alpha, vdupq_n_u8(6));
+
+            valid &= vminvq_u8(vorrq_u8(is_digit, is_alpha)) == 0xFF;
+
+            digits[half] = vbslq_u8(is_digit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+        }
+
+        if (!valid)
+            break;
+
+        vst1q_u8(data + i, vorrq_u8(vshlq_n_u8(vuzp1q_u8(digits[0], digits[1]), 4),
+                                    vuzp2q_u8(digits[0], digits[1])));
+    }
+#endif
+
+    for (; i + 4 <= pairs; i += 4) {
+        UInt64 x = swar_load(str + i * 2);
+
+        if (!swar_is_hex(x))
+            break;
+
+        UInt32 bytes = swar_hex_to_bytes(x);
+
+        memcpy(data + i, &bytes, sizeof(bytes));
+    }
+
+    // whatever is left, or the pairs leading up to the first bad digit
+    for (; i < pairs; i++) {
+        int high = hex_digit(str[i * 2]);
+        int low = hex_digit(str[i * 2 + 1]);
+
+        if (high < 0 || low < 0)
+            break;
+
+        data[i] = (UInt8)(high << 4 | low);
+    }
+
+    return i;
+}
+
+static char* strfind_char(char* str, Size len, char ch, bool stop_at_nul) {
+    strblock needle = strblock_splat(ch);
+    strblock nul = strblock_splat(0);
+
+    Size i = 0;
+
+    for (; i + kStrBlockSize <= len; i += kStrBlockSize) {
+        strblock block = strblock_load(str + i);
+
+        UInt64 mask = strblock_eq(block, needle);
 
-    while (s < end) {
-        if (*s == ch)
-            return s;
+        if (stop_at_nul)
+            mask |= strblock_eq(block, nul);
 
-        if (*s == 0)
+        if (mask) {
+            i += strblock_first(mask);
+
+            return str[i] == ch ? str + i : nullptr;
+        }
+    }
+
+    for (; i < len; i++) {
+        if (str[i] == ch)
+            return str + i;
+
+        if (stop_at_nul && str[i] == 0)
             return nullptr;
+    }
+
+    return nullptr;
+}
+
+char* strnchar(char* str, UInt32 len, char ch) {
+    return strfind_char(str, len, ch, true);
+}
+
+static char* strfind_horspool(char* str, Size len, char* needle, Size needle_len) {
+    UInt32 skip[256];
+
+    char last = needle[needle_len - 1];
+
+    for (UInt32 c = 0; c < 256; c++)
+        skip[c] = needle_len;
+
+    for (Size i = 0; i < needle_len - 1; i++)
+        skip[(UInt8)needle[i]] = needle_len - 1 - i;
+
+    for (Size i = 0; i + needle_len <= len; i += skip[(UInt8)str[i + needle_len - 1]]) {
+        if (str[i + needle_len - 1] == last && memcmp(str + i, needle, needle_len - 1) == 0)
+            return str + i;
+    }
+
+    return nullptr;
+}
+
+char* strfind(char* str, Size len, char* needle, Size needle_len) {
+    strblock first;
+    strblock last;
+
+    Size i = 0;
+
+    if (!needle_len)
+        return str;
+
+    if (needle_len > len)
+        return nullptr;
+
+    if (needle_len == 1)
+        return strfind_char(str, len, needle[0], false);
+
+    if (needle_len >= kStrFindHorspoolLength)
+        return strfind_horspool(str, len, needle, needle_len);
+
+    first = strblock_splat(needle[0]);
+    last = strblock_splat(needle[needle_len - 1]);
+
+    // only the positions whose first and last characters both match are compared in full
+    for (; i + needle_len - 1 + kStrBlockSize <= len; i += kStrBlockSize) {
+        UInt64 mask = strblock_eq(strblock_load(str + i), first) &
+                      strblock_eq(strblock_load(str + i + needle_len - 1), last);
 
-        s++;
+        while (mask) {
+            UInt32 lane = strblock_first(mask);
+
+            if (memcmp(str + i + lane + 1, needle + 1, needle_len - 2) == 0)
+                return str + i + lane;
+
+            mask = strblock_clear(mask, lane);
+        }
+    }
+
+    for (; i + needle_len <= len; i++) {
+        if (str[i] == needle[0] && memcmp(str + i + 1, needle + 1, needle_len - 1) == 0)
+            return str + i;
     }
 
     return nullptr;
@@ -99,6 +458,33 @@ enum strtoint_result strtoint(char* str, UInt32 len, bool sign, bool is_signed,
         goto no_chars;
 
     while (str != last && *str != 0) {
+        // whole groups of 8 digits at once, anything unusual is left to the digit loop
+        if ((base == 16 || base == 10) && last - str >= 8) {
+            UInt64 x = swar_load(str);
+
+            UInt64 new_value = 0;
+
+            bool fast = false;
+
+            // neither group can overflow 64 bits from these starting values
+            if (base == 16 && swar_is_hex(x) && !(_value >> 32)) {
+                new_value = _value << 32 | __builtin_bswap32(swar_hex_to_bytes(x));
+
+                fast = true;
+            } else if (base == 10 && swar_is_decimal(x) && _value <= 1844674407ULL) {
+                new_value = _value * 100000000ULL + swar_decimal_value(x);
+
+                fast = true;
+            }
+
+            if (fast && (!is_signed || new_value <= (UInt64)(negate ? INTMAX_MIN : INTMAX_MAX))) {
+                _value = new_value;
+                str += 8;
+
+                continue;
+            }
+        }
+
         d = hex_digit(*str);
 
         if (d < 0 || d >= base) {
@@ -107,6 +493,13 @@ enum strtoint_result strtoint(char* str, UInt32 len, bool sign, bool is_signed,
             goto fail;
         }
 
+        // new_value < _value misses most wraparounds once base > 2
+        if (_value > (UINT64_MAX - d) / base) {
+            result = STRTOINT_OVERFLOW;
+
+            goto fail;
+        }
+
         UInt64 new_value = _value * base + d;
 
         if (is_signed) {
@@ -117,10 +510,6 @@ enum strtoint_result strtoint(char* str, UInt32 len, bool sign, bool is_signed,
 
                 goto fail;
             }
-        } else if (new_value < _value) {
-            result = STRTOINT_OVERFLOW;
-
-            goto fail;
         }
 
         _value = new_value;
@@ -168,6 +557,36 @@ enum strtodata_result strtodata(char* str, UInt32 base, void* data, UInt32* size
 
     UInt32 realsize = 0;
 
+    // complete hex pairs go through hextobytes(), straight into the caller's buffer, the
+    // byte loop below handles the tail and reports errors exactly as before
+    if (bits_per_digit == 4) {
+        Size len = strlen(str);
+
+        while (len >= 2) {
+            UInt8 scratch[256];
+
+            UInt8* out = left ? p : scratch;
+
+            Size decoded = hextobytes(str, len, out, left ? left : sizeof(scratch));
+
+            if (!decoded)
+                break;
+
+            str += decoded * 2;
+            len -= decoded * 2;
+
+            realsize += decoded;
+
+            if (left) {
+                p += decoded;
+                left -= decoded;
+            }
+        }
+
+        if (realsize && *str == 0)
+            goto no_digits;
+    }
+
     do {
         UInt8 byte = 0;
 
@@ -250,40 +669,7 @@ char* strdup(char* s) {
 }
 
 char* strstr(char* string, char* substring) {
-    char *a, *b;
-
-    /* First scan quickly through the two strings looking for a
-     * single-character match.  When it's found, then compare the
-     * rest of the substring.
-     */
-
-    b = substring;
-
-    if (*b == 0) {
-        return string;
-    }
-
-    for (; *string != 0; string += 1) {
-        if (*string != *b) {
-            continue;
-        }
-
-        a = string;
-
-        while (1) {
-            if (*b == 0) {
-                return string;
-            }
-
-            if (*a++ != *b++) {
-                break;
-            }
-        }
-
-        b = substring;
-    }
-
-    return nullptr;
+    return strfind(string, strlen(string), substring, strlen(substring));
 }
 
 #endif
@@ -316,38 +702,103 @@ char* strtokmul(char* input, char* delimiter) {
     return temp;
 }
 
-char* ltrim(char* s) {
-    while (isspace(*s))
-        s++;
+bool strtokmul_span(struct strspan* input, char* delimiter, Size delimiter_len,
+                    struct strspan* token) {
+    char* end;
 
-    return s;
+    if (input->str == nullptr)
+        return false;
+
+    end = strfind(input->str, input->len, delimiter, delimiter_len);
+
+    token->str = input->str;
+
+    // an empty delimiter matches right away, treat it as no delimiter at all
+    if (end == nullptr || !delimiter_len) {
+        token->len = input->len;
+
+        input->str = nullptr;
+        input->len = 0;
+
+        return true;
+    }
+
+    token->len = end - input->str;
+
+    input->str = end + delimiter_len;
+    input->len -= token->len + delimiter_len;
+
+    return true;
 }
 
-char* rtrim(char* s) {
-    char* back = s + strlen(s);
+struct strspan trim_span(char* s, Size len) {
+    Size start = 0;
+    Size end = len;
+
+#ifdef STRPARSE_SIMD
+    for (; start + kStrBlockSize <= end; start += kStrBlockSize) {
+        UInt64 mask = strblock_nonspace(strblock_load(s + start));
+
+        if (mask) {
+            start += strblock_first(mask);
+
+            break;
+        }
+    }
+#endif
+
+    while (start < end && strparse_isspace(s[start]))
+        start++;
+
+#ifdef STRPARSE_SIMD
+    for (; end - start >= kStrBlockSize; end -= kStrBlockSize) {
+        UInt64 mask = strblock_nonspace(strblock_load(s + end - kStrBlockSize));
 
-    while (isspace(*--back))
-        ;
+        if (mask) {
+            end = end - kStrBlockSize + strblock_last(mask) + 1;
 
-    *(back + 1) = '\0';
+            break;
+        }
+    }
+#endif
+
+    while (end > start && strparse_isspace(s[end - 1]))
+        end--;
+
+    return {s + start, end - start};
+}
+
+char* ltrim(char* s) {
+    return trim_span(s, strlen(s)).str;
+}
+
+char* rtrim(char* s) {
+    struct strspan span = trim_span(s, strlen(s));
+
+    // all whitespace trims down to an empty string
+    *(span.len ? span.str + span.len : s) = '\0';
 
     return s;
 }
 
 char* trim(char* s) {
-    return rtrim(ltrim(s));
+    struct strspan span = trim_span(s, strlen(s));
+
+    span.str[span.len] = '\0';
+
+    return span.str;
 }
 
 char* deblank(char* input) {
-    int i, j;
+    Size i, j;
 
     char* output = input;
 
-    for (i = 0, j = 0; i < strlen(input); i++, j++) {
+    Size len = strlen(input);
+
+    for (i = 0, j = 0; i < len; i++) {
         if (input[i] != ' ')
-            output[j] = input[i];
-        else
-            j--;
+            output[j++] = input[i];
     }
 
     output[j] = '\0';
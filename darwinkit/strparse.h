@@ -40,8 +40,31 @@ enum strparse_result {
     STRPARSE_OVERFLOW,
 };
 
+/**
+ *  A view into a string that owns nothing and need not be nul terminated, returned by the
+ *  non-allocating variants below so callers can slice operands without strdup().
+ */
+struct strspan {
+    char* str;
+    Size len;
+};
+
+/**
+ *  Finds ch in the first len bytes of str, stopping at the terminating nul. Scans 16 bytes at
+ *  a time with SSE2 or NEON in userspace and 8 at a time with SWAR in the kernel, where the
+ *  vector registers are off limits.
+ */
 char* strnchar(char* str, UInt32 len, char ch);
 
+/**
+ *  Finds needle in the first len bytes of str, nul bytes included. Short needles are matched by
+ *  filtering blocks on their first and last characters, needles of kStrFindHorspoolLength
+ *  bytes or more fall back to Boyer-Moore-Horspool.
+ */
+char* strfind(char* str, Size len, char* needle, Size needle_len);
+
+static constexpr Size kStrFindHorspoolLength = 32;
+
 enum strtoint_result {
     STRTOINT_OK,
     STRTOINT_BADDIGIT,
@@ -62,6 +85,13 @@ enum strtodata_result {
 
 enum strtodata_result strtodata(char* str, UInt32 base, void* data, UInt32* size, char** end);
 
+/**
+ *  Decodes the hex pairs at the start of str straight into data, 32 characters at a time with
+ *  SSE2 or NEON and 8 at a time with SWAR in the kernel. Stops at the first pair that is not
+ *  valid hex, after len characters or once size bytes are written, returns the bytes written.
+ */
+Size hextobytes(char* str, Size len, UInt8* data, Size size);
+
 enum strparse_result strreplace(char* str, char find, char replace);
 
 #ifdef __KERNEL__
@@ -76,6 +106,15 @@ char* strstr(char* string, char* substring);
 
 char* strtokmul(char* input, char* delimiter);
 
+/**
+ *  Like strtokmul() but neither writes to the input nor keeps static state, input is advanced
+ *  past each token and the delimiter that ended it. Returns false once input is exhausted.
+ */
+bool strtokmul_span(struct strspan* input, char* delimiter, Size delimiter_len,
+                    struct strspan* token);
+
 char* trim(char* s);
 
+struct strspan trim_span(char* s, Size len);
+
 char* deblank(char* input);
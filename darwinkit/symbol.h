@@ -29,11 +29,18 @@ class Section;
 extern "C" {
 extern char* cxx_demangle(char* mangled);
 extern char* swift_demangle(char* mangled);
+
+/**
+ *  Demangles a Swift or C++ name through a process-wide, thread-safe cache.
+ *  The result is owned by the cache, which frees it when the process exits, and is nullptr
+ *  when the name is not mangled.
+ */
+extern char* demangle(char* mangled);
 }
 
 class Symbol {
 public:
-    explicit Symbol() {}
+    explicit Symbol() : name(nullptr), demangled_name(nullptr) {}
 
     explicit Symbol(MachO* macho, UInt32 type, char* name, xnu::mach::VmAddress address, Offset offset,
            Segment* segment, Section* section)
@@ -50,10 +57,12 @@ public:
     }
 
     bool IsCxx() {
-        return cxx_demangle(GetName()) != nullptr;
+        return (strncmp(GetName(), "__Z", 3) == 0 || strncmp(GetName(), "_Z", 2) == 0) &&
+               *GetDemangledName();
     }
     bool IsSwift() {
-        return /* swift */ cxx_demangle(GetName()) != nullptr;
+        return (strncmp(GetName(), "_$s", 3) == 0 || strncmp(GetName(), "$s", 2) == 0) &&
+               *GetDemangledName();
     }
 
     MachO* GetMachO() {
@@ -73,19 +82,14 @@ public:
     }
 
     char* GetDemangledName() {
-        char* _swift_demangle = swift_demangle(GetName());
-        char* _cxx_demangle = cxx_demangle(GetName());
-
-        if (_swift_demangle)
-            return _swift_demangle;
-        if (_cxx_demangle)
-            return _cxx_demangle;
-
-        char* empty = new char[1];
+        // demangled on first use, every symbol with the same name shares the cached string
+        if (!demangled_name) {
+            char* demangled = demangle(GetName());
 
-        *empty = '\0';
+            demangled_name = demangled ? demangled : const_cast<char*>("");
+        }
 
-        return empty;
+        return demangled_name;
     }
 
     xnu::mach::VmAddress GetAddress() {
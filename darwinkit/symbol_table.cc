@@ -21,7 +21,11 @@
 #include <cxxabi.h>
 #include <dlfcn.h>
 
-#include <memory>
+#include <atomic>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 
 #endif
 
@@ -33,41 +37,110 @@ char* cxx_demangle(char* mangled) {
 
     char* ret = abi::__cxa_demangle(mangled, 0, 0, &status);
 
-    std::shared_ptr<char> retval;
-
-    retval.reset((char*)ret, [](char* mem) {
-        if (mem)
-            free((void*)mem);
-    });
-
-    return static_cast<char*>(retval.get());
+    return status == 0 ? ret : nullptr;
 }
 
 typedef char* (*_swift_demangle)(char* mangled, UInt32 length, UInt8* output_buffer,
                                  UInt32 output_buffer_size, UInt32 flags);
 
-char* swift_demangle(char* mangled) {
+static _swift_demangle ResolveSwiftDemangle() {
     void* runtime_loader_default = dlopen(nullptr, RTLD_NOW);
 
-    if (runtime_loader_default) {
-        void* sym = dlsym(runtime_loader_default, "swift_demangle");
+    void* sym = nullptr;
+
+    // the handle stays open, the symbol is cached for the lifetime of the process
+    if (runtime_loader_default)
+        sym = dlsym(runtime_loader_default, "swift_demangle");
+
+    return reinterpret_cast<_swift_demangle>(sym);
+}
+
+char* swift_demangle(char* mangled) {
+    static _swift_demangle f = ResolveSwiftDemangle();
+
+    if (f)
+        return f(mangled, strlen(mangled), nullptr, 0, 0);
+
+    return nullptr;
+}
+
+static char* demangle_uncached(char* mangled) {
+    // Mach-O symbols carry an extra leading underscore
+    if (strncmp(mangled, "_$s", 3) == 0 || strncmp(mangled, "$s", 2) == 0 ||
+        strncmp(mangled, "_$S", 3) == 0 || strncmp(mangled, "$S", 2) == 0 ||
+        strncmp(mangled, "_T0", 3) == 0)
+        return swift_demangle(mangled);
+
+    if (strncmp(mangled, "__Z", 3) == 0)
+        return cxx_demangle(mangled + 1);
 
-        if (sym) {
-            _swift_demangle f = reinterpret_cast<_swift_demangle>(sym);
+    if (strncmp(mangled, "_Z", 2) == 0)
+        return cxx_demangle(mangled);
 
-            char* cString = f(mangled, strlen(mangled), nullptr, 0, 0);
+    return nullptr;
+}
+
+static constexpr UInt32 kDemangleCacheShards = 16;
+
+struct DemangleCacheShard {
+    std::mutex lock;
 
-            if (cString) {
-                dlclose(runtime_loader_default);
+    std::unordered_map<std::string_view, char*> names;
+};
 
-                return cString;
+// owns the cached names and frees them when the process exits
+struct DemangleCache {
+    DemangleCacheShard shards[kDemangleCacheShards];
+
+    ~DemangleCache() {
+        for (DemangleCacheShard& shard : shards) {
+            for (auto& [name, demangled] : shard.names) {
+                free(const_cast<char*>(name.data()));
+
+                if (demangled)
+                    free(demangled);
             }
         }
+    }
+};
 
-        dlclose(runtime_loader_default);
+static DemangleCache demangle_cache;
+
+char* demangle(char* mangled) {
+    std::string_view key(mangled);
+
+    DemangleCacheShard* shard =
+        &demangle_cache.shards[std::hash<std::string_view>()(key) % kDemangleCacheShards];
+
+    char* demangled;
+    char* name;
+
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+
+        auto it = shard->names.find(key);
+
+        if (it != shard->names.end())
+            return it->second;
     }
 
-    return nullptr;
+    // demangle without holding the lock, a slow name should not stall the whole shard
+    demangled = demangle_uncached(mangled);
+
+    name = strdup(mangled);
+
+    std::lock_guard<std::mutex> guard(shard->lock);
+
+    auto inserted = shard->names.emplace(std::string_view(name, key.size()), demangled);
+
+    if (!inserted.second) {
+        free(name);
+
+        if (demangled)
+            free(demangled);
+    }
+
+    return inserted.first->second;
 }
 
 #else
@@ -78,10 +151,50 @@ char* cxx_demangle(char* mangled) {
 char* swift_demangle(char* mangled) {
     return nullptr;
 }
+char* demangle(char* mangled) {
+    return nullptr;
+}
 
 #endif
 }
 
+#ifdef __USER__
+
+void SymbolTable::DemangleSymbols(UInt32 num_threads) {
+    std::atomic<Size> next_symbol(0);
+
+    std::vector<std::thread> workers;
+
+    Size count = symbolTable.size();
+
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+
+    if (!num_threads)
+        num_threads = 1;
+
+    auto worker = [&]() {
+        Size i;
+
+        while ((i = next_symbol.fetch_add(1, std::memory_order_relaxed)) < count)
+            symbolTable.at(i)->GetDemangledName();
+    };
+
+    for (UInt32 i = 1; i < num_threads && i < count; i++)
+        workers.emplace_back(worker);
+
+    worker();
+
+    for (std::thread& thread : workers)
+        thread.join();
+}
+
+#else
+
+void SymbolTable::DemangleSymbols(UInt32 num_threads) {}
+
+#endif
+
 Symbol* SymbolTable::GetSymbolByName(char* symname) {
     for (int32_t i = 0; i < symbolTable.size(); i++) {
         Symbol* symbol = symbolTable.at(i);
@@ -20,6 +20,10 @@
 
 #include <sys/types.h>
 
+#ifdef __USER__
+#include <algorithm>
+#endif
+
 #include "symbol.h"
 
 class Symbol;
@@ -67,6 +71,8 @@ public:
 
     void ReplaceSymbol(Symbol* symbol);
 
+    void DemangleSymbols(UInt32 num_threads = 0);
+
 private:
     std::vector<Symbol*> symbolTable;
 
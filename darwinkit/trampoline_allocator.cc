@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trampoline_allocator.h"
+
+#include <string.h>
+
+#ifdef __KERNEL__
+#include <kern/clock.h>
+#else
+#include <time.h>
+#endif
+
+#include "task.h"
+
+#if defined(__x86_64__) || defined(__USER__)
+#define TRAMPOLINE_PAGES_FROM_VM 1
+#else
+#include "kernel.h"
+#endif
+
+namespace darwin {
+
+static inline bool IsGranuleUsed(TrampolinePage* page, UInt32 granule) {
+    return (page->used[granule / 64] >> (granule % 64)) & 1;
+}
+
+static inline void MarkGranules(TrampolinePage* page, UInt32 first, UInt32 count, bool used) {
+    for (UInt32 granule = first; granule < first + count; granule++) {
+        if (used)
+            page->used[granule / 64] |= 1ULL << (granule % 64);
+        else
+            page->used[granule / 64] &= ~(1ULL << (granule % 64));
+    }
+}
+
+// first fit, trampolines are a handful of granules and pages at most a few hundred
+static inline Int32 FindGranules(TrampolinePage* page, UInt32 count) {
+    UInt32 run = 0;
+
+    if (page->free_granules < count)
+        return -1;
+
+    for (UInt32 granule = 0; granule < kTrampolineGranules; granule++) {
+        run = IsGranuleUsed(page, granule) ? 0 : run + 1;
+
+        if (run == count)
+            return granule + 1 - count;
+    }
+
+    return -1;
+}
+
+static UInt64 GetUptimeNanoseconds() {
+#ifdef __KERNEL__
+    UInt64 now;
+    UInt64 nanoseconds;
+
+    clock_get_uptime(&now);
+    absolutetime_to_nanoseconds(now, &nanoseconds);
+
+    return nanoseconds;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (UInt64)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+TrampolineAllocator::TrampolineAllocator()
+    : pages(nullptr), page_count(0), used_granules(0), protection_changes(0),
+      retired(nullptr), retired_tail(nullptr), retire_delay(kTrampolineRetireNanoseconds) {}
+
+TrampolineAllocator::~TrampolineAllocator() {
+    TrampolinePage* page = pages;
+
+    // retired slots keep their pages mapped below
+    while (retired) {
+        RetiredTrampoline* next = retired->next;
+
+        delete retired;
+
+        retired = next;
+    }
+
+    while (page) {
+        TrampolinePage* next = page->next;
+
+#ifdef TRAMPOLINE_PAGES_FROM_VM
+        // pages that still hold trampolines stay mapped, hooks may outlive their patcher
+        if (page->free_granules == kTrampolineGranules) {
+            page->task->VmDeallocate(page->alias, kTrampolinePageSize);
+            page->task->VmDeallocate(page->address, kTrampolinePageSize);
+        }
+#endif
+
+        delete page;
+
+        page = next;
+    }
+}
+
+TrampolinePage* TrampolineAllocator::MapPage(xnu::Task* task) {
+    TrampolinePage* page;
+
+    xnu::mach::VmAddress address;
+    xnu::mach::VmAddress alias;
+
+#ifdef TRAMPOLINE_PAGES_FROM_VM
+
+    address = task->VmAllocate(kTrampolinePageSize, VM_FLAGS_ANYWHERE,
+                               VM_PROT_READ | VM_PROT_EXECUTE);
+
+    if (!address)
+        return nullptr;
+
+    alias = reinterpret_cast<xnu::mach::VmAddress>(task->VmRemap(address, kTrampolinePageSize));
+
+    // a task that cannot alias the page would need it writable and executable at once
+    if (!alias || alias == address ||
+        !task->VmProtect(alias, kTrampolinePageSize, VM_PROT_READ | VM_PROT_WRITE)) {
+        if (alias && alias != address)
+            task->VmDeallocate(alias, kTrampolinePageSize);
+
+        task->VmDeallocate(address, kTrampolinePageSize);
+
+        return nullptr;
+    }
+
+    protection_changes++;
+
+#else
+
+    xnu::mach::VmAddress memory = xnu::Kernel::GetExecutableMemory();
+
+    address = memory + xnu::Kernel::GetExecutableMemoryOffset();
+    address = (address + kTrampolineAlignment - 1) & ~(kTrampolineAlignment - 1);
+
+    if (address + kTrampolinePageSize > memory + xnu::Kernel::GetExecutableMemorySize())
+        return nullptr;
+
+    xnu::Kernel::SetExecutableMemoryOffset(address + kTrampolinePageSize - memory);
+
+    alias = address;
+
+#endif
+
+    page = new TrampolinePage;
+
+    memset(page, 0, sizeof(TrampolinePage));
+
+    page->task = task;
+    page->address = address;
+    page->free_granules = kTrampolineGranules;
+    page->alias = alias;
+    page->next = pages;
+
+    pages = page;
+
+    page_count++;
+
+    return page;
+}
+
+TrampolinePage* TrampolineAllocator::PageForAddress(xnu::Task* task,
+                                                    xnu::mach::VmAddress address) {
+    for (TrampolinePage* page = pages; page; page = page->next) {
+        if (page->task == task && address >= page->address &&
+            address < page->address + kTrampolinePageSize)
+            return page;
+    }
+
+    return nullptr;
+}
+
+xnu::mach::VmAddress TrampolineAllocator::Allocate(xnu::Task* task, Size size) {
+    TrampolinePage* page;
+
+    UInt32 count = (size + kTrampolineAlignment - 1) / kTrampolineAlignment;
+
+    Int32 first = -1;
+
+    if (!task || !count || count > kTrampolineGranules)
+        return 0;
+
+    Reclaim();
+
+    for (page = pages; page; page = page->next) {
+        if (page->task == task && (first = FindGranules(page, count)) >= 0)
+            break;
+    }
+
+    if (!page) {
+        page = MapPage(task);
+
+        if (!page)
+            return 0;
+
+        first = 0;
+    }
+
+    MarkGranules(page, first, count, true);
+
+    page->free_granules -= count;
+
+    used_granules += count;
+
+    return page->address + first * kTrampolineAlignment;
+}
+
+void TrampolineAllocator::Free(xnu::Task* task, xnu::mach::VmAddress address, Size size) {
+    TrampolinePage* page = PageForAddress(task, address);
+
+    RetiredTrampoline* trampoline;
+
+    UInt32 count = (size + kTrampolineAlignment - 1) / kTrampolineAlignment;
+    UInt32 first;
+
+    if (!page)
+        return;
+
+    first = (address - page->address) / kTrampolineAlignment;
+
+    if (first + count > kTrampolineGranules)
+        return;
+
+    trampoline = new RetiredTrampoline;
+
+    // without a record the slot is never reused, which is still safe
+    if (!trampoline)
+        return;
+
+    trampoline->page = page;
+    trampoline->first = first;
+    trampoline->count = count;
+    trampoline->retired_at = GetUptimeNanoseconds();
+    trampoline->next = nullptr;
+
+    if (retired_tail)
+        retired_tail->next = trampoline;
+    else
+        retired = trampoline;
+
+    retired_tail = trampoline;
+}
+
+void TrampolineAllocator::Reclaim() {
+    UInt64 now;
+
+    if (!retired)
+        return;
+
+    now = GetUptimeNanoseconds();
+
+    while (retired && now - retired->retired_at >= retire_delay) {
+        RetiredTrampoline* next = retired->next;
+
+        MarkGranules(retired->page, retired->first, retired->count, false);
+
+        retired->page->free_granules += retired->count;
+
+        used_granules -= retired->count;
+
+        delete retired;
+
+        retired = next;
+    }
+
+    if (!retired)
+        retired_tail = nullptr;
+}
+
+xnu::mach::VmAddress TrampolineAllocator::GetWritableAddress(xnu::Task* task,
+                                                             xnu::mach::VmAddress address,
+                                                             Size size) {
+    TrampolinePage* page = PageForAddress(task, address);
+
+    if (!page || size > page->address + kTrampolinePageSize - address)
+        return 0;
+
+    return page->alias + (address - page->address);
+}
+
+} // namespace darwin
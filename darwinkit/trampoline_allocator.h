@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+#include "arch.h"
+
+namespace xnu {
+class Task;
+}; // namespace xnu
+
+namespace darwin {
+
+static constexpr Size kTrampolinePageSize =
+    arch::GetPageSize<arch::GetCurrentArchitecture()>();
+
+// trampolines start on a cache line and are carved out of pages in units of this size
+static constexpr Size kTrampolineAlignment = 64;
+
+static constexpr UInt32 kTrampolineGranules = kTrampolinePageSize / kTrampolineAlignment;
+
+// room for the first hook on a function and several more chained onto it
+static constexpr Size kFunctionTrampolineSize = 256;
+
+// saving and restoring every register takes most of the space on arm64
+static constexpr Size kBreakpointTrampolineSize = 512;
+
+// a thread preempted inside a trampoline has to have left it before its slot is handed out again
+static constexpr UInt64 kTrampolineRetireNanoseconds = 1000000000;
+
+struct TrampolinePage {
+    xnu::Task* task;
+
+    xnu::mach::VmAddress address;
+
+    // one bit per granule in use
+    UInt64 used[(kTrampolineGranules + 63) / 64];
+
+    UInt32 free_granules;
+
+    // read/write mapping of the same memory, trampolines are written through it
+    xnu::mach::VmAddress alias;
+
+    TrampolinePage* next;
+};
+
+struct RetiredTrampoline {
+    TrampolinePage* page;
+
+    UInt32 first;
+    UInt32 count;
+
+    UInt64 retired_at;
+
+    RetiredTrampoline* next;
+};
+
+/**
+ *  Packs the trampolines of many hooks into shared executable pages.
+ *
+ *  Before, every Hook mapped a page of its own for its Payload and flipped its protection on
+ *  every commit. The allocator hands out kTrampolineAlignment aligned slots from pages it maps
+ *  per task and keeps them mapped. Slots freed when a hook is uninstalled are retired first,
+ *  threads may still be running the old trampoline, and only reused by later hooks once the
+ *  retire delay has passed.
+ *
+ *  Pages are mapped read/execute and stay that way. Each one also gets a read/write alias of the
+ *  same memory and trampolines are only ever written through the alias, which
+ *  GetWritableAddress() hands out, so no mapping is writable and executable at once and the
+ *  trampolines of other hooks keep running while a page is written. Installing any number of
+ *  hooks costs no protection changes beyond the one per page that sets up its alias.
+ *
+ *  On arm64 kernels the pages come out of the kext's own executable region, which is written in
+ *  place, and their protection is never changed.
+ */
+class TrampolineAllocator {
+public:
+    explicit TrampolineAllocator();
+
+    ~TrampolineAllocator();
+
+    xnu::mach::VmAddress Allocate(xnu::Task* task, Size size);
+
+    void Free(xnu::Task* task, xnu::mach::VmAddress address, Size size);
+
+    // where to write size bytes of the trampoline at address, 0 if they are not in one page
+    xnu::mach::VmAddress GetWritableAddress(xnu::Task* task, xnu::mach::VmAddress address,
+                                            Size size);
+
+    bool IsTrampoline(xnu::Task* task, xnu::mach::VmAddress address) {
+        return PageForAddress(task, address) != nullptr;
+    }
+
+    UInt32 GetPageCount() {
+        return page_count;
+    }
+
+    Size GetUsedBytes() {
+        return used_granules * kTrampolineAlignment;
+    }
+
+    UInt32 GetProtectionChanges() {
+        return protection_changes;
+    }
+
+    void SetRetireDelay(UInt64 nanoseconds) {
+        retire_delay = nanoseconds;
+    }
+
+private:
+    TrampolinePage* pages;
+
+    UInt32 page_count;
+
+    UInt32 used_granules;
+
+    UInt32 protection_changes;
+
+    // oldest first
+    RetiredTrampoline* retired;
+    RetiredTrampoline* retired_tail;
+
+    UInt64 retire_delay;
+
+    TrampolinePage* MapPage(xnu::Task* task);
+
+    void Reclaim();
+
+    TrampolinePage* PageForAddress(xnu::Task* task, xnu::mach::VmAddress address);
+};
+
+} // namespace darwin
@@ -22,11 +22,48 @@
 
 #include <sys/types.h>
 
+#ifdef __APPLE__
+
 #include <mach/mach_types.h>
+#include <mach/vm_statistics.h>
 #include <mach/vm_types.h>
 
 #include <mach/kmod.h>
 
+#else
+
+// hosts without the Mach headers, e.g. Linux boxes reading shared caches and binaries offline
+typedef uint32_t mach_port_t;
+
+typedef mach_port_t vm_map_t;
+
+typedef uint64_t mach_vm_address_t;
+typedef uint64_t mach_vm_size_t;
+typedef uint64_t mach_vm_offset_t;
+
+typedef uintptr_t vm_address_t;
+typedef uintptr_t vm_size_t;
+typedef uintptr_t vm_offset_t;
+
+typedef int vm_prot_t;
+
+#define VM_PROT_NONE ((vm_prot_t)0x00)
+#define VM_PROT_READ ((vm_prot_t)0x01)
+#define VM_PROT_WRITE ((vm_prot_t)0x02)
+#define VM_PROT_EXECUTE ((vm_prot_t)0x04)
+
+#define VM_FLAGS_FIXED 0x0000
+#define VM_FLAGS_ANYWHERE 0x0001
+
+typedef int kern_return_t;
+
+typedef struct kmod_info kmod_info_t;
+
+typedef kern_return_t kmod_start_func_t(kmod_info_t* ki, void* data);
+typedef kern_return_t kmod_stop_func_t(kmod_info_t* ki, void* data);
+
+#endif
+
 #include <mach-o.h>
 
 using Bool = bool;
@@ -48,7 +85,11 @@ using Offset = off_t;
 using Size = size_t;
 #include "vector.h"
 #elif __USER__
+#ifdef __APPLE__
 #include <IOKit/IOKitLib.h>
+#else
+using Size = size_t;
+#endif
 #include <vector>
 #endif
 
@@ -177,108 +177,61 @@ Bool DeviceTree::IterateNode(void** data, void* data_end, UInt32* depth, dt_node
     return true;
 }
 
-DeviceTreeNode* DeviceTree::FindNode(char* nodename, UInt32* depth) {
-    UInt8* dt = GetAs<UInt8*>();
-
-    Size dt_size = GetSize();
-
-    UInt8* root = (UInt8*)dt;
-
-    *depth = 0;
+DeviceTreeIndex* DeviceTree::GetIndex() {
+    if (index)
+        return index;
 
-    dt_property_callback_t prop_cb = [](UInt32 ndepth, void* property, UInt32 size) -> Bool {
-        DeviceTreeProperty* prop = (DeviceTreeProperty*)property;
-
-        if (strcmp(prop->name, "name") == 0)
-            return true;
-
-        return false;
-    };
+    // the tree is indexed once, every lookup after that is a hash probe
+    index = new DeviceTreeIndex(GetAs<UInt8*>(), GetSize());
 
-    auto node_cb = [prop_cb, &nodename, this](UInt32 ndepth, void* dtnode, UInt32 size) -> Bool {
-        Bool ok;
-        Bool success;
+    if (!index->Parse()) {
+        DARWIN_KIT_LOG("MacRK::Failed to index device tree at 0x%llx\n", device_tree);
 
-        DeviceTreeNode* node = (DeviceTreeNode*)dtnode;
+        delete index;
 
-        UInt8* p = (UInt8*)node;
-
-        p += sizeof(*node);
-
-        UInt32 node_size = DeviceTree::GetNodeSize(ndepth, node);
+        index = nullptr;
+    }
 
-        // ok = DeviceTree::iterateNodeProperties((void**)&p, (void*)((UInt8*)node + node_size),
-        // &ndepth,
-        //                                         node, prop_cb, &success);
+    return index;
+}
 
-        if (ok && success) {
-            DeviceTreeProperty* prop = (DeviceTreeProperty*)p;
+DeviceTreeNode* DeviceTree::FindNode(char* nodename, UInt32* depth) {
+    DeviceTreeIndex* dt_index = GetIndex();
 
-            if (strcmp(nodename, (char*)&prop->val) == 0)
-                return true;
-        }
+    DeviceTreeIndexNode* node;
 
-        return false;
-    };
+    *depth = 0;
 
-    Bool ok;
-    Bool success = false;
+    if (!dt_index)
+        return nullptr;
 
-    // ok = DeviceTree::iterateNode((void**)&root, (void*)(root + dt_size), depth,
-    // (dt_node_callback_t) node_cb, nullptr,
-    //                             &success);
+    node = dt_index->FindNode(nodename);
 
-    if (success) {
-        DeviceTreeNode* node = (DeviceTreeNode*)root;
+    if (node) {
+        *depth = node->depth;
 
-        return node;
+        return node->node;
     }
 
     return nullptr;
 }
 
 DeviceTreeProperty* DeviceTree::FindProperty(char* nodename, char* propname) {
-    UInt8* dt = GetAs<UInt8*>();
+    DeviceTreeIndex* dt_index = GetIndex();
 
-    Size dt_size = GetSize();
+    DeviceTreeProperty* prop;
 
-    DeviceTreeNode* node;
+    if (!dt_index)
+        return nullptr;
 
-    Bool ok;
-    Bool success;
-
-    UInt32 node_size;
-    UInt32 depth = 0;
+    prop = dt_index->FindProperty(nodename, propname);
 
-    node = DeviceTree::FindNode(nodename, &depth);
+    if (prop) {
+        DARWIN_KIT_LOG("%s %s ", nodename, prop->name);
 
-    node_size = DeviceTree::GetNodeSize(depth, node);
-
-    if (node) {
-        auto prop_cb = [propname](UInt32 depth, void* property, UInt32 size) -> Bool {
-            DeviceTreeProperty* prop = (DeviceTreeProperty*)property;
-
-            if (strcmp(prop->name, propname) == 0)
-                return true;
-
-            return false;
-        };
+        DeviceTree::PrintData((UInt8*)&prop->val, DeviceTreeIndex::GetPropertySize(prop));
 
-        success = false;
-
-        // ok = DeviceTree::iterateNode((void**)&node, (void*)((UInt8*)node + node_size), &depth,
-        // nullptr,
-        //                             (dt_property_callback_t) prop_cb, &success);
-
-        if (success) {
-            DeviceTreeProperty* prop = (DeviceTreeProperty*)node;
-
-            DARWIN_KIT_LOG("%s %s ", nodename, prop->name);
-
-            DeviceTree::PrintData((UInt8*)&prop->val, prop->size);
-
-            return prop;
-        }
+        return prop;
     }
 
     return nullptr;
@@ -300,20 +253,26 @@ void DeviceTree::PrintData(UInt8* prop_data, UInt32 prop_size) {
 }
 
 void DeviceTree::PrintNode(char* nodename) {
-    UInt8* dt = GetAs<UInt8*>();
-
-    Size dt_size = GetSize();
+    DeviceTreeIndex* dt_index = GetIndex();
 
-    DeviceTreeNode* node;
+    DeviceTreeIndexNode* node;
 
-    UInt32 depth;
+    if (!dt_index)
+        return;
 
-    node = DeviceTree::FindNode(nodename, &depth);
+    node = dt_index->FindNode(nodename);
 
     if (node) {
-        Size node_size = DeviceTree::GetNodeSize(depth, node);
+        for (UInt32 i = 0; i < node->n_properties; i++) {
+            DeviceTreeProperty* prop = dt_index->GetProperty(node, i);
 
-        DeviceTree::Print(node, node_size);
+            for (UInt32 j = 0; j < node->depth + 1; j++)
+                DARWIN_KIT_LOG("\t");
+
+            DARWIN_KIT_LOG("%s ", prop->name);
+
+            PrintData((UInt8*)&prop->val, DeviceTreeIndex::GetPropertySize(prop));
+        }
     }
 }
 
@@ -18,26 +18,14 @@
 
 #include <types.h>
 
+#include "device_tree_index.h"
+
 #ifdef __arm64__
 
 namespace xnu {
 class Kernel;
 class DeviceTree;
 
-#define DT_KEY_LEN 0x20
-
-struct DeviceTreeNode {
-    UInt32 n_properties;
-    UInt32 n_children;
-};
-
-struct DeviceTreeProperty {
-    char name[DT_KEY_LEN];
-    UInt32 size;
-
-    char val[0];
-};
-
 using dt_node_callback_t = Bool (*)(UInt32 depth, void* node, UInt32 size);
 using dt_property_callback_t = Bool (*)(UInt32 depth, void* prop, UInt32 size);
 
@@ -66,9 +54,12 @@ class DeviceTree {
 public:
     explicit DeviceTree(xnu::Kernel* kernel)
         : kernel(kernel), device_tree(xnu::GetDeviceTreeHead<xnu::mach::VmAddress>(kernel)),
-          device_tree_sz(xnu::GetDeviceTreeSize(kernel)) {}
+          device_tree_sz(xnu::GetDeviceTreeSize(kernel)), index(nullptr) {}
 
-    ~DeviceTree() = default;
+    ~DeviceTree() {
+        if (index)
+            delete index;
+    }
 
     template <typename T>
     T GetAs() {
@@ -79,6 +70,8 @@ public:
         return device_tree_sz;
     }
 
+    DeviceTreeIndex* GetIndex();
+
     Size GetNodeSize(UInt32 depth, DeviceTreeNode* node);
 
     DeviceTreeNode* FindNode(char* nodename, UInt32* depth);
@@ -105,6 +98,8 @@ private:
     xnu::mach::VmAddress device_tree;
 
     Size device_tree_sz;
+
+    DeviceTreeIndex* index;
 };
 
 }; // namespace xnu
@@ -20,6 +20,8 @@
 #include "darwin_kit.h"
 
 #include "kernel.h"
+#include "hook_trace.h"
+#include "kernel_batch.h"
 #include "kernel_patcher.h"
 
 #include "task.h"
@@ -29,6 +31,7 @@
 
 #include "log.h"
 
+#include <kern/clock.h>
 #include <mach/vm_types.h>
 
 extern "C" {
@@ -37,6 +40,39 @@ extern "C" {
 
 OSDefineMetaClassAndStructors(IOKernelDarwinKitUserClient, IOUserClient)
 
+// hooks never ring the doorbell, a waiting client looks for their records this often
+static constexpr UInt32 kHookTraceDrainInterval = 10;
+
+// hook trace records moved into the event ring per ring record
+static constexpr Size kHookTraceDrainRecords = 256;
+
+/**
+ *  Runs the operations of a kIOKernelDarwinKitKernelBatch request against the kernel.
+ */
+class DarwinKitKernelBatchBackend : public darwin::KernelBatchBackend {
+public:
+    explicit DarwinKitKernelBatchBackend(xnu::Kernel* kernel) : kernel(kernel) {}
+
+    bool Read(xnu::mach::VmAddress address, void* data, Size size) override {
+        return address && kernel->Read(address, data, size);
+    }
+
+    bool Write(xnu::mach::VmAddress address, void* data, Size size) override {
+        return address && kernel->Write(address, data, size);
+    }
+
+    bool PhysicalRead(UInt64 paddr, void* data, Size size) override {
+        return kernel->PhysicalRead(paddr, data, size);
+    }
+
+    bool PhysicalWrite(UInt64 paddr, void* data, Size size) override {
+        return kernel->PhysicalWrite(paddr, data, size);
+    }
+
+private:
+    xnu::Kernel* kernel;
+};
+
 IOKernelDarwinKitUserClient* IOKernelDarwinKitUserClient::darwinKitUserClientWithKernel(
         xnu::Kernel* kernel, task_t owningTask, void* securityToken, UInt32 type) {
     IOKernelDarwinKitUserClient* client;
@@ -113,6 +149,13 @@ bool IOKernelDarwinKitUserClient::start(IOService* provider) {
 
     darwinkitService = service;
 
+    sharedMemoryLock = IOLockAlloc();
+
+    eventLock = IOSimpleLockAlloc();
+
+    if (!sharedMemoryLock || !eventLock)
+        return false;
+
     return IOUserClient::start(provider);
 }
 
@@ -121,6 +164,8 @@ void IOKernelDarwinKitUserClient::stop(IOService* provider) {
 }
 
 IOReturn IOKernelDarwinKitUserClient::clientClose() {
+    releaseSharedMemory();
+
     return kIOReturnSuccess;
 }
 
@@ -130,7 +175,16 @@ IOReturn IOKernelDarwinKitUserClient::clientDied() {
     return result;
 }
 
-void IOKernelDarwinKitUserClient::free() {}
+void IOKernelDarwinKitUserClient::free() {
+    if (sharedMemoryLock)
+        IOLockFree(sharedMemoryLock);
+
+    if (eventLock)
+        IOSimpleLockFree(eventLock);
+
+    sharedMemoryLock = nullptr;
+    eventLock = nullptr;
+}
 
 IOExternalMethod* IOKernelDarwinKitUserClient::getExternalMethodForIndex(UInt32 index) {
     return nullptr;
@@ -188,6 +242,354 @@ fail:
     return nullptr;
 }
 
+IOReturn IOKernelDarwinKitUserClient::createSharedMemory(Size size) {
+    IOBufferMemoryDescriptor* buffer;
+
+    UInt8* memory;
+
+    if (size < kSharedRingMinimumRegionSize || size > kSharedRingMaximumRegionSize)
+        return kIOReturnBadArgument;
+
+    buffer = IOBufferMemoryDescriptor::inTaskWithOptions(
+        kernelTask, kIODirectionInOut | kIOMemoryKernelUserShared, size, PAGE_SIZE);
+
+    if (!buffer)
+        return kIOReturnNoMemory;
+
+    memory = reinterpret_cast<UInt8*>(buffer->getBytesNoCopy());
+
+    memset(memory, 0, size);
+
+    if (!CreateSharedRings(memory, size)) {
+        buffer->release();
+
+        return kIOReturnError;
+    }
+
+    IOLockLock(sharedMemoryLock);
+
+    if (sharedMemory) {
+        IOLockUnlock(sharedMemoryLock);
+
+        buffer->release();
+
+        return kIOReturnBusy;
+    }
+
+    // the rings are attached before the client can map them, so the kext starts from indices it
+    // wrote itself, and only here, where a second call cannot move the rings of the first
+    if (!OpenSharedRing(memory, size, kSharedRingCommands, &commandRing) ||
+        !OpenSharedRing(memory, size, kSharedRingResults, &resultRing) ||
+        !OpenSharedRing(memory, size, kSharedRingEvents, &eventRing)) {
+        commandRing.Detach();
+        resultRing.Detach();
+        eventRing.Detach();
+
+        IOLockUnlock(sharedMemoryLock);
+
+        buffer->release();
+
+        return kIOReturnError;
+    }
+
+    IOSimpleLockLock(eventLock);
+
+    sharedMemory = buffer;
+
+    IOSimpleLockUnlock(eventLock);
+
+    IOLockUnlock(sharedMemoryLock);
+
+    return kIOReturnSuccess;
+}
+
+IOReturn IOKernelDarwinKitUserClient::mapSharedMemory(xnu::mach::VmAddress* address,
+                                                      Size* size) {
+    IOReturn result = kIOReturnSuccess;
+
+    IOLockLock(sharedMemoryLock);
+
+    if (!sharedMemory) {
+        result = kIOReturnNotReady;
+    } else {
+        if (!sharedMemoryMap)
+            sharedMemoryMap = sharedMemory->createMappingInTask(clientTask, 0, kIOMapAnywhere);
+
+        if (sharedMemoryMap) {
+            *address = sharedMemoryMap->getAddress();
+            *size = sharedMemoryMap->getLength();
+        } else {
+            result = kIOReturnNoMemory;
+        }
+    }
+
+    IOLockUnlock(sharedMemoryLock);
+
+    return result;
+}
+
+void IOKernelDarwinKitUserClient::releaseSharedMemory() {
+    if (!sharedMemoryLock || !eventLock)
+        return;
+
+    IOLockLock(sharedMemoryLock);
+
+    IOSimpleLockLock(eventLock);
+
+    commandRing.Detach();
+    resultRing.Detach();
+    eventRing.Detach();
+
+    IOSimpleLockUnlock(eventLock);
+
+    if (sharedMemoryMap)
+        sharedMemoryMap->release();
+
+    if (sharedMemory)
+        sharedMemory->release();
+
+    sharedMemoryMap = nullptr;
+    sharedMemory = nullptr;
+
+    // waiters see the shared memory is gone and return
+    IOLockWakeup(sharedMemoryLock, &eventRing, false);
+
+    IOLockUnlock(sharedMemoryLock);
+}
+
+IOReturn IOKernelDarwinKitUserClient::runKernelBatchCommand(UInt64 id, UInt8* request,
+                                                            Size request_size) {
+    DarwinKitKernelBatchBackend backend(kernel);
+
+    UInt8* copy;
+    UInt8* response;
+
+    Size response_size;
+
+    // the client can rewrite the command while it runs, so only a private copy is validated
+    copy = reinterpret_cast<UInt8*>(IOMalloc(request_size ? request_size : 1));
+
+    if (!copy)
+        return kIOReturnNoMemory;
+
+    memcpy(copy, request, request_size);
+
+    response_size = GetKernelBatchResponseSize(copy, request_size);
+
+    // malformed batches and responses that can never fit get an empty result
+    if (!response_size || response_size > resultRing.GetMaxRecordSize())
+        response_size = 0;
+
+    response = reinterpret_cast<UInt8*>(resultRing.Reserve(kSharedRingKernelBatch, id,
+                                                           response_size));
+
+    if (!response) {
+        IOFree(copy, request_size ? request_size : 1);
+
+        return kIOReturnNoSpace;
+    }
+
+    if (response_size)
+        ExecuteKernelBatch(&backend, copy, request_size, response, response_size);
+
+    IOFree(copy, request_size ? request_size : 1);
+
+    // the client reads results once the doorbell returns, nobody needs waking
+    resultRing.Commit(nullptr);
+
+    return kIOReturnSuccess;
+}
+
+IOReturn IOKernelDarwinKitUserClient::drainCommands() {
+    IOReturn result = kIOReturnSuccess;
+
+    SharedRingRecord* command;
+
+    UInt32 size;
+
+    IOLockLock(sharedMemoryLock);
+
+    if (!sharedMemory) {
+        IOLockUnlock(sharedMemoryLock);
+
+        return kIOReturnNotReady;
+    }
+
+    // the client can rewrite a record while it is looked at, so its header is read once and the
+    // payload is only ever bounded by the size Peek() checked
+    while ((command = commandRing.Peek(&size))) {
+        UInt64 id = command->id;
+
+        UInt16 type = command->type;
+
+        switch (type) {
+        case kSharedRingKernelBatch:
+            result = runKernelBatchCommand(id, reinterpret_cast<UInt8*>(command + 1), size);
+
+            break;
+        default:
+            result = resultRing.Push(type, id, nullptr, 0, nullptr) ? kIOReturnSuccess
+                                                                    : kIOReturnNoSpace;
+
+            break;
+        }
+
+        // a full result ring leaves the command queued until the client catches up
+        if (result != kIOReturnSuccess)
+            break;
+
+        commandRing.Pop();
+    }
+
+    if (commandRing.IsBroken() || resultRing.IsBroken())
+        result = kIOReturnBadArgument;
+
+    IOLockUnlock(sharedMemoryLock);
+
+    return result;
+}
+
+Size IOKernelDarwinKitUserClient::drainHookTrace() {
+    HookTrace* trace = darwinkitService->getDarwinKit()->GetKernelPatcher()->GetHookTrace();
+
+    Size queued = 0;
+
+    Size max_size;
+
+    max_size = eventRing.GetMaxRecordSize();
+
+    if (max_size > HookTraceEncodedSize(kHookTraceDrainRecords))
+        max_size = HookTraceEncodedSize(kHookTraceDrainRecords);
+
+    if (!trace || max_size < HookTraceEncodedSize(1))
+        return 0;
+
+    while (true) {
+        UInt8* out;
+
+        Size size = 0;
+
+        IOSimpleLockLock(eventLock);
+
+        // records are drained straight into the ring, a full ring leaves them with the CPUs
+        out = reinterpret_cast<UInt8*>(eventRing.Reserve(kSharedRingHookHit, 0, max_size));
+
+        if (out) {
+            size = trace->DrainEncoded(out, max_size);
+
+            if (size) {
+                eventRing.Truncate(size);
+                // the only client that could be woken is the one draining
+                eventRing.Commit(nullptr);
+            } else
+                eventRing.Cancel();
+        }
+
+        IOSimpleLockUnlock(eventLock);
+
+        if (!size)
+            break;
+
+        queued += size;
+    }
+
+    return queued;
+}
+
+IOReturn IOKernelDarwinKitUserClient::waitForEvents(UInt32 timeout) {
+    IOReturn result = kIOReturnSuccess;
+
+    UInt64 deadline = 0;
+
+    bool tracing;
+    bool drained;
+
+    if (timeout)
+        clock_interval_to_deadline(timeout, kMillisecondScale, &deadline);
+
+    IOLockLock(sharedMemoryLock);
+
+    while (sharedMemory) {
+        UInt64 wake = deadline;
+
+        int wait;
+
+        tracing = darwinkitService->getDarwinKit()->GetKernelPatcher()->GetHookTrace() != nullptr;
+
+        if (tracing)
+            drainHookTrace();
+
+        IOSimpleLockLock(eventLock);
+
+        drained = eventRing.IsDrained();
+
+        IOSimpleLockUnlock(eventLock);
+
+        if (!drained)
+            break;
+
+        if (deadline && mach_absolute_time() >= deadline) {
+            result = kIOReturnTimeout;
+
+            break;
+        }
+
+        if (tracing) {
+            UInt64 poll;
+
+            clock_interval_to_deadline(kHookTraceDrainInterval, kMillisecondScale, &poll);
+
+            if (!wake || poll < wake)
+                wake = poll;
+        }
+
+        if (wake)
+            wait = IOLockSleepDeadline(sharedMemoryLock, &eventRing, wake, THREAD_INTERRUPTIBLE);
+        else
+            wait = IOLockSleep(sharedMemoryLock, &eventRing, THREAD_INTERRUPTIBLE);
+
+        if (wait == THREAD_INTERRUPTED) {
+            result = kIOReturnAborted;
+
+            break;
+        }
+    }
+
+    if (!sharedMemory)
+        result = kIOReturnNotReady;
+
+    IOLockUnlock(sharedMemoryLock);
+
+    return result;
+}
+
+bool IOKernelDarwinKitUserClient::postEvent(UInt16 type, UInt64 id, const void* data,
+                                            Size size) {
+    bool doorbell = false;
+
+    bool success;
+
+    if (!eventLock)
+        return false;
+
+    IOSimpleLockLock(eventLock);
+
+    success = sharedMemory && eventRing.Push(type, id, data, size, &doorbell);
+
+    IOSimpleLockUnlock(eventLock);
+
+    // only a client that had drained the ring can be asleep in waitForEvents()
+    if (doorbell) {
+        IOLockLock(sharedMemoryLock);
+
+        IOLockWakeup(sharedMemoryLock, &eventRing, false);
+
+        IOLockUnlock(sharedMemoryLock);
+    }
+
+    return success;
+}
+
 IOReturn IOKernelDarwinKitUserClient::externalMethod(UInt32 selector,
                                                    IOExternalMethodArguments* arguments,
                                                    IOExternalMethodDispatch* dispatch,
@@ -1091,9 +1493,112 @@ IOReturn IOKernelDarwinKitUserClient::externalMethod(UInt32 selector,
         break;
     case kIOKernelDarwinKitCopyOut:
         break;
-    case kIOKernelDarwinKitCreateSharedMemory:
+    case kIOKernelDarwinKitCreateSharedMemory:;
+
+        if (arguments) {
+            if (arguments->scalarInputCount == 1) {
+                Size size = arguments->scalarInput[0];
+
+                result = createSharedMemory(size);
+            }
+        }
+
+        break;
+    case kIOKernelDarwinKitMapSharedMemory:;
+
+        if (arguments) {
+            if (arguments->scalarOutputCount == 2) {
+                xnu::mach::VmAddress address = 0;
+
+                Size size = 0;
+
+                result = mapSharedMemory(&address, &size);
+
+                arguments->scalarOutput[0] = address;
+                arguments->scalarOutput[1] = size;
+            }
+        }
+
+        break;
+    case kIOKernelDarwinKitSharedMemoryDoorbell:;
+
+        result = drainCommands();
+
+        break;
+    case kIOKernelDarwinKitSharedMemoryWait:;
+
+        if (arguments) {
+            if (arguments->scalarInputCount == 1) {
+                UInt32 timeout = (UInt32)arguments->scalarInput[0];
+
+                result = waitForEvents(timeout);
+            }
+        }
+
         break;
-    case kIOKernelDarwinKitMapSharedMemory:
+    case kIOKernelDarwinKitKernelBatch:;
+
+        if (arguments) {
+            if (arguments->scalarInputCount == 4) {
+                IOMemoryDescriptor* request_descriptor = nullptr;
+                IOMemoryDescriptor* response_descriptor = nullptr;
+
+                IOMemoryMap* request_map = nullptr;
+                IOMemoryMap* response_map = nullptr;
+
+                UInt8* request = nullptr;
+                UInt8* response = nullptr;
+
+                UInt8* copy = nullptr;
+
+                UInt64 request_data = arguments->scalarInput[0];
+                Size request_size = arguments->scalarInput[1];
+
+                UInt64 response_data = arguments->scalarInput[2];
+                Size response_size = arguments->scalarInput[3];
+
+                result = kIOReturnBadArgument;
+
+                if (request_size && request_size <= darwin::kKernelBatchMaxBufferSize &&
+                    response_size && response_size <= darwin::kKernelBatchMaxBufferSize) {
+                    request = mapBufferFromClientTask(request_data, request_size, kIODirectionOut,
+                                                      &request_descriptor, &request_map);
+
+                    response = mapBufferFromClientTask(response_data, response_size,
+                                                       kIODirectionOutIn, &response_descriptor,
+                                                       &response_map);
+
+                    copy = reinterpret_cast<UInt8*>(IOMalloc(request_size));
+                }
+
+                // the request is copied so the client cannot change it after it was validated
+                if (request && response && copy) {
+                    DarwinKitKernelBatchBackend backend(kernel);
+
+                    memcpy(copy, request, request_size);
+
+                    if (darwin::ExecuteKernelBatch(&backend, copy, request_size, response,
+                                                   response_size))
+                        result = kIOReturnSuccess;
+                }
+
+                if (copy)
+                    IOFree(copy, request_size);
+
+                if (request_map)
+                    request_map->release();
+
+                if (request_descriptor)
+                    request_descriptor->release();
+
+                if (response_map)
+                    response_map->release();
+
+                if (response_descriptor)
+                    response_descriptor->release();
+            }
+        }
+
         break;
 
     default:
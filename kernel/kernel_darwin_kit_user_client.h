@@ -16,7 +16,9 @@
 
 #pragma once
 
+#include <IOKit/IOBufferMemoryDescriptor.h>
 #include <IOKit/IOLib.h>
+#include <IOKit/IOLocks.h>
 #include <IOKit/IOUserClient.h>
 
 #include <mach/mach_types.h>
@@ -30,6 +32,8 @@
 
 #include "kernel.h"
 
+#include "shared_ring.h"
+
 namespace darwin {
 class DarwinKit;
 }
@@ -85,6 +89,13 @@ class IOKernelDarwinKitUserClient : public IOUserClient {
         return kernelTask;
     }
 
+    /**
+     *  Queues an event for the client on the event ring of the shared memory and wakes it up if
+     *  it had drained the ring. Fails when the client has not created the shared memory or is
+     *  not keeping up. Takes sleeping locks, so it must not be called from interrupt context.
+     */
+    bool postEvent(UInt16 type, UInt64 id, const void* data, Size size);
+
 private:
     IOKernelDarwinKitService* darwinkitService;
 
@@ -94,8 +105,37 @@ private:
 
     xnu::Kernel* kernel;
 
+    IOBufferMemoryDescriptor* sharedMemory;
+
+    IOMemoryMap* sharedMemoryMap;
+
+    darwin::SharedRing commandRing;
+    darwin::SharedRing resultRing;
+    darwin::SharedRing eventRing;
+
+    // guards the shared memory and the doorbell sleeps, taken before eventLock
+    IOLock* sharedMemoryLock;
+
+    // the event ring has a single producer, event sources take turns
+    IOSimpleLock* eventLock;
+
     void initDarwinKit();
 
+    IOReturn createSharedMemory(Size size);
+
+    IOReturn mapSharedMemory(xnu::mach::VmAddress* address, Size* size);
+
+    void releaseSharedMemory();
+
+    IOReturn drainCommands();
+
+    IOReturn runKernelBatchCommand(UInt64 id, UInt8* request, Size request_size);
+
+    // moves hook trace records into the event ring in the compact format, returns the bytes queued
+    Size drainHookTrace();
+
+    IOReturn waitForEvents(UInt32 timeout);
+
     UInt8* mapBufferFromClientTask(xnu::mach::VmAddress uaddr, Size size, IOOptionBits options,
                                    IOMemoryDescriptor** desc, IOMemoryMap** mapping);
 };
@@ -23,6 +23,7 @@
 #include "kernel_macho.h"
 
 #include "hook.h"
+#include "hook_trace.h"
 #include "payload.h"
 
 #include "kernel.h"
@@ -30,6 +31,8 @@
 
 #include "disassembler.h"
 
+#include <machine/machine_routines.h>
+
 #ifdef __arm64__
 
 #include <arm64/patch_finder_arm64.h>
@@ -58,6 +61,13 @@ KernelPatcher::KernelPatcher(xnu::Kernel* kernel)
 }
 
 void KernelPatcher::Initialize() {
+    darwin::HookTrace* trace = new darwin::HookTrace(ml_get_max_cpus());
+
+    if (trace->IsValid())
+        SetHookTrace(trace);
+    else
+        delete trace;
+
     ProcessAlreadyLoadedKexts();
 
     waitingForAlreadyLoadedKexts = false;
@@ -169,7 +179,9 @@ OSObject* KernelPatcher::CopyClientEntitlement(task_t task, const char* entitlem
 
     xnu::mach::VmAddress trampoline;
 
-    DARWIN_KIT_LOG("DarwinKit::KernelPatcher::copyClientEntitlement() hook!\n");
+    UInt64 arguments[] = {reinterpret_cast<UInt64>(task), reinterpret_cast<UInt64>(entitlement)};
+
+    hook->Trace(arguments, 2);
 
     trampoline = hook->GetTrampolineFromChain(
         reinterpret_cast<xnu::mach::VmAddress>(KernelPatcher::CopyClientEntitlement));
@@ -229,7 +241,9 @@ void KernelPatcher::TaskSetMainThreadQos(task_t task, thread_t thread) {
 
     typedef void* (*task_set_main_thread_qos)(task_t, thread_t);
 
-    DARWIN_KIT_LOG("DarwinKit::task_set_main_thread_qos hook!\n");
+    UInt64 arguments[] = {reinterpret_cast<UInt64>(task), reinterpret_cast<UInt64>(thread)};
+
+    hook->Trace(arguments, 2);
 
     if (that) {
         StoredArray<DarwinKit::BinaryLoadCallback>* binaryLoadCallbacks;
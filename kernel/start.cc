@@ -28,6 +28,8 @@
 #include "kernel_darwin_kit.h"
 #include "darwin_kit.h"
 
+#include "umm_malloc.h"
+
 darwin::DarwinKit* darwinkit = nullptr;
 
 darwin::DarwinKit* darwinkit_get_darwinkit() {
@@ -73,12 +75,17 @@ extern "C" {
 kern_return_t kern_start(kmod_info_t* ki, void* data) {
     DARWIN_KIT_LOG("DarwinKit::kmod_start()!\n");
 
+    // capstone allocates from the default umm heap, set it up before anything can disassemble
+    umm_init();
+
     return KERN_SUCCESS;
 }
 
 kern_return_t kern_stop(kmod_info_t* ki, void* data) {
     DARWIN_KIT_LOG("DarwinKit::kmod_stop()!\n");
 
+    umm_deinit();
+
     return KERN_SUCCESS;
 }
 
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef __KERNEL__
+#include <kern/thread.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <string.h>
+
+#include "umm_cache.h"
+
+/* ------------------------------------------------------------------------ */
+
+/*
+ * The classes are whole numbers of umm blocks, so a block handed out for a
+ * class has exactly that class' usable size and umm_cache_free() can tell
+ * it apart from anything umm_malloc() handed out directly.
+ */
+
+static const umm_blockno_t umm_cache_class_blocks[UMM_CACHE_CLASSES] = {
+  2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96
+};
+
+/* ------------------------------------------------------------------------ */
+
+static inline void umm_cache_lock( umm_cache_slot *slot ) {
+  umm_lock_acquire( &slot->lock );
+}
+
+static inline void umm_cache_unlock( umm_cache_slot *slot ) {
+  umm_lock_release( &slot->lock );
+}
+
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Cached blocks are linked through their first bytes, which are only 4 byte
+ * aligned with UMM_BLOCKNO_16.
+ */
+
+static inline void *umm_cache_next( void *ptr ) {
+  void *next;
+
+  memcpy( &next, ptr, sizeof(void *) );
+
+  return( next );
+}
+
+static inline void umm_cache_set_next( void *ptr, void *next ) {
+  memcpy( ptr, &next, sizeof(void *) );
+}
+
+/* ------------------------------------------------------------------------ */
+
+static umm_cache_slot *umm_cache_current_slot( umm_cache *cache ) {
+  unsigned long thread;
+
+#ifdef __KERNEL__
+  thread = (unsigned long)current_thread();
+#else
+  thread = (unsigned long)pthread_self();
+#endif
+
+  /* Thread structures are well aligned, so mix the upper bits in */
+
+  thread *= 0x9E3779B97F4A7C15ULL;
+
+  return( &cache->slots[(thread >> 32) % UMM_CACHE_SLOTS] );
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int umm_cache_class_of_size( umm_cache *cache, size_t size ) {
+  int i;
+
+  for( i = 0; i < UMM_CACHE_CLASSES; i++ ) {
+    if( size <= cache->class_sizes[i] )
+      return( i );
+  }
+
+  return( -1 );
+}
+
+static int umm_cache_class_of_block( umm_cache *cache, size_t usable ) {
+  int i;
+
+  for( i = 0; i < UMM_CACHE_CLASSES; i++ ) {
+    if( usable == cache->class_sizes[i] )
+      return( i );
+  }
+
+  return( -1 );
+}
+
+static umm_heap_context *umm_cache_heap_of( umm_cache *cache, void *ptr ) {
+  unsigned int i;
+
+  for( i = 0; i < cache->num_heaps; i++ ) {
+    if( umm_heap_contains( &cache->heaps[i], ptr ) )
+      return( &cache->heaps[i] );
+  }
+
+  return( (umm_heap_context *)NULL );
+}
+
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Hand up to UMM_CACHE_DEPTH cached blocks back, taking the lock of every
+ * heap they came from just once.
+ */
+
+static void umm_cache_release( umm_cache *cache, void **ptrs, size_t count ) {
+  void *owned[UMM_CACHE_DEPTH];
+
+  unsigned int i;
+  size_t j;
+  size_t n;
+
+  for( i = 0; i < cache->num_heaps && count; i++ ) {
+    n = 0;
+
+    for( j = 0; j < count; j++ ) {
+      if( umm_heap_contains( &cache->heaps[i], ptrs[j] ) )
+        owned[n++] = ptrs[j];
+    }
+
+    if( n )
+      umm_free_batch( &cache->heaps[i], owned, n );
+  }
+}
+
+/* ------------------------------------------------------------------------ */
+
+int umm_cache_init( umm_cache *cache, umm_heap_context *heaps, unsigned int num_heaps ) {
+  int i;
+
+  if( (umm_heap_context *)NULL == heaps || 0 == num_heaps )
+    return( 0 );
+
+  memset( cache, 0x00, sizeof(umm_cache) );
+
+  cache->heaps = heaps;
+  cache->num_heaps = num_heaps;
+
+  for( i = 0; i < UMM_CACHE_CLASSES; i++ )
+    cache->class_sizes[i] = umm_blocks_usable_size( umm_cache_class_blocks[i] );
+
+  /* Spread the slots over the heaps so that refills don't all hit one lock */
+
+  for( i = 0; i < UMM_CACHE_SLOTS; i++ ) {
+    if( !umm_lock_init( &cache->slots[i].lock ) ) {
+      while( i-- > 0 )
+        umm_lock_destroy( &cache->slots[i].lock );
+
+      return( 0 );
+    }
+
+    cache->slots[i].heap = i % num_heaps;
+  }
+
+  return( 1 );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void *umm_cache_malloc( umm_cache *cache, size_t size ) {
+  umm_cache_slot *slot;
+  umm_cache_bin *bin;
+
+  void *batch[UMM_CACHE_BATCH];
+  void *ptr = NULL;
+
+  unsigned int i;
+  size_t n = 0;
+
+  int cls;
+
+  if( 0 == size )
+    return( (void *)NULL );
+
+  slot = umm_cache_current_slot( cache );
+
+  cls = umm_cache_class_of_size( cache, size );
+
+  if( cls < 0 ) {
+    /* Too big to cache, try the home heap first and then all the others */
+
+    for( i = 0; i < cache->num_heaps && !ptr; i++ )
+      ptr = umm_malloc_heap( &cache->heaps[(slot->heap + i) % cache->num_heaps], size );
+
+    return( ptr );
+  }
+
+  bin = &slot->bins[cls];
+
+  umm_cache_lock( slot );
+
+  if( (ptr = bin->head) ) {
+    bin->head = umm_cache_next( ptr );
+    bin->count--;
+  }
+
+  umm_cache_unlock( slot );
+
+  if( ptr )
+    return( ptr );
+
+  /* The bin ran dry, refill a whole batch with a single heap lock */
+
+  for( i = 0; i < cache->num_heaps && !n; i++ ) {
+    n = umm_malloc_batch( &cache->heaps[(slot->heap + i) % cache->num_heaps],
+                          cache->class_sizes[cls], batch, UMM_CACHE_BATCH );
+  }
+
+  if( !n )
+    return( (void *)NULL );
+
+  if( n > 1 ) {
+    umm_cache_lock( slot );
+
+    for( i = 1; i < n; i++ ) {
+      umm_cache_set_next( batch[i], bin->head );
+      bin->head = batch[i];
+    }
+
+    bin->count += n - 1;
+
+    umm_cache_unlock( slot );
+  }
+
+  return( batch[0] );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void umm_cache_free( umm_cache *cache, void *ptr ) {
+  umm_heap_context *heap;
+
+  umm_cache_slot *slot;
+  umm_cache_bin *bin;
+
+  void *batch[UMM_CACHE_DEPTH / 2];
+
+  size_t n = 0;
+
+  int cls;
+
+  if( (void *)NULL == ptr )
+    return;
+
+  if( (umm_heap_context *)NULL == (heap = umm_cache_heap_of( cache, ptr )) )
+    return;
+
+  cls = umm_cache_class_of_block( cache, umm_usable_size( heap, ptr ) );
+
+  if( cls < 0 ) {
+    umm_free_heap( heap, ptr );
+
+    return;
+  }
+
+  slot = umm_cache_current_slot( cache );
+
+  bin = &slot->bins[cls];
+
+  umm_cache_lock( slot );
+
+  umm_cache_set_next( ptr, bin->head );
+  bin->head = ptr;
+  bin->count++;
+
+  /* Keep the bin bounded, half of it goes back to the heaps */
+
+  if( bin->count > UMM_CACHE_DEPTH ) {
+    while( n < UMM_CACHE_DEPTH / 2 ) {
+      batch[n++] = bin->head;
+      bin->head = umm_cache_next( bin->head );
+    }
+
+    bin->count -= n;
+  }
+
+  umm_cache_unlock( slot );
+
+  if( n )
+    umm_cache_release( cache, batch, n );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void *umm_cache_calloc( umm_cache *cache, size_t num, size_t item_size ) {
+  void *ret;
+
+  if( item_size && num > ((size_t)-1) / item_size )
+    return( (void *)NULL );
+
+  ret = umm_cache_malloc( cache, num * item_size );
+
+  if( ret )
+    memset( ret, 0x00, num * item_size );
+
+  return( ret );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void *umm_cache_realloc( umm_cache *cache, void *ptr, size_t size ) {
+  umm_heap_context *heap;
+
+  void *ret;
+
+  size_t usable;
+
+  if( (void *)NULL == ptr )
+    return( umm_cache_malloc( cache, size ) );
+
+  if( 0 == size ) {
+    umm_cache_free( cache, ptr );
+
+    return( (void *)NULL );
+  }
+
+  if( (umm_heap_context *)NULL == (heap = umm_cache_heap_of( cache, ptr )) )
+    return( (void *)NULL );
+
+  usable = umm_usable_size( heap, ptr );
+
+  /* Shrinking keeps the block, it still fits its class when freed */
+
+  if( size <= usable )
+    return( ptr );
+
+  if( (void *)NULL == (ret = umm_cache_malloc( cache, size )) )
+    return( (void *)NULL );
+
+  memcpy( ret, ptr, usable );
+
+  umm_cache_free( cache, ptr );
+
+  return( ret );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void umm_cache_flush( umm_cache *cache ) {
+  void *batch[UMM_CACHE_DEPTH];
+  void *list;
+
+  size_t n;
+
+  int i;
+  int j;
+
+  for( i = 0; i < UMM_CACHE_SLOTS; i++ ) {
+    for( j = 0; j < UMM_CACHE_CLASSES; j++ ) {
+      umm_cache_lock( &cache->slots[i] );
+
+      list = cache->slots[i].bins[j].head;
+
+      cache->slots[i].bins[j].head = NULL;
+      cache->slots[i].bins[j].count = 0;
+
+      umm_cache_unlock( &cache->slots[i] );
+
+      while( list ) {
+        n = 0;
+
+        while( list && n < UMM_CACHE_DEPTH ) {
+          batch[n++] = list;
+          list = umm_cache_next( list );
+        }
+
+        umm_cache_release( cache, batch, n );
+      }
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------ */
+
+void umm_cache_destroy( umm_cache *cache ) {
+  int i;
+
+  umm_cache_flush( cache );
+
+  for( i = 0; i < UMM_CACHE_SLOTS; i++ )
+    umm_lock_destroy( &cache->slots[i].lock );
+}
+
+/* ------------------------------------------------------------------------ */
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UMM_CACHE_H
+#define UMM_CACHE_H
+
+#include "umm_malloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------ */
+
+/*
+ * A size class front end for umm_malloc.
+ *
+ * Small allocations are rounded up to one of UMM_CACHE_CLASSES sizes and
+ * served from a cache slot picked by hashing the current thread, so most
+ * of them never touch a heap lock. A slot that runs dry refills a whole
+ * batch from its home heap in one go, and a slot that grows past
+ * UMM_CACHE_DEPTH hands half of it back the same way. Slots are spread
+ * over all the heaps the cache was created with, anything larger than the
+ * biggest class goes straight to a heap.
+ */
+
+#define UMM_CACHE_CLASSES   12
+#define UMM_CACHE_SLOTS     16
+#define UMM_CACHE_DEPTH     64
+#define UMM_CACHE_BATCH     16
+
+typedef struct umm_cache_bin_t {
+  void *head;
+  unsigned int count;
+} umm_cache_bin;
+
+typedef struct umm_cache_slot_t {
+  umm_lock_t lock;
+  unsigned int heap;
+  umm_cache_bin bins[UMM_CACHE_CLASSES];
+} __attribute__((aligned(64))) umm_cache_slot;
+
+typedef struct umm_cache_t {
+  umm_heap_context *heaps;
+  unsigned int num_heaps;
+  size_t class_sizes[UMM_CACHE_CLASSES];
+  umm_cache_slot slots[UMM_CACHE_SLOTS];
+} umm_cache;
+
+/*
+ * The heaps must already be initialized and outlive the cache. Fails when
+ * the slot locks can't be allocated, umm_cache_destroy() flushes the cache
+ * and releases them.
+ */
+
+int umm_cache_init(umm_cache *cache, umm_heap_context *heaps, unsigned int num_heaps);
+void umm_cache_destroy(umm_cache *cache);
+
+void* umm_cache_malloc(umm_cache *cache, size_t size);
+void* umm_cache_calloc(umm_cache *cache, size_t num, size_t size);
+void* umm_cache_realloc(umm_cache *cache, void *ptr, size_t size);
+void umm_cache_free(umm_cache *cache, void *ptr);
+
+/* Give every cached block back to its heap */
+
+void umm_cache_flush(umm_cache *cache);
+
+/* ------------------------------------------------------------------------ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UMM_CACHE_H */
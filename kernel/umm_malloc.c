@@ -44,18 +44,39 @@
  *                     - Move integrity and poison checking to separate file
  * R.Hempel 2017-12-29 - Fix bug in realloc when requesting a new block that
  *                        results in OOM error - see Issue 11
+ *                     - Support for multiple independent heaps, each with its
+ *                        own lock, and 32 bit block indices so a heap is no
+ *                        longer limited to 32767 blocks
+ *                     - Optional UMM_STATS counters and heap walk
  * ----------------------------------------------------------------------------
  */
 
+#ifdef __KERNEL__
 #include <Availability.h>
 #include <libkern/libkern.h>
 #include <IOKit/IOLib.h>
+#else
+#include <stdio.h>
+#endif
+
+#ifdef UMM_STATS
+#ifdef __KERNEL__
+#include <kern/clock.h>
+#else
+#include <time.h>
+#endif
+#endif
+
 #include <string.h>
 
 #include "umm_malloc.h"
 
 #ifdef UMM_DEBUG
+#ifdef __KERNEL__
 #define DBGLOG_DEBUG(format, ...) IOLog(format, ## __VA_ARGS__)
+#else
+#define DBGLOG_DEBUG(format, ...) printf(format, ## __VA_ARGS__)
+#endif
 #define DBGLOG_TRACE(format, ...) do { } while (0)
 #else
 #define DBGLOG_DEBUG(format, ...) do { } while (0)
@@ -65,20 +86,19 @@
 #define UMM_H_ATTPACKPRE
 #define UMM_H_ATTPACKSUF __attribute__((__packed__))
 
-#define UMM_CRITICAL_ENTRY()
-#define UMM_CRITICAL_EXIT()
-
-#define UMM_MALLOC_CFG_HEAP_SIZE 0x10000
+/*
+ * A spinlock per heap, the critical sections only walk the free list and
+ * the same code has to build for the kernel and for host side tests.
+ */
 
-static char default_umm_heap[UMM_MALLOC_CFG_HEAP_SIZE];
-
-#define UMM_MALLOC_CFG_HEAP_ADDR default_umm_heap
+#define UMM_CRITICAL_ENTRY() umm_lock_acquire( &heap->lock )
+#define UMM_CRITICAL_EXIT()  umm_lock_release( &heap->lock )
 
 /* ------------------------------------------------------------------------- */
 
 UMM_H_ATTPACKPRE typedef struct umm_ptr_t {
-  unsigned short int next;
-  unsigned short int prev;
+  umm_blockno_t next;
+  umm_blockno_t prev;
 } UMM_H_ATTPACKSUF umm_ptr;
 
 
@@ -88,23 +108,43 @@ UMM_H_ATTPACKPRE typedef struct umm_block_t {
   } header;
   union {
     umm_ptr free;
-    unsigned char data[4];
+    unsigned char data[sizeof(umm_ptr)];
   } body;
 } UMM_H_ATTPACKSUF umm_block;
 
+#ifdef UMM_BLOCKNO_16
 #define UMM_FREELIST_MASK (0x8000)
 #define UMM_BLOCKNO_MASK  (0x7FFF)
+#else
+#define UMM_FREELIST_MASK (0x80000000)
+#define UMM_BLOCKNO_MASK  (0x7FFFFFFF)
+#endif
+
+/*
+ * The default heap holds as many blocks as the original 64 KiB heap of 8
+ * byte blocks did, so capstone keeps the same room with 32 bit indices.
+ */
+
+#define UMM_MALLOC_CFG_HEAP_SIZE (0x2000 * sizeof(umm_block))
+
+static char default_umm_heap[UMM_MALLOC_CFG_HEAP_SIZE] __attribute__((aligned(16)));
+
+#define UMM_MALLOC_CFG_HEAP_ADDR default_umm_heap
 
 /* ------------------------------------------------------------------------- */
 
-umm_block *umm_heap = NULL;
-unsigned short int umm_numblocks = 0;
+static umm_heap_context umm_default_heap;
 
-#define UMM_NUMBLOCKS (umm_numblocks)
+#define UMM_NUMBLOCKS (heap->numblocks)
 
 /* ------------------------------------------------------------------------ */
 
-#define UMM_BLOCK(b)  (umm_heap[b])
+/*
+ * Every function below works on the heap passed in as `heap`, the macros
+ * pick it up from there.
+ */
+
+#define UMM_BLOCK(b)  (heap->blocks[b])
 
 #define UMM_NBLOCK(b) (UMM_BLOCK(b).header.used.next)
 #define UMM_PBLOCK(b) (UMM_BLOCK(b).header.used.prev)
@@ -128,7 +168,53 @@ unsigned short int umm_numblocks = 0;
 
 /* ------------------------------------------------------------------------ */
 
-static unsigned short int umm_blocks( size_t size ) {
+#ifdef UMM_STATS
+
+static unsigned int umm_stats_bucket( size_t size ) {
+  unsigned int b = 0;
+
+  while( b < UMM_STATS_BUCKETS - 1 && size > ((size_t)8 << b) )
+    b++;
+
+  return( b );
+}
+
+static unsigned long long umm_stats_now( void ) {
+#ifdef __KERNEL__
+  return( mach_absolute_time() );
+#else
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return( (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+#endif
+}
+
+static void umm_stats_used( umm_heap_context *heap, long blocks ) {
+  heap->stats.used_blocks += blocks;
+
+  if( heap->stats.used_blocks > heap->stats.peak_used_blocks )
+    heap->stats.peak_used_blocks = heap->stats.used_blocks;
+}
+
+#define UMM_STATS_COUNT(counter, size) (heap->stats.counter[umm_stats_bucket(size)]++)
+#define UMM_STATS_FAILED()             (heap->stats.failed++)
+#define UMM_STATS_USED(blocks)         umm_stats_used( heap, (long)(blocks) )
+#define UMM_STATS_TIMER(t)             unsigned long long t = umm_stats_now()
+#define UMM_STATS_TIME(counter, t)     (heap->stats.counter##_time += umm_stats_now() - (t), \
+                                        heap->stats.counter++)
+#else
+#define UMM_STATS_COUNT(counter, size) do { } while (0)
+#define UMM_STATS_FAILED()             do { } while (0)
+#define UMM_STATS_USED(blocks)         do { } while (0)
+#define UMM_STATS_TIMER(t)             do { } while (0)
+#define UMM_STATS_TIME(counter, t)     do { } while (0)
+#endif
+
+/* ------------------------------------------------------------------------ */
+
+static umm_blockno_t umm_blocks( size_t size ) {
 
   /*
    * The calculation of the block size is not too difficult, but there are
@@ -149,9 +235,23 @@ static unsigned short int umm_blocks( size_t size ) {
 
   size -= ( 1 + (sizeof(((umm_block *)0)->body)) );
 
+  /* Too big for any heap, umm_malloc() will simply fail to find a block */
+
+  if( size/(sizeof(umm_block)) >= UMM_BLOCKNO_MASK )
+    return( UMM_BLOCKNO_MASK );
+
   return( 2 + size/(sizeof(umm_block)) );
 }
 
+/* ------------------------------------------------------------------------ */
+
+static umm_blockno_t umm_block_of( umm_heap_context *heap, void *ptr ) {
+
+  /* Figure out which block we're in. Note the use of truncated division... */
+
+  return ((unsigned long)(((char *)ptr)-(char *)(&(heap->blocks[0]))))/sizeof(umm_block);
+}
+
 /* ------------------------------------------------------------------------ */
 /*
  * Split the block `c` into two blocks: `c` and `c + blocks`.
@@ -161,9 +261,10 @@ static unsigned short int umm_blocks( size_t size ) {
  *
  * Note that free pointers are NOT modified by this function.
  */
-static void umm_split_block( unsigned short int c,
-    unsigned short int blocks,
-    unsigned short int new_freemask ) {
+static void umm_split_block( umm_heap_context *heap,
+    umm_blockno_t c,
+    umm_blockno_t blocks,
+    umm_blockno_t new_freemask ) {
 
   UMM_NBLOCK(c+blocks) = (UMM_NBLOCK(c) & UMM_BLOCKNO_MASK) | new_freemask;
   UMM_PBLOCK(c+blocks) = c;
@@ -174,7 +275,7 @@ static void umm_split_block( unsigned short int c,
 
 /* ------------------------------------------------------------------------ */
 
-static void umm_disconnect_from_free_list( unsigned short int c ) {
+static void umm_disconnect_from_free_list( umm_heap_context *heap, umm_blockno_t c ) {
   /* Disconnect this block from the FREE list */
 
   UMM_NFREE(UMM_PFREE(c)) = UMM_NFREE(c);
@@ -190,7 +291,9 @@ static void umm_disconnect_from_free_list( unsigned short int c ) {
  * have the UMM_FREELIST_MASK bit set!
  */
 
-static void umm_assimilate_up( unsigned short int c ) {
+static void umm_assimilate_up( umm_heap_context *heap, umm_blockno_t c ) {
+
+  UMM_STATS_TIMER( start );
 
   if( UMM_NBLOCK(UMM_NBLOCK(c)) & UMM_FREELIST_MASK ) {
     /*
@@ -202,13 +305,15 @@ static void umm_assimilate_up( unsigned short int c ) {
 
     /* Disconnect the next block from the FREE list */
 
-    umm_disconnect_from_free_list( UMM_NBLOCK(c) );
+    umm_disconnect_from_free_list( heap, UMM_NBLOCK(c) );
 
     /* Assimilate the next block with this one */
 
     UMM_PBLOCK(UMM_NBLOCK(UMM_NBLOCK(c)) & UMM_BLOCKNO_MASK) = c;
     UMM_NBLOCK(c) = UMM_NBLOCK(UMM_NBLOCK(c)) & UMM_BLOCKNO_MASK;
   }
+
+  UMM_STATS_TIME( assimilate_up, start );
 }
 
 /* ------------------------------------------------------------------------
@@ -216,30 +321,63 @@ static void umm_assimilate_up( unsigned short int c ) {
  * have the UMM_FREELIST_MASK bit set!
  */
 
-static unsigned short int umm_assimilate_down( unsigned short int c, unsigned short int freemask ) {
+static umm_blockno_t umm_assimilate_down( umm_heap_context *heap, umm_blockno_t c, umm_blockno_t freemask ) {
+
+  UMM_STATS_TIMER( start );
 
   UMM_NBLOCK(UMM_PBLOCK(c)) = UMM_NBLOCK(c) | freemask;
   UMM_PBLOCK(UMM_NBLOCK(c)) = UMM_PBLOCK(c);
 
+  UMM_STATS_TIME( assimilate_down, start );
+
   return( UMM_PBLOCK(c) );
 }
 
 /* ------------------------------------------------------------------------- */
 
-void umm_init( void ) {
+void umm_init_heap( umm_heap_context *heap, void *addr, size_t size ) {
   /* init heap pointer and size, and memset it to 0 */
-  umm_heap = (umm_block *)UMM_MALLOC_CFG_HEAP_ADDR;
-  umm_numblocks = (UMM_MALLOC_CFG_HEAP_SIZE / sizeof(umm_block));
-  memset(umm_heap, 0x00, UMM_MALLOC_CFG_HEAP_SIZE);
+  heap->blocks = (umm_block *)addr;
+  heap->numblocks = 0;
+
+#ifdef UMM_STATS
+  memset( &heap->stats, 0x00, sizeof(umm_stats) );
+#endif
+
+  /* The free list head, one free block and the end marker at the very least */
+
+  if( (void *)NULL == addr || size / sizeof(umm_block) < 3 ) {
+    DBGLOG_DEBUG( "heap of %lu bytes is too small\n", (unsigned long)size );
+
+    heap->blocks = NULL;
+
+    return;
+  }
+
+  if( !umm_lock_init( &heap->lock ) ) {
+    DBGLOG_DEBUG( "failed to allocate the heap lock\n" );
+
+    heap->blocks = NULL;
+
+    return;
+  }
+
+  /* Anything past the largest block index is simply left unused */
+
+  if( size / sizeof(umm_block) > UMM_BLOCKNO_MASK )
+    size = (size_t)UMM_BLOCKNO_MASK * sizeof(umm_block);
+
+  heap->numblocks = (umm_blockno_t)(size / sizeof(umm_block));
+  memset(heap->blocks, 0x00, (size_t)heap->numblocks * sizeof(umm_block));
 
   /* setup initial blank heap structure */
   {
     /* index of the 0th `umm_block` */
-    const unsigned short int block_0th = 0;
+    const umm_blockno_t block_0th = 0;
     /* index of the 1st `umm_block` */
-    const unsigned short int block_1th = 1;
+    const umm_blockno_t block_1th = 1;
     /* index of the latest `umm_block` */
-    const unsigned short int block_last = UMM_NUMBLOCKS - 1;
+    const umm_blockno_t block_last = UMM_NUMBLOCKS - 1;
 
     /* setup the 0th `umm_block`, which just points to the 1st */
     UMM_NBLOCK(block_0th) = block_1th;
@@ -282,41 +420,37 @@ void umm_init( void ) {
   }
 }
 
-/* ------------------------------------------------------------------------ */
-
-void umm_free( void *ptr ) {
-
-  unsigned short int c;
+/* ------------------------------------------------------------------------- */
 
-  /* If we're being asked to free a NULL pointer, well that's just silly! */
+void umm_destroy_heap( umm_heap_context *heap ) {
+  if( (umm_block *)NULL == heap->blocks )
+    return;
 
-  if( (void *)0 == ptr ) {
-    DBGLOG_DEBUG( "free a null pointer -> do nothing\n" );
+  umm_lock_destroy( &heap->lock );
 
-    return;
-  }
+  heap->blocks = NULL;
+  heap->numblocks = 0;
+}
 
-  /*
-   * FIXME: At some point it might be a good idea to add a check to make sure
-   *        that the pointer we're being asked to free up is actually within
-   *        the umm_heap!
-   *
-   * NOTE:  See the new umm_info() function that you can use to see if a ptr is
-   *        on the free list!
-   */
+/* ------------------------------------------------------------------------
+ * The umm_free_core() and umm_malloc_core() functions expect the caller to
+ * hold the heap lock, so that realloc() and the batch functions can call
+ * them without taking it again.
+ */
 
-  /* Protect the critical section... */
-  UMM_CRITICAL_ENTRY();
+static void umm_free_core( umm_heap_context *heap, void *ptr ) {
 
-  /* Figure out which block we're in. Note the use of truncated division... */
+  umm_blockno_t c;
 
-  c = ((unsigned long)(((char *)ptr)-(char *)(&(umm_heap[0]))))/sizeof(umm_block);
+  c = umm_block_of( heap, ptr );
 
   DBGLOG_DEBUG( "Freeing block %6i\n", c );
 
+  UMM_STATS_USED( -(long)(UMM_NBLOCK(c) - c) );
+
   /* Now let's assimilate this block with the next one if possible. */
 
-  umm_assimilate_up( c );
+  umm_assimilate_up( heap, c );
 
   /* Then assimilate with the previous block if possible */
 
@@ -324,7 +458,7 @@ void umm_free( void *ptr ) {
 
     DBGLOG_DEBUG( "Assimilate down to next block, which is FREE\n" );
 
-    /* c = */ umm_assimilate_down(c, UMM_FREELIST_MASK);
+    /* c = */ umm_assimilate_down(heap, c, UMM_FREELIST_MASK);
   } else {
     /*
      * The previous block is not a free block, so add this one to the head
@@ -340,41 +474,18 @@ void umm_free( void *ptr ) {
 
     UMM_NBLOCK(c)          |= UMM_FREELIST_MASK;
   }
-
-  /* Release the critical section... */
-  UMM_CRITICAL_EXIT();
 }
 
 /* ------------------------------------------------------------------------ */
 
-void *umm_malloc( size_t size ) {
-  unsigned short int blocks;
-  unsigned short int blockSize = 0;
+static void *umm_malloc_core( umm_heap_context *heap, size_t size ) {
+  umm_blockno_t blocks;
+  umm_blockno_t blockSize = 0;
 
-  unsigned short int bestSize;
-  unsigned short int bestBlock;
+  umm_blockno_t bestSize;
+  umm_blockno_t bestBlock;
 
-  unsigned short int cf;
-
-  if (umm_heap == NULL) {
-    umm_init();
-  }
-
-  /*
-   * the very first thing we do is figure out if we're being asked to allocate
-   * a size of 0 - and if we are we'll simply return a null pointer. if not
-   * then reduce the size by 1 byte so that the subsequent calculations on
-   * the number of blocks to allocate are easier...
-   */
-
-  if( 0 == size ) {
-    DBGLOG_DEBUG( "malloc a block of 0 bytes -> do nothing\n" );
-
-    return( (void *)NULL );
-  }
-
-  /* Protect the critical section... */
-  UMM_CRITICAL_ENTRY();
+  umm_blockno_t cf;
 
   blocks = umm_blocks( size );
 
@@ -389,7 +500,7 @@ void *umm_malloc( size_t size ) {
   cf = UMM_NFREE(0);
 
   bestBlock = UMM_NFREE(0);
-  bestSize  = 0x7FFF;
+  bestSize  = UMM_BLOCKNO_MASK;
 
   while( cf ) {
     blockSize = (UMM_NBLOCK(cf) & UMM_BLOCKNO_MASK) - cf;
@@ -414,7 +525,7 @@ void *umm_malloc( size_t size ) {
     cf = UMM_NFREE(cf);
   }
 
-  if( 0x7FFF != bestSize ) {
+  if( UMM_BLOCKNO_MASK != bestSize ) {
     cf        = bestBlock;
     blockSize = bestSize;
   }
@@ -433,7 +544,7 @@ void *umm_malloc( size_t size ) {
 
       /* Disconnect this block from the FREE list */
 
-      umm_disconnect_from_free_list( cf );
+      umm_disconnect_from_free_list( heap, cf );
 
     } else {
       /* It's not an exact fit and we need to split off a block. */
@@ -443,7 +554,7 @@ void *umm_malloc( size_t size ) {
        * split current free block `cf` into two blocks. The first one will be
        * returned to user, so it's not free, and the second one will be free.
        */
-      umm_split_block( cf, blocks, UMM_FREELIST_MASK /*new block is free*/ );
+      umm_split_block( heap, cf, blocks, UMM_FREELIST_MASK /*new block is free*/ );
 
       /*
        * `umm_split_block()` does not update the free pointers (it affects
@@ -465,35 +576,166 @@ void *umm_malloc( size_t size ) {
 
     DBGLOG_DEBUG(  "Can't allocate %5i blocks\n", blocks );
 
-    /* Release the critical section... */
-    UMM_CRITICAL_EXIT();
+    UMM_STATS_FAILED();
 
     return( (void *)NULL );
   }
 
+  UMM_STATS_USED( blocks );
+
+  return( (void *)&UMM_DATA(cf) );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void umm_free_heap( umm_heap_context *heap, void *ptr ) {
+
+  /* If we're being asked to free a NULL pointer, well that's just silly! */
+
+  if( (void *)0 == ptr ) {
+    DBGLOG_DEBUG( "free a null pointer -> do nothing\n" );
+
+    return;
+  }
+
+  /*
+   * FIXME: At some point it might be a good idea to add a check to make sure
+   *        that the pointer we're being asked to free up is actually within
+   *        the heap! umm_heap_contains() does that for callers juggling
+   *        several heaps.
+   *
+   * NOTE:  See the new umm_info() function that you can use to see if a ptr is
+   *        on the free list!
+   */
+
+  /* Protect the critical section... */
+  UMM_CRITICAL_ENTRY();
+
+  UMM_STATS_COUNT( frees, umm_usable_size( heap, ptr ) );
+
+  umm_free_core( heap, ptr );
+
   /* Release the critical section... */
   UMM_CRITICAL_EXIT();
+}
 
-  return( (void *)&UMM_DATA(cf) );
+/* ------------------------------------------------------------------------ */
+
+void *umm_malloc_heap( umm_heap_context *heap, size_t size ) {
+  void *ptr;
+
+  /*
+   * the very first thing we do is figure out if we're being asked to allocate
+   * a size of 0 - and if we are we'll simply return a null pointer. if not
+   * then reduce the size by 1 byte so that the subsequent calculations on
+   * the number of blocks to allocate are easier...
+   */
+
+  if( 0 == size || (umm_block *)NULL == heap->blocks ) {
+    DBGLOG_DEBUG( "malloc a block of 0 bytes -> do nothing\n" );
+
+    return( (void *)NULL );
+  }
+
+  /* Protect the critical section... */
+  UMM_CRITICAL_ENTRY();
+
+  UMM_STATS_COUNT( mallocs, size );
+
+  ptr = umm_malloc_core( heap, size );
+
+  /* Release the critical section... */
+  UMM_CRITICAL_EXIT();
+
+  return( ptr );
 }
 
 /* ------------------------------------------------------------------------ */
 
-void *umm_realloc( void *ptr, size_t size ) {
+size_t umm_malloc_batch( umm_heap_context *heap, size_t size, void **ptrs, size_t count ) {
+  size_t i;
 
-  unsigned short int blocks;
-  unsigned short int blockSize;
-  unsigned short int prevBlockSize = 0;
-  unsigned short int nextBlockSize = 0;
+  if( 0 == size || (umm_block *)NULL == heap->blocks )
+    return( 0 );
 
-  unsigned short int c;
+  /* Protect the critical section... */
+  UMM_CRITICAL_ENTRY();
 
-  size_t curSize;
+  for( i = 0; i < count; i++ ) {
+    UMM_STATS_COUNT( mallocs, size );
 
-  if (umm_heap == NULL) {
-    umm_init();
+    if( (void *)NULL == (ptrs[i] = umm_malloc_core( heap, size )) )
+      break;
   }
 
+  /* Release the critical section... */
+  UMM_CRITICAL_EXIT();
+
+  return( i );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void umm_free_batch( umm_heap_context *heap, void **ptrs, size_t count ) {
+  size_t i;
+
+  /* Protect the critical section... */
+  UMM_CRITICAL_ENTRY();
+
+  for( i = 0; i < count; i++ ) {
+    if( ptrs[i] ) {
+      UMM_STATS_COUNT( frees, umm_usable_size( heap, ptrs[i] ) );
+
+      umm_free_core( heap, ptrs[i] );
+    }
+  }
+
+  /* Release the critical section... */
+  UMM_CRITICAL_EXIT();
+}
+
+/* ------------------------------------------------------------------------ */
+
+int umm_heap_contains( umm_heap_context *heap, void *ptr ) {
+  return( (umm_block *)NULL != heap->blocks &&
+          (char *)ptr >= (char *)&UMM_BLOCK(1) &&
+          (char *)ptr <  (char *)&UMM_BLOCK(UMM_NUMBLOCKS - 1) );
+}
+
+/* ------------------------------------------------------------------------ */
+
+size_t umm_blocks_usable_size( umm_blockno_t blocks ) {
+  return( (blocks*sizeof(umm_block))-(sizeof(((umm_block *)0)->header)) );
+}
+
+/* ------------------------------------------------------------------------ */
+
+size_t umm_usable_size( umm_heap_context *heap, void *ptr ) {
+  umm_blockno_t c;
+
+  if( (void *)NULL == ptr )
+    return( 0 );
+
+  c = umm_block_of( heap, ptr );
+
+  /* The block is in use, so the free bit is not set :-) */
+
+  return( umm_blocks_usable_size( UMM_NBLOCK(c) - c ) );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void *umm_realloc_heap( umm_heap_context *heap, void *ptr, size_t size ) {
+
+  umm_blockno_t blocks;
+  umm_blockno_t blockSize;
+  umm_blockno_t prevBlockSize = 0;
+  umm_blockno_t nextBlockSize = 0;
+
+  umm_blockno_t c;
+
+  size_t curSize;
+
   /*
    * This code looks after the case of a NULL value for ptr. The ANSI C
    * standard says that if ptr is NULL and size is non-zero, then we've
@@ -505,7 +747,7 @@ void *umm_realloc( void *ptr, size_t size ) {
   if( ((void *)NULL == ptr) ) {
     DBGLOG_DEBUG( "realloc the NULL pointer - call malloc()\n" );
 
-    return( umm_malloc(size) );
+    return( umm_malloc_heap(heap, size) );
   }
 
   /*
@@ -517,7 +759,7 @@ void *umm_realloc( void *ptr, size_t size ) {
   if( 0 == size ) {
     DBGLOG_DEBUG( "realloc to 0 size, just free the block\n" );
 
-    umm_free( ptr );
+    umm_free_heap( heap, ptr );
 
     return( (void *)NULL );
   }
@@ -533,9 +775,12 @@ void *umm_realloc( void *ptr, size_t size ) {
 
   blocks = umm_blocks( size );
 
-  /* Figure out which block we're in. Note the use of truncated division... */
+  /* Protect the critical section... */
+  UMM_CRITICAL_ENTRY();
+
+  UMM_STATS_COUNT( reallocs, size );
 
-  c = ((unsigned long)(((char *)ptr)-(char *)(&(umm_heap[0]))))/sizeof(umm_block);
+  c = umm_block_of( heap, ptr );
 
   /* Figure out how big this block is ... the free bit is not set :-) */
 
@@ -543,10 +788,7 @@ void *umm_realloc( void *ptr, size_t size ) {
 
   /* Figure out how many bytes are in this block */
 
-  curSize   = (blockSize*sizeof(umm_block))-(sizeof(((umm_block *)0)->header));
-
-  /* Protect the critical section... */
-  UMM_CRITICAL_ENTRY();
+  curSize   = umm_blocks_usable_size( blockSize );
 
   /* Now figure out if the previous and/or next blocks are free as well as
    * their sizes - this will help us to minimize special code later when we
@@ -595,30 +837,33 @@ void *umm_realloc( void *ptr, size_t size ) {
         /* This space intentionally left blank */
     } else if ((blockSize + nextBlockSize) >= blocks) {
         DBGLOG_DEBUG( "realloc using next block - %i\n", blocks );
-        umm_assimilate_up( c );
+        umm_assimilate_up( heap, c );
+        UMM_STATS_USED( nextBlockSize );
         blockSize += nextBlockSize;
     } else if ((prevBlockSize + blockSize) >= blocks) {
         DBGLOG_DEBUG( "realloc using prev block - %i\n", blocks );
-        umm_disconnect_from_free_list( UMM_PBLOCK(c) );
-        c = umm_assimilate_down(c, 0);
+        umm_disconnect_from_free_list( heap, UMM_PBLOCK(c) );
+        c = umm_assimilate_down(heap, c, 0);
         memmove( (void *)&UMM_DATA(c), ptr, curSize );
         ptr = (void *)&UMM_DATA(c);
+        UMM_STATS_USED( prevBlockSize );
         blockSize += prevBlockSize;
     } else if ((prevBlockSize + blockSize + nextBlockSize) >= blocks) {
         DBGLOG_DEBUG( "realloc using prev and next block - %i\n", blocks );
-        umm_assimilate_up( c );
-        umm_disconnect_from_free_list( UMM_PBLOCK(c) );
-        c = umm_assimilate_down(c, 0);
+        umm_assimilate_up( heap, c );
+        umm_disconnect_from_free_list( heap, UMM_PBLOCK(c) );
+        c = umm_assimilate_down(heap, c, 0);
         memmove( (void *)&UMM_DATA(c), ptr, curSize );
         ptr = (void *)&UMM_DATA(c);
+        UMM_STATS_USED( prevBlockSize + nextBlockSize );
         blockSize += (prevBlockSize + nextBlockSize);
     } else {
         DBGLOG_DEBUG( "realloc a completely new block %i\n", blocks );
         void *oldptr = ptr;
-        if( (ptr = umm_malloc( size )) ) {
+        if( (ptr = umm_malloc_core( heap, size )) ) {
             DBGLOG_DEBUG( "realloc %i to a bigger block %i, copy, and free the old\n", blockSize, blocks );
             memcpy( ptr, oldptr, curSize );
-            umm_free( oldptr );
+            umm_free_core( heap, oldptr );
         } else {
             DBGLOG_DEBUG( "realloc %i to a bigger block %i failed - return NULL and leave the old block!\n", blockSize, blocks );
             /* This space intentionally left blnk */
@@ -632,8 +877,8 @@ void *umm_realloc( void *ptr, size_t size ) {
 
     if (blockSize > blocks ) {
         DBGLOG_DEBUG( "split and free %i blocks from %i\n", blocks, blockSize );
-        umm_split_block( c, blocks, 0 );
-        umm_free( (void *)&UMM_DATA(c+blocks) );
+        umm_split_block( heap, c, blocks, 0 );
+        umm_free_core( heap, (void *)&UMM_DATA(c+blocks) );
     }
 
     /* Release the critical section... */
@@ -644,10 +889,15 @@ void *umm_realloc( void *ptr, size_t size ) {
 
 /* ------------------------------------------------------------------------ */
 
-void *umm_calloc( size_t num, size_t item_size ) {
+void *umm_calloc_heap( umm_heap_context *heap, size_t num, size_t item_size ) {
   void *ret;
 
-  ret = umm_malloc((size_t)(item_size * num));
+  /* Don't let num * item_size wrap around into a tiny allocation */
+
+  if( item_size && num > ((size_t)-1) / item_size )
+    return( (void *)NULL );
+
+  ret = umm_malloc_heap(heap, (size_t)(item_size * num));
 
   if (ret)
       memset(ret, 0x00, (size_t)(item_size * num));
@@ -655,5 +905,104 @@ void *umm_calloc( size_t num, size_t item_size ) {
   return ret;
 }
 
+#ifdef UMM_STATS
+
+/* ------------------------------------------------------------------------ */
+
+void umm_heap_stats( umm_heap_context *heap, umm_stats *stats ) {
+  umm_blockno_t cf;
+  umm_blockno_t blockSize;
+
+  memset( stats, 0x00, sizeof(umm_stats) );
+
+  if( (umm_block *)NULL == heap->blocks )
+    return;
+
+  /* Protect the critical section... */
+  UMM_CRITICAL_ENTRY();
+
+  memcpy( stats, &heap->stats, sizeof(umm_stats) );
+
+  stats->block_size = sizeof(umm_block);
+  stats->total_blocks = UMM_NUMBLOCKS;
+
+  stats->free_blocks = 0;
+  stats->free_list_length = 0;
+  stats->largest_free_block = 0;
+
+  for( cf = UMM_NFREE(0); cf; cf = UMM_NFREE(cf) ) {
+    blockSize = (UMM_NBLOCK(cf) & UMM_BLOCKNO_MASK) - cf;
+
+    stats->free_blocks += blockSize;
+    stats->free_list_length++;
+
+    if( blockSize > stats->largest_free_block )
+      stats->largest_free_block = blockSize;
+  }
+
+  /* Release the critical section... */
+  UMM_CRITICAL_EXIT();
+
+  stats->fragmentation = stats->free_blocks ?
+    100 - (unsigned int)((unsigned long long)stats->largest_free_block * 100 / stats->free_blocks) : 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void umm_heap_stats_reset( umm_heap_context *heap ) {
+  long used;
+
+  /* Protect the critical section... */
+  UMM_CRITICAL_ENTRY();
+
+  /* Blocks still in use stay accounted for, the high-water mark restarts */
+
+  used = heap->stats.used_blocks;
+
+  memset( &heap->stats, 0x00, sizeof(umm_stats) );
+
+  heap->stats.used_blocks = used;
+  heap->stats.peak_used_blocks = used;
+
+  /* Release the critical section... */
+  UMM_CRITICAL_EXIT();
+}
+
+#endif
+
+/* ------------------------------------------------------------------------ */
+
+void umm_init( void ) {
+  umm_init_heap( &umm_default_heap, UMM_MALLOC_CFG_HEAP_ADDR, UMM_MALLOC_CFG_HEAP_SIZE );
+}
+
+void umm_deinit( void ) {
+  umm_destroy_heap( &umm_default_heap );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void *umm_malloc( size_t size ) {
+  return umm_malloc_heap( &umm_default_heap, size );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void *umm_calloc( size_t num, size_t item_size ) {
+  return umm_calloc_heap( &umm_default_heap, num, item_size );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void *umm_realloc( void *ptr, size_t size ) {
+  return umm_realloc_heap( &umm_default_heap, ptr, size );
+}
+
+/* ------------------------------------------------------------------------ */
+
+void umm_free( void *ptr ) {
+  umm_free_heap( &umm_default_heap, ptr );
+}
+
 /* ------------------------------------------------------------------------ */
 
@@ -34,9 +34,180 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 /* ------------------------------------------------------------------------ */
 
+/*
+ * Block indices are 32 bits wide unless UMM_BLOCKNO_16 is defined, which
+ * brings back the original 8 byte blocks but limits a heap to 32767 of them.
+ */
+
+#ifdef UMM_BLOCKNO_16
+typedef unsigned short int umm_blockno_t;
+#else
+typedef unsigned int umm_blockno_t;
+#endif
+
+/*
+ * Every heap is independent, with its own free list and its own lock, so
+ * callers that spread their allocations over several heaps don't serialize
+ * on a single one.
+ *
+ * The kernel build uses an IOSimpleLock, which disables preemption while it
+ * is held so a lock holder can't be scheduled out from under the spinning
+ * waiters. The host build, which only backs the tests and benchmarks, spins
+ * on a plain word.
+ */
+
+#ifdef __KERNEL__
+
+#include <IOKit/IOLocks.h>
+
+typedef IOSimpleLock *umm_lock_t;
+
+static inline int umm_lock_init( umm_lock_t *lock ) {
+  *lock = IOSimpleLockAlloc();
+
+  return( NULL != *lock );
+}
+
+static inline void umm_lock_destroy( umm_lock_t *lock ) {
+  if( *lock )
+    IOSimpleLockFree( *lock );
+
+  *lock = NULL;
+}
+
+static inline void umm_lock_acquire( umm_lock_t *lock ) {
+  IOSimpleLockLock( *lock );
+}
+
+static inline void umm_lock_release( umm_lock_t *lock ) {
+  IOSimpleLockUnlock( *lock );
+}
+
+#else
+
+typedef volatile int umm_lock_t;
+
+static inline int umm_lock_init( umm_lock_t *lock ) {
+  *lock = 0;
+
+  return( 1 );
+}
+
+static inline void umm_lock_destroy( umm_lock_t *lock ) {
+  (void)lock;
+}
+
+static inline void umm_lock_acquire( umm_lock_t *lock ) {
+  while( __atomic_exchange_n( lock, 1, __ATOMIC_ACQUIRE ) ) {
+    while( __atomic_load_n( lock, __ATOMIC_RELAXED ) )
+      ;
+  }
+}
+
+static inline void umm_lock_release( umm_lock_t *lock ) {
+  __atomic_store_n( lock, 0, __ATOMIC_RELEASE );
+}
+
+#endif
+
+#ifdef UMM_STATS
+
+/*
+ * Optional instrumentation, compiled out completely unless UMM_STATS is
+ * defined for every file that includes this header.
+ *
+ * Requests are counted in power of two buckets, bucket b holds the sizes
+ * up to 8 << b bytes and the last one everything larger. Frees only know
+ * the usable size of the block, so they can land a bucket higher than the
+ * malloc they pair with. Times are in
+ * mach_absolute_time() units in the kernel and nanoseconds on the host.
+ */
+
+#define UMM_STATS_BUCKETS 16
+
+typedef struct umm_stats_t {
+  unsigned long mallocs[UMM_STATS_BUCKETS];
+  unsigned long frees[UMM_STATS_BUCKETS];
+  unsigned long reallocs[UMM_STATS_BUCKETS];
+  unsigned long failed;
+
+  long used_blocks;
+  long peak_used_blocks;
+
+  unsigned long assimilate_up;
+  unsigned long assimilate_down;
+  unsigned long long assimilate_up_time;
+  unsigned long long assimilate_down_time;
+
+  /* Filled in from a walk of the heap by umm_heap_stats() */
+
+  size_t block_size;
+  umm_blockno_t total_blocks;
+  umm_blockno_t free_blocks;
+  umm_blockno_t free_list_length;
+  umm_blockno_t largest_free_block;
+
+  /* Percentage of free blocks outside the largest free block */
+
+  unsigned int fragmentation;
+} umm_stats;
+
+#endif
+
+typedef struct umm_heap_context_t {
+  struct umm_block_t *blocks;
+  umm_blockno_t numblocks;
+  umm_lock_t lock;
+#ifdef UMM_STATS
+  umm_stats stats;
+#endif
+} umm_heap_context;
+
+/*
+ * Initialize a heap once before using it, a heap that failed to initialize
+ * has no blocks and every allocation from it fails. umm_destroy_heap()
+ * releases the lock, the memory itself belongs to the caller.
+ */
+
+void umm_init_heap(umm_heap_context *heap, void *addr, size_t size);
+void umm_destroy_heap(umm_heap_context *heap);
+void* umm_malloc_heap(umm_heap_context *heap, size_t size);
+void* umm_calloc_heap(umm_heap_context *heap, size_t num, size_t size);
+void* umm_realloc_heap(umm_heap_context *heap, void *ptr, size_t size);
+void umm_free_heap(umm_heap_context *heap, void *ptr);
+
+/*
+ * Allocate or free up to count blocks while taking the heap lock only once,
+ * returns the number of blocks that could be allocated.
+ */
+
+size_t umm_malloc_batch(umm_heap_context *heap, size_t size, void **ptrs, size_t count);
+void umm_free_batch(umm_heap_context *heap, void **ptrs, size_t count);
+
+int umm_heap_contains(umm_heap_context *heap, void *ptr);
+size_t umm_usable_size(umm_heap_context *heap, void *ptr);
+size_t umm_blocks_usable_size(umm_blockno_t blocks);
+
+#ifdef UMM_STATS
+void umm_heap_stats(umm_heap_context *heap, umm_stats *stats);
+void umm_heap_stats_reset(umm_heap_context *heap);
+#endif
+
+/* ------------------------------------------------------------------------ */
+
+/*
+ * The default heap, this is what capstone allocates from. umm_init() must
+ * run once, before anything allocates from it and before a second thread
+ * can, the kext does it from its start routine and umm_deinit() from its
+ * stop routine.
+ */
+
 void umm_init(void);
+void umm_deinit(void);
 void* umm_malloc(size_t size);
 void* umm_calloc(size_t num, size_t size);
 void* umm_realloc(void* ptr, size_t size);
@@ -0,0 +1,772 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include "arch.h"
+#include "buffer_task.h"
+#include "hook.h"
+#include "hook_batch.h"
+#include "patcher.h"
+#include "payload.h"
+
+namespace {
+
+using darwin::Hook;
+using darwin::HookBatch;
+using darwin::Patcher;
+using darwin::Payload;
+using xnu::BufferTask;
+
+static constexpr Size kTaskSize = 1 << 20;
+
+// the start of a kernelcache function, long enough to be overwritten by any branch we emit
+const UInt8 kFunctionX86_64[] = {
+    0x55,                                     // push rbp
+    0x48, 0x89, 0xe5,                         // mov rbp, rsp
+    0x41, 0x57,                               // push r15
+    0x41, 0x56,                               // push r14
+    0x53,                                     // push rbx
+    0x50,                                     // push rax
+    0x48, 0x89, 0xfb,                         // mov rbx, rdi
+    0x4c, 0x8b, 0x77, 0x08,                   // mov r14, qword ptr [rdi + 8]
+    0x4d, 0x85, 0xf6,                         // test r14, r14
+    0x74, 0x10,                               // je +0x10
+    0x48, 0x83, 0xc4, 0x08,                   // add rsp, 8
+    0x5b,                                     // pop rbx
+    0x41, 0x5e,                               // pop r14
+    0x41, 0x5f,                               // pop r15
+    0x5d,                                     // pop rbp
+    0xc3,                                     // ret
+};
+
+const UInt8 kFunctionArm64[] = {
+    0x7f, 0x23, 0x03, 0xd5, // pacibsp
+    0xf4, 0x4f, 0xbe, 0xa9, // stp x20, x19, [sp, #-0x20]!
+    0xfd, 0x7b, 0x01, 0xa9, // stp x29, x30, [sp, #0x10]
+    0xfd, 0x43, 0x00, 0x91, // add x29, sp, #0x10
+    0xf3, 0x03, 0x00, 0xaa, // mov x19, x0
+    0x08, 0x04, 0x40, 0xf9, // ldr x8, [x0, #8]
+    0xfd, 0x7b, 0x41, 0xa9, // ldp x29, x30, [sp, #0x10]
+    0xf4, 0x4f, 0xc2, 0xa8, // ldp x20, x19, [sp], #0x20
+    0xff, 0x0f, 0x5f, 0xd6, // retab
+};
+
+std::vector<UInt8> FunctionBytes() {
+  if (arch::GetCurrentArchitecture() == arch::ARCH_arm64) {
+    return std::vector<UInt8>(kFunctionArm64, kFunctionArm64 + sizeof(kFunctionArm64));
+  }
+  return std::vector<UInt8>(kFunctionX86_64, kFunctionX86_64 + sizeof(kFunctionX86_64));
+}
+
+TEST(BufferTaskTest, AllocatesPagesFirstFit) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  xnu::mach::VmAddress first = task.VmAllocate(100);
+  xnu::mach::VmAddress second = task.VmAllocate(100);
+  ASSERT_NE(first, 0);
+  ASSERT_NE(second, 0);
+  EXPECT_GT(second, first);
+  EXPECT_EQ(task.GetProtection(first), VM_PROT_READ | VM_PROT_WRITE);
+
+  task.VmDeallocate(first, 100);
+  EXPECT_EQ(task.VmAllocate(100), first);
+
+  // more than the whole region
+  EXPECT_EQ(task.VmAllocate(kTaskSize * 2), 0);
+  EXPECT_EQ(task.GetStats().allocations, 3);
+  EXPECT_EQ(task.GetStats().deallocations, 1);
+}
+
+TEST(BufferTaskTest, EnforcesProtection) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress function = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(function, 0);
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(function), code.data(), code.size()), 0);
+
+  UInt32 value = 0xdeadbeef;
+  task.SetEnforceProtection(true);
+  EXPECT_FALSE(task.Write(function, &value, sizeof(value)));
+  EXPECT_EQ(task.GetStats().protection_faults, 1);
+
+  EXPECT_TRUE(task.VmProtect(function, code.size(), VM_PROT_READ | VM_PROT_WRITE));
+  EXPECT_TRUE(task.Write(function, &value, sizeof(value)));
+  EXPECT_EQ(task.Read32(function), value);
+
+  // reads and writes never leave the region
+  EXPECT_FALSE(task.Read(task.GetBase() + task.GetSize() - 2, &value, sizeof(value)));
+  EXPECT_FALSE(task.Write(task.GetBase() - 2, &value, sizeof(value)));
+}
+
+TEST(BufferTaskTest, RemapsPagesOntoTheSameBytes) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Size page = getpagesize();
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress function = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(function, 0);
+
+  xnu::mach::VmAddress alias =
+      reinterpret_cast<xnu::mach::VmAddress>(task.VmRemap(function, page));
+  ASSERT_NE(alias, 0);
+  EXPECT_NE(alias, function);
+  EXPECT_EQ(task.GetProtection(alias), task.GetProtection(function));
+
+  // the alias can be made writable while the original stays executable
+  task.SetEnforceProtection(true);
+  ASSERT_TRUE(task.VmProtect(alias, page, VM_PROT_READ | VM_PROT_WRITE));
+  EXPECT_EQ(task.GetProtection(function), VM_PROT_READ | VM_PROT_EXECUTE);
+
+  UInt32 value = 0xdeadbeef;
+  EXPECT_FALSE(task.Write(function, &value, sizeof(value)));
+  EXPECT_TRUE(task.Write(alias, &value, sizeof(value)));
+  EXPECT_EQ(task.Read32(function), value);
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(function), &value, sizeof(value)), 0);
+
+  // deallocating the alias leaves the original alone
+  task.VmDeallocate(alias, page);
+  EXPECT_EQ(task.Read32(function), value);
+  EXPECT_EQ(task.VmRemap(function + 1, page), nullptr);
+}
+
+TEST(BufferTaskTest, SimulatesLatency) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  task.SetLatency(100000);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 10; i++) {
+    task.Read8(task.GetBase());
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_GE(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), 1000);
+  EXPECT_EQ(task.GetStats().reads, 10);
+}
+
+TEST(BufferTaskTest, ReadVCoalescesNearbyRanges) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  xnu::mach::VmAddress region = task.VmAllocate(0x10000);
+  ASSERT_NE(region, 0);
+
+  for (Size i = 0; i < 0x10000; i++) {
+    reinterpret_cast<UInt8 *>(region)[i] = i * 7;
+  }
+
+  UInt8 a[8], b[16], c[16], d[8];
+
+  // out of order, b and c overlap, and d is too far from the others to share their read
+  xnu::TaskIoVector vectors[] = {
+      {region + 0x8000, sizeof(d), d},
+      {region + 0x100, sizeof(b), b},
+      {region + 0x10, sizeof(a), a},
+      {region + 0x108, sizeof(c), c},
+      {region + 0x200, 0, nullptr},
+  };
+
+  task.ResetStats();
+  ASSERT_TRUE(task.ReadV(vectors, sizeof(vectors) / sizeof(vectors[0])));
+  EXPECT_EQ(task.GetStats().reads, 2);
+  EXPECT_EQ(task.GetStats().bytes_read, 0x108 + sizeof(c) - 0x10 + sizeof(d));
+
+  EXPECT_EQ(memcmp(a, reinterpret_cast<void *>(region + 0x10), sizeof(a)), 0);
+  EXPECT_EQ(memcmp(b, reinterpret_cast<void *>(region + 0x100), sizeof(b)), 0);
+  EXPECT_EQ(memcmp(c, reinterpret_cast<void *>(region + 0x108), sizeof(c)), 0);
+  EXPECT_EQ(memcmp(d, reinterpret_cast<void *>(region + 0x8000), sizeof(d)), 0);
+}
+
+TEST(BufferTaskTest, ReadVFallsBackOverHoles) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Size page = getpagesize();
+
+  xnu::mach::VmAddress first = task.VmAllocate(page);
+  xnu::mach::VmAddress hole = task.VmAllocate(page);
+  xnu::mach::VmAddress last = task.VmAllocate(page);
+  ASSERT_EQ(hole, first + page);
+  ASSERT_EQ(last, hole + page);
+
+  memset(reinterpret_cast<void *>(first), 0x11, page);
+  memset(reinterpret_cast<void *>(last), 0x22, page);
+
+  task.VmDeallocate(hole, page);
+  task.SetEnforceProtection(true);
+
+  UInt8 a[16], b[16];
+
+  // close enough to be read as one span, which fails on the unmapped page between them
+  xnu::TaskIoVector vectors[] = {
+      {first + page - sizeof(a), sizeof(a), a},
+      {last, sizeof(b), b},
+  };
+
+  task.ResetStats();
+  ASSERT_TRUE(task.ReadV(vectors, 2));
+  EXPECT_EQ(task.GetStats().protection_faults, 1);
+  EXPECT_EQ(task.GetStats().reads, 2);
+  EXPECT_EQ(a[0], 0x11);
+  EXPECT_EQ(b[sizeof(b) - 1], 0x22);
+
+  // a range that is itself unmapped fails the call, the others are still read
+  memset(b, 0, sizeof(b));
+  vectors[0] = {hole, sizeof(a), a};
+  EXPECT_FALSE(task.ReadV(vectors, 2));
+  EXPECT_EQ(b[0], 0x22);
+}
+
+TEST(BufferTaskTest, WriteVMergesTouchingRanges) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  xnu::mach::VmAddress region = task.VmAllocate(0x1000);
+  ASSERT_NE(region, 0);
+
+  UInt8 a[8], b[8], c[4], d[4];
+  memset(a, 0xAA, sizeof(a));
+  memset(b, 0xBB, sizeof(b));
+  memset(c, 0xCC, sizeof(c));
+  memset(d, 0xDD, sizeof(d));
+
+  // a and b touch and c overlaps both, d leaves a gap that cannot be filled in
+  xnu::TaskIoVector vectors[] = {
+      {region + 0x8, sizeof(b), b},
+      {region + 0x6, sizeof(c), c},
+      {region, sizeof(a), a},
+      {region + 0x20, sizeof(d), d},
+  };
+
+  task.ResetStats();
+  ASSERT_TRUE(task.WriteV(vectors, 4));
+  EXPECT_EQ(task.GetStats().writes, 2);
+  EXPECT_EQ(task.GetStats().bytes_written, 0x10 + sizeof(d));
+
+  // overlapping bytes hold whatever was given last, not whatever sits at the higher address
+  const UInt8 expected[] = {0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+                            0xCC, 0xCC, 0xBB, 0xBB, 0xBB, 0xBB, 0xBB, 0xBB};
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(region), expected, sizeof(expected)), 0);
+  EXPECT_EQ(reinterpret_cast<UInt8 *>(region)[0x10], 0);
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(region + 0x20), d, sizeof(d)), 0);
+}
+
+TEST(BufferTaskTest, ReadStringDropsStaleWindow) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  xnu::mach::VmAddress region = task.VmAllocate(0x1000);
+  ASSERT_NE(region, 0);
+
+  strcpy(reinterpret_cast<char *>(region), "first");
+
+  char *string = task.Task::ReadString(region);
+  EXPECT_STREQ(string, "first");
+  free(string);
+
+  // changed behind the task's back, the window from the last call must not be reused
+  strcpy(reinterpret_cast<char *>(region), "second");
+
+  string = task.Task::ReadString(region);
+  EXPECT_STREQ(string, "second");
+  free(string);
+}
+
+TEST(BufferTaskTest, ReadsThroughPageCache) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  xnu::mach::VmAddress region = task.VmAllocate(0x4000);
+  ASSERT_NE(region, 0);
+  memset(reinterpret_cast<void *>(region), 0x5A, 0x4000);
+
+  task.EnablePageCache(16);
+  xnu::TaskPageCache *cache = task.GetPageCache();
+  ASSERT_NE(cache, nullptr);
+
+  // the first read pulls in the whole page, the next one in it never reaches the region
+  task.ResetStats();
+  EXPECT_EQ(task.Read64(region + 0x10), 0x5A5A5A5A5A5A5A5AULL);
+  EXPECT_EQ(task.Read64(region + 0x20), 0x5A5A5A5A5A5A5A5AULL);
+  EXPECT_EQ(cache->GetStats().misses, 1);
+  EXPECT_EQ(cache->GetStats().hits, 1);
+  EXPECT_EQ(task.GetStats().reads, 1);
+  EXPECT_EQ(task.GetStats().bytes_read, cache->GetPageSize());
+
+  // a read spanning two pages misses only on the new one
+  UInt8 span[0x20];
+  ASSERT_TRUE(task.Read(region + cache->GetPageSize() - 0x10, span, sizeof(span)));
+  EXPECT_EQ(cache->GetStats().misses, 2);
+  EXPECT_EQ(cache->GetStats().hits, 2);
+  EXPECT_EQ(cache->GetCount(), 2);
+
+  // every change through the task drops the pages it touched
+  task.Write64(region + 0x10, 0x1122334455667788ULL);
+  EXPECT_EQ(cache->GetCount(), 1);
+  EXPECT_EQ(task.Read64(region + 0x10), 0x1122334455667788ULL);
+  EXPECT_EQ(cache->GetStats().misses, 3);
+
+  EXPECT_TRUE(task.VmProtect(region, 0x1000, VM_PROT_READ));
+  EXPECT_EQ(cache->GetCount(), 1);
+  task.Read8(region);
+  EXPECT_EQ(cache->GetStats().misses, 4);
+
+  task.VmDeallocate(region, 0x4000);
+  EXPECT_EQ(cache->GetCount(), 0);
+  EXPECT_EQ(cache->GetStats().invalidations, 3);
+
+  task.DisablePageCache();
+  EXPECT_EQ(task.GetPageCache(), nullptr);
+}
+
+TEST(BufferTaskTest, HookInstallsInvalidatePageCache) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Patcher patcher;
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress function = task.LoadCode(code.data(), code.size());
+  xnu::mach::VmAddress replacement = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(function, 0);
+  ASSERT_NE(replacement, 0);
+
+  task.EnablePageCache();
+  xnu::TaskPageCache *cache = task.GetPageCache();
+  ASSERT_NE(cache, nullptr);
+
+  std::vector<UInt8> before(code.size());
+  ASSERT_TRUE(task.Read(function, before.data(), before.size()));
+  EXPECT_EQ(before, code);
+
+  // the patched prologue is what a read sees afterwards, not the cached original
+  Hook *hook = Hook::CreateHookForFunction(&task, &patcher, function);
+  hook->HookFunction(replacement);
+  ASSERT_EQ(hook->GetHooks().size(), 1);
+  EXPECT_GT(cache->GetStats().invalidations, 0);
+
+  std::vector<UInt8> patched(code.size());
+  ASSERT_TRUE(task.Read(function, patched.data(), patched.size()));
+  EXPECT_EQ(memcmp(patched.data(), reinterpret_cast<void *>(function), patched.size()), 0);
+  EXPECT_NE(patched, code);
+
+  hook->UninstallHook();
+
+  std::vector<UInt8> restored(code.size());
+  ASSERT_TRUE(task.Read(function, restored.data(), restored.size()));
+  EXPECT_EQ(restored, code);
+
+  patcher.RemoveHook(hook);
+}
+
+TEST(BufferTaskTest, InstallsAndUninstallsHook) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Patcher patcher;
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress function = task.LoadCode(code.data(), code.size());
+  xnu::mach::VmAddress replacement = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(function, 0);
+  ASSERT_NE(replacement, 0);
+
+  Hook *hook = Hook::CreateHookForFunction(&task, &patcher, function);
+  hook->HookFunction(replacement);
+  ASSERT_EQ(hook->GetHooks().size(), 1);
+
+  struct HookPatch *patch = hook->GetLatestRegisteredHook();
+  Size branch_size = hook->GetArchitecture()->GetBranchSize();
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(function), &patch->patch, branch_size), 0);
+
+  // the trampoline starts with the instructions the branch replaced
+  xnu::mach::VmAddress trampoline = hook->GetTrampoline();
+  ASSERT_TRUE(task.Contains(trampoline, patch->patch_size));
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(trampoline), code.data(), patch->patch_size), 0);
+  EXPECT_GE(patch->patch_size, branch_size);
+
+  hook->UninstallHook();
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(function), code.data(), code.size()), 0);
+  EXPECT_TRUE(hook->GetHooks().empty());
+
+  patcher.RemoveHook(hook);
+}
+
+TEST(BufferTaskTest, RetiresTrampolinesBeforeReuse) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Patcher patcher;
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress function = task.LoadCode(code.data(), code.size());
+  xnu::mach::VmAddress replacement = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(function, 0);
+  ASSERT_NE(replacement, 0);
+
+  Hook *hook = Hook::CreateHookForFunction(&task, &patcher, function);
+  hook->HookFunction(replacement);
+  xnu::mach::VmAddress first = hook->GetTrampoline();
+  ASSERT_NE(first, 0);
+
+  // a thread may still be inside the old trampoline, the next hook gets a different slot
+  hook->UninstallHook();
+  hook->HookFunction(replacement);
+  xnu::mach::VmAddress second = hook->GetTrampoline();
+  EXPECT_NE(second, first);
+
+  // once the delay has passed the retired slots are handed out again
+  patcher.GetTrampolineAllocator().SetRetireDelay(0);
+  hook->UninstallHook();
+  hook->HookFunction(replacement);
+  EXPECT_EQ(hook->GetTrampoline(), first);
+
+  hook->UninstallHook();
+  patcher.RemoveHook(hook);
+}
+
+TEST(BufferTaskTest, KeepsTrampolinePagesExecutable) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Patcher patcher;
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress first = task.LoadCode(code.data(), code.size());
+  xnu::mach::VmAddress second = task.LoadCode(code.data(), code.size());
+  xnu::mach::VmAddress replacement = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(first, 0);
+  ASSERT_NE(second, 0);
+  ASSERT_NE(replacement, 0);
+
+  // the functions themselves are patched in place, only the trampolines are of interest here
+  ASSERT_TRUE(task.VmProtect(first, code.size(),
+                             VM_PROT_READ | VM_PROT_WRITE | VM_PROT_EXECUTE));
+  ASSERT_TRUE(task.VmProtect(second, code.size(),
+                             VM_PROT_READ | VM_PROT_WRITE | VM_PROT_EXECUTE));
+  task.SetEnforceProtection(true);
+
+  Hook *first_hook = Hook::CreateHookForFunction(&task, &patcher, first);
+  first_hook->HookFunction(replacement);
+  xnu::mach::VmAddress trampoline = first_hook->GetTrampoline();
+  ASSERT_NE(trampoline, 0);
+  EXPECT_EQ(task.GetProtection(trampoline), VM_PROT_READ | VM_PROT_EXECUTE);
+
+  // the second trampoline shares the page of the first, which never stops being executable
+  Hook *second_hook = Hook::CreateHookForFunction(&task, &patcher, second);
+  second_hook->HookFunction(replacement);
+  xnu::mach::VmAddress next = second_hook->GetTrampoline();
+  ASSERT_NE(next, 0);
+  EXPECT_EQ((next ^ trampoline) & ~static_cast<xnu::mach::VmAddress>(getpagesize() - 1), 0);
+  EXPECT_EQ(task.GetProtection(trampoline), VM_PROT_READ | VM_PROT_EXECUTE);
+  EXPECT_EQ(task.GetStats().protection_faults, 0);
+
+  // both were written through the alias and read back through the executable mapping
+  struct HookPatch *patch = second_hook->GetLatestRegisteredHook();
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(trampoline), code.data(), patch->patch_size), 0);
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(next), code.data(), patch->patch_size), 0);
+
+  first_hook->UninstallHook();
+  second_hook->UninstallHook();
+  EXPECT_EQ(task.GetProtection(trampoline), VM_PROT_READ | VM_PROT_EXECUTE);
+  EXPECT_EQ(task.GetStats().protection_faults, 0);
+
+  patcher.RemoveHook(first_hook);
+  patcher.RemoveHook(second_hook);
+}
+
+TEST(BufferTaskTest, RegistersHooksOnce) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Patcher patcher;
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress function = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(function, 0);
+
+  // two hooks on the same function, the registry only has room for the first
+  Hook *first = Hook::CreateHookForFunction(&task, &patcher, function);
+  Hook *second = Hook::CreateHookForFunction(&task, &patcher, function);
+  ASSERT_NE(first, second);
+
+  patcher.RouteFunction(first);
+  patcher.RouteFunction(second);
+  patcher.RouteFunction(second);
+  patcher.RouteFunction(first);
+  EXPECT_EQ(patcher.GetHooks().size(), 2);
+  EXPECT_EQ(patcher.HookForFunction(function), first);
+
+  patcher.RemoveHook(second);
+  EXPECT_EQ(patcher.GetHooks().size(), 1);
+  patcher.RemoveHook(first);
+  EXPECT_TRUE(patcher.GetHooks().empty());
+}
+
+TEST(BufferTaskTest, FailedBatchLeavesTaskUntouched) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Patcher patcher;
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress function = task.LoadCode(code.data(), code.size());
+  xnu::mach::VmAddress replacement = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(function, 0);
+  ASSERT_NE(replacement, 0);
+
+  // a function on a page the batch cannot read
+  xnu::mach::VmAddress hidden = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(hidden, 0);
+  ASSERT_TRUE(task.VmProtect(hidden, code.size(), VM_PROT_NONE));
+  task.SetEnforceProtection(true);
+
+  Hook *hook = Hook::CreateHookForFunction(&task, &patcher, function);
+  Hook *unreadable = Hook::CreateHookForFunction(&task, &patcher, hidden);
+
+  task.ResetStats();
+
+  HookBatch batch(&patcher);
+  EXPECT_TRUE(batch.AddHook(hook, replacement));
+  EXPECT_FALSE(batch.AddHook(unreadable, replacement));
+  EXPECT_FALSE(batch.Commit());
+
+  // nothing was written, to the functions or to the trampolines, and nothing was registered
+  EXPECT_EQ(task.GetStats().writes, 0);
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(function), code.data(), code.size()), 0);
+  EXPECT_TRUE(hook->GetHooks().empty());
+  EXPECT_TRUE(unreadable->GetHooks().empty());
+  EXPECT_TRUE(patcher.GetHooks().empty());
+
+  delete hook;
+  delete unreadable;
+}
+
+TEST(BufferTaskTest, AbortDiscardsStagedPatches) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Patcher patcher;
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress function = task.LoadCode(code.data(), code.size());
+  xnu::mach::VmAddress replacement = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(function, 0);
+  ASSERT_NE(replacement, 0);
+
+  Hook *hook = Hook::CreateHookForFunction(&task, &patcher, function);
+
+  task.ResetStats();
+
+  HookBatch batch(&patcher);
+  ASSERT_TRUE(batch.AddHook(hook, replacement));
+  EXPECT_EQ(hook->GetHooks().size(), 1);
+  EXPECT_GT(batch.GetWriteCount(), 0);
+
+  batch.Abort();
+  EXPECT_EQ(batch.GetHookCount(), 0);
+  EXPECT_EQ(batch.GetWriteCount(), 0);
+  EXPECT_EQ(task.GetStats().writes, 0);
+  EXPECT_EQ(memcmp(reinterpret_cast<void *>(function), code.data(), code.size()), 0);
+  EXPECT_TRUE(hook->GetHooks().empty());
+  EXPECT_TRUE(patcher.GetHooks().empty());
+
+  // the batch is empty again, committing it now writes nothing
+  EXPECT_TRUE(batch.Commit());
+  EXPECT_EQ(task.GetStats().writes, 0);
+
+  delete hook;
+}
+
+TEST(BufferTaskTest, CommitsBatchOncePerRegion) {
+  static constexpr int kHooks = 16;
+
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Patcher patcher;
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress replacement = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(replacement, 0);
+
+  std::vector<xnu::mach::VmAddress> functions;
+  std::vector<Hook *> hooks;
+
+  for (int i = 0; i < kHooks; i++) {
+    functions.push_back(task.LoadCode(code.data(), code.size()));
+    ASSERT_NE(functions.back(), 0);
+    hooks.push_back(Hook::CreateHookForFunction(&task, &patcher, functions.back()));
+  }
+
+  task.ResetStats();
+
+  HookBatch batch(&patcher);
+  for (Hook *hook : hooks) {
+    ASSERT_TRUE(batch.AddHook(hook, replacement));
+  }
+
+  // staging only maps the trampoline page and its alias
+  UInt32 pages = patcher.GetTrampolineAllocator().GetPageCount();
+  EXPECT_EQ(task.GetStats().writes, 0);
+  EXPECT_EQ(task.GetStats().protection_changes, pages);
+
+  task.ResetStats();
+  ASSERT_TRUE(batch.Commit());
+
+  // one write per function and at most one per trampoline, with no protection changes at all
+  EXPECT_EQ(task.GetStats().protection_changes, 0);
+  EXPECT_LE(task.GetStats().writes, 2 * kHooks);
+  EXPECT_LT(pages, kHooks);
+  EXPECT_EQ(patcher.GetHooks().size(), kHooks);
+
+  for (int i = 0; i < kHooks; i++) {
+    struct HookPatch *patch = hooks[i]->GetLatestRegisteredHook();
+    ASSERT_NE(patch, nullptr);
+    EXPECT_EQ(memcmp(reinterpret_cast<void *>(functions[i]), &patch->patch,
+                     hooks[i]->GetArchitecture()->GetBranchSize()),
+              0);
+  }
+
+  for (Hook *hook : hooks) {
+    patcher.RemoveHook(hook);
+  }
+}
+
+TEST(BufferTaskTest, PayloadStagesWritesUntilFlush) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Patcher patcher;
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress function = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(function, 0);
+
+  Hook *hook = Hook::CreateHookForFunction(&task, &patcher, function);
+
+  {
+    Payload payload(&task, hook, VM_PROT_READ | VM_PROT_EXECUTE);
+    ASSERT_TRUE(payload.Prepare());
+
+    xnu::mach::VmAddress slot = payload.GetAddress();
+    std::vector<UInt8> before(payload.GetSize());
+    ASSERT_TRUE(task.Read(slot, before.data(), before.size()));
+
+    task.ResetStats();
+
+    // two appends and an overwrite of the middle of them
+    UInt8 first[] = {0x11, 0x11, 0x11, 0x11};
+    UInt8 second[] = {0x22, 0x22, 0x22, 0x22};
+    UInt8 middle[] = {0x33, 0x33};
+    ASSERT_TRUE(payload.WriteBytes(first, sizeof(first)));
+    ASSERT_TRUE(payload.WriteBytes(second, sizeof(second)));
+    ASSERT_TRUE(payload.WriteBytes(3, middle, sizeof(middle)));
+
+    const UInt8 staged[] = {0x11, 0x11, 0x11, 0x33, 0x33, 0x22, 0x22, 0x22};
+
+    // reads see the staged bytes while the task still has the old ones
+    UInt8 read[sizeof(staged)];
+    ASSERT_TRUE(payload.ReadBytes(0, read, sizeof(read)));
+    EXPECT_EQ(memcmp(read, staged, sizeof(staged)), 0);
+    EXPECT_EQ(memcmp(reinterpret_cast<void *>(slot), before.data(), sizeof(staged)), 0);
+    EXPECT_EQ(task.GetStats().writes, 0);
+
+    // one write covering the dirty run and nothing else in the slot
+    ASSERT_TRUE(payload.Flush());
+    EXPECT_EQ(task.GetStats().writes, 1);
+    EXPECT_EQ(task.GetStats().bytes_written, sizeof(staged));
+    EXPECT_EQ(memcmp(reinterpret_cast<void *>(slot), staged, sizeof(staged)), 0);
+    EXPECT_EQ(memcmp(reinterpret_cast<void *>(slot + sizeof(staged)),
+                     before.data() + sizeof(staged), before.size() - sizeof(staged)),
+              0);
+
+    EXPECT_EQ(payload.GetWriteCount(), 3);
+    EXPECT_EQ(payload.GetRemoteWriteCount(), 1);
+    EXPECT_EQ(payload.GetSavedWriteCount(), 2);
+
+    // with nothing staged there is nothing to write
+    ASSERT_TRUE(payload.Flush());
+    EXPECT_EQ(task.GetStats().writes, 1);
+    EXPECT_EQ(payload.GetRemoteWriteCount(), 1);
+  }
+
+  delete hook;
+}
+
+TEST(BufferTaskTest, PayloadFlushesIntoActiveBatch) {
+  BufferTask task(kTaskSize);
+  ASSERT_TRUE(task.IsValid());
+
+  Patcher patcher;
+
+  std::vector<UInt8> code = FunctionBytes();
+  xnu::mach::VmAddress function = task.LoadCode(code.data(), code.size());
+  ASSERT_NE(function, 0);
+
+  Hook *hook = Hook::CreateHookForFunction(&task, &patcher, function);
+
+  {
+    Payload payload(&task, hook, VM_PROT_READ | VM_PROT_EXECUTE);
+    ASSERT_TRUE(payload.Prepare());
+
+    xnu::mach::VmAddress slot = payload.GetAddress();
+
+    task.ResetStats();
+
+    HookBatch batch(&patcher);
+    patcher.SetActiveBatch(&batch);
+
+    UInt8 bytes[] = {0x44, 0x44, 0x44, 0x44};
+    ASSERT_TRUE(payload.WriteBytes(bytes, sizeof(bytes)));
+    ASSERT_TRUE(payload.Flush());
+
+    // the flush went to the batch, the task has not been written and reads see the batch
+    EXPECT_EQ(batch.GetWriteCount(), 1);
+    EXPECT_EQ(task.GetStats().writes, 0);
+    EXPECT_EQ(payload.GetRemoteWriteCount(), 1);
+
+    UInt8 read[sizeof(bytes)];
+    ASSERT_TRUE(payload.ReadBytes(0, read, sizeof(read)));
+    EXPECT_EQ(memcmp(read, bytes, sizeof(bytes)), 0);
+    EXPECT_NE(memcmp(reinterpret_cast<void *>(slot), bytes, sizeof(bytes)), 0);
+
+    patcher.SetActiveBatch(nullptr);
+
+    // committing the batch writes the trampoline region once
+    ASSERT_TRUE(batch.Commit());
+    EXPECT_EQ(task.GetStats().writes, 1);
+    EXPECT_EQ(memcmp(reinterpret_cast<void *>(slot), bytes, sizeof(bytes)), 0);
+  }
+
+  delete hook;
+}
+
+void WritesLandInBuffer(Size offset, std::vector<UInt8> data) {
+  BufferTask task(kTaskSize);
+  xnu::mach::VmAddress address = task.GetBase() + offset % kTaskSize;
+
+  if (!task.Write(address, data.data(), data.size())) {
+    EXPECT_FALSE(task.Contains(address, data.size()));
+    return;
+  }
+
+  std::vector<UInt8> read(data.size());
+  ASSERT_TRUE(task.Read(address, read.data(), read.size()));
+  EXPECT_EQ(read, data);
+}
+FUZZ_TEST(BufferTaskTest, WritesLandInBuffer);
+
+} // namespace
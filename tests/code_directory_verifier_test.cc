@@ -0,0 +1,254 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "code_directory_verifier.h"
+#include "sha256.h"
+#include "types.h"
+
+namespace {
+
+using darwin::CodeDirectoryVerifier;
+using darwin::crypto::kSha256DigestSize;
+
+static constexpr UInt8 kPageShift = 12;
+static constexpr Size kPageSize = 1 << kPageShift;
+
+const darwin::crypto::Sha256Implementation kImplementations[] = {
+    darwin::crypto::kSha256Portable,
+    darwin::crypto::kSha256Avx2,
+    darwin::crypto::kSha256ShaNi,
+    darwin::crypto::kSha256ArmCrypto,
+};
+
+std::string Hex(const UInt8 *digest) {
+  static const char kDigits[] = "0123456789abcdef";
+  std::string hex;
+  for (Size i = 0; i < kSha256DigestSize; i++) {
+    hex += kDigits[digest[i] >> 4];
+    hex += kDigits[digest[i] & 0xF];
+  }
+  return hex;
+}
+
+// A code directory with SHA-256 slots followed by its hashes, all in big endian.
+std::vector<UInt8> BuildCodeDirectory(std::vector<UInt8> &code, UInt8 hash_type,
+                                      UInt8 hash_size) {
+  UInt32 slots = (code.size() + kPageSize - 1) / kPageSize;
+
+  std::vector<UInt8> blob(sizeof(struct code_directory) + slots * hash_size);
+
+  auto *directory = reinterpret_cast<code_directory_t>(blob.data());
+  directory->blob.magic = __builtin_bswap32(CSMAGIC_CODEDIRECTORY);
+  directory->blob.length = __builtin_bswap32(blob.size());
+  directory->hashOffset = __builtin_bswap32(sizeof(struct code_directory));
+  directory->nCodeSlots = __builtin_bswap32(slots);
+  directory->codeLimit = __builtin_bswap32(code.size());
+  directory->hashSize = hash_size;
+  directory->hashType = hash_type;
+  directory->pageSize = kPageShift;
+
+  for (UInt32 slot = 0; slot < slots; slot++) {
+    UInt8 digest[kSha256DigestSize];
+    Size offset = slot * kPageSize;
+    Size size = code.size() - offset < kPageSize ? code.size() - offset : kPageSize;
+
+    darwin::crypto::Sha256(code.data() + offset, size, digest);
+    memcpy(blob.data() + sizeof(struct code_directory) + slot * hash_size, digest, hash_size);
+  }
+
+  return blob;
+}
+
+std::vector<UInt8> RandomCode(Size size) {
+  std::vector<UInt8> code(size);
+  for (Size i = 0; i < size; i++) {
+    code[i] = (UInt8)(i * 131 + (i >> 8) * 7);
+  }
+  return code;
+}
+
+TEST(Sha256Test, MatchesKnownDigests) {
+  std::string million(1000000, 'a');
+
+  for (auto implementation : kImplementations) {
+    if (!darwin::crypto::SetSha256Implementation(implementation)) {
+      continue;
+    }
+
+    UInt8 digest[kSha256DigestSize];
+
+    darwin::crypto::Sha256(nullptr, 0, digest);
+    EXPECT_EQ(Hex(digest), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+    darwin::crypto::Sha256(reinterpret_cast<const UInt8 *>("abc"), 3, digest);
+    EXPECT_EQ(Hex(digest), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    darwin::crypto::Sha256(reinterpret_cast<const UInt8 *>(million.data()), million.size(),
+                           digest);
+    EXPECT_EQ(Hex(digest), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+  }
+}
+
+TEST(Sha256Test, BatchMatchesSingleMessages) {
+  std::vector<UInt8> code = RandomCode(kPageSize * 11);
+
+  for (auto implementation : kImplementations) {
+    if (!darwin::crypto::SetSha256Implementation(implementation)) {
+      continue;
+    }
+
+    for (Size size : {0UL, 55UL, 64UL, 119UL, kPageSize}) {
+      std::vector<const UInt8 *> messages;
+      for (Size i = 0; i < 11; i++) {
+        messages.push_back(code.data() + i * kPageSize);
+      }
+
+      std::vector<UInt8> digests(messages.size() * kSha256DigestSize);
+      darwin::crypto::Sha256Batch(messages.data(), size, messages.size(), digests.data());
+
+      for (Size i = 0; i < messages.size(); i++) {
+        UInt8 digest[kSha256DigestSize];
+        darwin::crypto::Sha256(messages[i], size, digest);
+        EXPECT_EQ(memcmp(digest, &digests[i * kSha256DigestSize], kSha256DigestSize), 0)
+            << darwin::crypto::GetSha256ImplementationName() << " size " << size << " msg " << i;
+      }
+    }
+  }
+}
+
+TEST(Sha256Test, SwitchesImplementationWhileHashing) {
+  std::vector<UInt8> code = RandomCode(kPageSize);
+
+  UInt8 expected[kSha256DigestSize];
+  darwin::crypto::SetSha256Implementation(darwin::crypto::kSha256Portable);
+  darwin::crypto::Sha256(code.data(), code.size(), expected);
+
+  std::vector<std::thread> threads;
+
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 200; i++) {
+        UInt8 digest[kSha256DigestSize];
+        darwin::crypto::Sha256(code.data(), code.size(), digest);
+        EXPECT_EQ(memcmp(digest, expected, kSha256DigestSize), 0);
+      }
+    });
+  }
+
+  for (int i = 0; i < 200; i++) {
+    darwin::crypto::SetSha256Implementation(kImplementations[i % 4]);
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+TEST(CodeDirectoryVerifierTest, ReportsMismatchedSlots) {
+  // 150 pages plus a partial one, enough for several batches
+  std::vector<UInt8> code = RandomCode(kPageSize * 150 + 100);
+  std::vector<UInt8> blob = BuildCodeDirectory(code, HASH_TYPE_SHA256, kSha256DigestSize);
+
+  CodeDirectoryVerifier verifier(code.data(), code.size(),
+                                 reinterpret_cast<code_directory_t>(blob.data()), blob.size());
+  ASSERT_TRUE(verifier.Parse());
+  EXPECT_EQ(verifier.GetCodeSlotCount(), 151);
+  EXPECT_TRUE(verifier.Verify(4));
+  EXPECT_TRUE(verifier.GetMismatchedSlots().empty());
+
+  code[kPageSize * 3 + 5] ^= 1;
+  code[kPageSize * 99] ^= 1;
+  code[code.size() - 1] ^= 1;
+
+  EXPECT_FALSE(verifier.Verify(4));
+  EXPECT_EQ(verifier.GetMismatchedSlots(), (std::vector<UInt32>{3, 99, 150}));
+  EXPECT_FALSE(verifier.IsSlotValid(99));
+  EXPECT_TRUE(verifier.IsSlotValid(100));
+}
+
+TEST(CodeDirectoryVerifierTest, VerifiesTruncatedSha256) {
+  std::vector<UInt8> code = RandomCode(kPageSize * 3);
+  std::vector<UInt8> blob = BuildCodeDirectory(code, HASH_TYPE_SHA256_TRUNCATED, 20);
+
+  CodeDirectoryVerifier verifier(code.data(), code.size(),
+                                 reinterpret_cast<code_directory_t>(blob.data()), blob.size());
+  ASSERT_TRUE(verifier.Parse());
+  EXPECT_TRUE(verifier.Verify(1));
+}
+
+TEST(CodeDirectoryVerifierTest, RejectsMalformedDirectories) {
+  std::vector<UInt8> code = RandomCode(kPageSize * 3);
+  std::vector<UInt8> blob = BuildCodeDirectory(code, HASH_TYPE_SHA256, kSha256DigestSize);
+
+  // hashes run past the end of the blob
+  CodeDirectoryVerifier truncated(code.data(), code.size(),
+                                  reinterpret_cast<code_directory_t>(blob.data()),
+                                  blob.size() - 1);
+  EXPECT_FALSE(truncated.Parse());
+
+  // code limit past the end of the image
+  CodeDirectoryVerifier short_code(code.data(), code.size() - 1,
+                                   reinterpret_cast<code_directory_t>(blob.data()), blob.size());
+  EXPECT_FALSE(short_code.Parse());
+
+  reinterpret_cast<code_directory_t>(blob.data())->hashType = 0x7F;
+  CodeDirectoryVerifier unknown(code.data(), code.size(),
+                                reinterpret_cast<code_directory_t>(blob.data()), blob.size());
+  EXPECT_FALSE(unknown.Parse());
+}
+
+TEST(CodeDirectoryVerifierTest, ResignsOnlyDirtyPages) {
+  std::vector<UInt8> code = RandomCode(kPageSize * 200 + 10);
+  std::vector<UInt8> blob = BuildCodeDirectory(code, HASH_TYPE_SHA256, kSha256DigestSize);
+
+  CodeDirectoryVerifier verifier(code.data(), code.size(),
+                                 reinterpret_cast<code_directory_t>(blob.data()), blob.size());
+  ASSERT_TRUE(verifier.Parse());
+
+  UInt8 old_cd_hash[kSha256DigestSize];
+  memcpy(old_cd_hash, verifier.GetCodeDirectoryHash(), sizeof(old_cd_hash));
+
+  // one patch straddling two pages, one inside a single page and one hitting the partial page
+  memset(&code[kPageSize * 10 - 2], 0xCC, 4);
+  memset(&code[kPageSize * 120 + 100], 0xCC, 8);
+  memset(&code[code.size() - 4], 0xCC, 4);
+
+  EXPECT_TRUE(verifier.MarkDirty(kPageSize * 10 - 2, 4));
+  EXPECT_TRUE(verifier.MarkDirty(kPageSize * 120 + 100, 8));
+  EXPECT_TRUE(verifier.MarkDirty(code.size() - 4, 4));
+  EXPECT_TRUE(verifier.MarkDirty(kPageSize * 120, 1));
+  EXPECT_FALSE(verifier.MarkDirty(code.size(), 16));
+  EXPECT_EQ(verifier.GetDirtySlotCount(), 4);
+
+  EXPECT_EQ(verifier.Resign(2), 4);
+  EXPECT_EQ(verifier.GetDirtySlotCount(), 0);
+  EXPECT_NE(memcmp(old_cd_hash, verifier.GetCodeDirectoryHash(), sizeof(old_cd_hash)), 0);
+
+  // the slots in the blob now match a directory built from scratch
+  std::vector<UInt8> expected = BuildCodeDirectory(code, HASH_TYPE_SHA256, kSha256DigestSize);
+  EXPECT_EQ(blob, expected);
+  EXPECT_TRUE(verifier.Verify(2));
+
+  UInt8 cd_hash[kSha256DigestSize];
+  darwin::crypto::Sha256(expected.data(), expected.size(), cd_hash);
+  EXPECT_EQ(memcmp(cd_hash, verifier.GetCodeDirectoryHash(), sizeof(cd_hash)), 0);
+}
+
+void VerifierNeverCrashes(std::vector<UInt8> code, std::vector<UInt8> blob) {
+  blob.resize(blob.size() + sizeof(struct code_directory));
+  reinterpret_cast<code_directory_t>(blob.data())->blob.length = __builtin_bswap32(blob.size());
+  CodeDirectoryVerifier verifier(code.data(), code.size(),
+                                 reinterpret_cast<code_directory_t>(blob.data()), blob.size());
+  if (verifier.Parse()) {
+    verifier.Verify(2);
+  }
+}
+FUZZ_TEST(CodeDirectoryVerifierTest, VerifierNeverCrashes);
+
+} // namespace
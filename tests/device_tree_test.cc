@@ -0,0 +1,143 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "device_tree_index.h"
+#include "types.h"
+
+namespace {
+
+using xnu::DeviceTreeIndex;
+using xnu::DeviceTreeIndexNode;
+using xnu::DeviceTreeProperty;
+
+// Serializes a tree in the flattened format iBoot hands to the kernel.
+struct DeviceTreeBuilder {
+  std::vector<UInt8> blob;
+
+  void Node(UInt32 n_properties, UInt32 n_children) {
+    Append(&n_properties, sizeof(n_properties));
+    Append(&n_children, sizeof(n_children));
+  }
+
+  void Property(const char *name, const void *value, UInt32 size) {
+    char key[DT_KEY_LEN] = {};
+    strncpy(key, name, sizeof(key) - 1);
+    Append(key, sizeof(key));
+    Append(&size, sizeof(size));
+    Append(value, size);
+    blob.resize((blob.size() + 3) & ~3);
+  }
+
+  void Property(const char *name, const char *value) {
+    Property(name, value, strlen(value) + 1);
+  }
+
+  void Append(const void *data, Size size) {
+    const UInt8 *bytes = reinterpret_cast<const UInt8 *>(data);
+    blob.insert(blob.end(), bytes, bytes + size);
+  }
+};
+
+// /                  (device-tree)
+// /chosen
+// /arm-io
+// /arm-io/uart0
+// /arm-io/i2c0
+std::vector<UInt8> SampleTree() {
+  DeviceTreeBuilder builder;
+  UInt64 memory = 0x800000000;
+  UInt32 reg = 0x1234;
+
+  builder.Node(2, 2);
+  builder.Property("name", "device-tree");
+  builder.Property("compatible", "VMA2MACOS");
+
+  builder.Node(2, 0);
+  builder.Property("name", "chosen");
+  builder.Property("memory", &memory, sizeof(memory));
+
+  builder.Node(1, 2);
+  builder.Property("name", "arm-io");
+
+  builder.Node(2, 0);
+  builder.Property("name", "uart0");
+  builder.Property("reg", &reg, sizeof(reg));
+
+  builder.Node(1, 0);
+  builder.Property("name", "i2c0");
+
+  return builder.blob;
+}
+
+TEST(DeviceTreeTest, IndexesNodesByPathAndName) {
+  std::vector<UInt8> blob = SampleTree();
+
+  DeviceTreeIndex index(blob.data(), blob.size());
+  ASSERT_TRUE(index.Parse());
+  EXPECT_EQ(index.GetNodeCount(), 5);
+  EXPECT_EQ(index.GetPropertyCount(), 8);
+
+  DeviceTreeIndexNode *root = index.FindNodeByPath("/");
+  ASSERT_NE(root, nullptr);
+  EXPECT_EQ(root, index.GetRoot());
+  EXPECT_STREQ(root->name, "device-tree");
+
+  DeviceTreeIndexNode *uart = index.FindNode("/arm-io/uart0");
+  ASSERT_NE(uart, nullptr);
+  EXPECT_EQ(uart, index.FindNode("uart0"));
+  EXPECT_EQ(uart->depth, 2);
+  EXPECT_STREQ(index.GetParent(uart)->path, "/arm-io");
+  EXPECT_EQ(reinterpret_cast<UInt8 *>(uart->node), blob.data() + uart->offset);
+
+  EXPECT_NE(index.FindNode("/arm-io/i2c0"), nullptr);
+  EXPECT_EQ(index.FindNode("/uart0"), nullptr);
+  EXPECT_EQ(index.FindNode("missing"), nullptr);
+}
+
+TEST(DeviceTreeTest, FindsPropertiesInPlace) {
+  std::vector<UInt8> blob = SampleTree();
+
+  DeviceTreeIndex index(blob.data(), blob.size());
+  ASSERT_TRUE(index.Parse());
+
+  DeviceTreeProperty *memory = index.FindProperty("/chosen", "memory");
+  ASSERT_NE(memory, nullptr);
+  EXPECT_EQ(DeviceTreeIndex::GetPropertySize(memory), sizeof(UInt64));
+  EXPECT_EQ(*reinterpret_cast<UInt64 *>(memory->val), 0x800000000);
+  EXPECT_GE(reinterpret_cast<UInt8 *>(memory), blob.data());
+  EXPECT_LT(reinterpret_cast<UInt8 *>(memory), blob.data() + blob.size());
+
+  DeviceTreeProperty *reg = index.FindProperty("uart0", "reg");
+  ASSERT_NE(reg, nullptr);
+  EXPECT_EQ(*reinterpret_cast<UInt32 *>(reg->val), 0x1234);
+
+  EXPECT_STREQ(index.FindProperty("/", "compatible")->val, "VMA2MACOS");
+
+  // properties belong to exactly one node
+  EXPECT_EQ(index.FindProperty("/arm-io", "reg"), nullptr);
+  EXPECT_EQ(index.FindProperty("/chosen", "compatible"), nullptr);
+}
+
+TEST(DeviceTreeTest, RejectsTruncatedTree) {
+  std::vector<UInt8> blob = SampleTree();
+
+  for (Size size = 0; size < blob.size(); size += 4) {
+    DeviceTreeIndex index(blob.data(), size);
+    EXPECT_FALSE(index.Parse()) << size;
+  }
+}
+
+void DeviceTreeIndexNeverCrashes(std::vector<UInt8> blob, std::string path) {
+  DeviceTreeIndex index(blob.data(), blob.size());
+  if (index.Parse()) {
+    index.FindProperty(path.c_str(), "name");
+  }
+}
+FUZZ_TEST(DeviceTreeTest, DeviceTreeIndexNeverCrashes);
+
+} // namespace
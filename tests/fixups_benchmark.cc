@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "fixups.h"
+
+// Usage: fixups_benchmark [megabytes] [iterations]
+//
+// Builds an image whose __DATA_CONST is nothing but pointers, 40 MB by default, and times
+// sliding all of them once through a DYLD_CHAINED_PTR_64 chain per page and once through a
+// single run of rebase opcodes. Each pass restores the pristine segment first, outside the
+// timed region. A memcpy() over the same bytes is the memory bandwidth both should approach.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using darwin::dyld::FixupDecoder;
+
+static constexpr UInt64 kTextVmAddr = 0x100000000;
+static constexpr UInt64 kDataVmAddr = 0x100004000;
+static constexpr UInt64 kDataFileOff = 0x4000;
+static constexpr UInt64 kPageSize = 0x4000;
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Image {
+  std::vector<UInt8> buffer;
+  std::vector<UInt64> pristine;
+
+  Size data_size;
+  Offset linkedit;
+
+  UInt8 *cmd;
+
+  Image(Size data_size) : data_size(data_size) {
+    linkedit = kDataFileOff + data_size;
+
+    // room for the chained starts of every page or the rebase opcodes, whichever is used
+    buffer.resize(linkedit + 0x100 + (data_size / kPageSize) * sizeof(UInt16));
+
+    cmd = buffer.data() + sizeof(struct mach_header_64);
+
+    AddSegment("__TEXT", kTextVmAddr, 0, kDataFileOff);
+    AddSegment("__DATA_CONST", kDataVmAddr, kDataFileOff, data_size);
+  }
+
+  struct mach_header_64 *Header() {
+    return reinterpret_cast<struct mach_header_64 *>(buffer.data());
+  }
+
+  UInt64 *Data() { return reinterpret_cast<UInt64 *>(buffer.data() + kDataFileOff); }
+
+  Size PointerCount() { return data_size / sizeof(UInt64); }
+
+  void AddCommand(void *command, UInt32 size) {
+    memcpy(cmd, command, size);
+    cmd += size;
+
+    Header()->magic = MH_MAGIC_64;
+    Header()->ncmds++;
+    Header()->sizeofcmds = cmd - buffer.data() - sizeof(struct mach_header_64);
+  }
+
+  void AddSegment(const char *name, UInt64 vmaddr, UInt64 fileoff, UInt64 size) {
+    struct segment_command_64 segment = {};
+    segment.cmd = LC_SEGMENT_64;
+    segment.cmdsize = sizeof(segment);
+    strncpy(segment.segname, name, sizeof(segment.segname));
+    segment.vmaddr = vmaddr;
+    segment.vmsize = size;
+    segment.fileoff = fileoff;
+    segment.filesize = size;
+    AddCommand(&segment, sizeof(segment));
+  }
+
+  void Save() { pristine.assign(Data(), Data() + PointerCount()); }
+
+  void Restore() { memcpy(Data(), pristine.data(), data_size); }
+};
+
+void BuildChainedImage(Image &image) {
+  UInt8 *blob = image.buffer.data() + image.linkedit;
+
+  UInt32 page_count = image.data_size / kPageSize;
+
+  auto *header = reinterpret_cast<struct dyld_chained_fixups_header *>(blob);
+  header->starts_offset = 0x20;
+
+  auto *starts_in_image = reinterpret_cast<struct dyld_chained_starts_in_image *>(blob + 0x20);
+  starts_in_image->seg_count = 2;
+  starts_in_image->seg_info_offset[0] = 0;
+  starts_in_image->seg_info_offset[1] = 0x10;
+
+  auto *starts = reinterpret_cast<struct dyld_chained_starts_in_segment *>(blob + 0x30);
+  starts->size = sizeof(*starts) + page_count * sizeof(UInt16);
+  starts->page_size = kPageSize;
+  starts->pointer_format = DYLD_CHAINED_PTR_64;
+  starts->segment_offset = kDataFileOff;
+  starts->page_count = page_count;
+
+  for (UInt32 i = 0; i < page_count; i++) {
+    starts->page_start[i] = 0;
+  }
+
+  struct linkedit_data_command data = {};
+  data.cmd = LC_DYLD_CHAINED_FIXUPS;
+  data.cmdsize = sizeof(data);
+  data.dataoff = image.linkedit;
+  data.datasize = image.buffer.size() - image.linkedit;
+  image.AddCommand(&data, sizeof(data));
+
+  // every pointer links to the next one, 4 byte stride, until the end of its page
+  for (Size i = 0; i < image.PointerCount(); i++) {
+    bool last = (i + 1) % (kPageSize / sizeof(UInt64)) == 0;
+
+    image.Data()[i] = (kTextVmAddr + (i & 0xFFF) * 8) | (last ? 0 : (2ULL << 51));
+  }
+
+  image.Save();
+}
+
+void BuildOpcodeImage(Image &image) {
+  UInt8 *p = image.buffer.data() + image.linkedit;
+  UInt8 *start = p;
+
+  *p++ = REBASE_OPCODE_SET_TYPE_IMM | REBASE_TYPE_POINTER;
+  *p++ = REBASE_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB | 1;
+  *p++ = 0;
+  *p++ = REBASE_OPCODE_DO_REBASE_ULEB_TIMES;
+
+  for (UInt64 count = image.PointerCount();; count >>= 7) {
+    *p++ = (count & 0x7F) | (count >= 0x80 ? 0x80 : 0);
+
+    if (count < 0x80) {
+      break;
+    }
+  }
+
+  *p++ = REBASE_OPCODE_DONE;
+
+  struct dyld_info_command info = {};
+  info.cmd = LC_DYLD_INFO_ONLY;
+  info.cmdsize = sizeof(info);
+  info.rebase_off = image.linkedit;
+  info.rebase_size = p - start;
+  image.AddCommand(&info, sizeof(info));
+
+  for (Size i = 0; i < image.PointerCount(); i++) {
+    image.Data()[i] = kTextVmAddr + (i & 0xFFF) * 8;
+  }
+
+  image.Save();
+}
+
+struct Result {
+  double ms;
+  Size rebased;
+};
+
+template <typename Apply>
+Result Run(Image &image, int iterations, Apply apply) {
+  Result result = {};
+
+  for (int i = 0; i < iterations; i++) {
+    image.Restore();
+
+    Clock::time_point start = Clock::now();
+
+    result.rebased = apply();
+    result.ms += MillisecondsSince(start);
+  }
+
+  result.ms /= iterations;
+
+  return result;
+}
+
+void Report(const char *name, const Result &result, Size bytes) {
+  printf("%-8s %8.2f ms %7.2f GB/s  %zu pointers\n", name, result.ms,
+         bytes / result.ms / 1e6, result.rebased);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Size megabytes = argc > 1 ? atoll(argv[1]) : 40;
+  int iterations = argc > 2 ? atoi(argv[2]) : 10;
+
+  Size data_size = (megabytes << 20) & ~(kPageSize - 1);
+
+  Image chained(data_size);
+  Image opcodes(data_size);
+
+  BuildChainedImage(chained);
+  BuildOpcodeImage(opcodes);
+
+  std::vector<UInt8> copy(data_size);
+
+  Result baseline = Run(chained, iterations, [&]() {
+    memcpy(copy.data(), chained.Data(), data_size);
+    return data_size / sizeof(UInt64);
+  });
+
+  Report("memcpy", baseline, data_size);
+
+  FixupDecoder chained_decoder(chained.buffer.data(), chained.buffer.size());
+  FixupDecoder opcode_decoder(opcodes.buffer.data(), opcodes.buffer.size());
+
+  if (!chained_decoder.Parse() || !opcode_decoder.Parse()) {
+    fprintf(stderr, "failed to parse the synthetic images\n");
+    return 1;
+  }
+
+  Result chain = Run(chained, iterations, [&]() { return chained_decoder.ApplyRebases(0x4000); });
+
+  Report("chained", chain, data_size);
+
+  Result stream = Run(opcodes, iterations, [&]() { return opcode_decoder.ApplyRebases(0x4000); });
+
+  Report("opcodes", stream, data_size);
+
+  // both images must have slid every pointer to the same place
+  bool ok = chain.rebased == chained.PointerCount() && stream.rebased == opcodes.PointerCount();
+
+  for (Size i = 0; ok && i < chained.PointerCount(); i++) {
+    ok = chained.Data()[i] == kTextVmAddr + (i & 0xFFF) * 8 + 0x4000 &&
+         opcodes.Data()[i] == chained.Data()[i];
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "fixups.h"
+#include "types.h"
+
+namespace {
+
+using darwin::dyld::Fixup;
+using darwin::dyld::FixupDecoder;
+
+static constexpr UInt64 kTextVmAddr = 0x100000000;
+static constexpr UInt64 kDataVmAddr = 0x100004000;
+static constexpr UInt64 kDataFileOff = 0x4000;
+static constexpr UInt64 kLinkeditFileOff = 0x8000;
+static constexpr UInt64 kImageSize = 0x9000;
+
+struct TestImage {
+  std::vector<UInt8> buffer;
+
+  UInt8 *cmd;
+  UInt32 ncmds;
+
+  TestImage() : buffer(kImageSize), ncmds(0) {
+    cmd = buffer.data() + sizeof(struct mach_header_64);
+
+    AddSegment("__TEXT", kTextVmAddr, 0);
+    AddSegment("__DATA", kDataVmAddr, kDataFileOff);
+  }
+
+  struct mach_header_64 *Header() {
+    return reinterpret_cast<struct mach_header_64 *>(buffer.data());
+  }
+
+  void AddCommand(void *command, UInt32 size) {
+    memcpy(cmd, command, size);
+    cmd += size;
+    ncmds++;
+
+    Header()->magic = MH_MAGIC_64;
+    Header()->ncmds = ncmds;
+    Header()->sizeofcmds = cmd - buffer.data() - sizeof(struct mach_header_64);
+  }
+
+  void AddSegment(const char *name, UInt64 vmaddr, UInt64 fileoff) {
+    struct segment_command_64 segment = {};
+    segment.cmd = LC_SEGMENT_64;
+    segment.cmdsize = sizeof(segment);
+    strncpy(segment.segname, name, sizeof(segment.segname));
+    segment.vmaddr = vmaddr;
+    segment.vmsize = 0x4000;
+    segment.fileoff = fileoff;
+    segment.filesize = 0x4000;
+    AddCommand(&segment, sizeof(segment));
+  }
+
+  UInt64 *Data(UInt64 offset) {
+    return reinterpret_cast<UInt64 *>(buffer.data() + kDataFileOff + offset);
+  }
+};
+
+void AddArm64eChain(TestImage &image) {
+  UInt8 *blob = image.buffer.data() + kLinkeditFileOff;
+
+  auto *header = reinterpret_cast<struct dyld_chained_fixups_header *>(blob);
+  header->starts_offset = 0x20;
+
+  auto *starts_in_image = reinterpret_cast<struct dyld_chained_starts_in_image *>(blob + 0x20);
+  starts_in_image->seg_count = 2;
+  starts_in_image->seg_info_offset[0] = 0;
+  starts_in_image->seg_info_offset[1] = 0x10;
+
+  auto *starts = reinterpret_cast<struct dyld_chained_starts_in_segment *>(blob + 0x30);
+  starts->size = sizeof(*starts) + sizeof(UInt16);
+  starts->page_size = 0x4000;
+  starts->pointer_format = DYLD_CHAINED_PTR_ARM64E;
+  starts->segment_offset = kDataFileOff;
+  starts->page_count = 1;
+  starts->page_start[0] = 0;
+
+  struct linkedit_data_command data = {};
+  data.cmd = LC_DYLD_CHAINED_FIXUPS;
+  data.cmdsize = sizeof(data);
+  data.dataoff = kLinkeditFileOff;
+  data.datasize = 0x100;
+  image.AddCommand(&data, sizeof(data));
+
+  // plain rebase to __TEXT+0x100, next link two pointers ahead
+  *image.Data(0) = (kTextVmAddr + 0x100) | (2ULL << 51);
+  // authenticated rebase to __TEXT+0x200 with key DA and diversity 0x1234
+  *image.Data(0x10) = (1ULL << 63) | (2ULL << 49) | (0x1234ULL << 32) | 0x200;
+}
+
+bool CollectFixups(void *context, Fixup *fixups, Size count) {
+  auto *collected = reinterpret_cast<std::vector<Fixup> *>(context);
+  collected->insert(collected->end(), fixups, fixups + count);
+  return true;
+}
+
+TEST(FixupsTest, DecodesArm64eChain) {
+  TestImage image;
+  AddArm64eChain(image);
+
+  FixupDecoder decoder(image.buffer.data(), image.buffer.size());
+  ASSERT_TRUE(decoder.Parse());
+  EXPECT_EQ(decoder.GetBase(), kTextVmAddr);
+  EXPECT_TRUE(decoder.HasChainedFixups());
+
+  std::vector<Fixup> fixups;
+  ASSERT_TRUE(decoder.DecodeAll(CollectFixups, &fixups));
+  ASSERT_EQ(fixups.size(), 2);
+
+  EXPECT_EQ(fixups[0].address, kDataVmAddr);
+  EXPECT_EQ(fixups[0].target, kTextVmAddr + 0x100);
+  EXPECT_FALSE(fixups[0].auth);
+
+  EXPECT_EQ(fixups[1].address, kDataVmAddr + 0x10);
+  EXPECT_EQ(fixups[1].target, kTextVmAddr + 0x200);
+  EXPECT_TRUE(fixups[1].auth);
+  EXPECT_EQ(fixups[1].diversity, 0x1234);
+  EXPECT_EQ(fixups[1].key, 2);
+
+  Fixup fixup;
+  EXPECT_TRUE(decoder.FindFixup(kDataVmAddr + 0x10, &fixup));
+  EXPECT_FALSE(decoder.FindFixup(kDataVmAddr + 0x8, &fixup));
+}
+
+TEST(FixupsTest, AppliesChainedRebases) {
+  TestImage image;
+  AddArm64eChain(image);
+
+  FixupDecoder decoder(image.buffer.data(), image.buffer.size());
+  ASSERT_TRUE(decoder.Parse());
+
+  EXPECT_EQ(decoder.ApplyChainedRebases(0x4000), 2);
+  EXPECT_EQ(*image.Data(0), kTextVmAddr + 0x4100);
+  EXPECT_EQ(*image.Data(0x10), kTextVmAddr + 0x4200);
+}
+
+TEST(FixupsTest, AppliesLongChainedRuns) {
+  TestImage image;
+  AddArm64eChain(image);
+
+  // 40 adjacent links, a jump of three pointers, then 13 more that end the chain
+  std::vector<UInt64> targets;
+  UInt64 offset = 0;
+  for (int i = 0; i < 54; i++) {
+    UInt64 next = i == 53 ? 0 : (i == 39 ? 3 : 1);
+    targets.push_back(kTextVmAddr + 0x1000 + i * 8);
+    *image.Data(offset) = (kTextVmAddr + 0x1000 + i * 8) | (next << 51);
+    offset += next * 8;
+  }
+
+  FixupDecoder decoder(image.buffer.data(), image.buffer.size());
+  ASSERT_TRUE(decoder.Parse());
+
+  EXPECT_EQ(decoder.ApplyChainedRebases(0x4000), 54);
+
+  offset = 0;
+  for (int i = 0; i < 54; i++) {
+    EXPECT_EQ(*image.Data(offset), targets[i] + 0x4000) << i;
+    offset += (i == 39 ? 3 : 1) * 8;
+  }
+  EXPECT_EQ(*image.Data(40 * 8), 0);
+}
+
+TEST(FixupsTest, AppliesRebaseOpcodes) {
+  TestImage image;
+
+  UInt8 opcodes[] = {
+      REBASE_OPCODE_SET_TYPE_IMM | REBASE_TYPE_POINTER,
+      REBASE_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB | 1, 0x10,
+      REBASE_OPCODE_DO_REBASE_IMM_TIMES | 3,
+      REBASE_OPCODE_DONE,
+  };
+  memcpy(image.buffer.data() + kLinkeditFileOff, opcodes, sizeof(opcodes));
+
+  struct dyld_info_command info = {};
+  info.cmd = LC_DYLD_INFO_ONLY;
+  info.cmdsize = sizeof(info);
+  info.rebase_off = kLinkeditFileOff;
+  info.rebase_size = sizeof(opcodes);
+  image.AddCommand(&info, sizeof(info));
+
+  for (int i = 0; i < 3; i++) {
+    *image.Data(0x10 + i * 8) = kTextVmAddr + i;
+  }
+
+  FixupDecoder decoder(image.buffer.data(), image.buffer.size());
+  ASSERT_TRUE(decoder.Parse());
+
+  EXPECT_EQ(decoder.ApplyRebaseOpcodes(-0x1000), 3);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(*image.Data(0x10 + i * 8), kTextVmAddr - 0x1000 + i);
+  }
+  EXPECT_EQ(*image.Data(0x28), 0);
+}
+
+void FixupDecoderNeverCrashes(std::vector<UInt8> buffer) {
+  std::vector<Fixup> fixups;
+  FixupDecoder decoder(buffer.data(), buffer.size());
+  if (decoder.Parse()) {
+    decoder.DecodeAll(CollectFixups, &fixups);
+  }
+}
+FUZZ_TEST(FixupsTest, FixupDecoderNeverCrashes);
+
+} // namespace
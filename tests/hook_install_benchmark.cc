@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "arch.h"
+#include "buffer_task.h"
+#include "hook.h"
+#include "hook_batch.h"
+#include "patcher.h"
+
+// Usage: hook_install_benchmark [hooks] [latency_ns]
+//
+// Loads copies of a kernelcache function prologue into a BufferTask and times installing and
+// removing an instrumentation hook on each of them, one hook at a time and through a HookBatch.
+// The task spins for latency_ns on every call to model what a Mach VM call costs, so the
+// number of task calls each path makes shows up directly in the wall clock time.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using darwin::Hook;
+using darwin::HookBatch;
+using darwin::Patcher;
+using xnu::BufferTask;
+
+const UInt8 kFunctionX86_64[] = {
+    0x55, 0x48, 0x89, 0xe5, 0x41, 0x57, 0x41, 0x56, 0x53, 0x50, 0x48, 0x89, 0xfb, 0x4c, 0x8b, 0x77,
+    0x08, 0x4d, 0x85, 0xf6, 0x74, 0x10, 0x48, 0x83, 0xc4, 0x08, 0x5b, 0x41, 0x5e, 0x41, 0x5f, 0xc3,
+};
+
+const UInt8 kFunctionArm64[] = {
+    0x7f, 0x23, 0x03, 0xd5, 0xf4, 0x4f, 0xbe, 0xa9, 0xfd, 0x7b, 0x01, 0xa9, 0xfd, 0x43, 0x00, 0x91,
+    0xf3, 0x03, 0x00, 0xaa, 0x08, 0x04, 0x40, 0xf9, 0xfd, 0x7b, 0x41, 0xa9, 0xff, 0x0f, 0x5f, 0xd6,
+};
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void Report(const char *name, BufferTask &task, Size count, double ms) {
+  xnu::BufferTaskStats &stats = task.GetStats();
+
+  printf("%-24s %9.2f ms %9.1f us/hook  reads %6llu  writes %6llu  protects %6llu\n", name, ms,
+         ms * 1e3 / count, stats.reads, stats.writes, stats.protection_changes);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Size count = argc > 1 ? atoi(argv[1]) : 1000;
+  UInt64 latency = argc > 2 ? atoll(argv[2]) : 2000;
+
+  const UInt8 *function = kFunctionX86_64;
+
+  if (arch::GetCurrentArchitecture() == arch::ARCH_arm64) {
+    function = kFunctionArm64;
+  }
+
+  // a page per function plus room for the trampolines
+  BufferTask task((count + 1) * 0x4000 + (16 << 20));
+
+  if (!task.IsValid()) {
+    fprintf(stderr, "failed to map the task\n");
+    return 1;
+  }
+
+  std::vector<xnu::mach::VmAddress> functions;
+
+  // every function gets its own page, like functions spread over a kernelcache
+  for (Size i = 0; i < count; i++) {
+    xnu::mach::VmAddress address = task.LoadCode(function, sizeof(kFunctionX86_64));
+
+    if (!address) {
+      fprintf(stderr, "out of task memory at function %zu\n", i);
+      return 1;
+    }
+
+    functions.push_back(address);
+  }
+
+  xnu::mach::VmAddress replacement = functions.back();
+
+  functions.pop_back();
+
+  count = functions.size();
+
+  printf("%zu hooks, %llu ns per task call\n\n", count, latency);
+
+  task.SetLatency(latency);
+
+  for (int batched = 0; batched < 2; batched++) {
+    Patcher patcher;
+
+    std::vector<Hook *> hooks;
+
+    task.ResetStats();
+
+    Clock::time_point start = Clock::now();
+
+    HookBatch batch(&patcher);
+
+    for (Size i = 0; i < count; i++) {
+      Hook *hook = Hook::CreateHookForFunction(&task, &patcher, functions[i]);
+
+      if (batched) {
+        batch.AddHook(hook, replacement);
+      } else {
+        hook->HookFunction(replacement);
+      }
+
+      hooks.push_back(hook);
+    }
+
+    if (batched && !batch.Commit()) {
+      fprintf(stderr, "batch failed to commit\n");
+      return 1;
+    }
+
+    Report(batched ? "install batched" : "install", task, count, MillisecondsSince(start));
+
+    task.ResetStats();
+
+    start = Clock::now();
+
+    for (Hook *hook : hooks) {
+      patcher.RemoveHook(hook);
+    }
+
+    Report("uninstall", task, count, MillisecondsSince(start));
+  }
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "hook_registry.h"
+
+// Usage: hook_registry_benchmark [hooks] [iterations]
+//
+// Installs 10k instrumentation hooks and breakpoints spread over a kernel sized text range and
+// times the lookups Patcher does on every exec and kext load: exact (address, type) lookups
+// that hit and miss, and "anything hooked within this page" range queries, once with the
+// linear scan over the hooks vector that Patcher used to do and once through HookRegistry.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using darwin::Hook;
+using darwin::HookRegistry;
+using darwin::HookRegistryEntry;
+
+// values of HookType
+static constexpr UInt32 kBreakpoint = 1;
+static constexpr UInt32 kInstrumentFunction = 3;
+static constexpr UInt32 kReplaceFunction = 4;
+
+static constexpr xnu::mach::VmAddress kTextBase = 0xFFFFFE0007004000ULL;
+static constexpr Size kPageSize = 0x4000;
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+Hook *FakeHook(Size i) {
+  // the registry never dereferences hooks
+  return reinterpret_cast<Hook *>((i + 1) * 16);
+}
+
+Hook *LinearFind(std::vector<HookRegistryEntry> &hooks, xnu::mach::VmAddress from, UInt32 type) {
+  for (Size i = 0; i < hooks.size(); i++) {
+    if (hooks[i].from == from && hooks[i].type == type) {
+      return hooks[i].hook;
+    }
+  }
+
+  return nullptr;
+}
+
+Size LinearRange(std::vector<HookRegistryEntry> &hooks, xnu::mach::VmAddress start,
+                 xnu::mach::VmAddress end) {
+  Size found = 0;
+
+  for (Size i = 0; i < hooks.size(); i++) {
+    if (hooks[i].from >= start && hooks[i].from < end) {
+      found++;
+    }
+  }
+
+  return found;
+}
+
+template <typename F>
+void Time(const char *name, Size operations, F &&f) {
+  Size sink = 0;
+
+  Clock::time_point start = Clock::now();
+  for (Size i = 0; i < operations; i++) {
+    asm volatile("" ::: "memory");
+    sink += f(i);
+  }
+  double ms = MillisecondsSince(start);
+
+  printf("%-36s %9.2f ms %9.1f ns/op  (%zu)\n", name, ms, ms * 1e6 / operations, sink);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Size count = argc > 1 ? atoi(argv[1]) : 10000;
+  Size iterations = argc > 2 ? atoi(argv[2]) : 10;
+
+  std::vector<HookRegistryEntry> hooks;
+  std::vector<xnu::mach::VmAddress> probes;
+
+  HookRegistry registry;
+
+  // functions are 16 byte aligned and a few hundred bytes apart
+  srand(1);
+
+  xnu::mach::VmAddress address = kTextBase;
+
+  for (Size i = 0; i < count; i++) {
+    address += 16 * (1 + rand() % 48);
+
+    UInt32 type = i % 4 == 0 ? kBreakpoint : i % 7 == 0 ? kReplaceFunction : kInstrumentFunction;
+
+    hooks.push_back({address, type, FakeHook(i)});
+
+    if (!registry.Insert(address, type, FakeHook(i))) {
+      fprintf(stderr, "failed to insert hook %zu\n", i);
+      return 1;
+    }
+  }
+
+  xnu::mach::VmAddress text_end = address + 16;
+
+  for (Size i = 0; i < count; i++) {
+    // every other probe lands between hooks
+    probes.push_back(hooks[rand() % count].from + (i & 1) * 8);
+  }
+
+  for (Size i = 0; i < count; i++) {
+    UInt32 type = hooks[i].type;
+
+    if (registry.Find(hooks[i].from, type) != LinearFind(hooks, hooks[i].from, type)) {
+      fprintf(stderr, "lookup mismatch at %zu\n", i);
+      return 1;
+    }
+  }
+
+  printf("%zu hooks over %zu KB of text\n\n", count, (Size)(text_end - kTextBase) / 1024);
+
+  Size lookups = count * iterations;
+  Size pages = (text_end - kTextBase) / kPageSize;
+
+  Time("linear IsFunctionHooked", lookups / 10, [&](Size i) {
+    xnu::mach::VmAddress probe = probes[i % count];
+    return LinearFind(hooks, probe, kInstrumentFunction) ||
+           LinearFind(hooks, probe, kReplaceFunction);
+  });
+  Time("registry IsFunctionHooked", lookups, [&](Size i) {
+    xnu::mach::VmAddress probe = probes[i % count];
+    return registry.Find(probe, kInstrumentFunction) || registry.Find(probe, kReplaceFunction);
+  });
+
+  Time("linear BreakpointForAddress", lookups / 10, [&](Size i) {
+    return LinearFind(hooks, probes[i % count], kBreakpoint) != nullptr;
+  });
+  Time("registry BreakpointForAddress", lookups, [&](Size i) {
+    return registry.Find(probes[i % count], kBreakpoint) != nullptr;
+  });
+
+  Time("linear hooks within a page", pages * iterations, [&](Size i) {
+    xnu::mach::VmAddress start = kTextBase + (i % pages) * kPageSize;
+    return LinearRange(hooks, start, start + kPageSize);
+  });
+  Time("registry hooks within a page", pages * iterations * 100, [&](Size i) {
+    xnu::mach::VmAddress start = kTextBase + (i % pages) * kPageSize;
+    UInt32 found;
+    registry.FindInRange(start, start + kPageSize, &found);
+    return (Size)found;
+  });
+
+  Time("registry remove + insert + range", count, [&](Size i) {
+    HookRegistryEntry &hook = hooks[i];
+    UInt32 found;
+    registry.Remove(hook.from, hook.type);
+    registry.Insert(hook.from, hook.type, hook.hook);
+    registry.FindInRange(hook.from, hook.from + kPageSize, &found);
+    return (Size)found;
+  });
+
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "hook_registry.h"
+#include "types.h"
+
+namespace {
+
+using darwin::Hook;
+using darwin::HookRegistry;
+using darwin::HookRegistryEntry;
+
+// values of HookType
+static constexpr UInt32 kBreakpoint = 1;
+static constexpr UInt32 kInstrumentFunction = 3;
+static constexpr UInt32 kReplaceFunction = 4;
+
+Hook *FakeHook(Size i) {
+  return reinterpret_cast<Hook *>((i + 1) * 16);
+}
+
+TEST(HookRegistryTest, FindsHooksByAddressAndType) {
+  HookRegistry registry;
+
+  EXPECT_EQ(registry.Find(0x1000, kBreakpoint), nullptr);
+
+  EXPECT_TRUE(registry.Insert(0x1000, kBreakpoint, FakeHook(0)));
+  EXPECT_TRUE(registry.Insert(0x1000, kInstrumentFunction, FakeHook(1)));
+  EXPECT_FALSE(registry.Insert(0x1000, kBreakpoint, FakeHook(2)));
+  EXPECT_FALSE(registry.Insert(0x2000, kBreakpoint, nullptr));
+  EXPECT_EQ(registry.GetCount(), 2);
+
+  EXPECT_EQ(registry.Find(0x1000, kBreakpoint), FakeHook(0));
+  EXPECT_EQ(registry.Find(0x1000, kInstrumentFunction), FakeHook(1));
+  EXPECT_EQ(registry.Find(0x1000, kReplaceFunction), nullptr);
+
+  EXPECT_TRUE(registry.Remove(0x1000, kBreakpoint));
+  EXPECT_FALSE(registry.Remove(0x1000, kBreakpoint));
+  EXPECT_EQ(registry.Find(0x1000, kBreakpoint), nullptr);
+  EXPECT_EQ(registry.Find(0x1000, kInstrumentFunction), FakeHook(1));
+}
+
+TEST(HookRegistryTest, SurvivesGrowthAndRemoval) {
+  HookRegistry registry;
+
+  for (Size i = 0; i < 10000; i++) {
+    ASSERT_TRUE(registry.Insert(0xFFFFFE0007004000ULL + i * 16, kInstrumentFunction,
+                                FakeHook(i)));
+  }
+
+  // removing every third hook shifts probe sequences around the holes
+  for (Size i = 0; i < 10000; i += 3) {
+    ASSERT_TRUE(registry.Remove(0xFFFFFE0007004000ULL + i * 16, kInstrumentFunction));
+  }
+
+  for (Size i = 0; i < 10000; i++) {
+    EXPECT_EQ(registry.Find(0xFFFFFE0007004000ULL + i * 16, kInstrumentFunction),
+              i % 3 ? FakeHook(i) : nullptr);
+  }
+
+  registry.Clear();
+  EXPECT_EQ(registry.GetCount(), 0);
+  EXPECT_EQ(registry.Find(0xFFFFFE0007004010ULL, kInstrumentFunction), nullptr);
+}
+
+TEST(HookRegistryTest, FindsHooksWithinRange) {
+  HookRegistry registry;
+  UInt32 found;
+
+  registry.Insert(0x3000, kBreakpoint, FakeHook(0));
+  registry.Insert(0x1000, kReplaceFunction, FakeHook(1));
+  registry.Insert(0x2000, kBreakpoint, FakeHook(2));
+  registry.Insert(0x2000, kInstrumentFunction, FakeHook(3));
+
+  HookRegistryEntry *entries = registry.FindInRange(0x1800, 0x3000, &found);
+  ASSERT_EQ(found, 2);
+  EXPECT_EQ(entries[0].hook, FakeHook(2));
+  EXPECT_EQ(entries[1].hook, FakeHook(3));
+
+  EXPECT_TRUE(registry.IsRangeHooked(0x1000, 0x1001));
+  EXPECT_FALSE(registry.IsRangeHooked(0x1001, 0x2000));
+  EXPECT_FALSE(registry.IsRangeHooked(0x3000, 0x3000));
+
+  // the range index follows later changes
+  registry.Remove(0x2000, kBreakpoint);
+  registry.Insert(0x2800, kBreakpoint, FakeHook(4));
+
+  entries = registry.FindInRange(0x1800, 0x3001, &found);
+  ASSERT_EQ(found, 3);
+  EXPECT_EQ(entries[0].hook, FakeHook(3));
+  EXPECT_EQ(entries[1].hook, FakeHook(4));
+  EXPECT_EQ(entries[2].hook, FakeHook(0));
+}
+
+void MatchesReferenceMap(std::vector<std::pair<UInt16, bool>> operations) {
+  HookRegistry registry;
+  std::map<std::pair<xnu::mach::VmAddress, UInt32>, Hook *> reference;
+
+  for (Size i = 0; i < operations.size(); i++) {
+    xnu::mach::VmAddress from = 0x1000 + (operations[i].first >> 2) * 4;
+    UInt32 type = operations[i].first & 3;
+
+    // builds the range index halfway through so the rest patch it in place
+    if (i == operations.size() / 2) {
+      registry.IsRangeHooked(0, ~0ULL);
+    }
+
+    if (operations[i].second) {
+      bool inserted = reference.emplace(std::make_pair(from, type), FakeHook(i)).second;
+      EXPECT_EQ(registry.Insert(from, type, FakeHook(i)), inserted);
+    } else {
+      EXPECT_EQ(registry.Remove(from, type), reference.erase(std::make_pair(from, type)) != 0);
+    }
+  }
+
+  ASSERT_EQ(registry.GetCount(), reference.size());
+
+  for (auto &[key, hook] : reference) {
+    EXPECT_EQ(registry.Find(key.first, key.second), hook);
+  }
+
+  UInt32 found;
+  HookRegistryEntry *entries = registry.FindInRange(0, ~0ULL, &found);
+  ASSERT_EQ(found, reference.size());
+
+  Size i = 0;
+  for (auto &[key, hook] : reference) {
+    EXPECT_EQ(entries[i].from, key.first);
+    EXPECT_EQ(entries[i].type, key.second);
+    EXPECT_EQ(entries[i].hook, hook);
+    i++;
+  }
+}
+FUZZ_TEST(HookRegistryTest, MatchesReferenceMap);
+
+} // namespace
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "hook_trace.h"
+#include "hook_trace_decoder.h"
+
+// Usage: hook_trace_benchmark [threads] [records_per_thread] [records_per_cpu] [work_ns]
+//
+// Has every thread fire a hook, then spend work_ns in the traced function, while one drainer
+// thread empties the trace the way the kext does: DrainEncoded() in pieces the size of one
+// event ring record, until nothing is left. It runs once with each thread on a CPU buffer of
+// its own and once with all of them on a single buffer of the same total capacity, which is
+// what a global buffer would cost. Only records the drainer delivered count towards the
+// throughput, a run that drops most of its hits only measures the drainer; ns/hit is what a
+// hook thread spent per hit, work included. The pieces are then decoded like
+// Kernel::ReadHookTrace() does, to check that no kept record went missing.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using darwin::HookTrace;
+using darwin::HookTraceDecoder;
+using darwin::HookTraceRecord;
+
+static constexpr Size kDrainRecords = 256;
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Result {
+  double ms;
+  double hook_ns;
+  UInt64 recorded;
+  UInt64 dropped;
+  UInt64 delivered;
+  Size encoded;
+};
+
+Result Run(UInt32 threads, UInt64 records_per_thread, UInt32 records_per_cpu, UInt64 work_ns,
+           bool per_cpu) {
+  HookTrace trace(per_cpu ? threads : 1, per_cpu ? records_per_cpu : threads * records_per_cpu);
+
+  std::atomic<UInt32> running(threads);
+  std::atomic<UInt64> recorded(0);
+  std::atomic<UInt64> hook_ns(0);
+
+  std::vector<std::thread> workers;
+
+  std::vector<UInt8> stream;
+  std::vector<Size> pieces;
+
+  std::vector<UInt8> piece(darwin::HookTraceEncodedSize(kDrainRecords));
+
+  Result result = {};
+
+  stream.reserve(threads * records_per_thread * 16);
+
+  Clock::time_point start = Clock::now();
+
+  for (UInt32 thread = 0; thread < threads; thread++) {
+    workers.emplace_back([&, thread]() {
+      UInt32 cpu = per_cpu ? thread : 0;
+      UInt64 count = 0;
+
+      Clock::time_point begin = Clock::now();
+
+      for (UInt64 i = 0; i < records_per_thread; i++) {
+        UInt64 arguments[] = {0xFFFFFF8000000000ULL + i * 16, i & 0xFF};
+        UInt64 timestamp = HookTrace::GetTimestamp();
+
+        count += trace.RecordOnCpu(cpu, timestamp, thread + 1, arguments, 2);
+
+        while (work_ns && HookTrace::GetTimestamp() - timestamp < work_ns) {
+        }
+      }
+
+      hook_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin)
+                     .count();
+      recorded += count;
+      running--;
+    });
+  }
+
+  // drains until a pass comes back empty, the last pass after the hooks stopped included
+  while (true) {
+    bool done = running.load() == 0;
+    Size size;
+    Size drained = 0;
+
+    while ((size = trace.DrainEncoded(piece.data(), piece.size())) != 0) {
+      stream.insert(stream.end(), piece.begin(), piece.begin() + size);
+      pieces.push_back(size);
+      drained += size;
+    }
+
+    if (done && !drained) {
+      break;
+    }
+
+    if (!drained) {
+      std::this_thread::yield();
+    }
+  }
+
+  result.ms = MillisecondsSince(start);
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  result.recorded = recorded.load();
+  result.dropped = trace.GetDroppedCount();
+  result.hook_ns = (double)hook_ns.load() / ((UInt64)threads * records_per_thread);
+  result.encoded = stream.size();
+
+  HookTraceDecoder decoder;
+  Size offset = 0;
+
+  for (Size size : pieces) {
+    if (decoder.Decode(&stream[offset], size)) {
+      for (HookTraceRecord &record : decoder.GetRecords()) {
+        result.delivered += !(record.flags & darwin::kHookTraceFlagDropped);
+      }
+    }
+
+    offset += size;
+  }
+
+  return result;
+}
+
+void Report(const char *name, const Result &result) {
+  UInt64 hits = result.recorded + result.dropped;
+
+  printf("%-8s %9.2f ms %8.2f Mrecords/s %8.2f ns/hit  kept %6.2f%%  %5.2f bytes/record\n",
+         name, result.ms, result.delivered / result.ms / 1e3, result.hook_ns,
+         hits ? 100.0 * result.recorded / hits : 0.0,
+         result.delivered ? (double)result.encoded / result.delivered : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  UInt32 threads = argc > 1 ? atoi(argv[1]) : 4;
+  UInt64 records_per_thread = argc > 2 ? atoll(argv[2]) : 1000000;
+  UInt32 records_per_cpu = argc > 3 ? atoi(argv[3]) : darwin::kHookTraceDefaultRecords;
+  UInt64 work_ns = argc > 4 ? atoll(argv[4]) : 500;
+
+  Result shared = Run(threads, records_per_thread, records_per_cpu, work_ns, false);
+
+  Report("shared", shared);
+
+  Result per_cpu = Run(threads, records_per_thread, records_per_cpu, work_ns, true);
+
+  Report("per-cpu", per_cpu);
+
+  printf("raw      %zu bytes/record\n", sizeof(HookTraceRecord));
+
+  // every record a hook kept must have come out of the drainer
+  return shared.delivered == shared.recorded && per_cpu.delivered == per_cpu.recorded ? 0 : 1;
+}
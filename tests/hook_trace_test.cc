@@ -0,0 +1,366 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "hook_trace.h"
+#include "hook_trace_decoder.h"
+#include "types.h"
+
+namespace {
+
+using darwin::HookTrace;
+using darwin::HookTraceDecoder;
+using darwin::HookTraceEncoder;
+using darwin::HookTraceRecord;
+
+std::vector<UInt8> EncodeTrace(const std::vector<HookTraceRecord> &records, UInt32 cpu_count,
+                               UInt64 base_timestamp) {
+  HookTraceEncoder encoder;
+  std::vector<UInt8> trace(sizeof(darwin::HookTraceFileHeader) +
+                           records.size() * darwin::kHookTraceMaxEncodedSize);
+
+  Size size = encoder.EncodeHeader(cpu_count, base_timestamp, trace.data(), trace.size());
+  for (const HookTraceRecord &record : records) {
+    Size encoded = encoder.Encode(&record, &trace[size], trace.size() - size);
+    EXPECT_NE(encoded, 0);
+    size += encoded;
+  }
+
+  trace.resize(size);
+  return trace;
+}
+
+TEST(HookTraceTest, DrainsRecordsPerCpuInOrder) {
+  HookTrace trace(2, 16);
+  ASSERT_TRUE(trace.IsValid());
+  EXPECT_EQ(trace.GetRecordsPerCpu(), 16);
+
+  for (UInt64 i = 0; i < 5; i++) {
+    UInt64 arguments[] = {i, i * 2, i * 3};
+    ASSERT_TRUE(trace.RecordOnCpu(i % 2, 100 + i, 7, arguments, 3));
+  }
+
+  std::vector<HookTraceRecord> records(16);
+  ASSERT_EQ(trace.Drain(records.data(), records.size()), 5);
+
+  // CPU 0 first, then CPU 1, each in the order its hooks fired
+  UInt64 expected[] = {0, 2, 4, 1, 3};
+  for (Size i = 0; i < 5; i++) {
+    EXPECT_EQ(records[i].timestamp, 100 + expected[i]);
+    EXPECT_EQ(records[i].hook_id, 7);
+    EXPECT_EQ(records[i].cpu, expected[i] % 2);
+    EXPECT_EQ(records[i].argument_count, 3);
+    EXPECT_EQ(records[i].flags, 0);
+    EXPECT_EQ(records[i].arguments[2], expected[i] * 3);
+    EXPECT_EQ(records[i].arguments[3], 0);
+  }
+
+  EXPECT_EQ(trace.Drain(records.data(), records.size()), 0);
+}
+
+TEST(HookTraceTest, CountsAndReportsDroppedRecords) {
+  HookTrace trace(1, 4);
+  UInt64 argument = 1;
+
+  for (UInt32 i = 0; i < 4; i++) {
+    EXPECT_TRUE(trace.RecordOnCpu(0, i, 1, &argument, 1));
+  }
+  for (UInt32 i = 0; i < 3; i++) {
+    EXPECT_FALSE(trace.RecordOnCpu(0, i, 1, &argument, 1));
+  }
+  EXPECT_EQ(trace.GetDroppedCount(), 3);
+
+  std::vector<HookTraceRecord> records(8);
+  ASSERT_EQ(trace.Drain(records.data(), records.size()), 5);
+  EXPECT_EQ(records[0].flags, darwin::kHookTraceFlagDropped);
+  EXPECT_EQ(records[0].arguments[0], 3);
+
+  // drained slots are handed back, the next lap fits again and the drop is reported once
+  EXPECT_TRUE(trace.RecordOnCpu(0, 10, 1, &argument, 1));
+  ASSERT_EQ(trace.Drain(records.data(), records.size()), 1);
+  EXPECT_EQ(records[0].flags, 0);
+  EXPECT_EQ(records[0].timestamp, 10);
+}
+
+TEST(HookTraceTest, DrainStopsAtMaxRecords) {
+  HookTrace trace(3, 8);
+
+  for (UInt32 i = 0; i < 12; i++) {
+    ASSERT_TRUE(trace.RecordOnCpu(i % 3, i, i, nullptr, 0));
+  }
+
+  std::vector<HookTraceRecord> records(5);
+  Size total = 0;
+  Size drained;
+  while ((drained = trace.Drain(records.data(), records.size())) != 0) {
+    EXPECT_LE(drained, records.size());
+    total += drained;
+  }
+  EXPECT_EQ(total, 12);
+}
+
+TEST(HookTraceTest, RejectsBadGeometry) {
+  EXPECT_FALSE(HookTrace(0, 16).IsValid());
+  EXPECT_FALSE(HookTrace(darwin::kHookTraceMaxCpus + 1, 16).IsValid());
+  EXPECT_FALSE(HookTrace(1, 0).IsValid());
+
+  // capacity rounds up to a power of two
+  EXPECT_EQ(HookTrace(1, 100).GetRecordsPerCpu(), 128);
+}
+
+TEST(HookTraceTest, ConcurrentHooksAndDrainerLoseNothing) {
+  static constexpr UInt32 kCpus = 4;
+  static constexpr UInt32 kThreadsPerCpu = 3;
+  static constexpr UInt64 kRecordsPerThread = 20000;
+
+  HookTrace trace(kCpus, 256);
+  std::atomic<UInt32> running(kCpus * kThreadsPerCpu);
+  std::vector<std::thread> threads;
+  std::vector<UInt64> seen(kCpus * kThreadsPerCpu);
+  UInt64 dropped = 0;
+  UInt64 accepted = 0;
+  std::atomic<UInt64> recorded(0);
+
+  // several threads share a CPU id, like hooks preempting each other on one core
+  for (UInt32 thread = 0; thread < kCpus * kThreadsPerCpu; thread++) {
+    threads.emplace_back([&, thread]() {
+      UInt64 count = 0;
+      for (UInt64 i = 0; i < kRecordsPerThread; i++) {
+        UInt64 arguments[] = {thread, i};
+        if (trace.RecordOnCpu(thread % kCpus, i, thread + 1, arguments, 2)) {
+          count++;
+        }
+      }
+      recorded += count;
+      running--;
+    });
+  }
+
+  std::vector<HookTraceRecord> records(100);
+  std::vector<UInt64> last(kCpus * kThreadsPerCpu, 0);
+  while (true) {
+    bool done = running.load() == 0;
+    Size drained = trace.Drain(records.data(), records.size());
+
+    for (Size i = 0; i < drained; i++) {
+      if (records[i].flags & darwin::kHookTraceFlagDropped) {
+        dropped += records[i].arguments[0];
+        continue;
+      }
+
+      UInt64 thread = records[i].arguments[0];
+      ASSERT_LT(thread, seen.size());
+      ASSERT_EQ(records[i].hook_id, thread + 1);
+      ASSERT_EQ(records[i].cpu, thread % kCpus);
+
+      // each thread's records come out in the order it made them
+      if (seen[thread]) {
+        ASSERT_GT(records[i].arguments[1], last[thread]);
+      }
+      last[thread] = records[i].arguments[1];
+      seen[thread]++;
+      accepted++;
+    }
+
+    if (done && !drained) {
+      break;
+    }
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(accepted, recorded.load());
+  EXPECT_EQ(dropped, trace.GetDroppedCount());
+  EXPECT_EQ(accepted + dropped, kCpus * kThreadsPerCpu * kRecordsPerThread);
+}
+
+TEST(HookTraceEncoderTest, RoundTripsRecords) {
+  std::vector<HookTraceRecord> records;
+
+  // drain order is per CPU, so timestamps go backwards between CPUs
+  UInt64 timestamps[] = {1000, 1010, 900, 5000000000ULL, 950};
+  for (UInt32 i = 0; i < 5; i++) {
+    HookTraceRecord record = {};
+    record.timestamp = timestamps[i];
+    record.hook_id = i == 3 ? 0xFFFFFFFF : i + 1;
+    record.cpu = i % 3;
+    record.argument_count = i;
+    for (UInt32 j = 0; j < i; j++) {
+      record.arguments[j] = j == 0 ? ~0ULL : (UInt64)j << (j * 10);
+    }
+    records.push_back(record);
+  }
+
+  HookTraceRecord dropped = {};
+  dropped.timestamp = 990;
+  dropped.cpu = 2;
+  dropped.argument_count = 1;
+  dropped.flags = darwin::kHookTraceFlagDropped;
+  dropped.arguments[0] = 17;
+  records.push_back(dropped);
+
+  std::vector<UInt8> trace = EncodeTrace(records, 3, 1000);
+  EXPECT_LT(trace.size(), records.size() * sizeof(HookTraceRecord));
+
+  HookTraceDecoder decoder;
+  ASSERT_TRUE(decoder.Decode(trace.data(), trace.size()));
+  EXPECT_EQ(decoder.GetCpuCount(), 3);
+  EXPECT_EQ(decoder.GetDroppedCount(), 17);
+  EXPECT_EQ(decoder.GetDecodedSize(), trace.size());
+  ASSERT_EQ(decoder.GetRecords().size(), records.size());
+
+  for (Size i = 0; i < records.size(); i++) {
+    EXPECT_EQ(memcmp(&decoder.GetRecords()[i], &records[i], sizeof(HookTraceRecord)), 0)
+        << "record " << i;
+  }
+
+  decoder.SortByTimestamp();
+  std::vector<UInt64> sorted;
+  for (HookTraceRecord &record : decoder.GetRecords()) {
+    sorted.push_back(record.timestamp);
+  }
+  EXPECT_EQ(sorted, (std::vector<UInt64>{900, 950, 990, 1000, 1010, 5000000000ULL}));
+}
+
+TEST(HookTraceEncoderTest, RejectsSmallBuffers) {
+  HookTraceEncoder encoder;
+  HookTraceRecord record = {};
+  record.timestamp = 1ULL << 40;
+  record.argument_count = 2;
+  record.arguments[0] = ~0ULL;
+  UInt8 out[8];
+
+  EXPECT_EQ(encoder.EncodeHeader(1, 0, out, sizeof(out)), 0);
+  EXPECT_EQ(encoder.Encode(&record, out, sizeof(out)), 0);
+  EXPECT_EQ(encoder.EncodeHeader(darwin::kHookTraceMaxCpus + 1, 0, out, 16), 0);
+}
+
+TEST(HookTraceEncoderTest, DrainsEncodedTracesThatDecodeOnTheirOwn) {
+  HookTrace trace(2, 64);
+
+  // records that encode to the largest size there is, so the encoder runs closest to the
+  // records it has not read yet
+  std::vector<HookTraceRecord> expected(40);
+  for (UInt32 i = 0; i < expected.size(); i++) {
+    HookTraceRecord &record = expected[i];
+    record.timestamp = i % 2 ? ~0ULL - i : i;
+    record.hook_id = 0xFFFFFFF0 + (i % 16);
+    record.cpu = i % 2;
+    record.argument_count = darwin::kHookTraceMaxArguments;
+    for (UInt32 j = 0; j < darwin::kHookTraceMaxArguments; j++) {
+      record.arguments[j] = ~0ULL - i * 8 - j;
+    }
+    ASSERT_TRUE(trace.RecordOnCpu(record.cpu, record.timestamp, record.hook_id,
+                                  record.arguments, record.argument_count));
+  }
+
+  // room for 15 records at a time, at an odd address
+  std::vector<UInt8> buffer(darwin::HookTraceEncodedSize(15) + 1);
+  UInt8 *out = buffer.data() + 1;
+  Size out_size = buffer.size() - 1;
+
+  std::vector<HookTraceRecord> decoded;
+  Size size;
+  while ((size = trace.DrainEncoded(out, out_size)) != 0) {
+    ASSERT_LE(size, out_size);
+
+    HookTraceDecoder decoder;
+    ASSERT_TRUE(decoder.Decode(out, size));
+    EXPECT_EQ(decoder.GetCpuCount(), 2);
+    EXPECT_LE(decoder.GetRecords().size(), 15);
+    decoded.insert(decoded.end(), decoder.GetRecords().begin(), decoder.GetRecords().end());
+  }
+
+  ASSERT_EQ(decoded.size(), expected.size());
+  for (HookTraceRecord &record : decoded) {
+    UInt64 i = (~0ULL - record.arguments[0]) / 8;
+    ASSERT_LT(i, expected.size());
+    EXPECT_EQ(memcmp(&record, &expected[i], sizeof(HookTraceRecord)), 0) << "record " << i;
+  }
+
+  // too small for a single record leaves everything with the CPUs
+  UInt64 argument = 1;
+  ASSERT_TRUE(trace.RecordOnCpu(0, 1, 1, &argument, 1));
+  EXPECT_EQ(trace.DrainEncoded(out, darwin::HookTraceEncodedSize(1) - 1), 0);
+  EXPECT_NE(trace.DrainEncoded(out, darwin::HookTraceEncodedSize(1)), 0);
+}
+
+TEST(HookTraceDecoderTest, RejectsMalformedTraces) {
+  HookTraceRecord record = {};
+  record.timestamp = 5;
+  record.cpu = 1;
+  record.argument_count = 1;
+  record.arguments[0] = 42;
+
+  std::vector<UInt8> trace = EncodeTrace({record}, 2, 0);
+  HookTraceDecoder decoder;
+
+  std::vector<UInt8> magic = trace;
+  magic[0] ^= 1;
+  EXPECT_FALSE(decoder.Decode(magic.data(), magic.size()));
+
+  std::vector<UInt8> version = trace;
+  version[4] = 2;
+  EXPECT_FALSE(decoder.Decode(version.data(), version.size()));
+
+  // a CPU the header does not account for
+  std::vector<UInt8> cpus = trace;
+  cpus[6] = 1;
+  EXPECT_FALSE(decoder.Decode(cpus.data(), cpus.size()));
+
+  // more arguments than a record can hold
+  std::vector<UInt8> arguments = trace;
+  arguments[sizeof(darwin::HookTraceFileHeader)] = 0x70;
+  EXPECT_FALSE(decoder.Decode(arguments.data(), arguments.size()));
+
+  // a varint that never ends
+  std::vector<UInt8> varint = trace;
+  varint.resize(sizeof(darwin::HookTraceFileHeader) + 1);
+  varint.insert(varint.end(), 11, 0xFF);
+  EXPECT_FALSE(decoder.Decode(varint.data(), varint.size()));
+
+  EXPECT_FALSE(decoder.Decode(trace.data(), sizeof(darwin::HookTraceFileHeader) - 1));
+  EXPECT_TRUE(decoder.Decode(trace.data(), trace.size()));
+}
+
+TEST(HookTraceDecoderTest, KeepsRecordsBeforeTruncation) {
+  std::vector<HookTraceRecord> records(10);
+  for (UInt32 i = 0; i < records.size(); i++) {
+    records[i].timestamp = i * 1000;
+    records[i].hook_id = i;
+    records[i].argument_count = 2;
+    records[i].arguments[0] = i;
+    records[i].arguments[1] = 1ULL << 50;
+  }
+
+  std::vector<UInt8> trace = EncodeTrace(records, 1, 0);
+  HookTraceDecoder decoder;
+
+  EXPECT_FALSE(decoder.Decode(trace.data(), trace.size() - 3));
+  ASSERT_EQ(decoder.GetRecords().size(), 9);
+  EXPECT_EQ(decoder.GetRecords().back().hook_id, 8);
+  EXPECT_LT(decoder.GetDecodedSize(), trace.size() - 3);
+
+  // the complete trace decodes in full
+  EXPECT_TRUE(decoder.Decode(trace.data(), trace.size()));
+  EXPECT_EQ(decoder.GetRecords().size(), 10);
+}
+
+void DecoderNeverCrashes(std::vector<UInt8> data) {
+  HookTraceDecoder decoder;
+  if (decoder.Decode(data.data(), data.size())) {
+    EXPECT_EQ(decoder.GetDecodedSize(), data.size());
+  }
+  EXPECT_LE(decoder.GetDecodedSize(), data.size());
+  decoder.SortByTimestamp();
+}
+FUZZ_TEST(HookTraceDecoderTest, DecoderNeverCrashes);
+
+} // namespace
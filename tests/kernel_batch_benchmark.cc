@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "kernel_batch.h"
+
+// Usage: kernel_batch_benchmark [reads] [latency_ns]
+//
+// Reads 8 byte values out of a stand-in for kernel memory, once with one call per value like
+// kernel_read64() and once through KernelBatch. Every call into the backend spins for latency_ns
+// to model the cost of crossing into the kext through IOConnectCallMethod, so the time saved is
+// the number of calls avoided.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using darwin::KernelBatch;
+
+static constexpr UInt64 kKernelBase = 0xFFFFFF8000000000;
+
+class SlowBackend : public darwin::KernelBatchBackend {
+public:
+  SlowBackend(Size size, UInt64 latency) : memory(size), latency(latency) {}
+
+  bool Read(xnu::mach::VmAddress address, void *data, Size size) override {
+    return Access(address, data, size, false);
+  }
+
+  bool Write(xnu::mach::VmAddress address, void *data, Size size) override {
+    return Access(address, data, size, true);
+  }
+
+  bool PhysicalRead(UInt64 paddr, void *data, Size size) override {
+    return Access(paddr, data, size, false);
+  }
+
+  bool PhysicalWrite(UInt64 paddr, void *data, Size size) override {
+    return Access(paddr, data, size, true);
+  }
+
+  // what one trip into the kext costs
+  void Call() {
+    Clock::time_point end = Clock::now() + std::chrono::nanoseconds(latency);
+
+    calls++;
+
+    while (Clock::now() < end) {
+    }
+  }
+
+  std::vector<UInt8> memory;
+
+  UInt64 latency;
+
+  Size calls = 0;
+
+private:
+  bool Access(UInt64 address, void *data, Size size, bool write) {
+    if (address < kKernelBase || address - kKernelBase + size > memory.size()) {
+      return false;
+    }
+
+    if (write) {
+      memcpy(&memory[address - kKernelBase], data, size);
+    } else {
+      memcpy(data, &memory[address - kKernelBase], size);
+    }
+
+    return true;
+  }
+};
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Size count = argc > 1 ? atoi(argv[1]) : 10000;
+  UInt64 latency = argc > 2 ? atoll(argv[2]) : 5000;
+
+  SlowBackend backend(count * 8, latency);
+
+  std::vector<UInt64> single(count);
+  std::vector<UInt64> batched(count);
+
+  for (Size i = 0; i < count; i++) {
+    UInt64 value = kKernelBase + ((i * 7919) % count) * 8;
+
+    memcpy(&backend.memory[i * 8], &value, sizeof(value));
+  }
+
+  Clock::time_point start = Clock::now();
+
+  for (Size i = 0; i < count; i++) {
+    backend.Call();
+    backend.Read(kKernelBase + i * 8, &single[i], sizeof(UInt64));
+  }
+
+  double single_ms = MillisecondsSince(start);
+  Size single_calls = backend.calls;
+
+  backend.calls = 0;
+
+  KernelBatch batch;
+
+  start = Clock::now();
+
+  // batches are capped at kKernelBatchMaxOperations, larger walks take several calls
+  for (Size i = 0; i < count; i++) {
+    batch.AddRead(kKernelBase + i * 8, &batched[i], sizeof(UInt64));
+
+    if (batch.GetOperationCount() == darwin::kKernelBatchMaxOperations || i + 1 == count) {
+      batch.Build();
+
+      backend.Call();
+
+      darwin::ExecuteKernelBatch(&backend, batch.GetRequest(), batch.GetRequestSize(),
+                                 batch.GetResponse(), batch.GetResponseSize());
+
+      batch.Decode();
+      batch.Reset();
+    }
+  }
+
+  double batch_ms = MillisecondsSince(start);
+
+  if (single != batched) {
+    fprintf(stderr, "batched reads do not match the single reads\n");
+    return 1;
+  }
+
+  printf("%-8s %9.2f ms %9.1f us/read  calls %6zu\n", "single", single_ms,
+         single_ms * 1e3 / count, single_calls);
+  printf("%-8s %9.2f ms %9.1f us/read  calls %6zu\n", "batch", batch_ms, batch_ms * 1e3 / count,
+         backend.calls);
+
+  return 0;
+}
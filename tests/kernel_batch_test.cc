@@ -0,0 +1,247 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "kernel_batch.h"
+#include "types.h"
+
+namespace {
+
+using darwin::KernelBatch;
+using darwin::KernelBatchHeader;
+using darwin::KernelBatchOperation;
+
+static constexpr UInt64 kKernelBase = 0xFFFFFF8000100000;
+static constexpr UInt64 kPhysicalBase = 0x80000000;
+static constexpr Size kMemorySize = 0x10000;
+
+// Kernel and physical memory backed by host arrays, anything outside of them fails.
+class FakeBackend : public darwin::KernelBatchBackend {
+public:
+  FakeBackend() : kernel(kMemorySize), physical(kMemorySize) {
+    for (Size i = 0; i < kMemorySize; i++) {
+      kernel[i] = (UInt8)(i * 7);
+      physical[i] = (UInt8)(i * 13 + 1);
+    }
+  }
+
+  bool Read(xnu::mach::VmAddress address, void *data, Size size) override {
+    calls++;
+    UInt8 *bytes = Translate(kernel, kKernelBase, address, size);
+    return bytes && memcpy(data, bytes, size);
+  }
+
+  bool Write(xnu::mach::VmAddress address, void *data, Size size) override {
+    calls++;
+    UInt8 *bytes = Translate(kernel, kKernelBase, address, size);
+    return bytes && memcpy(bytes, data, size);
+  }
+
+  bool PhysicalRead(UInt64 paddr, void *data, Size size) override {
+    calls++;
+    UInt8 *bytes = Translate(physical, kPhysicalBase, paddr, size);
+    return bytes && memcpy(data, bytes, size);
+  }
+
+  bool PhysicalWrite(UInt64 paddr, void *data, Size size) override {
+    calls++;
+    UInt8 *bytes = Translate(physical, kPhysicalBase, paddr, size);
+    return bytes && memcpy(bytes, data, size);
+  }
+
+  std::vector<UInt8> kernel;
+  std::vector<UInt8> physical;
+
+  Size calls = 0;
+
+private:
+  static UInt8 *Translate(std::vector<UInt8> &memory, UInt64 base, UInt64 address, Size size) {
+    if (address < base || address - base > memory.size() || size > memory.size() - (address - base)) {
+      return nullptr;
+    }
+    return memory.data() + (address - base);
+  }
+};
+
+bool ExecuteBatch(FakeBackend &backend, KernelBatch &batch) {
+  if (!batch.Build()) {
+    return false;
+  }
+  if (!darwin::ExecuteKernelBatch(&backend, batch.GetRequest(), batch.GetRequestSize(),
+                                  batch.GetResponse(), batch.GetResponseSize())) {
+    return false;
+  }
+  return batch.Decode();
+}
+
+TEST(KernelBatchTest, RoundTripsReadsAndWrites) {
+  FakeBackend backend;
+  KernelBatch batch;
+
+  UInt64 value = 0;
+  UInt8 bytes[13] = {};
+  UInt32 physical = 0;
+  const UInt8 patch[5] = {0xCC, 0xCC, 0xCC, 0xCC, 0xCC};
+  const UInt32 marker = 0x41414141;
+
+  ASSERT_TRUE(batch.AddRead(kKernelBase + 0x100, &value, sizeof(value)));
+  ASSERT_TRUE(batch.AddWrite(kKernelBase + 0x200, patch, sizeof(patch)));
+  ASSERT_TRUE(batch.AddRead(kKernelBase + 0x1FE, bytes, sizeof(bytes)));
+  ASSERT_TRUE(batch.AddPhysicalWrite(kPhysicalBase + 0x40, &marker, sizeof(marker)));
+  ASSERT_TRUE(batch.AddPhysicalRead(kPhysicalBase + 0x40, &physical, sizeof(physical)));
+  EXPECT_EQ(batch.GetOperationCount(), 5);
+
+  ASSERT_TRUE(ExecuteBatch(backend, batch));
+  EXPECT_EQ(batch.GetFailedCount(), 0);
+  EXPECT_EQ(backend.calls, 5);
+
+  UInt64 expected;
+  memcpy(&expected, &backend.kernel[0x100], sizeof(expected));
+  EXPECT_EQ(value, expected);
+
+  // operations run in order, so the read sees the write before it
+  EXPECT_EQ(bytes[0], backend.kernel[0x1FE]);
+  EXPECT_EQ(memcmp(&bytes[2], patch, sizeof(patch)), 0);
+  EXPECT_EQ(bytes[7], (UInt8)(0x205 * 7));
+
+  EXPECT_EQ(physical, marker);
+}
+
+TEST(KernelBatchTest, ReportsFailedOperations) {
+  FakeBackend backend;
+  KernelBatch batch;
+
+  UInt64 first = 0, missing = 0x1234, last = 0;
+  const UInt64 value = 0x5555;
+
+  batch.AddRead(kKernelBase, &first, sizeof(first));
+  batch.AddRead(0x1000, &missing, sizeof(missing));
+  batch.AddWrite(kKernelBase + kMemorySize - 4, &value, sizeof(value));
+  batch.AddRead(kKernelBase + 8, &last, sizeof(last));
+
+  EXPECT_FALSE(ExecuteBatch(backend, batch));
+  EXPECT_EQ(batch.GetFailedCount(), 2);
+  EXPECT_EQ(backend.calls, 4);
+
+  EXPECT_TRUE(batch.Succeeded(0));
+  EXPECT_FALSE(batch.Succeeded(1));
+  EXPECT_FALSE(batch.Succeeded(2));
+  EXPECT_TRUE(batch.Succeeded(3));
+  EXPECT_FALSE(batch.Succeeded(4));
+
+  // failed reads leave the destination alone and do not shift the reads after them
+  EXPECT_EQ(missing, 0x1234);
+  EXPECT_EQ(memcmp(&first, &backend.kernel[0], sizeof(first)), 0);
+  EXPECT_EQ(memcmp(&last, &backend.kernel[8], sizeof(last)), 0);
+}
+
+TEST(KernelBatchTest, ReusesBuffersAfterReset) {
+  FakeBackend backend;
+  KernelBatch batch;
+
+  std::vector<UInt64> values(1000);
+
+  for (int round = 0; round < 3; round++) {
+    batch.Reset();
+    for (Size i = 0; i < values.size(); i++) {
+      ASSERT_TRUE(batch.AddRead(kKernelBase + i * 8 + round, &values[i], sizeof(UInt64)));
+    }
+    ASSERT_TRUE(ExecuteBatch(backend, batch));
+    for (Size i = 0; i < values.size(); i++) {
+      ASSERT_EQ(memcmp(&values[i], &backend.kernel[i * 8 + round], sizeof(UInt64)), 0);
+    }
+  }
+}
+
+TEST(KernelBatchTest, RejectsOversizedOperations) {
+  KernelBatch batch;
+  UInt8 byte;
+  std::vector<UInt8> large(darwin::kKernelBatchMaxOperationSize + 1);
+
+  EXPECT_FALSE(batch.AddRead(kKernelBase, &byte, 0));
+  EXPECT_FALSE(batch.AddRead(kKernelBase, nullptr, 1));
+  EXPECT_FALSE(batch.AddRead(kKernelBase, large.data(), large.size()));
+  EXPECT_FALSE(batch.Build());
+
+  for (UInt32 i = 0; i < darwin::kKernelBatchMaxOperations; i++) {
+    ASSERT_TRUE(batch.AddRead(kKernelBase, &byte, 1));
+  }
+  EXPECT_FALSE(batch.AddRead(kKernelBase, &byte, 1));
+}
+
+TEST(KernelBatchTest, RejectsMalformedRequests) {
+  FakeBackend backend;
+  KernelBatch batch;
+  UInt64 value;
+  const UInt64 patch = 0;
+
+  batch.AddRead(kKernelBase, &value, sizeof(value));
+  batch.AddWrite(kKernelBase, &patch, sizeof(patch));
+  ASSERT_TRUE(batch.Build());
+
+  std::vector<UInt8> request(batch.GetRequest(), batch.GetRequest() + batch.GetRequestSize());
+  std::vector<UInt8> response(batch.GetResponseSize());
+
+  EXPECT_EQ(darwin::GetKernelBatchResponseSize(request.data(), request.size()), response.size());
+
+  // a response buffer that is too small runs nothing
+  EXPECT_FALSE(darwin::ExecuteKernelBatch(&backend, request.data(), request.size(),
+                                          response.data(), response.size() - 1));
+
+  // write bytes missing from the end of the request
+  EXPECT_FALSE(darwin::ExecuteKernelBatch(&backend, request.data(), request.size() - 8,
+                                          response.data(), response.size()));
+
+  auto *header = reinterpret_cast<KernelBatchHeader *>(request.data());
+  auto *operations = reinterpret_cast<KernelBatchOperation *>(header + 1);
+
+  header->operation_count = 3;
+  EXPECT_FALSE(darwin::ExecuteKernelBatch(&backend, request.data(), request.size(),
+                                          response.data(), response.size()));
+  header->operation_count = 2;
+
+  operations[1].type = 9;
+  EXPECT_FALSE(darwin::ExecuteKernelBatch(&backend, request.data(), request.size(),
+                                          response.data(), response.size()));
+  operations[1].type = darwin::kKernelBatchWrite;
+
+  operations[0].size = 0xFFFFFFFF;
+  EXPECT_FALSE(darwin::ExecuteKernelBatch(&backend, request.data(), request.size(),
+                                          response.data(), response.size()));
+  operations[0].size = sizeof(UInt64);
+
+  header->magic = 0;
+  EXPECT_FALSE(darwin::ExecuteKernelBatch(&backend, request.data(), request.size(),
+                                          response.data(), response.size()));
+
+  EXPECT_EQ(backend.calls, 0);
+}
+
+void ExecuteNeverCrashes(std::vector<UInt8> request, std::vector<KernelBatchOperation> operations,
+                         Size response_size) {
+  FakeBackend backend;
+
+  // a valid header gets the fuzzer past the first check
+  std::vector<UInt8> buffer(sizeof(KernelBatchHeader));
+  auto *header = reinterpret_cast<KernelBatchHeader *>(buffer.data());
+  header->magic = darwin::kKernelBatchMagic;
+  header->version = darwin::kKernelBatchVersion;
+  header->operation_count = operations.size();
+
+  buffer.insert(buffer.end(), reinterpret_cast<UInt8 *>(operations.data()),
+                reinterpret_cast<UInt8 *>(operations.data() + operations.size()));
+  buffer.insert(buffer.end(), request.begin(), request.end());
+  reinterpret_cast<KernelBatchHeader *>(buffer.data())->size = buffer.size();
+
+  std::vector<UInt8> response(response_size % (1 << 20));
+  darwin::ExecuteKernelBatch(&backend, buffer.data(), buffer.size(), response.data(),
+                             response.size());
+  darwin::ExecuteKernelBatch(&backend, request.data(), request.size(), response.data(),
+                             response.size());
+}
+FUZZ_TEST(KernelBatchTest, ExecuteNeverCrashes);
+
+} // namespace
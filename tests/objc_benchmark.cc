@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "objc.h"
+#include "macho_userspace.h"
+
+// Usage: objc_benchmark <dumped image, e.g. UIKitCore> [iterations]
+//
+// Times ParseObjC() and then looks up every class, method and selector in the image through
+// the hash indexes, next to the linear strcmp scans they replaced. Finally times a lazy
+// ParseObjC() followed by realizing a handful of classes.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+objc::ObjCClass *LinearClassByName(objc::ObjCData *data, char *name) {
+  for (objc::ObjCClass *cls : data->GetClasses()) {
+    if (cls->GetName() && strcmp(cls->GetName(), name) == 0) {
+      return cls;
+    }
+  }
+  return nullptr;
+}
+
+objc::Method *LinearMethod(objc::ObjCClass *cls, char *name) {
+  for (objc::Method *method : cls->GetMethods()) {
+    if (method->GetName() && strcmp(method->GetName(), name) == 0) {
+      return method;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <macho> [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  int iterations = argc > 2 ? atoi(argv[2]) : 10;
+
+  darwin::MachOUserspace macho(argv[1]);
+
+  Clock::time_point start = Clock::now();
+  macho.ParseObjC();
+  double parse_ms = MillisecondsSince(start);
+
+  objc::ObjCData *data = macho.GetObjCMetadata();
+
+  std::vector<objc::ObjCClass *> &classes = data->GetClasses();
+
+  Size methods = 0;
+  for (objc::ObjCClass *cls : classes) {
+    methods += cls->GetMethods().size();
+  }
+
+  printf("%zu classes, %zu methods, %zu categories, ParseObjC %.2f ms\n", classes.size(),
+         methods, data->GetCategories().size(), parse_ms);
+
+  Size found = 0;
+
+  start = Clock::now();
+  for (int i = 0; i < iterations; i++) {
+    for (objc::ObjCClass *cls : classes) {
+      found += data->GetClassByName(cls->GetName()) != nullptr;
+      found += data->GetClassByIsa(reinterpret_cast<UInt64>(cls->GetClass())) != nullptr;
+      for (objc::Method *method : cls->GetMethods()) {
+        found += cls->GetMethod(method->GetName()) != nullptr;
+        found += data->GetImplementations(method->GetName()) != nullptr;
+      }
+    }
+  }
+  double indexed_ms = MillisecondsSince(start);
+
+  printf("indexed: %.2f ms per iteration (%zu hits)\n", indexed_ms / iterations, found);
+
+  found = 0;
+
+  // the linear scans are quadratic, a single pass is plenty to show the difference
+  start = Clock::now();
+  for (objc::ObjCClass *cls : classes) {
+    found += LinearClassByName(data, cls->GetName()) != nullptr;
+    for (objc::Method *method : cls->GetMethods()) {
+      found += LinearMethod(cls, method->GetName()) != nullptr;
+    }
+  }
+  double linear_ms = MillisecondsSince(start);
+
+  printf("linear:  %.2f ms per iteration (%zu hits)\n", linear_ms, found);
+
+  darwin::MachOUserspace lazy_macho(argv[1]);
+
+  start = Clock::now();
+  lazy_macho.ParseObjC(true);
+  double lazy_parse_ms = MillisecondsSince(start);
+
+  objc::ObjCData *lazy_data = lazy_macho.GetObjCMetadata();
+
+  found = 0;
+
+  // a tool that only cares about a handful of classes realizes just those
+  start = Clock::now();
+  for (Size i = 0; i < classes.size() && i < 16; i++) {
+    objc::ObjCClass *cls = lazy_data->GetClassByName(classes[i]->GetName());
+    found += cls ? cls->GetMethods().size() : 0;
+  }
+  double lazy_lookup_ms = MillisecondsSince(start);
+
+  printf("lazy:    ParseObjC %.2f ms, 16 classes realized in %.2f ms (%zu methods)\n",
+         lazy_parse_ms, lazy_lookup_ms, found);
+
+  return 0;
+}
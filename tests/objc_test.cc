@@ -0,0 +1,279 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "macho_userspace.h"
+#include "objc.h"
+#include "types.h"
+
+namespace {
+
+// file offsets and vm addresses are the same, like an unslid image read off disk
+static constexpr UInt64 kDataConstOffset = 0x1000;
+static constexpr UInt64 kDataOffset = 0x2000;
+static constexpr UInt64 kConstOffset = 0x2000;
+static constexpr UInt64 kClassesOffset = 0x4000;
+static constexpr UInt64 kSelRefsOffset = 0x5000;
+static constexpr UInt64 kIvarOffset = 0x5800;
+static constexpr UInt64 kMethNameOffset = 0x6000;
+static constexpr UInt64 kImageSize = 0x8000;
+
+static constexpr UInt32 kClasses = 8;
+
+// every class implements the same two selectors
+static const char *const kSelectors[] = {"run", "stop"};
+static constexpr UInt32 kSelectorCount = 2;
+
+struct SectionSpec {
+  const char *name;
+  UInt64 offset;
+  UInt64 size;
+};
+
+// A Mach-O with a __DATA_CONST,__objc_classlist of kClasses classes, each with a metaclass and
+// two instance methods, and the __DATA sections ObjCData expects. Pointers are plain file
+// offsets, which is what the parser reads out of images without a dyld cache.
+struct ObjCImage {
+  std::vector<UInt8> buffer;
+
+  UInt8 *cmd;
+  UInt32 ncmds;
+
+  darwin::MachOUserspace macho;
+
+  ObjCImage() : buffer(kImageSize), ncmds(0) {
+    cmd = buffer.data() + sizeof(struct mach_header_64);
+
+    SectionSpec data_const[] = {{"__objc_classlist", kDataConstOffset, kClasses * sizeof(UInt64)}};
+    // segment ends are inclusive to the parser, so the segments do not touch
+    AddSegment("__DATA_CONST", kDataConstOffset, 0x800, data_const, 1);
+
+    SectionSpec data[] = {
+        {"__objc_const", kConstOffset, kClassesOffset - kConstOffset},
+        {"__objc_data", kClassesOffset, kSelRefsOffset - kClassesOffset},
+        {"__objc_selrefs", kSelRefsOffset, kSelectorCount * sizeof(UInt64)},
+        {"__objc_ivar", kIvarOffset, sizeof(UInt64)},
+        {"__objc_methname", kMethNameOffset, kImageSize - kMethNameOffset},
+    };
+    AddSegment("__DATA", kDataOffset, kImageSize - kDataOffset, data, 5);
+
+    for (UInt32 i = 0; i < kSelectorCount; i++) {
+      strcpy(At<char>(SelectorName(i)), kSelectors[i]);
+      *At<UInt64>(kSelRefsOffset + i * sizeof(UInt64)) = SelectorName(i);
+    }
+
+    for (UInt32 i = 0; i < kClasses; i++) {
+      AddClass(i);
+    }
+
+    macho.SetObjectiveCLibrary(nullptr);
+    macho.WithBuffer(0, reinterpret_cast<char *>(buffer.data()), 0);
+  }
+
+  template <typename T> T *At(UInt64 offset) {
+    return reinterpret_cast<T *>(buffer.data() + offset);
+  }
+
+  static UInt64 SelectorName(UInt32 i) { return kMethNameOffset + i * 0x10; }
+
+  static UInt64 ClassName(UInt32 i) { return kMethNameOffset + 0x100 + i * 0x10; }
+
+  static UInt64 Class(UInt32 i) { return kClassesOffset + i * 0x80; }
+
+  static UInt64 Metaclass(UInt32 i) { return Class(i) + 0x40; }
+
+  void AddSegment(const char *name, UInt64 offset, UInt64 size, SectionSpec *sections,
+                  UInt32 count) {
+    auto *segment = reinterpret_cast<struct segment_command_64 *>(cmd);
+    segment->cmd = LC_SEGMENT_64;
+    segment->cmdsize = sizeof(*segment) + count * sizeof(struct section_64);
+    strncpy(segment->segname, name, sizeof(segment->segname));
+    segment->vmaddr = offset;
+    segment->vmsize = size;
+    segment->fileoff = offset;
+    segment->filesize = size;
+    segment->nsects = count;
+
+    auto *section = reinterpret_cast<struct section_64 *>(segment + 1);
+    for (UInt32 i = 0; i < count; i++, section++) {
+      strncpy(section->sectname, sections[i].name, sizeof(section->sectname));
+      strncpy(section->segname, name, sizeof(section->segname));
+      section->addr = sections[i].offset;
+      section->size = sections[i].size;
+      section->offset = sections[i].offset;
+    }
+
+    cmd += segment->cmdsize;
+    ncmds++;
+
+    auto *header = reinterpret_cast<struct mach_header_64 *>(buffer.data());
+    header->magic = MH_MAGIC_64;
+    header->ncmds = ncmds;
+    header->sizeofcmds = cmd - buffer.data() - sizeof(struct mach_header_64);
+  }
+
+  void AddClass(UInt32 i) {
+    UInt64 ro = kConstOffset + i * 0x100;
+    UInt64 meta_ro = ro + 0x80;
+    UInt64 methods = ro + sizeof(objc::_objc_2_class_data);
+
+    snprintf(At<char>(ClassName(i)), 0x10, "Class%u", i);
+
+    auto *data = At<objc::_objc_2_class_data>(ro);
+    data->name = ClassName(i);
+    data->methods = methods;
+
+    // metaclasses carry the name of their class and no methods here
+    auto *meta_data = At<objc::_objc_2_class_data>(meta_ro);
+    meta_data->flags = 1;
+    meta_data->name = ClassName(i);
+
+    auto *info = At<objc::_objc_2_class_method_info>(methods);
+    info->entrySize = sizeof(objc::_objc_2_class_method);
+    info->count = kSelectorCount;
+
+    for (UInt32 j = 0; j < kSelectorCount; j++) {
+      auto *method = At<objc::_objc_2_class_method>(methods + sizeof(*info) +
+                                                     j * sizeof(objc::_objc_2_class_method));
+
+      // relative to the field, pointing at the selector reference
+      UInt64 field = reinterpret_cast<UInt8 *>(&method->name) - buffer.data();
+      method->name = static_cast<UInt32>(kSelRefsOffset + j * sizeof(UInt64) - field);
+      method->imp = 0x100 + i * 0x10 + j;
+    }
+
+    auto *cls = At<objc::_objc_2_class>(Class(i));
+    cls->isa = Metaclass(i);
+    cls->data = reinterpret_cast<objc::_objc_2_class_data *>(ro);
+
+    auto *metaclass = At<objc::_objc_2_class>(Metaclass(i));
+    metaclass->isa = Metaclass(0);
+    metaclass->data = reinterpret_cast<objc::_objc_2_class_data *>(meta_ro);
+
+    *At<UInt64>(kDataConstOffset + i * sizeof(UInt64)) = Class(i);
+  }
+};
+
+TEST(ObjCTest, LooksUpClassesByNameAndIsa) {
+  ObjCImage image;
+  image.macho.ParseObjC();
+
+  objc::ObjCData *data = image.macho.GetObjCMetadata();
+  ASSERT_NE(data, nullptr);
+
+  // a class and its metaclass per entry in the class list
+  EXPECT_EQ(data->GetClasses().size(), 2 * kClasses);
+
+  for (UInt32 i = 0; i < kClasses; i++) {
+    char name[0x10];
+    snprintf(name, sizeof(name), "Class%u", i);
+
+    objc::ObjCClass *cls = data->GetClassByName(name);
+    ASSERT_NE(cls, nullptr);
+    EXPECT_STREQ(cls->GetName(), name);
+    EXPECT_EQ(cls->GetClass(), image.At<objc::_objc_2_class>(ObjCImage::Class(i)));
+    EXPECT_EQ(cls->GetIsa(), ObjCImage::Metaclass(i));
+
+    // the class and the metaclass are both found by the address of their objc_class
+    EXPECT_EQ(data->GetClassByIsa(reinterpret_cast<UInt64>(cls->GetClass())), cls);
+
+    objc::ObjCClass *metaclass = data->GetClassByIsa(
+        reinterpret_cast<UInt64>(image.At<objc::_objc_2_class>(ObjCImage::Metaclass(i))));
+    ASSERT_NE(metaclass, nullptr);
+    EXPECT_NE(metaclass, cls);
+    EXPECT_STREQ(metaclass->GetName(), name);
+
+    ASSERT_EQ(cls->GetMethods().size(), kSelectorCount);
+    objc::Method *stop = cls->GetMethod(const_cast<char *>("stop"));
+    ASSERT_NE(stop, nullptr);
+    EXPECT_STREQ(stop->GetName(), "stop");
+    EXPECT_EQ(data->GetMethod(name, const_cast<char *>("run")), cls->GetMethods()[0]);
+  }
+
+  EXPECT_EQ(data->GetClassByName(const_cast<char *>("Class99")), nullptr);
+  EXPECT_EQ(data->GetClassByIsa(reinterpret_cast<UInt64>(image.buffer.data())), nullptr);
+  EXPECT_EQ(data->GetMethod(const_cast<char *>("Class0"), const_cast<char *>("walk")), nullptr);
+
+  // every class implements every selector
+  std::vector<objc::Method *> *runs = data->GetImplementations(const_cast<char *>("run"));
+  ASSERT_NE(runs, nullptr);
+  EXPECT_EQ(runs->size(), kClasses);
+}
+
+TEST(ObjCTest, RealizesLazyClassOnceAcrossThreads) {
+  static constexpr int kThreads = 8;
+
+  ObjCImage image;
+  image.macho.ParseObjC(true);
+
+  objc::ObjCData *data = image.macho.GetObjCMetadata();
+  ASSERT_NE(data, nullptr);
+  ASSERT_TRUE(data->IsLazy());
+
+  objc::ObjCClass *cls = data->GetClassByName(const_cast<char *>("Class3"));
+  ASSERT_NE(cls, nullptr);
+
+  std::vector<std::thread> threads;
+  std::vector<std::vector<objc::Method *> *> seen(kThreads);
+  std::vector<objc::Method *> found(kThreads);
+
+  // all of them race for the first access, which parses the methods
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&, i]() {
+      cls->Realize();
+      seen[i] = &cls->GetMethods();
+      found[i] = cls->GetMethod(const_cast<char *>("run"));
+    });
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  // a second realization would have appended the methods again
+  ASSERT_EQ(cls->GetMethods().size(), kSelectorCount);
+  ASSERT_NE(found[0], nullptr);
+  EXPECT_STREQ(found[0]->GetName(), "run");
+
+  for (int i = 0; i < kThreads; i++) {
+    EXPECT_EQ(seen[i], &cls->GetMethods());
+    EXPECT_EQ(found[i], found[0]);
+  }
+
+  // another class is realized on its own, with methods of its own
+  objc::ObjCClass *other = data->GetClassByName(const_cast<char *>("Class4"));
+  ASSERT_NE(other, nullptr);
+  EXPECT_EQ(other->GetMethods().size(), kSelectorCount);
+  EXPECT_NE(other->GetMethod(const_cast<char *>("run")), found[0]);
+}
+
+void LookupsMatchNames(std::string name) {
+  static ObjCImage *image = [] {
+    auto *parsed = new ObjCImage();
+    parsed->macho.ParseObjC(true);
+    return parsed;
+  }();
+
+  objc::ObjCData *data = image->macho.GetObjCMetadata();
+
+  objc::ObjCClass *cls = data->GetClassByName(name.data());
+  if (cls) {
+    EXPECT_EQ(std::string(cls->GetName()), name);
+  }
+
+  objc::ObjCClass *first = data->GetClassByName(const_cast<char *>("Class0"));
+  ASSERT_NE(first, nullptr);
+  objc::Method *method = first->GetMethod(name.data());
+  if (method) {
+    EXPECT_EQ(std::string(method->GetName()), name);
+  }
+}
+FUZZ_TEST(ObjCTest, LookupsMatchNames);
+
+} // namespace
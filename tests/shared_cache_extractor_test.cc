@@ -0,0 +1,285 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "shared_cache.h"
+#include "shared_cache_extractor.h"
+#include "types.h"
+
+namespace {
+
+using darwin::dyld::SharedCache;
+using darwin::dyld::SharedCacheExtractor;
+namespace shared_cache = darwin::dyld::shared_cache;
+
+static constexpr UInt64 kCacheBase = 0x180000000;
+
+static constexpr Size kCacheSize = 0x4000;
+
+// the image's header and load commands live here, its __TEXT right behind them
+static constexpr Size kImageOffset = 0x1000;
+static constexpr Size kTextSize = 0x200;
+
+// A single file cache holding one image with a __TEXT segment and a symtab command.
+struct SyntheticCache {
+  std::vector<UInt8> file;
+
+  shared_cache::Header *Header() { return reinterpret_cast<shared_cache::Header *>(file.data()); }
+
+  struct mach_header_64 *Image() {
+    return reinterpret_cast<struct mach_header_64 *>(&file[kImageOffset]);
+  }
+
+  UInt8 *Commands() { return &file[kImageOffset + sizeof(struct mach_header_64)]; }
+};
+
+SyntheticCache BuildCache() {
+  SyntheticCache cache;
+  cache.file.resize(kCacheSize);
+
+  shared_cache::Header *header = cache.Header();
+  Size offset = sizeof(*header);
+
+  memcpy(header->magic, "dyld_v1   arm64e", sizeof(header->magic));
+  header->mappingOffset = offset;
+  header->mappingCount = 1;
+
+  auto *mapping = reinterpret_cast<shared_cache::MappingInfo *>(&cache.file[offset]);
+  mapping->address = kCacheBase;
+  mapping->size = kCacheSize;
+  offset += sizeof(*mapping);
+
+  header->imagesOffset = offset;
+  header->imagesCount = 1;
+
+  auto *image = reinterpret_cast<shared_cache::CacheImageInfo *>(&cache.file[offset]);
+  image->address = kCacheBase + kImageOffset;
+  image->pathFileOffset = offset + sizeof(*image);
+  strcpy(reinterpret_cast<char *>(&cache.file[image->pathFileOffset]), "/usr/lib/libtest.dylib");
+
+  struct mach_header_64 *mh = cache.Image();
+  mh->magic = MH_MAGIC_64;
+  mh->ncmds = 2;
+  mh->sizeofcmds = sizeof(struct segment_command_64) + sizeof(struct symtab_command);
+
+  auto *text = reinterpret_cast<struct segment_command_64 *>(cache.Commands());
+  text->cmd = LC_SEGMENT_64;
+  text->cmdsize = sizeof(*text);
+  strcpy(text->segname, "__TEXT");
+  text->vmaddr = kCacheBase + kImageOffset;
+  text->vmsize = kTextSize;
+  text->fileoff = kImageOffset;
+  text->filesize = kTextSize;
+
+  auto *symtab = reinterpret_cast<struct symtab_command *>(cache.Commands() + sizeof(*text));
+  symtab->cmd = LC_SYMTAB;
+  symtab->cmdsize = sizeof(*symtab);
+
+  memset(&cache.file[kImageOffset + 0x100], 0xC3, kTextSize - 0x100);
+
+  return cache;
+}
+
+SharedCache *OpenCache(SyntheticCache &synthetic, const char *name) {
+  std::string path = testing::TempDir() + name;
+  FILE *file = fopen(path.c_str(), "wb");
+  EXPECT_NE(file, nullptr);
+  fwrite(synthetic.file.data(), 1, synthetic.file.size(), file);
+  fclose(file);
+  return SharedCache::CacheWithPath(path.c_str());
+}
+
+bool Dump(SyntheticCache &synthetic, std::vector<UInt8> *buffer) {
+  SharedCache *cache = OpenCache(synthetic, "extractor_cache");
+  EXPECT_NE(cache, nullptr);
+  if (!cache) {
+    return false;
+  }
+
+  SharedCacheExtractor extractor(cache, 1);
+  bool dumped = extractor.DumpImage(&cache->GetImages()[0], *buffer);
+  delete cache;
+  return dumped;
+}
+
+TEST(SharedCacheExtractorTest, DumpsImage) {
+  SyntheticCache synthetic = BuildCache();
+  std::vector<UInt8> buffer;
+
+  ASSERT_TRUE(Dump(synthetic, &buffer));
+  ASSERT_GE(buffer.size(), 0x1000 + kTextSize);
+
+  // __TEXT moves to the first page behind the header and its load command follows it
+  auto *text = reinterpret_cast<struct segment_command_64 *>(buffer.data() +
+                                                             sizeof(struct mach_header_64));
+  EXPECT_EQ(text->fileoff, 0x1000);
+  EXPECT_EQ(buffer[0x1000 + 0x100], 0xC3);
+  EXPECT_EQ(reinterpret_cast<struct mach_header_64 *>(buffer.data())->magic, MH_MAGIC_64);
+}
+
+TEST(SharedCacheExtractorTest, RejectsMalformedLoadCommands) {
+  std::vector<UInt8> buffer;
+
+  // a zero cmdsize never advances to the next command
+  SyntheticCache zero = BuildCache();
+  reinterpret_cast<struct load_command *>(zero.Commands())->cmdsize = 0;
+  EXPECT_FALSE(Dump(zero, &buffer));
+
+  // a command running past sizeofcmds
+  SyntheticCache oversized = BuildCache();
+  reinterpret_cast<struct load_command *>(oversized.Commands())->cmdsize = 0x1000;
+  EXPECT_FALSE(Dump(oversized, &buffer));
+
+  // more commands than sizeofcmds holds
+  SyntheticCache ncmds = BuildCache();
+  ncmds.Image()->ncmds = 3;
+  EXPECT_FALSE(Dump(ncmds, &buffer));
+
+  // sections that do not fit in the segment command
+  SyntheticCache sections = BuildCache();
+  reinterpret_cast<struct segment_command_64 *>(sections.Commands())->nsects = 1;
+  EXPECT_FALSE(Dump(sections, &buffer));
+
+  // a symtab command too short for its struct
+  SyntheticCache symtab = BuildCache();
+  auto *text = reinterpret_cast<struct segment_command_64 *>(symtab.Commands());
+  text->cmdsize += sizeof(struct symtab_command) - sizeof(struct load_command);
+  reinterpret_cast<struct load_command *>(symtab.Commands() + text->cmdsize)->cmd = LC_SYMTAB;
+  reinterpret_cast<struct load_command *>(symtab.Commands() + text->cmdsize)->cmdsize =
+      sizeof(struct load_command);
+  EXPECT_FALSE(Dump(symtab, &buffer));
+
+  // load commands past the end of the mapping
+  SyntheticCache header = BuildCache();
+  header.Image()->sizeofcmds = kCacheSize;
+  EXPECT_FALSE(Dump(header, &buffer));
+
+  // a segment that is not in the cache
+  SyntheticCache segment = BuildCache();
+  reinterpret_cast<struct segment_command_64 *>(segment.Commands())->filesize = ~0ULL;
+  EXPECT_FALSE(Dump(segment, &buffer));
+}
+
+// local symbols for the image at kLocalSymbolsOffset, one nlist keyed by its VM offset
+static constexpr Size kLocalSymbolsOffset = 0x3000;
+
+void AddLocalSymbols(SyntheticCache &synthetic) {
+  shared_cache::Header *header = synthetic.Header();
+  header->localSymbolsOffset = kLocalSymbolsOffset;
+  header->localSymbolsSize = 0x100;
+
+  auto *info =
+      reinterpret_cast<shared_cache::LocalSymbolsInfo *>(&synthetic.file[kLocalSymbolsOffset]);
+  info->nlistOffset = 0x40;
+  info->nlistCount = 1;
+  info->stringsOffset = 0x60;
+  info->stringsSize = 0x10;
+  info->entriesOffset = 0x80;
+  info->entriesCount = 1;
+
+  strcpy(reinterpret_cast<char *>(info) + 0x61, "_local");
+
+  auto *nlist = reinterpret_cast<struct nlist_64 *>(reinterpret_cast<UInt8 *>(info) + 0x40);
+  nlist->n_strx = 1;
+  nlist->n_value = kCacheBase + kImageOffset + 0x100;
+
+  auto *entry = reinterpret_cast<shared_cache::LocalSymbolsEntry64 *>(
+      reinterpret_cast<UInt8 *>(info) + 0x80);
+  entry->dylibOffset = kImageOffset;
+  entry->nlistStartIndex = 0;
+  entry->nlistCount = 1;
+}
+
+bool HasLocalSymbols(SyntheticCache &synthetic) {
+  SharedCache *cache = OpenCache(synthetic, "local_symbols_cache");
+  EXPECT_NE(cache, nullptr);
+  if (!cache) {
+    return false;
+  }
+
+  SharedCacheExtractor extractor(cache, 1);
+  darwin::dyld::LocalSymbols locals = {};
+  bool found = extractor.GetLocalSymbols(&cache->GetImages()[0], &locals);
+  if (found) {
+    EXPECT_EQ(locals.count, 1);
+    EXPECT_STREQ(locals.strings + locals.nlist->n_strx, "_local");
+  }
+  delete cache;
+  return found;
+}
+
+TEST(SharedCacheExtractorTest, FindsLocalSymbols) {
+  SyntheticCache synthetic = BuildCache();
+  AddLocalSymbols(synthetic);
+  EXPECT_TRUE(HasLocalSymbols(synthetic));
+}
+
+TEST(SharedCacheExtractorTest, RejectsMalformedLocalSymbols) {
+  auto local_info = [](SyntheticCache &synthetic) {
+    return reinterpret_cast<shared_cache::LocalSymbolsInfo *>(
+        &synthetic.file[kLocalSymbolsOffset]);
+  };
+
+  // entries that run past the local symbols
+  SyntheticCache entries = BuildCache();
+  AddLocalSymbols(entries);
+  local_info(entries)->entriesCount = 0x10000000;
+  EXPECT_FALSE(HasLocalSymbols(entries));
+
+  // local symbols that end in the middle of the entry
+  SyntheticCache truncated = BuildCache();
+  AddLocalSymbols(truncated);
+  truncated.Header()->localSymbolsSize = 0x88;
+  EXPECT_FALSE(HasLocalSymbols(truncated));
+
+  // an entries offset past the local symbols
+  SyntheticCache offset = BuildCache();
+  AddLocalSymbols(offset);
+  local_info(offset)->entriesOffset = 0xFFFFFFF0;
+  EXPECT_FALSE(HasLocalSymbols(offset));
+
+  // nlists and strings past the local symbols
+  SyntheticCache nlist = BuildCache();
+  AddLocalSymbols(nlist);
+  local_info(nlist)->nlistCount = 0xFFFFFFFF;
+  EXPECT_FALSE(HasLocalSymbols(nlist));
+
+  SyntheticCache strings = BuildCache();
+  AddLocalSymbols(strings);
+  local_info(strings)->stringsOffset = 0xFFFFFFFF;
+  EXPECT_FALSE(HasLocalSymbols(strings));
+
+  // too small for the info struct
+  SyntheticCache small = BuildCache();
+  AddLocalSymbols(small);
+  small.Header()->localSymbolsSize = sizeof(shared_cache::LocalSymbolsInfo) - 1;
+  EXPECT_FALSE(HasLocalSymbols(small));
+
+  // a size that wraps around when added to the offset
+  SyntheticCache wrap = BuildCache();
+  AddLocalSymbols(wrap);
+  wrap.Header()->localSymbolsSize = ~0ULL - kLocalSymbolsOffset + 2;
+  EXPECT_FALSE(HasLocalSymbols(wrap));
+}
+
+void DumpNeverCrashes(std::vector<UInt8> commands, UInt32 ncmds) {
+  SyntheticCache synthetic = BuildCache();
+  Size size = std::min<Size>(commands.size(), 0x400);
+  if (size) {
+    memcpy(synthetic.Commands(), commands.data(), size);
+  }
+  synthetic.Image()->ncmds = ncmds;
+  synthetic.Image()->sizeofcmds = size;
+
+  std::vector<UInt8> buffer;
+  Dump(synthetic, &buffer);
+}
+FUZZ_TEST(SharedCacheExtractorTest, DumpNeverCrashes);
+
+} // namespace
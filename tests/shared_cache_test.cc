@@ -0,0 +1,231 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "shared_cache.h"
+#include "types.h"
+
+namespace {
+
+using darwin::dyld::SharedCache;
+namespace shared_cache = darwin::dyld::shared_cache;
+
+static constexpr UInt64 kCacheBase = 0x180000000;
+static constexpr UInt64 kSubCacheBase = 0x180100000;
+
+static constexpr Size kCacheSize = 0x1000;
+
+const char *const kImagePaths[] = {
+    "/usr/lib/libobjc.A.dylib",
+    "/System/Library/Frameworks/Foundation.framework/Versions/C/Foundation",
+};
+
+// A main cache with one mapping and two images, optionally split with a ".01" subcache.
+struct SyntheticCache {
+  std::vector<UInt8> main;
+  std::vector<UInt8> subcache;
+
+  shared_cache::Header *Header() { return reinterpret_cast<shared_cache::Header *>(main.data()); }
+
+  shared_cache::CacheImageInfo *Images() {
+    return reinterpret_cast<shared_cache::CacheImageInfo *>(main.data() + Header()->imagesOffset);
+  }
+};
+
+// newer caches have a cacheSubType after imagesCount, which is what marks suffixed subcaches
+static constexpr Size kMappingOffset = sizeof(shared_cache::Header) + sizeof(UInt64);
+
+void InitHeader(std::vector<UInt8> &file, UInt64 address) {
+  auto *header = reinterpret_cast<shared_cache::Header *>(file.data());
+  auto *mapping = reinterpret_cast<shared_cache::MappingInfo *>(file.data() + kMappingOffset);
+
+  memcpy(header->magic, "dyld_v1   arm64e", sizeof(header->magic));
+  header->mappingOffset = kMappingOffset;
+  header->mappingCount = 1;
+
+  mapping->address = address;
+  mapping->size = file.size();
+  mapping->fileOffset = 0;
+}
+
+SyntheticCache BuildCache(bool split) {
+  SyntheticCache cache;
+  cache.main.resize(kCacheSize);
+  InitHeader(cache.main, kCacheBase);
+
+  shared_cache::Header *header = cache.Header();
+  Size offset = kMappingOffset + sizeof(shared_cache::MappingInfo);
+
+  header->imagesOffset = offset;
+  header->imagesCount = 2;
+  offset += 2 * sizeof(shared_cache::CacheImageInfo);
+
+  for (UInt32 i = 0; i < 2; i++) {
+    cache.Images()[i].address = kCacheBase + 0x800 + i * 0x100;
+    cache.Images()[i].pathFileOffset = offset;
+    strcpy(reinterpret_cast<char *>(&cache.main[offset]), kImagePaths[i]);
+    offset += strlen(kImagePaths[i]) + 1;
+  }
+
+  if (split) {
+    offset = (offset + 7) & ~7;
+
+    auto *entry = reinterpret_cast<shared_cache::SubCacheEntry *>(&cache.main[offset]);
+    header->subCacheArrayOffset = offset;
+    header->subCacheArrayCount = 1;
+    entry->cacheVMOffset = kSubCacheBase - kCacheBase;
+    strcpy(entry->fileSuffix, ".01");
+
+    cache.subcache.resize(kCacheSize);
+    InitHeader(cache.subcache, kSubCacheBase);
+    strcpy(reinterpret_cast<char *>(&cache.subcache[0x800]), "in the subcache");
+  }
+
+  strcpy(reinterpret_cast<char *>(&cache.main[0xC00]), "in the main cache");
+
+  return cache;
+}
+
+std::string WriteFile(const std::string &path, const std::vector<UInt8> &data) {
+  FILE *file = fopen(path.c_str(), "wb");
+  EXPECT_NE(file, nullptr);
+  if (!data.empty()) {
+    fwrite(data.data(), 1, data.size(), file);
+  }
+  fclose(file);
+  return path;
+}
+
+std::string WriteCache(SyntheticCache &cache, const char *name) {
+  std::string path = testing::TempDir() + name;
+  WriteFile(path, cache.main);
+  if (!cache.subcache.empty()) {
+    WriteFile(path + ".01", cache.subcache);
+  } else {
+    unlink((path + ".01").c_str());
+  }
+  return path;
+}
+
+TEST(SharedCacheTest, MapsCacheAndSubCaches) {
+  SyntheticCache synthetic = BuildCache(true);
+  std::string path = WriteCache(synthetic, "split_cache");
+
+  SharedCache *cache = SharedCache::CacheWithPath(path.c_str());
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->GetBaseAddress(), kCacheBase);
+  EXPECT_EQ(cache->GetSubCaches().size(), 1);
+  EXPECT_EQ(cache->GetImageCount(), 2);
+
+  // by full install path and by file name
+  char *image_path = nullptr;
+  EXPECT_EQ(cache->GetImageLoadedAt(kImagePaths[1], &image_path), kCacheBase + 0x900);
+  EXPECT_STREQ(image_path, kImagePaths[1]);
+  EXPECT_EQ(cache->GetImageLoadedAt("libobjc.A.dylib", nullptr), kCacheBase + 0x800);
+  EXPECT_EQ(cache->GetImageByPath("libnothing.dylib"), nullptr);
+
+  char *string = cache->ReadString(kCacheBase + 0xC00);
+  EXPECT_STREQ(string, "in the main cache");
+  free(string);
+
+  string = cache->ReadString(kSubCacheBase + 0x800);
+  EXPECT_STREQ(string, "in the subcache");
+  free(string);
+
+  darwin::dyld::SharedCacheFile *file;
+  Offset offset;
+  ASSERT_TRUE(cache->AddressToFileOffset(kSubCacheBase + 0x10, &file, &offset));
+  EXPECT_EQ(file, cache->GetSubCaches()[0]);
+  EXPECT_EQ(offset, 0x10);
+
+  UInt8 byte;
+  EXPECT_FALSE(cache->Read(kSubCacheBase + kCacheSize, &byte, 1));
+  EXPECT_EQ(cache->AddressToPointer(kCacheBase - 1), nullptr);
+
+  delete cache;
+}
+
+TEST(SharedCacheTest, RejectsHostileHeaders) {
+  std::string path;
+
+  // too small to hold a header
+  path = WriteFile(testing::TempDir() + "tiny_cache", std::vector<UInt8>(16, 'd'));
+  EXPECT_EQ(SharedCache::CacheWithPath(path.c_str()), nullptr);
+
+  // mappings that run past the end of the file
+  SyntheticCache mappings = BuildCache(false);
+  mappings.Header()->mappingCount = 0xFFFFFFFF;
+  path = WriteCache(mappings, "mapping_cache");
+  EXPECT_EQ(SharedCache::CacheWithPath(path.c_str()), nullptr);
+
+  // a subcache list past the end of the file
+  SyntheticCache subcaches = BuildCache(true);
+  subcaches.Header()->subCacheArrayOffset = kCacheSize - 8;
+  path = WriteCache(subcaches, "subcache_cache");
+  EXPECT_EQ(SharedCache::CacheWithPath(path.c_str()), nullptr);
+
+  subcaches = BuildCache(true);
+  subcaches.Header()->subCacheArrayCount = 0x10000000;
+  path = WriteCache(subcaches, "subcache_count_cache");
+  EXPECT_EQ(SharedCache::CacheWithPath(path.c_str()), nullptr);
+}
+
+TEST(SharedCacheTest, DropsImagesOutsideTheFile) {
+  SyntheticCache images = BuildCache(false);
+  images.Header()->imagesCount = 0x1000000;
+  std::string path = WriteCache(images, "image_count_cache");
+
+  SharedCache *cache = SharedCache::CacheWithPath(path.c_str());
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->GetImageCount(), 0);
+  EXPECT_EQ(cache->GetImageByPath("libobjc.A.dylib"), nullptr);
+  delete cache;
+
+  // one path past the end of the file, one that never ends
+  SyntheticCache paths = BuildCache(false);
+  paths.Images()[0].pathFileOffset = 0xFFFFFFF0;
+  paths.Images()[1].pathFileOffset = kCacheSize - 4;
+  memset(&paths.main[kCacheSize - 4], 'A', 4);
+  path = WriteCache(paths, "image_path_cache");
+
+  cache = SharedCache::CacheWithPath(path.c_str());
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->GetImageCount(), 2);
+  EXPECT_EQ(cache->GetImagePath(&cache->GetImages()[0]), nullptr);
+  EXPECT_EQ(cache->GetImagePath(&cache->GetImages()[1]), nullptr);
+  EXPECT_EQ(cache->GetImageLoadedAt("libobjc.A.dylib", nullptr), 0);
+  delete cache;
+}
+
+void CacheNeverCrashes(std::vector<UInt8> header, UInt32 image_count, UInt32 path_offset) {
+  SyntheticCache synthetic = BuildCache(false);
+  synthetic.Images()[0].pathFileOffset = path_offset;
+  synthetic.Header()->imagesCount = image_count;
+
+  // everything after the magic is up for grabs
+  if (!header.empty()) {
+    memcpy(synthetic.main.data() + 16, header.data(),
+           std::min(header.size(), sizeof(shared_cache::Header) - 16));
+  }
+
+  std::string path = WriteCache(synthetic, "fuzz_cache");
+  SharedCache *cache = SharedCache::CacheWithPath(path.c_str());
+  if (cache) {
+    for (UInt32 i = 0; i < cache->GetImageCount(); i++) {
+      cache->GetImagePath(&cache->GetImages()[i]);
+    }
+    free(cache->ReadString(kCacheBase + 0xC00));
+    delete cache;
+  }
+}
+FUZZ_TEST(SharedCacheTest, CacheNeverCrashes);
+
+} // namespace
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "shared_ring.h"
+
+// Usage: shared_ring_benchmark [events] [event_size] [latency_ns]
+//
+// Streams events from a producer thread to a consumer thread, once with a call of latency_ns
+// per event like externalMethod() copying every event out, and once through a SharedRing in a
+// region of kSharedRingMinimumRegionSize * 16 bytes where only doorbells cost a call. The
+// consumer sleeps on a condition variable whenever the ring runs dry.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using darwin::SharedRing;
+using darwin::SharedRingRecord;
+
+void Spin(UInt64 latency) {
+  Clock::time_point end = Clock::now() + std::chrono::nanoseconds(latency);
+
+  while (Clock::now() < end) {
+  }
+}
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void Report(const char *name, Size count, Size event_size, double ms, Size calls) {
+  printf("%-8s %9.2f ms %8.2f Mevents/s %8.1f MB/s  calls %8zu\n", name, ms, count / ms / 1e3,
+         count * event_size / ms / 1e3, calls);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Size count = argc > 1 ? atoi(argv[1]) : 1000000;
+  Size event_size = argc > 2 ? atoi(argv[2]) : 48;
+  UInt64 latency = argc > 3 ? atoll(argv[3]) : 2000;
+
+  Size region_size = darwin::kSharedRingMinimumRegionSize * 16;
+
+  std::vector<UInt64> region(region_size / sizeof(UInt64));
+
+  std::vector<UInt8> event(event_size, 0xAB);
+
+  UInt64 checksum = 0;
+
+  // one call per event, the consumer does nothing but pay for the copy out
+  Clock::time_point start = Clock::now();
+
+  for (Size i = 0; i < count; i++) {
+    std::vector<UInt8> copy(event);
+
+    Spin(latency);
+
+    checksum += copy[0];
+  }
+
+  Report("syscall", count, event_size, MillisecondsSince(start), count);
+
+  if (!darwin::CreateSharedRings(region.data(), region_size)) {
+    fprintf(stderr, "failed to lay out the shared rings\n");
+    return 1;
+  }
+
+  SharedRing producer, consumer;
+
+  darwin::OpenSharedRing(region.data(), region_size, darwin::kSharedRingEvents, &producer);
+  darwin::OpenSharedRing(region.data(), region_size, darwin::kSharedRingEvents, &consumer);
+
+  std::mutex lock;
+  std::condition_variable doorbell;
+
+  Size doorbells = 0;
+  Size received = 0;
+
+  start = Clock::now();
+
+  std::thread consumer_thread([&]() {
+    while (received < count) {
+      SharedRingRecord *record = consumer.Peek();
+
+      if (!record) {
+        std::unique_lock<std::mutex> guard(lock);
+        doorbell.wait(guard, [&]() { return !consumer.PrepareToWait(); });
+        continue;
+      }
+
+      checksum += reinterpret_cast<UInt8 *>(record + 1)[0];
+
+      consumer.Pop();
+      received++;
+    }
+  });
+
+  for (Size i = 0; i < count; i++) {
+    bool ring = false;
+
+    while (!producer.Push(darwin::kSharedRingHookHit, i, event.data(), event_size, &ring)) {
+      std::this_thread::yield();
+    }
+
+    // the doorbell is the only call into the kernel left
+    if (ring) {
+      Spin(latency);
+
+      std::lock_guard<std::mutex> guard(lock);
+      doorbells++;
+      doorbell.notify_one();
+    }
+  }
+
+  consumer_thread.join();
+
+  Report("ring", count, event_size, MillisecondsSince(start), doorbells);
+
+  return checksum == count * 2 * 0xAB ? 0 : 1;
+}
@@ -0,0 +1,388 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "shared_ring.h"
+#include "types.h"
+
+namespace {
+
+using darwin::SharedRing;
+using darwin::SharedRingHeader;
+using darwin::SharedRingRecord;
+
+static constexpr Size kRingSize = sizeof(SharedRingHeader) + 0x1000;
+
+// shared memory is page aligned, keep the tests just as aligned
+std::vector<UInt64> AllocateRing(Size size) {
+  return std::vector<UInt64>(size / sizeof(UInt64));
+}
+
+TEST(SharedRingTest, PopsRecordsInOrder) {
+  std::vector<UInt64> memory = AllocateRing(kRingSize);
+  SharedRing producer, consumer;
+
+  ASSERT_TRUE(producer.Create(memory.data(), kRingSize));
+  ASSERT_TRUE(consumer.Attach(memory.data(), kRingSize));
+  EXPECT_EQ(producer.GetCapacity(), 0x1000);
+  EXPECT_TRUE(consumer.IsEmpty());
+  EXPECT_EQ(consumer.Peek(), nullptr);
+
+  for (UInt64 i = 0; i < 10; i++) {
+    UInt64 value = i * 3;
+    ASSERT_TRUE(producer.Push(darwin::kSharedRingHookHit, i, &value, sizeof(value), nullptr));
+  }
+
+  for (UInt64 i = 0; i < 10; i++) {
+    SharedRingRecord *record = consumer.Peek();
+    ASSERT_NE(record, nullptr);
+    EXPECT_EQ(record->type, darwin::kSharedRingHookHit);
+    EXPECT_EQ(record->id, i);
+    ASSERT_EQ(record->size, sizeof(UInt64));
+    EXPECT_EQ(*reinterpret_cast<UInt64 *>(record + 1), i * 3);
+    consumer.Pop();
+  }
+
+  EXPECT_TRUE(consumer.IsEmpty());
+}
+
+TEST(SharedRingTest, WrapsAroundBehindPadding) {
+  std::vector<UInt64> memory = AllocateRing(kRingSize);
+  SharedRing producer, consumer;
+  std::vector<UInt8> payload(700);
+
+  ASSERT_TRUE(producer.Create(memory.data(), kRingSize));
+  ASSERT_TRUE(consumer.Attach(memory.data(), kRingSize));
+
+  // 720 byte records never line up with the end of a 4096 byte ring
+  for (UInt64 i = 0; i < 100; i++) {
+    memset(payload.data(), (int)i, payload.size());
+    ASSERT_TRUE(
+        producer.Push(darwin::kSharedRingHookHit, i, payload.data(), payload.size(), nullptr));
+
+    SharedRingRecord *record = consumer.Peek();
+    ASSERT_NE(record, nullptr);
+    EXPECT_EQ(record->id, i);
+    EXPECT_EQ(reinterpret_cast<UInt8 *>(record + 1)[699], (UInt8)i);
+    consumer.Pop();
+  }
+
+  EXPECT_FALSE(producer.IsBroken());
+  EXPECT_FALSE(consumer.IsBroken());
+}
+
+TEST(SharedRingTest, RejectsRecordsThatDoNotFit) {
+  std::vector<UInt64> memory = AllocateRing(kRingSize);
+  SharedRing producer, consumer;
+
+  ASSERT_TRUE(producer.Create(memory.data(), kRingSize));
+  ASSERT_TRUE(consumer.Attach(memory.data(), kRingSize));
+
+  std::vector<UInt8> payload(producer.GetMaxRecordSize() + 1);
+  EXPECT_FALSE(
+      producer.Push(darwin::kSharedRingCoverage, 0, payload.data(), payload.size(), nullptr));
+
+  Size pushed = 0;
+  while (producer.Push(darwin::kSharedRingCoverage, pushed, payload.data(), 240, nullptr)) {
+    pushed++;
+  }
+  EXPECT_EQ(pushed, 0x1000 / 256);
+
+  // a full ring takes records again once the consumer catches up
+  consumer.Peek();
+  consumer.Pop();
+  EXPECT_TRUE(producer.Push(darwin::kSharedRingCoverage, pushed, payload.data(), 240, nullptr));
+}
+
+TEST(SharedRingTest, RingsDoorbellOnlyWhenEmpty) {
+  std::vector<UInt64> memory = AllocateRing(kRingSize);
+  SharedRing producer, consumer;
+  bool doorbell = false;
+  UInt32 value = 0;
+
+  ASSERT_TRUE(producer.Create(memory.data(), kRingSize));
+  ASSERT_TRUE(consumer.Attach(memory.data(), kRingSize));
+
+  ASSERT_TRUE(producer.Push(darwin::kSharedRingBreakpoint, 0, &value, sizeof(value), &doorbell));
+  EXPECT_TRUE(doorbell);
+
+  ASSERT_TRUE(producer.Push(darwin::kSharedRingBreakpoint, 1, &value, sizeof(value), &doorbell));
+  EXPECT_FALSE(doorbell);
+
+  EXPECT_FALSE(consumer.PrepareToWait());
+  EXPECT_FALSE(producer.IsDrained());
+
+  consumer.Peek();
+  consumer.Pop();
+
+  ASSERT_TRUE(producer.Push(darwin::kSharedRingBreakpoint, 2, &value, sizeof(value), &doorbell));
+  EXPECT_FALSE(doorbell);
+
+  consumer.Peek();
+  consumer.Pop();
+  consumer.Peek();
+  consumer.Pop();
+  EXPECT_TRUE(consumer.PrepareToWait());
+  EXPECT_TRUE(producer.IsDrained());
+
+  ASSERT_TRUE(producer.Push(darwin::kSharedRingBreakpoint, 3, &value, sizeof(value), &doorbell));
+  EXPECT_TRUE(doorbell);
+}
+
+TEST(SharedRingTest, TruncatesAndCancelsReservations) {
+  std::vector<UInt64> memory = AllocateRing(kRingSize);
+  SharedRing producer, consumer;
+
+  ASSERT_TRUE(producer.Create(memory.data(), kRingSize));
+  ASSERT_TRUE(consumer.Attach(memory.data(), kRingSize));
+
+  // a cancelled reservation never shows up
+  ASSERT_NE(producer.Reserve(darwin::kSharedRingHookHit, 1, 512), nullptr);
+  producer.Cancel();
+  EXPECT_FALSE(producer.Commit(nullptr));
+  EXPECT_TRUE(consumer.IsEmpty());
+
+  UInt64 *payload =
+      reinterpret_cast<UInt64 *>(producer.Reserve(darwin::kSharedRingHookHit, 2, 512));
+  ASSERT_NE(payload, nullptr);
+  payload[0] = 0x1234;
+  EXPECT_FALSE(producer.Truncate(513));
+  ASSERT_TRUE(producer.Truncate(sizeof(UInt64)));
+  ASSERT_TRUE(producer.Commit(nullptr));
+
+  // the space the truncated record gave back goes to the next one
+  UInt64 value = 5;
+  ASSERT_TRUE(producer.Push(darwin::kSharedRingHookHit, 3, &value, sizeof(value), nullptr));
+
+  SharedRingRecord *record = consumer.Peek();
+  ASSERT_NE(record, nullptr);
+  EXPECT_EQ(record->id, 2);
+  ASSERT_EQ(record->size, sizeof(UInt64));
+  EXPECT_EQ(*reinterpret_cast<UInt64 *>(record + 1), 0x1234);
+  consumer.Pop();
+
+  record = consumer.Peek();
+  ASSERT_NE(record, nullptr);
+  EXPECT_EQ(record->id, 3);
+  EXPECT_EQ(*reinterpret_cast<UInt64 *>(record + 1), 5);
+  consumer.Pop();
+  EXPECT_TRUE(consumer.IsEmpty());
+}
+
+TEST(SharedRingTest, BreaksOnCorruptIndices) {
+  std::vector<UInt64> memory = AllocateRing(kRingSize);
+  SharedRing producer, consumer;
+  UInt64 value = 0;
+
+  ASSERT_TRUE(producer.Create(memory.data(), kRingSize));
+  ASSERT_TRUE(consumer.Attach(memory.data(), kRingSize));
+
+  auto *header = reinterpret_cast<SharedRingHeader *>(memory.data());
+
+  // a head past the capacity
+  header->head = 0x10000;
+  EXPECT_EQ(consumer.Peek(), nullptr);
+  EXPECT_TRUE(consumer.IsBroken());
+
+  // a tail ahead of head, seen once the producer runs out of room
+  header->head = 0;
+  header->tail = 0x5000;
+  while (producer.Push(darwin::kSharedRingHookHit, 0, &value, sizeof(value), nullptr)) {
+  }
+  EXPECT_TRUE(producer.IsBroken());
+
+  // a record that claims more than was published
+  SharedRing clean_producer, clean_consumer;
+  ASSERT_TRUE(clean_producer.Create(memory.data(), kRingSize));
+  ASSERT_TRUE(clean_consumer.Attach(memory.data(), kRingSize));
+  ASSERT_TRUE(clean_producer.Push(darwin::kSharedRingHookHit, 0, &value, sizeof(value), nullptr));
+  reinterpret_cast<SharedRingRecord *>(header + 1)->size = 0x800;
+  EXPECT_EQ(clean_consumer.Peek(), nullptr);
+  EXPECT_TRUE(clean_consumer.IsBroken());
+  // indices off the record alignment, whether found on attach or later
+  SharedRing aligned_producer, aligned_consumer, misaligned_consumer;
+  ASSERT_TRUE(aligned_producer.Create(memory.data(), kRingSize));
+  header->head = 0x18;
+  EXPECT_FALSE(misaligned_consumer.Attach(memory.data(), kRingSize));
+  header->head = 0;
+  header->tail = 0x8;
+  EXPECT_FALSE(misaligned_consumer.Attach(memory.data(), kRingSize));
+  header->tail = 0;
+
+  ASSERT_TRUE(aligned_consumer.Attach(memory.data(), kRingSize));
+  header->head = 0x19;
+  EXPECT_EQ(aligned_consumer.Peek(), nullptr);
+  EXPECT_TRUE(aligned_consumer.IsBroken());
+}
+
+TEST(SharedRingTest, PeekReportsCheckedSize) {
+  std::vector<UInt64> memory = AllocateRing(kRingSize);
+  SharedRing producer, consumer;
+  UInt64 value = 7;
+  UInt32 size = 0;
+
+  ASSERT_TRUE(producer.Create(memory.data(), kRingSize));
+  ASSERT_TRUE(consumer.Attach(memory.data(), kRingSize));
+  ASSERT_TRUE(producer.Push(darwin::kSharedRingHookHit, 0, &value, sizeof(value), nullptr));
+  ASSERT_TRUE(producer.Push(darwin::kSharedRingHookHit, 1, &value, sizeof(value), nullptr));
+
+  SharedRingRecord *record = consumer.Peek(&size);
+  ASSERT_NE(record, nullptr);
+  EXPECT_EQ(size, sizeof(value));
+
+  // growing the record after the check changes neither the size handed out nor where Pop() goes
+  record->size = 0x800;
+  consumer.Pop();
+
+  record = consumer.Peek(&size);
+  ASSERT_NE(record, nullptr);
+  EXPECT_EQ(record->id, 1);
+  EXPECT_EQ(size, sizeof(value));
+  consumer.Pop();
+  EXPECT_TRUE(consumer.IsEmpty());
+  EXPECT_FALSE(consumer.IsBroken());
+}
+
+TEST(SharedRingTest, SplitsRegionIntoRings) {
+  Size size = darwin::kSharedRingMinimumRegionSize * 4;
+  std::vector<UInt64> memory = AllocateRing(size);
+  SharedRing rings[darwin::kSharedRingCount];
+
+  EXPECT_FALSE(
+      darwin::CreateSharedRings(memory.data(), darwin::kSharedRingMinimumRegionSize - 1));
+  ASSERT_TRUE(darwin::CreateSharedRings(memory.data(), size));
+
+  for (UInt32 i = 0; i < darwin::kSharedRingCount; i++) {
+    ASSERT_TRUE(darwin::OpenSharedRing(memory.data(), size, i, &rings[i]));
+  }
+  EXPECT_FALSE(darwin::OpenSharedRing(memory.data(), size, darwin::kSharedRingCount, &rings[0]));
+  EXPECT_FALSE(
+      darwin::OpenSharedRing(memory.data(), size / 2, darwin::kSharedRingEvents, &rings[0]));
+
+  EXPECT_EQ(rings[darwin::kSharedRingEvents].GetCapacity(),
+            rings[darwin::kSharedRingCommands].GetCapacity() * 2);
+
+  // the rings do not overlap
+  UInt64 value = 0x4141;
+  SharedRing consumers[darwin::kSharedRingCount];
+  for (UInt32 i = 0; i < darwin::kSharedRingCount; i++) {
+    ASSERT_TRUE(darwin::OpenSharedRing(memory.data(), size, i, &consumers[i]));
+    ASSERT_TRUE(rings[i].Push(darwin::kSharedRingHookHit, i, &value, sizeof(value), nullptr));
+  }
+  for (UInt32 i = 0; i < darwin::kSharedRingCount; i++) {
+    SharedRingRecord *record = consumers[i].Peek();
+    ASSERT_NE(record, nullptr);
+    EXPECT_EQ(record->id, i);
+    consumers[i].Pop();
+    EXPECT_TRUE(consumers[i].IsEmpty());
+  }
+}
+
+// Variable sized records through a small ring, the consumer sleeps on a condition variable that
+// stands in for the doorbell whenever it runs dry.
+TEST(SharedRingTest, StressesProducerAndConsumer) {
+  static constexpr UInt64 kRecords = 1000000;
+
+  std::vector<UInt64> memory = AllocateRing(sizeof(SharedRingHeader) + 0x4000);
+  SharedRing producer, consumer;
+
+  ASSERT_TRUE(producer.Create(memory.data(), memory.size() * sizeof(UInt64)));
+  ASSERT_TRUE(consumer.Attach(memory.data(), memory.size() * sizeof(UInt64)));
+
+  std::mutex lock;
+  std::condition_variable doorbell;
+  std::atomic<UInt64> doorbells(0);
+  std::atomic<bool> failed(false);
+
+  std::thread consumer_thread([&]() {
+    UInt64 expected = 0;
+
+    while (expected < kRecords) {
+      SharedRingRecord *record = consumer.Peek();
+
+      if (!record) {
+        std::unique_lock<std::mutex> guard(lock);
+        doorbell.wait(guard, [&]() { return !consumer.PrepareToWait(); });
+        continue;
+      }
+
+      UInt8 *payload = reinterpret_cast<UInt8 *>(record + 1);
+
+      if (record->id != expected || record->size != expected % 97 ||
+          (record->size && (payload[0] != (UInt8)expected ||
+                            payload[record->size - 1] != (UInt8)expected))) {
+        failed = true;
+        return;
+      }
+
+      consumer.Pop();
+      expected++;
+    }
+  });
+
+  UInt8 payload[96];
+
+  for (UInt64 i = 0; i < kRecords; i++) {
+    bool ring = false;
+    Size size = i % 97;
+
+    memset(payload, (int)i, sizeof(payload));
+
+    while (!producer.Push(darwin::kSharedRingHookHit, i, payload, size, &ring)) {
+      std::this_thread::yield();
+      if (failed) {
+        break;
+      }
+    }
+
+    if (ring) {
+      std::lock_guard<std::mutex> guard(lock);
+      doorbells++;
+      doorbell.notify_one();
+    }
+  }
+
+  consumer_thread.join();
+
+  EXPECT_FALSE(failed);
+  EXPECT_FALSE(producer.IsBroken());
+  EXPECT_FALSE(consumer.IsBroken());
+  EXPECT_LT(doorbells, kRecords);
+}
+
+void ConsumerNeverCrashes(std::vector<UInt8> records, UInt64 head, UInt64 tail) {
+  std::vector<UInt64> memory = AllocateRing(kRingSize);
+  SharedRing producer, consumer;
+
+  producer.Create(memory.data(), kRingSize);
+  if (!records.empty()) {
+    memcpy(reinterpret_cast<UInt8 *>(memory.data()) + sizeof(SharedRingHeader), records.data(),
+           records.size() < 0x1000 ? records.size() : 0x1000);
+  }
+
+  auto *header = reinterpret_cast<SharedRingHeader *>(memory.data());
+  header->head = head;
+  header->tail = tail;
+
+  if (!consumer.Attach(memory.data(), kRingSize)) {
+    return;
+  }
+
+  for (int i = 0; i < 1000; i++) {
+    SharedRingRecord *record = consumer.Peek();
+    if (!record) {
+      break;
+    }
+    consumer.Pop();
+  }
+}
+FUZZ_TEST(SharedRingTest, ConsumerNeverCrashes);
+
+} // namespace
@@ -0,0 +1,103 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "string_arena.h"
+
+namespace {
+
+using darwin::StringArena;
+
+TEST(StringArenaTest, InternsEachStringOnce) {
+  StringArena arena;
+
+  char *a = arena.Intern("Swift.Int");
+  char *b = arena.Intern(std::string("Swift.Int").c_str());
+  ASSERT_NE(a, nullptr);
+  EXPECT_EQ(a, b);
+  EXPECT_STREQ(a, "Swift.Int");
+
+  // only the first length bytes count, and the copy is terminated
+  char *prefix = arena.Intern("Swift.IntX", 9);
+  EXPECT_EQ(prefix, a);
+
+  EXPECT_EQ(arena.Find("Swift.Int"), a);
+  EXPECT_EQ(arena.Find("Swift.String"), nullptr);
+
+  EXPECT_EQ(arena.GetCount(), 1);
+  EXPECT_EQ(arena.GetBytes(), strlen("Swift.Int") + 1);
+}
+
+TEST(StringArenaTest, KeepsOversizedStrings) {
+  StringArena arena;
+
+  std::string big(darwin::kStringArenaChunkSize, 'x');
+
+  char *small = arena.Intern("before");
+  char *large = arena.Intern(big.c_str());
+  char *after = arena.Intern("after");
+
+  EXPECT_EQ(std::string(large), big);
+  EXPECT_STREQ(small, "before");
+  EXPECT_STREQ(after, "after");
+  EXPECT_EQ(arena.Find(big.c_str()), large);
+}
+
+TEST(StringArenaTest, InternsFromManyThreads) {
+  static constexpr int kThreads = 8;
+  static constexpr int kStrings = 2000;
+
+  StringArena arena;
+
+  std::vector<std::vector<char *>> results(kThreads, std::vector<char *>(kStrings));
+  std::vector<std::thread> threads;
+
+  // every thread interns the same strings, starting at a different one
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kStrings; i++) {
+        int n = (i + t * kStrings / kThreads) % kStrings;
+        results[t][n] = arena.Intern(("Module.Type" + std::to_string(n)).c_str());
+      }
+    });
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(arena.GetCount(), kStrings);
+
+  for (int i = 0; i < kStrings; i++) {
+    ASSERT_NE(results[0][i], nullptr);
+    EXPECT_EQ(std::string(results[0][i]), "Module.Type" + std::to_string(i));
+
+    for (int t = 1; t < kThreads; t++) {
+      EXPECT_EQ(results[t][i], results[0][i]);
+    }
+  }
+}
+
+void InternNeverLoses(std::vector<std::string> strings) {
+  StringArena arena;
+  std::vector<char *> interned;
+
+  for (const std::string &string : strings) {
+    interned.push_back(arena.Intern(string.data(), string.size()));
+  }
+
+  for (Size i = 0; i < strings.size(); i++) {
+    ASSERT_NE(interned[i], nullptr);
+    EXPECT_EQ(memcmp(interned[i], strings[i].data(), strings[i].size()), 0);
+    EXPECT_EQ(interned[i][strings[i].size()], '\0');
+    EXPECT_EQ(arena.Intern(strings[i].data(), strings[i].size()), interned[i]);
+  }
+}
+FUZZ_TEST(StringArenaTest, InternNeverLoses);
+
+} // namespace
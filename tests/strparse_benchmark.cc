@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "strparse.h"
+
+// Usage: strparse_benchmark [iterations]
+//
+// Times the vectorized strparse primitives against the byte at a time versions they replaced,
+// on assembler-like input: substring search with short and long needles, character search,
+// trimming and splitting operands with and without strdup() copies, and decoding a 4 MB hex
+// payload and addresses one digit at a time or in bulk.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+char *NaiveStrstr(char *string, char *substring) {
+  char *a, *b;
+
+  b = substring;
+
+  if (*b == 0) {
+    return string;
+  }
+
+  for (; *string != 0; string += 1) {
+    if (*string != *b) {
+      continue;
+    }
+
+    a = string;
+
+    while (1) {
+      if (*b == 0) {
+        return string;
+      }
+
+      if (*a++ != *b++) {
+        break;
+      }
+    }
+
+    b = substring;
+  }
+
+  return nullptr;
+}
+
+char *NaiveStrnchar(char *str, UInt32 len, char ch) {
+  char *s = str;
+  char *end = str + len;
+
+  while (s < end) {
+    if (*s == ch) {
+      return s;
+    }
+
+    if (*s == 0) {
+      return nullptr;
+    }
+
+    s++;
+  }
+
+  return nullptr;
+}
+
+char *NaiveTrim(char *s) {
+  while (isspace(*s)) {
+    s++;
+  }
+
+  char *back = s + strlen(s);
+
+  while (back > s && isspace(*(back - 1))) {
+    back--;
+  }
+
+  *back = '\0';
+
+  return s;
+}
+
+Size DigitLoopHex(char *str, Size len, UInt8 *data) {
+  Size i = 0;
+
+  for (; i < len / 2; i++) {
+    int high = hex_digit(str[i * 2]);
+    int low = hex_digit(str[i * 2 + 1]);
+
+    if (high < 0 || low < 0) {
+      break;
+    }
+
+    data[i] = (UInt8)(high << 4 | low);
+  }
+
+  return i;
+}
+
+template <typename F>
+void Time(const char *name, int iterations, Size bytes, F &&f) {
+  Size sink = 0;
+
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < iterations; i++) {
+    // keeps the compiler from hoisting pure calls like strstr() out of the loop
+    asm volatile("" ::: "memory");
+    sink += f();
+  }
+  double ms = MillisecondsSince(start);
+
+  printf("%-36s %9.2f ms %9.2f MB/s  (%zu)\n", name, ms, bytes * iterations / ms / 1e3, sink);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+
+  std::string text;
+  while (text.size() < (1 << 16)) {
+    text += "    ldr x0, [x1, #0x10]\n    add x0, x0, x2, lsl #3\n    bl 0xfffffff007b6b668\n";
+  }
+
+  std::string short_needle = "x2, lsl #4";
+  std::string long_needle = "add x0, x0, x2, lsl #3\n    bl 0xfffffff007b6b668\n    ldr x3";
+
+  Time("naive strstr, short needle", iterations, text.size(), [&] {
+    return NaiveStrstr(text.data(), short_needle.data()) != nullptr;
+  });
+  Time("libc strstr, short needle", iterations, text.size(), [&] {
+    return strstr(text.data(), short_needle.data()) != nullptr;
+  });
+  Time("strfind, short needle", iterations, text.size(), [&] {
+    return strfind(text.data(), text.size(), short_needle.data(), short_needle.size()) != nullptr;
+  });
+
+  Time("naive strstr, long needle", iterations, text.size(), [&] {
+    return NaiveStrstr(text.data(), long_needle.data()) != nullptr;
+  });
+  Time("libc strstr, long needle", iterations, text.size(), [&] {
+    return strstr(text.data(), long_needle.data()) != nullptr;
+  });
+  Time("strfind, long needle", iterations, text.size(), [&] {
+    return strfind(text.data(), text.size(), long_needle.data(), long_needle.size()) != nullptr;
+  });
+
+  Time("naive strnchar", iterations, text.size(), [&] {
+    return NaiveStrnchar(text.data(), text.size(), '%') != nullptr;
+  });
+  Time("strnchar", iterations, text.size(), [&] {
+    return strnchar(text.data(), text.size(), '%') != nullptr;
+  });
+
+  std::string padded = std::string(200, ' ') + "mov x0, x1" + std::string(200, '\t');
+  std::vector<char> scratch(padded.size() + 1);
+
+  Time("naive trim", iterations * 100, padded.size(), [&] {
+    memcpy(scratch.data(), padded.c_str(), padded.size() + 1);
+    return strlen(NaiveTrim(scratch.data()));
+  });
+  Time("trim_span", iterations * 100, padded.size(), [&] {
+    return trim_span(padded.data(), padded.size()).len;
+  });
+
+  std::string operands = "x0, [x1, #0x10], x2, lsl #3, x4, x5, x6, x7";
+  char delim[] = ", ";
+
+  Time("strtokmul + strdup", iterations * 100, operands.size(), [&] {
+    Size count = 0;
+    char *copy = strdup(operands.c_str());
+    for (char *token = strtokmul(copy, delim); token; token = strtokmul(nullptr, delim)) {
+      char *operand = strdup(token);
+      count += strlen(operand);
+      free(operand);
+    }
+    free(copy);
+    return count;
+  });
+  Time("strtokmul_span", iterations * 100, operands.size(), [&] {
+    Size count = 0;
+    strspan input = {operands.data(), operands.size()};
+    strspan token;
+    while (strtokmul_span(&input, delim, strlen(delim), &token)) {
+      count += token.len;
+    }
+    return count;
+  });
+
+  std::string payload;
+  for (Size i = 0; i < (4 << 20); i++) {
+    payload += "0123456789abcdef"[(UInt32)(i * 2654435761u) >> 28];
+  }
+  std::vector<UInt8> decoded(payload.size() / 2);
+
+  Time("digit loop hex decode", iterations / 100 + 1, payload.size(), [&] {
+    return DigitLoopHex(payload.data(), payload.size(), decoded.data());
+  });
+  Time("hextobytes", iterations / 100 + 1, payload.size(), [&] {
+    return hextobytes(payload.data(), payload.size(), decoded.data(), decoded.size());
+  });
+  Time("strtodata", iterations / 100 + 1, payload.size(), [&] {
+    UInt32 size = decoded.size();
+    char *end;
+    strtodata(payload.data(), 16, decoded.data(), &size, &end);
+    return (Size)size;
+  });
+
+  char address[] = "0xfffffff007b6b668";
+  Time("strtoint, 64-bit address", iterations * 1000, strlen(address), [&] {
+    UInt64 value;
+    char *end;
+    strtoint(address, strlen(address), false, false, 16, &value, &end);
+    return (Size)value;
+  });
+
+  return 0;
+}
@@ -0,0 +1,187 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "strparse.h"
+
+namespace {
+
+char *NaiveFind(char *str, Size len, const char *needle, Size needle_len) {
+  for (Size i = 0; i + needle_len <= len; i++) {
+    if (memcmp(str + i, needle, needle_len) == 0) {
+      return str + i;
+    }
+  }
+  return nullptr;
+}
+
+std::string Trimmed(std::string s) {
+  strspan span = trim_span(s.data(), s.size());
+  return std::string(span.str, span.len);
+}
+
+TEST(StrParseTest, FindsNeedlesOfEveryLength) {
+  std::string haystack;
+  for (int i = 0; i < 600; i++) {
+    haystack += static_cast<char>('a' + (i * 7 + i / 13) % 5);
+  }
+
+  for (Size needle_len = 0; needle_len < 80; needle_len++) {
+    for (Size offset : {0UL, 1UL, 15UL, 16UL, 17UL, 300UL, 600UL - needle_len}) {
+      std::string needle = haystack.substr(offset, needle_len);
+
+      EXPECT_EQ(strfind(haystack.data(), haystack.size(), needle.data(), needle.size()),
+                NaiveFind(haystack.data(), haystack.size(), needle.data(), needle.size()))
+          << "needle_len " << needle_len << " offset " << offset;
+    }
+  }
+
+  char missing[] = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaz";
+  EXPECT_EQ(strfind(haystack.data(), haystack.size(), missing, strlen(missing)), nullptr);
+}
+
+TEST(StrParseTest, CharSearchStopsAtNul) {
+  char str[] = "ldr x0, [x1, #0x10]\0]";
+
+  EXPECT_EQ(strnchar(str, sizeof(str), '['), str + 8);
+  EXPECT_EQ(strnchar(str, sizeof(str), ']'), str + 18);
+  EXPECT_EQ(strnchar(str, 8, '['), nullptr);
+  EXPECT_EQ(strnchar(str, sizeof(str), 'z'), nullptr);
+}
+
+TEST(StrParseTest, TrimsWhitespace) {
+  EXPECT_EQ(Trimmed(""), "");
+  EXPECT_EQ(Trimmed(" \t\r\n\v\f "), "");
+  EXPECT_EQ(Trimmed("mov x0, x1"), "mov x0, x1");
+  EXPECT_EQ(Trimmed(std::string(40, ' ') + "b.eq 0x10" + std::string(33, '\n')), "b.eq 0x10");
+
+  char str[] = "   \tret  \n";
+  EXPECT_STREQ(trim(str), "ret");
+}
+
+TEST(StrParseTest, RemovesBlanks) {
+  char empty[] = "";
+  EXPECT_STREQ(deblank(empty), "");
+
+  char blanks[] = "   ";
+  EXPECT_STREQ(deblank(blanks), "");
+
+  char str[] = " ldr  x0, [x1] ";
+  EXPECT_STREQ(deblank(str), "ldrx0,[x1]");
+}
+
+TEST(StrParseTest, TokenizesWithoutCopies) {
+  char str[] = "x0, [x1, #0x10], lsl";
+  char delim[] = ", ";
+
+  strspan input = {str, strlen(str)};
+  strspan token;
+
+  std::vector<std::string> tokens;
+  while (strtokmul_span(&input, delim, strlen(delim), &token)) {
+    tokens.push_back(std::string(token.str, token.len));
+  }
+
+  EXPECT_EQ(tokens, (std::vector<std::string>{"x0", "[x1", "#0x10]", "lsl"}));
+  EXPECT_STREQ(str, "x0, [x1, #0x10], lsl");
+}
+
+TEST(StrParseTest, DecodesHexInBulk) {
+  static const char kDigits[] = "0123456789abcdefABCDEF";
+
+  std::string hex;
+  std::vector<UInt8> expected;
+  for (int i = 0; i < 1000; i++) {
+    char high = kDigits[(i * 7) % 22];
+    char low = kDigits[(i * 13 + 5) % 22];
+    hex += high;
+    hex += low;
+    expected.push_back(hex_digit(high) << 4 | hex_digit(low));
+  }
+
+  for (Size pairs : {0UL, 1UL, 3UL, 4UL, 15UL, 16UL, 17UL, 33UL, 1000UL}) {
+    std::vector<UInt8> data(pairs + 1, 0xEE);
+    EXPECT_EQ(hextobytes(hex.data(), pairs * 2, data.data(), data.size()), pairs);
+    EXPECT_TRUE(std::equal(data.begin(), data.begin() + pairs, expected.begin()));
+    EXPECT_EQ(data[pairs], 0xEE);
+  }
+
+  // stops at the pair holding a bad digit and never writes past size
+  for (Size bad : {0UL, 1UL, 31UL, 32UL, 77UL, 1999UL}) {
+    std::string broken = hex;
+    broken[bad] = 'g';
+    std::vector<UInt8> data(1000);
+    EXPECT_EQ(hextobytes(broken.data(), broken.size(), data.data(), data.size()), bad / 2);
+  }
+
+  std::vector<UInt8> small(10);
+  EXPECT_EQ(hextobytes(hex.data(), hex.size(), small.data(), small.size()), 10);
+}
+
+TEST(StrParseTest, ParsesDataAndIntegers) {
+  std::string hex = "0x" + std::string(64, 'a') + "0123456789";
+  std::vector<UInt8> data(40);
+  UInt32 size = data.size();
+  char *end;
+
+  EXPECT_EQ(strtodata(hex.data(), 16, data.data(), &size, &end), STRTODATA_OK);
+  EXPECT_EQ(size, 37);
+  EXPECT_EQ(*end, '\0');
+  EXPECT_EQ(data[32], 0x01);
+  EXPECT_EQ(data[36], 0x89);
+
+  size = 0;
+  EXPECT_EQ(strtodata(hex.data(), 16, nullptr, &size, &end), STRTODATA_OK);
+  EXPECT_EQ(size, 37);
+
+  char odd[] = "0xabcdef012";
+  EXPECT_EQ(strtodata(odd, 16, data.data(), &size, &end), STRTODATA_NEEDDIGIT);
+
+  UInt64 value;
+  char address[] = "0xfffffff007b6b668";
+  EXPECT_EQ(strtoint(address, strlen(address), false, false, 16, &value, &end), STRTOINT_OK);
+  EXPECT_EQ(value, 0xfffffff007b6b668ULL);
+
+  char decimal[] = "18446744073709551615";
+  EXPECT_EQ(strtoint(decimal, strlen(decimal), false, false, 10, &value, &end), STRTOINT_OK);
+  EXPECT_EQ(value, 18446744073709551615ULL);
+
+  char too_big[] = "18446744073709551616";
+  EXPECT_EQ(strtoint(too_big, strlen(too_big), false, false, 10, &value, &end),
+            STRTOINT_OVERFLOW);
+
+  char negative[] = "-1234567890123";
+  EXPECT_EQ(strtoint(negative, strlen(negative), true, true, 10, &value, &end), STRTOINT_OK);
+  EXPECT_EQ((int64_t)value, -1234567890123LL);
+
+  char bad[] = "12345678x";
+  EXPECT_EQ(strtoint(bad, strlen(bad), false, false, 10, &value, &end), STRTOINT_BADDIGIT);
+  EXPECT_EQ(end, bad + 8);
+}
+
+void FindMatchesNaive(std::string haystack, std::string needle) {
+  EXPECT_EQ(strfind(haystack.data(), haystack.size(), needle.data(), needle.size()),
+            NaiveFind(haystack.data(), haystack.size(), needle.data(), needle.size()));
+}
+FUZZ_TEST(StrParseTest, FindMatchesNaive);
+
+void HexMatchesDigitLoop(std::string hex) {
+  std::vector<UInt8> data(hex.size() / 2);
+  Size decoded = hextobytes(hex.data(), hex.size(), data.data(), data.size());
+
+  Size expected = 0;
+  while (expected < data.size() && hex_digit(hex[expected * 2]) >= 0 &&
+         hex_digit(hex[expected * 2 + 1]) >= 0) {
+    EXPECT_EQ(data[expected], hex_digit(hex[expected * 2]) << 4 | hex_digit(hex[expected * 2 + 1]));
+    expected++;
+  }
+  EXPECT_EQ(decoded, expected);
+}
+FUZZ_TEST(StrParseTest, HexMatchesDigitLoop);
+
+} // namespace
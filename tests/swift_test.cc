@@ -0,0 +1,262 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "macho.h"
+#include "swift.h"
+#include "types.h"
+
+namespace {
+
+using swift::ContextDescriptorKind;
+using swift::SwiftABI;
+
+static constexpr Size kImageSize = 0x10000;
+
+// A MachO over a plain buffer with no segments, so SwiftABI finds no sections of its own and
+// only parses the descriptors a test hands it.
+class BufferMachO : public MachO {
+public:
+  explicit BufferMachO(std::vector<UInt8> &image)
+      : MachO(reinterpret_cast<char *>(image.data()),
+              reinterpret_cast<xnu::macho::Header64 *>(image.data()),
+              reinterpret_cast<xnu::mach::VmAddress>(image.data()), 0),
+        size(image.size()) {}
+
+  Size GetSize() override { return size; }
+
+private:
+  Size size;
+};
+
+struct SwiftImage {
+  std::vector<UInt8> buffer;
+
+  BufferMachO macho;
+
+  SwiftABI swift;
+
+  SwiftImage() : buffer(kImageSize), macho(buffer), swift(&macho, nullptr) {}
+
+  template <typename T> T *At(Offset offset) {
+    return reinterpret_cast<T *>(buffer.data() + offset);
+  }
+
+  // aims the relative pointer at field at the given offset
+  void Point(void *field, Offset target) {
+    Int32 value = static_cast<Int32>(buffer.data() + target - reinterpret_cast<UInt8 *>(field));
+    memcpy(field, &value, sizeof(value));
+  }
+
+  // a descriptor named "Name", whose name sits at 0x100
+  template <typename T> T *Descriptor(Offset offset, ContextDescriptorKind kind) {
+    T *descriptor = At<T>(offset);
+
+    strcpy(At<char>(0x100), "Name");
+
+    descriptor->flags = static_cast<UInt32>(kind);
+    Point(&descriptor->name, 0x100);
+
+    return descriptor;
+  }
+};
+
+TEST(SwiftTest, ParsesProtocolDescriptor) {
+  SwiftImage image;
+
+  auto *descriptor =
+      image.Descriptor<swift::ProtocolDescriptor>(0x200, ContextDescriptorKind::Protocol);
+  descriptor->num_requirements_in_signature = 2;
+  descriptor->num_requirements = 5;
+
+  auto *protocol = static_cast<swift::Protocol *>(
+      image.swift.ParseTypeDescriptor(image.At<swift::TypeDescriptor>(0x200)));
+  ASSERT_NE(protocol, nullptr);
+  EXPECT_EQ(protocol->kind, swift::MK_Existential);
+  EXPECT_EQ(protocol->descriptor.num_requirements_in_signature, 2);
+  EXPECT_EQ(protocol->descriptor.num_requirements, 5);
+  delete protocol;
+}
+
+// the descriptor swiftc emits into __swift5_protos for
+//   protocol Container { associatedtype Element; associatedtype Index
+//                        func get(_ index: Index) -> Element }
+// with one requirement in the signature and one requirement per associated type and method
+TEST(SwiftTest, ParsesProtocolTrailingRequirements) {
+  SwiftImage image;
+
+  // Protocol, unique, not class bound
+  UInt8 bytes[] = {
+      0x43, 0x00, 0x01, 0x00, // flags
+      0x00, 0x00, 0x00, 0x00, // parent
+      0x00, 0x00, 0x00, 0x00, // name
+      0x01, 0x00, 0x00, 0x00, // num_requirements_in_signature
+      0x03, 0x00, 0x00, 0x00, // num_requirements
+      0x00, 0x00, 0x00, 0x00, // associated_type_names
+      // GenericRequirementDescriptor: a protocol requirement with a key argument
+      0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      // ProtocolRequirements: two associated types and a method
+      0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, //
+      0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, //
+      0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, //
+  };
+  static_assert(sizeof(bytes) == sizeof(swift::ProtocolDescriptor) +
+                                     sizeof(swift::GenericRequirementDescriptor) +
+                                     3 * sizeof(swift::ProtocolRequirement));
+
+  memcpy(image.At<UInt8>(0x200), bytes, sizeof(bytes));
+
+  auto *descriptor = image.At<swift::ProtocolDescriptor>(0x200);
+  strcpy(image.At<char>(0x100), "Container");
+  image.Point(&descriptor->name, 0x100);
+  strcpy(image.At<char>(0x180), "Element Index");
+  image.Point(&descriptor->associated_type_names, 0x180);
+
+  auto *protocol = static_cast<swift::Protocol *>(
+      image.swift.ParseTypeDescriptor(image.At<swift::TypeDescriptor>(0x200)));
+  ASSERT_NE(protocol, nullptr);
+  EXPECT_EQ(protocol->descriptor.num_requirements_in_signature, 1);
+  EXPECT_EQ(protocol->descriptor.num_requirements, 3);
+  ASSERT_NE(protocol->associated_type_names, nullptr);
+  EXPECT_STREQ(protocol->associated_type_names, "Element Index");
+
+  ASSERT_EQ(reinterpret_cast<UInt8 *>(protocol->requirements_in_signature),
+            image.At<UInt8>(0x200 + 24));
+  EXPECT_EQ(protocol->requirements_in_signature[0].flags, 0x80);
+  ASSERT_EQ(reinterpret_cast<UInt8 *>(protocol->requirements), image.At<UInt8>(0x200 + 36));
+  EXPECT_EQ(protocol->requirements[0].flags, 0x07);
+  EXPECT_EQ(protocol->requirements[2].flags, 0x11);
+  delete protocol;
+
+  // requirements running past the end of the image are not handed out
+  descriptor->num_requirements = 0x10000000;
+  protocol = static_cast<swift::Protocol *>(
+      image.swift.ParseTypeDescriptor(image.At<swift::TypeDescriptor>(0x200)));
+  ASSERT_NE(protocol, nullptr);
+  EXPECT_EQ(protocol->requirements_in_signature, nullptr);
+  EXPECT_EQ(protocol->requirements, nullptr);
+  EXPECT_STREQ(protocol->associated_type_names, "Element Index");
+  delete protocol;
+}
+
+TEST(SwiftTest, RejectsDescriptorsPastTheImage) {
+  SwiftImage image;
+
+  // room for a type descriptor but not for a protocol descriptor
+  Offset offset = kImageSize - sizeof(swift::TypeDescriptor);
+
+  image.Descriptor<swift::TypeDescriptor>(offset, ContextDescriptorKind::Protocol);
+  EXPECT_EQ(image.swift.ParseTypeDescriptor(image.At<swift::TypeDescriptor>(offset)), nullptr);
+
+  image.swift.IndexTypeDescriptor(image.At<swift::TypeDescriptor>(offset));
+  EXPECT_TRUE(image.swift.GetTypeIndex().empty());
+
+  // a struct there is whole
+  image.Descriptor<swift::TypeDescriptor>(offset, ContextDescriptorKind::Struct);
+  auto *structure = static_cast<swift::Struct *>(
+      image.swift.ParseTypeDescriptor(image.At<swift::TypeDescriptor>(offset)));
+  ASSERT_NE(structure, nullptr);
+  EXPECT_EQ(structure->kind, swift::MK_Struct);
+  delete structure;
+
+  image.swift.IndexTypeDescriptor(image.At<swift::TypeDescriptor>(offset));
+  ASSERT_EQ(image.swift.GetTypeIndex().size(), 1);
+  EXPECT_STREQ(image.swift.GetTypeIndex()[0].name, "Name");
+}
+
+// Structs Test.Type0 to Test.Type<count - 1>, each with one field whose type is a symbolic
+// reference to the next struct.
+void AddStructs(SwiftImage &image, UInt32 count) {
+  auto *module = image.At<swift::ModuleDescriptor>(0x200);
+  strcpy(image.At<char>(0x280), "Test");
+  module->flags = static_cast<UInt32>(ContextDescriptorKind::Module);
+  image.Point(&module->name, 0x280);
+
+  for (UInt32 i = 0; i < count; i++) {
+    Offset descriptor_offset = 0x1000 + i * 0x20;
+    Offset fields_offset = 0x4000 + i * 0x20;
+    Offset names_offset = 0x8000 + i * 0x20;
+    Offset reference_offset = 0xC000 + i * 8;
+
+    auto *descriptor = image.At<swift::TypeDescriptor>(descriptor_offset);
+    descriptor->flags = static_cast<UInt32>(ContextDescriptorKind::Struct);
+    image.Point(&descriptor->parent, 0x200);
+    snprintf(image.At<char>(names_offset), 0x10, "Type%u", i);
+    image.Point(&descriptor->name, names_offset);
+    image.Point(&descriptor->field_descriptor, fields_offset);
+
+    auto *fields = image.At<swift::FieldDescriptor>(fields_offset);
+    fields->field_record_size = sizeof(swift::FieldRecord);
+    fields->num_fields = 1;
+
+    auto *record = image.At<swift::FieldRecord>(fields_offset + sizeof(*fields));
+    snprintf(image.At<char>(names_offset + 0x10), 0x10, "field%u", i);
+    image.Point(&record->field_name, names_offset + 0x10);
+
+    UInt8 *reference = image.At<UInt8>(reference_offset);
+    reference[0] = 0x01;
+    image.Point(reference + 1, 0x1000 + ((i + 1) % count) * 0x20);
+    image.Point(&record->mangled_type_name, reference_offset);
+  }
+
+  for (UInt32 i = 0; i < count; i++) {
+    image.swift.IndexTypeDescriptor(image.At<swift::TypeDescriptor>(0x1000 + i * 0x20));
+  }
+}
+
+TEST(SwiftTest, DecodesFieldsInParallel) {
+  SwiftImage image;
+
+  // enough types for every thread to get a few batches
+  AddStructs(image, 300);
+  ASSERT_EQ(image.swift.GetTypeIndex().size(), 300);
+
+  EXPECT_EQ(image.swift.DecodeTypes(4), 300);
+
+  for (UInt32 i = 0; i < 300; i++) {
+    swift::Type *type = image.swift.GetTypeIndex()[i].type;
+    ASSERT_NE(type, nullptr);
+    ASSERT_NE(type->fields, nullptr);
+    ASSERT_EQ(type->fields->records.size(), 1);
+
+    // a lone reference to a type in the image resolves to its qualified name
+    std::string name = "field" + std::to_string(i);
+    std::string field_type = "Test.Type" + std::to_string((i + 1) % 300);
+    EXPECT_EQ(std::string(type->fields->records[0]->name), name);
+    EXPECT_EQ(std::string(type->fields->records[0]->demangled_name), field_type);
+  }
+
+  // and every type is found by its qualified and its mangled name
+  swift::TypeIndexEntry *entry = image.swift.GetTypeIndexEntry(const_cast<char *>("Test.Type7"));
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(entry,
+            image.swift.GetTypeIndexEntryByMangledName(const_cast<char *>("$s4Test5Type7V")));
+}
+
+void ParseNeverCrashes(std::vector<UInt8> descriptor, UInt32 offset) {
+  SwiftImage image;
+
+  // descriptors are 4 byte aligned in any image the linker produced
+  offset = (offset % kImageSize) & ~3;
+
+  if (!descriptor.empty()) {
+    memcpy(image.At<UInt8>(offset), descriptor.data(),
+           std::min<Size>(descriptor.size(), kImageSize - offset));
+  }
+
+  image.swift.IndexTypeDescriptor(image.At<swift::TypeDescriptor>(offset));
+
+  for (swift::TypeIndexEntry &entry : image.swift.GetTypeIndex()) {
+    image.swift.GetType(&entry);
+  }
+}
+FUZZ_TEST(SwiftTest, ParseNeverCrashes);
+
+} // namespace
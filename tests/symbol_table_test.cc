@@ -0,0 +1,116 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "symbol.h"
+#include "symbol_table.h"
+#include "types.h"
+
+namespace {
+
+static constexpr char kCxxName[] = "__ZN6darwin4Hook7InstallEv";
+static constexpr char kCxxDemangled[] = "darwin::Hook::Install()";
+
+Symbol *MakeSymbol(const char *name, xnu::mach::VmAddress address) {
+  return new Symbol(nullptr, 0, strdup(name), address, address - 0x1000, nullptr, nullptr);
+}
+
+// symbols do not own their names, in a real table those point into the string table
+void DeleteSymbol(Symbol *symbol) {
+  free(symbol->GetName());
+  delete symbol;
+}
+
+TEST(SymbolTableTest, DemanglesThroughTheCache) {
+  std::string name = kCxxName;
+
+  char *demangled = demangle(name.data());
+  ASSERT_NE(demangled, nullptr);
+  EXPECT_STREQ(demangled, kCxxDemangled);
+
+  // a second lookup, from another buffer, hands back the cached string
+  std::string copy = kCxxName;
+  EXPECT_EQ(demangle(copy.data()), demangled);
+
+  // the cache is keyed by contents, reusing the buffer for another name is a different entry
+  name = "__ZN6darwin4Hook9UninstallEv";
+  char *other = demangle(name.data());
+  ASSERT_NE(other, nullptr);
+  EXPECT_STREQ(other, "darwin::Hook::Uninstall()");
+  EXPECT_STREQ(demangled, kCxxDemangled);
+
+  // names without a mangling prefix never reach a demangler, and that is cached too
+  char plain[] = "_kernel_task";
+  EXPECT_EQ(demangle(plain), nullptr);
+  EXPECT_EQ(demangle(plain), nullptr);
+
+  char bogus[] = "__Znot_a_mangled_name";
+  EXPECT_EQ(demangle(bogus), nullptr);
+}
+
+TEST(SymbolTableTest, SymbolsShareDemangledNames) {
+  Symbol *first = MakeSymbol(kCxxName, 0x2000);
+  Symbol *second = MakeSymbol(kCxxName, 0x3000);
+  Symbol *plain = MakeSymbol("_kernel_task", 0x4000);
+
+  EXPECT_TRUE(first->IsCxx());
+  EXPECT_FALSE(first->IsSwift());
+  EXPECT_STREQ(first->GetDemangledName(), kCxxDemangled);
+  EXPECT_EQ(first->GetDemangledName(), second->GetDemangledName());
+
+  EXPECT_FALSE(plain->IsCxx());
+  EXPECT_STREQ(plain->GetDemangledName(), "");
+
+  DeleteSymbol(first);
+  DeleteSymbol(second);
+  DeleteSymbol(plain);
+}
+
+TEST(SymbolTableTest, FindsSymbolsAfterDemanglingInParallel) {
+  static constexpr int kSymbols = 1000;
+
+  SymbolTable table;
+
+  for (int i = 0; i < kSymbols; i++) {
+    std::string name = "__ZN4Test" + std::to_string(std::to_string(i).size() + 4) + "Func" +
+                       std::to_string(i) + "Ev";
+    table.AddSymbol(MakeSymbol(name.c_str(), 0x10000 + i * 0x10));
+  }
+
+  table.DemangleSymbols(8);
+
+  for (int i = 0; i < kSymbols; i++) {
+    Symbol *symbol = table.GetAllSymbols()[i];
+    std::string demangled = "Test::Func" + std::to_string(i) + "()";
+    EXPECT_EQ(std::string(symbol->GetDemangledName()), demangled);
+  }
+
+  Symbol *symbol = table.GetSymbolByAddress(0x10000 + 42 * 0x10);
+  ASSERT_NE(symbol, nullptr);
+  EXPECT_EQ(table.GetSymbolByName(symbol->GetName()), symbol);
+  EXPECT_EQ(table.GetSymbolByOffset(0x10000 + 42 * 0x10 - 0x1000), symbol);
+  EXPECT_STREQ(symbol->GetDemangledName(), "Test::Func42()");
+
+  table.RemoveSymbol(symbol);
+  EXPECT_FALSE(table.ContainsSymbolWithAddress(0x10000 + 42 * 0x10));
+
+  DeleteSymbol(symbol);
+
+  for (Symbol *remaining : table.GetAllSymbols()) {
+    DeleteSymbol(remaining);
+  }
+}
+
+void DemangleNeverCrashes(std::string name) {
+  char *first = demangle(name.data());
+  EXPECT_EQ(demangle(name.data()), first);
+}
+FUZZ_TEST(SymbolTableTest, DemangleNeverCrashes);
+
+} // namespace
@@ -0,0 +1,162 @@
+#include "fuzztest/fuzztest.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <list>
+#include <vector>
+
+#include "task_page_cache.h"
+
+namespace {
+
+using xnu::TaskPageCache;
+
+static constexpr Size kPageSize = xnu::kTaskPageCachePageSize;
+static constexpr xnu::mach::VmAddress kBase = 0x100000000ULL;
+
+xnu::mach::VmAddress Page(Size i) {
+  return kBase + i * kPageSize;
+}
+
+TEST(TaskPageCacheTest, HitsAfterInsert) {
+  TaskPageCache cache(4);
+  ASSERT_TRUE(cache.IsValid());
+
+  EXPECT_EQ(cache.Lookup(Page(0)), nullptr);
+
+  UInt8 *page = cache.Insert(Page(0));
+  ASSERT_NE(page, nullptr);
+  memset(page, 0xAB, kPageSize);
+
+  UInt8 *cached = cache.Lookup(Page(0));
+  ASSERT_EQ(cached, page);
+  EXPECT_EQ(cached[kPageSize - 1], 0xAB);
+
+  EXPECT_EQ(cache.GetStats().hits, 1);
+  EXPECT_EQ(cache.GetStats().misses, 1);
+  EXPECT_EQ(cache.GetCount(), 1);
+}
+
+TEST(TaskPageCacheTest, EvictsLeastRecentlyUsed) {
+  TaskPageCache cache(3);
+  ASSERT_TRUE(cache.IsValid());
+
+  cache.Insert(Page(0));
+  cache.Insert(Page(1));
+  cache.Insert(Page(2));
+
+  // page 0 becomes the most recently used, so page 1 is the one to go
+  ASSERT_NE(cache.Lookup(Page(0)), nullptr);
+  cache.Insert(Page(3));
+
+  EXPECT_EQ(cache.GetStats().evictions, 1);
+  EXPECT_EQ(cache.GetCount(), 3);
+  EXPECT_NE(cache.Lookup(Page(0)), nullptr);
+  EXPECT_EQ(cache.Lookup(Page(1)), nullptr);
+  EXPECT_NE(cache.Lookup(Page(2)), nullptr);
+  EXPECT_NE(cache.Lookup(Page(3)), nullptr);
+}
+
+TEST(TaskPageCacheTest, InvalidatesRanges) {
+  TaskPageCache cache(8);
+  ASSERT_TRUE(cache.IsValid());
+
+  for (Size i = 0; i < 8; i++) {
+    cache.Insert(Page(i));
+  }
+
+  UInt64 generation = cache.GetGeneration();
+
+  // a write straddling pages 2 and 3
+  cache.Invalidate(Page(3) - 4, 8);
+
+  EXPECT_GT(cache.GetGeneration(), generation);
+  EXPECT_EQ(cache.GetCount(), 6);
+  EXPECT_EQ(cache.Lookup(Page(2)), nullptr);
+  EXPECT_EQ(cache.Lookup(Page(3)), nullptr);
+  EXPECT_NE(cache.Lookup(Page(4)), nullptr);
+
+  generation = cache.GetGeneration();
+
+  cache.InvalidateAll();
+
+  EXPECT_GT(cache.GetGeneration(), generation);
+  EXPECT_EQ(cache.GetCount(), 0);
+  EXPECT_EQ(cache.Lookup(Page(4)), nullptr);
+
+  // everything is usable again after a full invalidation
+  for (Size i = 0; i < 8; i++) {
+    EXPECT_NE(cache.Insert(Page(i + 100)), nullptr);
+  }
+  EXPECT_EQ(cache.GetCount(), 8);
+}
+
+TEST(TaskPageCacheTest, RejectsBadGeometry) {
+  TaskPageCache empty(0);
+  EXPECT_FALSE(empty.IsValid());
+  EXPECT_EQ(empty.Insert(Page(0)), nullptr);
+
+  TaskPageCache odd(4, 3000);
+  EXPECT_FALSE(odd.IsValid());
+}
+
+// operations are (opcode, page) pairs replayed against a list based LRU model
+void MatchesReferenceLru(UInt8 capacity, std::vector<std::pair<UInt8, UInt8>> operations) {
+  TaskPageCache cache(capacity % 16 + 1);
+  std::list<xnu::mach::VmAddress> model;
+
+  for (auto &[opcode, index] : operations) {
+    xnu::mach::VmAddress page = Page(index % 64);
+
+    auto it = std::find(model.begin(), model.end(), page);
+
+    switch (opcode % 4) {
+    case 0: {
+      bool hit = cache.Lookup(page) != nullptr;
+      ASSERT_EQ(hit, it != model.end());
+      if (hit) {
+        model.erase(it);
+        model.push_front(page);
+      }
+      break;
+    }
+    case 1: {
+      UInt8 *data = cache.Insert(page);
+      ASSERT_NE(data, nullptr);
+      data[0] = index;
+      if (it != model.end()) {
+        model.erase(it);
+      } else if (model.size() == cache.GetCapacity()) {
+        model.pop_back();
+      }
+      model.push_front(page);
+      break;
+    }
+    case 2:
+      cache.Remove(page);
+      if (it != model.end()) {
+        model.erase(it);
+      }
+      break;
+    case 3: {
+      Size pages = index % 3 + 1;
+      cache.Invalidate(page, kPageSize * pages);
+      // ranges with more pages than are cached drop the whole cache
+      if (pages - 1 >= model.size()) {
+        model.clear();
+      }
+      model.remove_if([&](xnu::mach::VmAddress cached) {
+        return cached >= page && cached < page + kPageSize * pages;
+      });
+      break;
+    }
+    }
+
+    ASSERT_EQ(cache.GetCount(), model.size());
+  }
+}
+FUZZ_TEST(TaskPageCacheTest, MatchesReferenceLru);
+
+} // namespace
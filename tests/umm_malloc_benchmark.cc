@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "umm_cache.h"
+#include "umm_malloc.h"
+
+// Usage: umm_malloc_benchmark [operations per thread] [max threads]
+//
+// Runs the same multithreaded alloc/free mix against a single umm_malloc heap, the size class
+// cache spread over several heaps and the system malloc. Every live block is filled with a
+// pattern that is checked before it is freed, so the run doubles as a stress test and exits
+// non-zero if any block was handed out twice or overwritten.
+//
+// Built with UMM_STATS (the umm_malloc_stats_benchmark target), every umm run is followed by
+// a report of the heap counters: requests per size bucket, the high-water mark, free list
+// shape and the time spent coalescing free blocks.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kArenaSize = 64 << 20;
+constexpr unsigned int kNumHeaps = 4;
+constexpr size_t kLiveBlocks = 1024;
+
+struct Allocator {
+  const char *name;
+  void *(*malloc)(void *context, size_t size);
+  void (*free)(void *context, void *ptr);
+  void *context;
+  umm_heap_context *heaps;
+  unsigned int num_heaps;
+};
+
+void *HeapMalloc(void *context, size_t size) {
+  return umm_malloc_heap(static_cast<umm_heap_context *>(context), size);
+}
+
+void HeapFree(void *context, void *ptr) {
+  umm_free_heap(static_cast<umm_heap_context *>(context), ptr);
+}
+
+void *CacheMalloc(void *context, size_t size) {
+  return umm_cache_malloc(static_cast<umm_cache *>(context), size);
+}
+
+void CacheFree(void *context, void *ptr) {
+  umm_cache_free(static_cast<umm_cache *>(context), ptr);
+}
+
+void *SystemMalloc(void *context, size_t size) {
+  return malloc(size);
+}
+
+void SystemFree(void *context, void *ptr) {
+  free(ptr);
+}
+
+// Mostly small blocks like capstone's, with the odd large one that bypasses the size classes
+size_t NextSize(unsigned int &seed) {
+  seed = seed * 1103515245 + 12345;
+
+  unsigned int r = (seed >> 8) % 100;
+
+  if (r < 80) {
+    return 8 + (seed >> 16) % 248;
+  } else if (r < 95) {
+    return 256 + (seed >> 16) % 768;
+  }
+
+  return 1024 + (seed >> 16) % 7168;
+}
+
+struct Block {
+  unsigned char *ptr;
+  size_t size;
+  unsigned char pattern;
+};
+
+void Worker(Allocator &allocator, unsigned int id, size_t operations,
+            std::atomic<size_t> &corrupted, std::atomic<size_t> &failed) {
+  std::vector<Block> live(kLiveBlocks);
+
+  unsigned int seed = id * 7919 + 1;
+
+  for (size_t i = 0; i < operations; i++) {
+    seed = seed * 1103515245 + 12345;
+
+    Block &block = live[(seed >> 12) % kLiveBlocks];
+
+    if (block.ptr) {
+      for (size_t j = 0; j < block.size; j += 61) {
+        if (block.ptr[j] != block.pattern) {
+          corrupted++;
+          break;
+        }
+      }
+
+      if (block.ptr[block.size - 1] != block.pattern) {
+        corrupted++;
+      }
+
+      allocator.free(allocator.context, block.ptr);
+      block.ptr = nullptr;
+      continue;
+    }
+
+    block.size = NextSize(seed);
+    block.pattern = static_cast<unsigned char>(id * 31 + i);
+    block.ptr = static_cast<unsigned char *>(allocator.malloc(allocator.context, block.size));
+
+    if (!block.ptr) {
+      failed++;
+      continue;
+    }
+
+    memset(block.ptr, block.pattern, block.size);
+  }
+
+  for (Block &block : live) {
+    if (block.ptr) {
+      allocator.free(allocator.context, block.ptr);
+    }
+  }
+}
+
+#ifdef UMM_STATS
+
+void ResetStats(Allocator &allocator) {
+  for (unsigned int i = 0; i < allocator.num_heaps; i++) {
+    umm_heap_stats_reset(&allocator.heaps[i]);
+  }
+}
+
+void PrintStats(Allocator &allocator) {
+  for (unsigned int i = 0; i < allocator.num_heaps; i++) {
+    umm_stats stats;
+
+    umm_heap_stats(&allocator.heaps[i], &stats);
+
+    printf("  heap %u: peak %zu KB, %lu failed, free list %u blocks, largest free %zu KB, "
+           "%u%% fragmented\n",
+           i, stats.peak_used_blocks * stats.block_size >> 10, stats.failed,
+           stats.free_list_length, stats.largest_free_block * stats.block_size >> 10,
+           stats.fragmentation);
+
+    printf("          assimilate up %lu in %.2f ms, down %lu in %.2f ms\n", stats.assimilate_up,
+           stats.assimilate_up_time / 1e6, stats.assimilate_down,
+           stats.assimilate_down_time / 1e6);
+
+    for (unsigned int b = 0; b < UMM_STATS_BUCKETS; b++) {
+      if (!stats.mallocs[b] && !stats.frees[b] && !stats.reallocs[b]) {
+        continue;
+      }
+
+      if (b == UMM_STATS_BUCKETS - 1) {
+        printf("          > %6zu bytes:", (size_t)8 << (b - 1));
+      } else {
+        printf("          <= %6zu bytes:", (size_t)8 << b);
+      }
+
+      printf(" %9lu malloc %9lu free %9lu realloc\n", stats.mallocs[b], stats.frees[b],
+             stats.reallocs[b]);
+    }
+  }
+}
+
+#endif
+
+bool Run(Allocator &allocator, unsigned int num_threads, size_t operations) {
+  std::atomic<size_t> corrupted(0);
+  std::atomic<size_t> failed(0);
+
+  std::vector<std::thread> threads;
+
+#ifdef UMM_STATS
+  ResetStats(allocator);
+#endif
+
+  Clock::time_point start = Clock::now();
+
+  for (unsigned int i = 0; i < num_threads; i++) {
+    threads.emplace_back(Worker, std::ref(allocator), i, operations, std::ref(corrupted),
+                         std::ref(failed));
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  printf("%-12s %2u threads  %8.2f Mops/s  %zu failed  %zu corrupted\n", allocator.name,
+         num_threads, num_threads * operations / seconds / 1e6, failed.load(), corrupted.load());
+
+#ifdef UMM_STATS
+  PrintStats(allocator);
+#endif
+
+  return corrupted == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t operations = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1000000;
+  unsigned int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+
+  std::vector<char> single_arena(kArenaSize);
+  std::vector<char> cache_arena(kArenaSize);
+
+  umm_heap_context single;
+  umm_heap_context heaps[kNumHeaps];
+
+  static umm_cache cache;
+
+  bool ok = true;
+
+  umm_init_heap(&single, single_arena.data(), single_arena.size());
+
+  for (unsigned int i = 0; i < kNumHeaps; i++) {
+    umm_init_heap(&heaps[i], cache_arena.data() + i * (kArenaSize / kNumHeaps),
+                  kArenaSize / kNumHeaps);
+  }
+
+  umm_cache_init(&cache, heaps, kNumHeaps);
+
+  Allocator allocators[] = {
+      {"umm_malloc", HeapMalloc, HeapFree, &single, &single, 1},
+      {"umm_cache", CacheMalloc, CacheFree, &cache, heaps, kNumHeaps},
+      {"malloc", SystemMalloc, SystemFree, nullptr, nullptr, 0},
+  };
+
+  for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+    for (Allocator &allocator : allocators) {
+      ok &= Run(allocator, threads, operations);
+    }
+
+    umm_cache_flush(&cache);
+  }
+
+  umm_cache_destroy(&cache);
+
+  umm_destroy_heap(&single);
+
+  for (unsigned int i = 0; i < kNumHeaps; i++) {
+    umm_destroy_heap(&heaps[i]);
+  }
+
+  return ok ? 0 : 1;
+}
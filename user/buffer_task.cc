@@ -0,0 +1,484 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "buffer_task.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+
+namespace xnu {
+
+static constexpr UInt8 kBufferTaskPageMapped = 0x80;
+
+static constexpr UInt8 kBufferTaskPageProtection = 0x07;
+
+BufferTask::BufferTask(Size size)
+    : Task(), buffer(nullptr), size(0), page_size(getpagesize()), page_count(0),
+      pages(nullptr), aliases(nullptr), latency(0), enforce_protection(false), stats() {
+    void* region;
+
+    Size length = (size + page_size - 1) & ~(page_size - 1);
+
+    kernel = nullptr;
+    macho = nullptr;
+    process = nullptr;
+    dyld = nullptr;
+
+    task_port = 0;
+    task = 0;
+    proc = 0;
+    map = 0;
+    pmap = 0;
+
+    name = const_cast<char*>("buffer");
+    path = nullptr;
+    pid = -1;
+    slide = 0;
+
+    dyld_base = 0;
+    dyld_shared_cache = 0;
+
+    region = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (region == MAP_FAILED)
+        return;
+
+    buffer = reinterpret_cast<UInt8*>(region);
+
+    this->size = length;
+
+    base = reinterpret_cast<xnu::mach::VmAddress>(buffer);
+
+    page_count = length / page_size;
+
+    pages = new UInt8[page_count];
+    aliases = new Size[page_count];
+
+    memset(pages, 0, page_count);
+    memset(aliases, 0, page_count * sizeof(Size));
+}
+
+BufferTask::~BufferTask() {
+    if (buffer)
+        munmap(buffer, size);
+
+    if (pages)
+        delete[] pages;
+
+    if (aliases)
+        delete[] aliases;
+}
+
+void BufferTask::ResetStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void BufferTask::Delay() {
+    std::chrono::steady_clock::time_point start;
+
+    if (!latency)
+        return;
+
+    start = std::chrono::steady_clock::now();
+
+    // spinning keeps sub-microsecond latencies honest, sleeping would round them up
+    while ((UInt64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+               .count() < latency)
+        ;
+}
+
+bool BufferTask::Contains(xnu::mach::VmAddress address, Size length) {
+    return buffer && address >= base && address - base <= size && length <= size - (address - base);
+}
+
+xnu::mach::VmProtection BufferTask::GetProtection(xnu::mach::VmAddress address) {
+    if (!Contains(address, 1))
+        return VM_PROT_NONE;
+
+    return pages[(address - base) / page_size] & kBufferTaskPageProtection;
+}
+
+bool BufferTask::HasProtection(xnu::mach::VmAddress address, Size length,
+                               xnu::mach::VmProtection prot) {
+    Size first;
+    Size last;
+
+    if (!enforce_protection || !length)
+        return true;
+
+    first = (address - base) / page_size;
+    last = (address - base + length - 1) / page_size;
+
+    for (Size page = first; page <= last; page++) {
+        if (!(pages[page] & kBufferTaskPageMapped) || (pages[page] & prot) != prot)
+            return false;
+    }
+
+    return true;
+}
+
+Size BufferTask::FindFreePages(Size count) {
+    Size run = 0;
+
+    // first fit, the region is small and allocations are page sized
+    for (Size page = 0; page < page_count; page++) {
+        run = pages[page] & kBufferTaskPageMapped ? 0 : run + 1;
+
+        if (run == count)
+            return page + 1 - count;
+    }
+
+    return page_count;
+}
+
+UInt8* BufferTask::Resolve(xnu::mach::VmAddress address) {
+    Size page = (address - base) / page_size;
+
+    if (aliases[page])
+        return buffer + (aliases[page] - 1) * page_size + (address - base) % page_size;
+
+    return reinterpret_cast<UInt8*>(address);
+}
+
+void BufferTask::Copy(xnu::mach::VmAddress address, void* data, Size size, bool write) {
+    UInt8* bytes = reinterpret_cast<UInt8*>(data);
+
+    while (size) {
+        Size chunk = page_size - (address - base) % page_size;
+
+        UInt8* target = Resolve(address);
+
+        if (chunk > size)
+            chunk = size;
+
+        if (write) {
+            memcpy(target, bytes, chunk);
+
+            // cached copies of the page the alias maps are stale as well
+            InvalidateCaches(address, chunk);
+
+            if (target != reinterpret_cast<UInt8*>(address))
+                InvalidateCaches(reinterpret_cast<xnu::mach::VmAddress>(target), chunk);
+        } else {
+            memcpy(bytes, target, chunk);
+        }
+
+        address += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+}
+
+xnu::mach::VmAddress BufferTask::LoadCode(const UInt8* code, Size length) {
+    xnu::mach::VmAddress address =
+        VmAllocate(length, VM_FLAGS_ANYWHERE, VM_PROT_READ | VM_PROT_EXECUTE);
+
+    if (!address)
+        return 0;
+
+    memcpy(reinterpret_cast<void*>(address), code, length);
+
+    return address;
+}
+
+xnu::mach::VmAddress BufferTask::GetBase() {
+    return base;
+}
+
+Offset BufferTask::GetSlide() {
+    return 0;
+}
+
+char* BufferTask::GetTaskName() {
+    return name;
+}
+
+UInt64 BufferTask::Call(char* symbolname, UInt64* arguments, Size argCount) {
+    return 0;
+}
+
+UInt64 BufferTask::Call(xnu::mach::VmAddress func, UInt64* arguments, Size argCount) {
+    return 0;
+}
+
+xnu::mach::VmAddress BufferTask::VmAllocate(Size size) {
+    return VmAllocate(size, VM_FLAGS_ANYWHERE, VM_PROT_READ | VM_PROT_WRITE);
+}
+
+xnu::mach::VmAddress BufferTask::VmAllocate(Size size, UInt32 flags,
+                                            xnu::mach::VmProtection prot) {
+    Size count = (size + page_size - 1) / page_size;
+    Size first;
+
+    Delay();
+
+    if (!buffer || !count)
+        return 0;
+
+    first = FindFreePages(count);
+
+    if (first == page_count)
+        return 0;
+
+    memset(&pages[first], kBufferTaskPageMapped | (prot & kBufferTaskPageProtection), count);
+    memset(buffer + first * page_size, 0, count * page_size);
+
+    stats.allocations++;
+
+    return base + first * page_size;
+}
+
+void BufferTask::VmDeallocate(xnu::mach::VmAddress address, Size size) {
+    Size first;
+    Size count;
+
+    Delay();
+
+    if (!Contains(address, size) || (address - base) % page_size)
+        return;
+
+    first = (address - base) / page_size;
+    count = (size + page_size - 1) / page_size;
+
+    memset(&pages[first], 0, count);
+    memset(&aliases[first], 0, count * sizeof(Size));
+
+    InvalidateCaches(address, size);
+
+    stats.deallocations++;
+}
+
+bool BufferTask::VmProtect(xnu::mach::VmAddress address, Size size,
+                           xnu::mach::VmProtection prot) {
+    Size first;
+    Size last;
+
+    Delay();
+
+    if (!size || !Contains(address, size))
+        return false;
+
+    first = (address - base) / page_size;
+    last = (address - base + size - 1) / page_size;
+
+    for (Size page = first; page <= last; page++) {
+        if (!(pages[page] & kBufferTaskPageMapped))
+            return false;
+    }
+
+    for (Size page = first; page <= last; page++)
+        pages[page] = kBufferTaskPageMapped | (prot & kBufferTaskPageProtection);
+
+    InvalidateCaches(address, size);
+
+    stats.protection_changes++;
+
+    return true;
+}
+
+void* BufferTask::VmRemap(xnu::mach::VmAddress address, Size size) {
+    Size count = (size + page_size - 1) / page_size;
+    Size source;
+    Size first;
+
+    Delay();
+
+    if (!count || !Contains(address, count * page_size) || (address - base) % page_size)
+        return nullptr;
+
+    source = (address - base) / page_size;
+
+    for (Size page = source; page < source + count; page++) {
+        if (!(pages[page] & kBufferTaskPageMapped))
+            return nullptr;
+    }
+
+    first = FindFreePages(count);
+
+    if (first == page_count)
+        return nullptr;
+
+    // like mach_vm_remap(), the new pages start out with the protection of the ones they map
+    for (Size i = 0; i < count; i++) {
+        Size page = aliases[source + i] ? aliases[source + i] - 1 : source + i;
+
+        pages[first + i] = pages[source + i];
+        aliases[first + i] = page + 1;
+    }
+
+    stats.allocations++;
+
+    return buffer + first * page_size;
+}
+
+UInt64 BufferTask::VirtualToPhysical(xnu::mach::VmAddress address) {
+    return Contains(address, 1) ? address - base : 0;
+}
+
+bool BufferTask::Read(xnu::mach::VmAddress address, void* data, Size size) {
+    if (page_cache && ReadCached(address, data, size))
+        return true;
+
+    return ReadBuffer(address, data, size);
+}
+
+bool BufferTask::ReadBuffer(xnu::mach::VmAddress address, void* data, Size size) {
+    Delay();
+
+    if (!Contains(address, size))
+        return false;
+
+    if (!HasProtection(address, size, VM_PROT_READ)) {
+        stats.protection_faults++;
+
+        return false;
+    }
+
+    Copy(address, data, size, false);
+
+    stats.reads++;
+    stats.bytes_read += size;
+
+    return true;
+}
+
+bool BufferTask::ReadUnsafe(xnu::mach::VmAddress address, void* data, Size size) {
+    return Read(address, data, size);
+}
+
+bool BufferTask::TryRead(xnu::mach::VmAddress address, void* data, Size size) {
+    return ReadBuffer(address, data, size);
+}
+
+UInt8 BufferTask::Read8(xnu::mach::VmAddress address) {
+    UInt8 value = 0;
+
+    Read(address, &value, sizeof(value));
+
+    return value;
+}
+
+UInt16 BufferTask::Read16(xnu::mach::VmAddress address) {
+    UInt16 value = 0;
+
+    Read(address, &value, sizeof(value));
+
+    return value;
+}
+
+UInt32 BufferTask::Read32(xnu::mach::VmAddress address) {
+    UInt32 value = 0;
+
+    Read(address, &value, sizeof(value));
+
+    return value;
+}
+
+UInt64 BufferTask::Read64(xnu::mach::VmAddress address) {
+    UInt64 value = 0;
+
+    Read(address, &value, sizeof(value));
+
+    return value;
+}
+
+bool BufferTask::Write(xnu::mach::VmAddress address, void* data, Size size) {
+    Delay();
+
+    if (!Contains(address, size))
+        return false;
+
+    if (!HasProtection(address, size, VM_PROT_WRITE)) {
+        stats.protection_faults++;
+
+        return false;
+    }
+
+    Copy(address, data, size, true);
+
+    stats.writes++;
+    stats.bytes_written += size;
+
+    return true;
+}
+
+bool BufferTask::WriteUnsafe(xnu::mach::VmAddress address, void* data, Size size) {
+    if (!Contains(address, size))
+        return false;
+
+    // like a physical write, ignores the page protections and costs nothing
+    Copy(address, data, size, true);
+
+    return true;
+}
+
+void BufferTask::Write8(xnu::mach::VmAddress address, UInt8 value) {
+    Write(address, &value, sizeof(value));
+}
+
+void BufferTask::Write16(xnu::mach::VmAddress address, UInt16 value) {
+    Write(address, &value, sizeof(value));
+}
+
+void BufferTask::Write32(xnu::mach::VmAddress address, UInt32 value) {
+    Write(address, &value, sizeof(value));
+}
+
+void BufferTask::Write64(xnu::mach::VmAddress address, UInt64 value) {
+    Write(address, &value, sizeof(value));
+}
+
+char* BufferTask::ReadString(xnu::mach::VmAddress address) {
+    char* string;
+
+    Size length = 0;
+
+    if (!Contains(address, 1))
+        return nullptr;
+
+    while (Contains(address, length + 1) && reinterpret_cast<char*>(address)[length])
+        length++;
+
+    // callers free() strings read from a task
+    string = (char*)malloc(length + 1);
+
+    Read(address, string, length);
+
+    string[length] = '\0';
+
+    return string;
+}
+
+Symbol* BufferTask::GetSymbolByName(char* symname) {
+    return nullptr;
+}
+
+Symbol* BufferTask::GetSymbolByAddress(xnu::mach::VmAddress address) {
+    return nullptr;
+}
+
+xnu::mach::VmAddress BufferTask::GetSymbolAddressByName(char* symbolname) {
+    return 0;
+}
+
+void BufferTask::PrintLoadedImages() {}
+
+} // namespace xnu
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+#include "task.h"
+
+namespace xnu {
+
+struct BufferTaskStats {
+    UInt64 reads;
+    UInt64 writes;
+
+    UInt64 bytes_read;
+    UInt64 bytes_written;
+
+    UInt64 allocations;
+    UInt64 deallocations;
+
+    UInt64 protection_changes;
+
+    // accesses refused because the page was unmapped or lacked the permission, only counted
+    // when enforcing
+    UInt64 protection_faults;
+};
+
+/**
+ *  A Task whose memory is a region mapped in the current process.
+ *
+ *  Hooks, payloads, the patcher and the disassembler only talk to a task through Read(),
+ *  Write(), VmAllocate() and VmProtect(), so running them against a BufferTask exercises the
+ *  whole install and uninstall path without a live Darwin task. Function bytes, for example
+ *  ones lifted out of a kernelcache, are placed with LoadCode() and the resulting patches can be
+ *  inspected directly through GetBuffer().
+ *
+ *  Task addresses are the addresses of the region in this process. VmAllocate() hands out pages of
+ *  the region and protections are only tracked, never applied, so the bytes can always be
+ *  inspected. VmRemap() maps other pages of the region onto the same bytes, each with a protection
+ *  of its own, and accesses through them land on the original pages. With SetEnforceProtection()
+ *  reads of unmapped pages or pages without VM_PROT_READ, and writes to pages without
+ *  VM_PROT_WRITE, fail the way mach_vm_read() and mach_vm_write() do. SetLatency() makes every call
+ *  spin for a while to model the cost of a Mach VM call in benchmarks. EnablePageCache() works as
+ *  it does on a live task, Read() is served from the cache and TryRead() always goes to the region.
+ */
+class BufferTask : public xnu::Task {
+public:
+    explicit BufferTask(Size size);
+
+    ~BufferTask();
+
+    bool IsValid() {
+        return buffer != nullptr;
+    }
+
+    UInt8* GetBuffer() {
+        return buffer;
+    }
+
+    Size GetSize() {
+        return size;
+    }
+
+    bool Contains(xnu::mach::VmAddress address, Size length);
+
+    xnu::mach::VmProtection GetProtection(xnu::mach::VmAddress address);
+
+    void SetLatency(UInt64 nanoseconds) {
+        latency = nanoseconds;
+    }
+
+    UInt64 GetLatency() {
+        return latency;
+    }
+
+    void SetEnforceProtection(bool enforce) {
+        enforce_protection = enforce;
+    }
+
+    BufferTaskStats& GetStats() {
+        return stats;
+    }
+
+    void ResetStats();
+
+    // copies code into freshly allocated read/execute pages and returns where it landed
+    xnu::mach::VmAddress LoadCode(const UInt8* code, Size length);
+
+    virtual xnu::mach::VmAddress GetBase();
+
+    virtual Offset GetSlide();
+
+    virtual char* GetTaskName();
+
+    virtual UInt64 Call(char* symbolname, UInt64* arguments, Size argCount);
+    virtual UInt64 Call(xnu::mach::VmAddress func, UInt64* arguments, Size argCount);
+
+    virtual xnu::mach::VmAddress VmAllocate(Size size);
+    virtual xnu::mach::VmAddress VmAllocate(Size size, UInt32 flags, xnu::mach::VmProtection prot);
+
+    virtual void VmDeallocate(xnu::mach::VmAddress address, Size size);
+
+    virtual bool VmProtect(xnu::mach::VmAddress address, Size size, xnu::mach::VmProtection prot);
+
+    virtual void* VmRemap(xnu::mach::VmAddress address, Size size);
+
+    virtual UInt64 VirtualToPhysical(xnu::mach::VmAddress address);
+
+    virtual bool Read(xnu::mach::VmAddress address, void* data, Size size);
+    virtual bool ReadUnsafe(xnu::mach::VmAddress address, void* data, Size size);
+
+    virtual bool TryRead(xnu::mach::VmAddress address, void* data, Size size);
+
+    virtual UInt8 Read8(xnu::mach::VmAddress address);
+    virtual UInt16 Read16(xnu::mach::VmAddress address);
+    virtual UInt32 Read32(xnu::mach::VmAddress address);
+    virtual UInt64 Read64(xnu::mach::VmAddress address);
+
+    virtual bool Write(xnu::mach::VmAddress address, void* data, Size size);
+    virtual bool WriteUnsafe(xnu::mach::VmAddress address, void* data, Size size);
+
+    virtual void Write8(xnu::mach::VmAddress address, UInt8 value);
+    virtual void Write16(xnu::mach::VmAddress address, UInt16 value);
+    virtual void Write32(xnu::mach::VmAddress address, UInt32 value);
+    virtual void Write64(xnu::mach::VmAddress address, UInt64 value);
+
+    virtual char* ReadString(xnu::mach::VmAddress address);
+
+    virtual Symbol* GetSymbolByName(char* symname);
+    virtual Symbol* GetSymbolByAddress(xnu::mach::VmAddress address);
+
+    virtual xnu::mach::VmAddress GetSymbolAddressByName(char* symbolname);
+
+    virtual void PrintLoadedImages();
+
+private:
+    UInt8* buffer;
+    Size size;
+
+    Size page_size;
+    Size page_count;
+
+    // per page, kBufferTaskPageMapped and the VM_PROT_* bits the page was given
+    UInt8* pages;
+
+    // per page, 1 + the page it was remapped from, 0 for pages of their own
+    Size* aliases;
+
+    UInt64 latency;
+
+    bool enforce_protection;
+
+    BufferTaskStats stats;
+
+    void Delay();
+
+    Size FindFreePages(Size count);
+
+    // where the byte at address lives, following aliases
+    UInt8* Resolve(xnu::mach::VmAddress address);
+
+    // page by page, so that accesses through an alias land on the page it maps
+    void Copy(xnu::mach::VmAddress address, void* data, Size size, bool write);
+
+    // a read straight from the region, Read() goes through the page cache first when enabled
+    bool ReadBuffer(xnu::mach::VmAddress address, void* data, Size size);
+
+    bool HasProtection(xnu::mach::VmAddress address, Size length, xnu::mach::VmProtection prot);
+};
+
+} // namespace xnu
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "code_directory_verifier.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+
+#ifdef __APPLE__
+#include <CommonCrypto/CommonDigest.h>
+#endif
+
+#include "sha256.h"
+
+// code signatures are always stored big endian
+#define swap32(x) __builtin_bswap32(x)
+
+namespace darwin {
+
+CodeDirectoryVerifier::CodeDirectoryVerifier(UInt8* code, Size code_size,
+                                             code_directory_t directory, Size directory_size)
+    : code(code), code_size(code_size), directory(directory), directory_size(directory_size),
+      hashes(nullptr), code_slots(0), code_limit(0), page_size(0), hash_type(0), hash_size(0),
+      digest_size(0), digests(nullptr), dirty_slot_count(0), cd_hash() {}
+
+CodeDirectoryVerifier::~CodeDirectoryVerifier() {
+    if (digests)
+        delete[] digests;
+}
+
+Size CodeDirectoryVerifier::GetDigestSize(UInt8 hash_type) {
+    switch (hash_type) {
+    case HASH_TYPE_SHA256:
+    case HASH_TYPE_SHA256_TRUNCATED:
+        return crypto::kSha256DigestSize;
+#ifdef __APPLE__
+    // SHA-1 comes from CommonCrypto, hosts without it can only verify SHA-256 directories
+    case HASH_TYPE_SHA1:
+        return CC_SHA1_DIGEST_LENGTH;
+#endif
+    default:
+        return 0;
+    }
+}
+
+bool CodeDirectoryVerifier::ComputeDigest(UInt8 hash_type, UInt8* data, Size size,
+                                          UInt8* digest) {
+    switch (hash_type) {
+    case HASH_TYPE_SHA256:
+    case HASH_TYPE_SHA256_TRUNCATED:
+        crypto::Sha256(data, size, digest);
+
+        return true;
+#ifdef __APPLE__
+    case HASH_TYPE_SHA1:
+        CC_SHA1(data, static_cast<UInt32>(size), digest);
+
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+bool CodeDirectoryVerifier::Parse() {
+    UInt32 hash_offset;
+
+    Size length;
+
+    if (!code || !directory || directory_size < sizeof(struct code_directory))
+        return false;
+
+    length = swap32(directory->blob.length);
+
+    // everything, including the code directory hash, is bounded by the blob's own length
+    if (length < sizeof(struct code_directory) || length > directory_size)
+        return false;
+
+    directory_size = length;
+
+    hash_offset = swap32(directory->hashOffset);
+
+    code_slots = swap32(directory->nCodeSlots);
+    code_limit = swap32(directory->codeLimit);
+
+    hash_type = directory->hashType;
+    hash_size = directory->hashSize;
+
+    digest_size = GetDigestSize(hash_type);
+
+    if (!digest_size || !hash_size || hash_size > digest_size)
+        return false;
+
+    if (directory->pageSize >= 32 || code_limit > code_size)
+        return false;
+
+    // a page size of zero means the whole image is covered by a single slot
+    page_size = directory->pageSize ? (Size)1 << directory->pageSize : code_limit;
+
+    if (page_size ? code_slots != (code_limit + page_size - 1) / page_size : code_slots != 0)
+        return false;
+
+    if (hash_offset > directory_size || (directory_size - hash_offset) / hash_size < code_slots)
+        return false;
+
+    hashes = reinterpret_cast<UInt8*>(directory) + hash_offset;
+
+    if (digests)
+        delete[] digests;
+
+    digests = new UInt8[code_slots ? code_slots * digest_size : 1];
+
+    dirty_slots.assign((code_slots + 63) / 64, 0);
+    dirty_slot_count = 0;
+
+    return ComputeCodeDirectoryHash();
+}
+
+void CodeDirectoryVerifier::HashSlots(UInt32 first_slot, UInt32 count) {
+    const UInt8* pages[kCodeSlotsPerBatch];
+
+    UInt32 full_pages = 0;
+
+    bool sha256 = hash_type == HASH_TYPE_SHA256 || hash_type == HASH_TYPE_SHA256_TRUNCATED;
+
+    // only the last slot can cover less than a full page
+    if (sha256) {
+        while (full_pages < count && (first_slot + full_pages + 1) * page_size <= code_limit) {
+            pages[full_pages] = code + (first_slot + full_pages) * page_size;
+
+            full_pages++;
+        }
+
+        crypto::Sha256Batch(pages, page_size, full_pages, GetDigest(first_slot));
+    }
+
+    for (UInt32 i = full_pages; i < count; i++) {
+        UInt32 slot = first_slot + i;
+
+        Size offset = slot * page_size;
+        Size size = code_limit - offset < page_size ? code_limit - offset : page_size;
+
+        ComputeDigest(hash_type, code + offset, size, GetDigest(slot));
+    }
+}
+
+void CodeDirectoryVerifier::HashSlotRuns(std::vector<CodeSlotRun>& runs, UInt32 num_threads) {
+    std::atomic<Size> next_run(0);
+
+    std::vector<std::thread> workers;
+
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+
+    if (!num_threads)
+        num_threads = 1;
+
+    auto worker = [&]() {
+        Size run;
+
+        while ((run = next_run.fetch_add(1, std::memory_order_relaxed)) < runs.size())
+            HashSlots(runs[run].first_slot, runs[run].count);
+    };
+
+    for (UInt32 i = 1; i < num_threads && i < runs.size(); i++)
+        workers.emplace_back(worker);
+
+    worker();
+
+    for (std::thread& thread : workers)
+        thread.join();
+}
+
+bool CodeDirectoryVerifier::Verify(UInt32 num_threads) {
+    std::vector<CodeSlotRun> runs;
+
+    if (!digests && !Parse())
+        return false;
+
+    for (UInt32 slot = 0; slot < code_slots; slot += kCodeSlotsPerBatch) {
+        UInt32 count = code_slots - slot < kCodeSlotsPerBatch ? code_slots - slot
+                                                               : kCodeSlotsPerBatch;
+
+        runs.push_back({slot, count});
+    }
+
+    HashSlotRuns(runs, num_threads);
+
+    mismatched_slots.clear();
+
+    for (UInt32 slot = 0; slot < code_slots; slot++) {
+        if (!IsSlotValid(slot))
+            mismatched_slots.push_back(slot);
+    }
+
+    return mismatched_slots.empty();
+}
+
+bool CodeDirectoryVerifier::MarkDirty(Offset offset, Size size) {
+    UInt32 first_slot;
+    UInt32 last_slot;
+
+    if (!digests || !page_size || !size || offset < 0 || (Size)offset >= code_limit)
+        return false;
+
+    // bytes past the code limit are not covered by any slot
+    if (size > code_limit - offset)
+        size = code_limit - offset;
+
+    first_slot = offset / page_size;
+    last_slot = (offset + size - 1) / page_size;
+
+    for (UInt32 slot = first_slot; slot <= last_slot; slot++) {
+        UInt64 bit = 1ULL << (slot % 64);
+
+        if (!(dirty_slots[slot / 64] & bit)) {
+            dirty_slots[slot / 64] |= bit;
+
+            dirty_slot_count++;
+        }
+    }
+
+    return true;
+}
+
+UInt32 CodeDirectoryVerifier::Resign(UInt32 num_threads) {
+    std::vector<CodeSlotRun> runs;
+
+    UInt32 resigned = dirty_slot_count;
+
+    if (!resigned)
+        return 0;
+
+    // neighbouring dirty pages are hashed together so they still go through Sha256Batch()
+    for (UInt32 word = 0; word < dirty_slots.size(); word++) {
+        UInt64 bits = dirty_slots[word];
+
+        while (bits) {
+            UInt32 slot = word * 64 + __builtin_ctzll(bits);
+
+            if (!runs.empty() && runs.back().first_slot + runs.back().count == slot &&
+                runs.back().count < kCodeSlotsPerBatch)
+                runs.back().count++;
+            else
+                runs.push_back({slot, 1});
+
+            bits &= bits - 1;
+        }
+
+        dirty_slots[word] = 0;
+    }
+
+    dirty_slot_count = 0;
+
+    HashSlotRuns(runs, num_threads);
+
+    for (CodeSlotRun& run : runs) {
+        for (UInt32 slot = run.first_slot; slot < run.first_slot + run.count; slot++)
+            memcpy(GetExpectedDigest(slot), GetDigest(slot), hash_size);
+    }
+
+    ComputeCodeDirectoryHash();
+
+    return resigned;
+}
+
+bool CodeDirectoryVerifier::ComputeCodeDirectoryHash() {
+    return ComputeDigest(hash_type, reinterpret_cast<UInt8*>(directory), directory_size, cd_hash);
+}
+
+bool CodeDirectoryVerifier::IsSlotValid(UInt32 slot) {
+    if (slot >= code_slots || !digests)
+        return false;
+
+    return memcmp(GetDigest(slot), GetExpectedDigest(slot), hash_size) == 0;
+}
+
+} // namespace darwin
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+#include <vector>
+
+extern "C" {
+#include <mach-o.h>
+}
+
+namespace darwin {
+
+static constexpr UInt32 kCodeSlotsPerBatch = 64;
+
+// large enough for every digest a code directory can carry
+static constexpr Size kMaxCodeSlotDigestSize = 32;
+
+struct CodeSlotRun {
+    UInt32 first_slot;
+    UInt32 count;
+};
+
+/**
+ *  Verifies the code slots of a code directory against the image it was generated for.
+ *
+ *  Pages are hashed in batches of kCodeSlotsPerBatch on a pool of worker threads, full pages
+ *  of a batch go through Sha256Batch() so that multi-buffer and hardware SHA-256 kick in. All
+ *  digests land in one array allocated by Parse(), nothing is allocated per page, and the
+ *  slots that do not match are reported together once hashing is done.
+ *
+ *  After the image has been patched, MarkDirty() records the touched byte ranges and Resign()
+ *  rehashes only those pages, writes their slots back into the code directory and refreshes
+ *  the code directory hash. The CMS signature is left alone, so this only produces a valid
+ *  signature for ad-hoc signed images.
+ */
+class CodeDirectoryVerifier {
+public:
+    explicit CodeDirectoryVerifier(UInt8* code, Size code_size, code_directory_t directory,
+                                   Size directory_size);
+
+    ~CodeDirectoryVerifier();
+
+    bool Parse();
+
+    bool Verify(UInt32 num_threads = 0);
+
+    UInt32 GetCodeSlotCount() {
+        return code_slots;
+    }
+
+    Size GetPageSize() {
+        return page_size;
+    }
+
+    Size GetCodeLimit() {
+        return code_limit;
+    }
+
+    UInt8 GetHashType() {
+        return hash_type;
+    }
+
+    UInt8 GetHashSize() {
+        return hash_size;
+    }
+
+    UInt8* GetDigest(UInt32 slot) {
+        return slot < code_slots ? &digests[slot * digest_size] : nullptr;
+    }
+
+    UInt8* GetExpectedDigest(UInt32 slot) {
+        return slot < code_slots ? &hashes[slot * hash_size] : nullptr;
+    }
+
+    std::vector<UInt32>& GetMismatchedSlots() {
+        return mismatched_slots;
+    }
+
+    bool IsSlotValid(UInt32 slot);
+
+    bool MarkDirty(Offset offset, Size size);
+
+    UInt32 GetDirtySlotCount() {
+        return dirty_slot_count;
+    }
+
+    UInt32 Resign(UInt32 num_threads = 0);
+
+    UInt8* GetCodeDirectoryHash() {
+        return cd_hash;
+    }
+
+    bool ComputeCodeDirectoryHash();
+
+    static Size GetDigestSize(UInt8 hash_type);
+
+    static bool ComputeDigest(UInt8 hash_type, UInt8* data, Size size, UInt8* digest);
+
+private:
+    UInt8* code;
+    Size code_size;
+
+    code_directory_t directory;
+    Size directory_size;
+
+    UInt8* hashes;
+
+    UInt32 code_slots;
+
+    Size code_limit;
+    Size page_size;
+
+    UInt8 hash_type;
+    UInt8 hash_size;
+
+    Size digest_size;
+
+    UInt8* digests;
+
+    std::vector<UInt32> mismatched_slots;
+
+    // one bit per code slot
+    std::vector<UInt64> dirty_slots;
+
+    UInt32 dirty_slot_count;
+
+    UInt8 cd_hash[kMaxCodeSlotDigestSize];
+
+    void HashSlots(UInt32 first_slot, UInt32 count);
+
+    void HashSlotRuns(std::vector<CodeSlotRun>& runs, UInt32 num_threads);
+};
+
+} // namespace darwin
@@ -20,8 +20,7 @@
 
 #include <sys/stat.h>
 
-#include <CommonCrypto/CommonDigest.h>
-
+#include "code_directory_verifier.h"
 #include "macho_userspace.h"
 
 using namespace darwin;
@@ -33,25 +32,23 @@ CodeSignature* CodeSignature::CodeSignatureWithLinkedit(MachOUserspace* macho,
     return new CodeSignature(macho, cmd);
 }
 
+CodeSignature::~CodeSignature() {
+    if (codeVerifier)
+        delete codeVerifier;
+}
+
 bool CodeSignature::VerifyCodeSlot(UInt8* blob, Size size, bool sha256, char* signature,
                                    Size signature_size) {
-    bool verified = false;
-
-    if (sha256) {
-        unsigned char result[CC_SHA256_DIGEST_LENGTH];
+    UInt8 result[kMaxCodeSlotDigestSize];
 
-        CC_SHA256(blob, static_cast<UInt32>(size), result);
+    UInt8 hash_type = sha256 ? HASH_TYPE_SHA256 : HASH_TYPE_SHA1;
 
-        verified = (memcmp(result, signature, min(CC_SHA256_DIGEST_LENGTH, signature_size)));
-    } else {
-        unsigned char result[CC_SHA1_DIGEST_LENGTH];
+    Size digest_size = CodeDirectoryVerifier::GetDigestSize(hash_type);
 
-        CC_SHA1(blob, static_cast<UInt32>(size), result);
+    if (!CodeDirectoryVerifier::ComputeDigest(hash_type, blob, size, result))
+        return false;
 
-        verified = (memcmp(result, signature, min(CC_SHA1_DIGEST_LENGTH, signature_size)));
-    }
-
-    return verified;
+    return memcmp(result, signature, digest_size < signature_size ? digest_size : signature_size) == 0;
 }
 
 bool CodeSignature::CompareHash(UInt8* hash1, UInt8* hash2, Size hashSize) {
@@ -61,30 +58,22 @@ bool CodeSignature::CompareHash(UInt8* hash1, UInt8* hash2, Size hashSize) {
     return (memcmp(h1, h2, hashSize) == 0);
 }
 
-UInt8* CodeSignature::ComputeHash(bool sha256, UInt8* blob, Size size) {
-    UInt8* result;
-
-    if (sha256) {
-        result = static_cast<UInt8*>(malloc(CC_SHA256_DIGEST_LENGTH));
+void CodeSignature::ComputeHash(bool sha256, UInt8* blob, Size size, UInt8* digest) {
+    UInt8 hash_type = sha256 ? HASH_TYPE_SHA256 : HASH_TYPE_SHA1;
 
-        CC_SHA256(blob, static_cast<UInt32>(size), result);
-    } else {
-        result = static_cast<UInt8*>(malloc(CC_SHA1_DIGEST_LENGTH));
-
-        CC_SHA1(blob, static_cast<UInt32>(size), result);
-    }
-
-    return result;
+    CodeDirectoryVerifier::ComputeDigest(hash_type, blob, size, digest);
 }
 
 bool CodeSignature::ParseCodeSignature() {
-    SuperBlob* superblob;
+    SuperBlob* superblob = reinterpret_cast<SuperBlob*>((*macho)[cmd->dataoff]);
 
     UInt32 blobcount = swap32(superblob->count);
 
     UInt32 offset = cmd->dataoff;
     UInt32 size = cmd->datasize;
 
+    superBlob = superblob;
+
     DARWIN_KIT_LOG("\t%u blobs\n", blobcount);
 
     for (UInt32 blobidx = 0; blobidx < blobcount; blobidx++) {
@@ -128,30 +117,41 @@ bool CodeSignature::ParseCodeSignature() {
                 DARWIN_KIT_LOG("\tUnknown hashing algorithm in pages\n");
             }
 
-            for (int i = 0; i < nCodeSlots; i++) {
-                UInt32 pages = nCodeSlots;
+            codeDirectory = directory;
+
+            if (codeVerifier)
+                delete codeVerifier;
 
-                if (pages)
-                    DARWIN_KIT_LOG("\t\tPage %2u ", i);
+            // every page is hashed up front across all cores, the loop below only reports
+            codeVerifier = new CodeDirectoryVerifier(reinterpret_cast<UInt8*>((*macho)[0]),
+                                                     macho->GetSize(), directory, length);
 
+            if (!codeVerifier->Parse()) {
+                DARWIN_KIT_LOG("\tCode directory is malformed or uses an unsupported hash\n");
+
+                delete codeVerifier;
+
+                codeVerifier = nullptr;
+            } else {
+                codeVerifier->Verify();
+
+                DARWIN_KIT_LOG("\t%zu of %u pages do not match their code slot\n",
+                               codeVerifier->GetMismatchedSlots().size(), nCodeSlots);
+            }
+
+            for (int i = 0; i < nCodeSlots; i++) {
                 UInt8* hash = (UInt8*)(*macho)[begin + hashOffset + i * hashSize];
 
+                DARWIN_KIT_LOG("\t\tPage %2u ", i);
+
                 for (int j = 0; j < hashSize; j++)
                     DARWIN_KIT_LOG("%.2x", hash[j]);
 
-                UInt8* blob = (UInt8*)(*macho)[i * (1 << pageSize)];
-
-                if (i + 1 != nCodeSlots) {
-                    if (VerifyCodeSlot(blob, 1 << pageSize, sha256, (char*)hash, hashSize))
+                if (codeVerifier) {
+                    if (codeVerifier->IsSlotValid(i))
                         DARWIN_KIT_LOG(" OK...");
                     else
                         DARWIN_KIT_LOG(" Invalid!!!");
-                } else {
-
-                    if (VerifyCodeSlot(blob, 1 << pageSize, sha256, (char*)hash, hashSize))
-                        // hash the last page only until the code signature,
-                        // so that that code signature doesn't get included into hash
-                        DARWIN_KIT_LOG(" OK...");
                 }
 
                 DARWIN_KIT_LOG("\n");
@@ -259,12 +259,15 @@ bool CodeSignature::ParseCodeSignature() {
 
                             UInt8* info_buf = new UInt8[info_size];
                             fseek(info, 0, SEEK_SET);
-                            fread(info_buf, 1, size, info);
+                            fread(info_buf, 1, info_size, info);
 
                             fclose(info);
 
-                            UInt8* info_hash = ComputeHash(special_slots[i].sha256, info_buf,
-                                                                 (UInt32)info_size);
+                            UInt8 info_hash[kMaxCodeSlotDigestSize];
+
+                            ComputeHash(special_slots[i].sha256, info_buf, info_size, info_hash);
+
+                            delete[] info_buf;
 
                             if (memcmp(info_hash, special_slots[i].hash,
                                        special_slots[i].hashSize) == 0)
@@ -288,7 +291,7 @@ bool CodeSignature::ParseCodeSignature() {
             break;
         case CSMAGIC_EMBEDDED_ENTITLEMENTS: {
             UInt8* blob_raw;
-            UInt8* blob_hash;
+            UInt8 blob_hash[kMaxCodeSlotDigestSize];
 
             char* entitlements;
 
@@ -298,7 +301,7 @@ bool CodeSignature::ParseCodeSignature() {
                    length - sizeof(struct Blob));
 
             blob_raw = (UInt8*)(*macho)[begin];
-            blob_hash = ComputeHash(special_slots[ENTITLEMENTS].sha256, blob_raw, length);
+            ComputeHash(special_slots[ENTITLEMENTS].sha256, blob_raw, length, blob_hash);
 
             DARWIN_KIT_LOG("\nEntitlements ");
 
@@ -19,12 +19,16 @@
 #include "library.h"
 #include "macho.h"
 #include "offsets.h"
+#include "shared_cache.h"
+#include "shared_cache_extractor.h"
 #include "task.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <vector>
+
 #include <mach/mach.h>
 
 namespace darwin {
@@ -46,6 +50,29 @@ int Dyld::EndsWith(const char* str, const char* suffix) {
     return strncmp(str + lenstr - lensuffix, suffix, lensuffix) == 0;
 }
 
+Dyld::Dyld(SharedCache* cache)
+    : main_image_path(nullptr), kernel(nullptr), task(nullptr), cache(cache),
+      main_image_load_base(0), dyld(0), slide(0), all_image_info_addr(0), all_image_info_size(0),
+      all_image_infos(nullptr), main_image_info(nullptr) {
+    dyld_shared_cache = cache->GetBaseAddress();
+
+    dyld = cache->GetImageLoadedAt("libdyld.dylib", nullptr);
+}
+
+bool Dyld::Read(xnu::mach::VmAddress address, void* data, Size size) {
+    if (cache)
+        return cache->Read(address, data, size);
+
+    return task->Read(address, data, size);
+}
+
+char* Dyld::ReadString(xnu::mach::VmAddress address) {
+    if (cache)
+        return cache->ReadString(address);
+
+    return task->ReadString(address);
+}
+
 void Dyld::IterateAllImages() {
     bool found_main_image = false;
 
@@ -66,20 +93,22 @@ void Dyld::IterateAllImages() {
 
     char* task_name = task->GetName();
 
+    // the whole array in one read instead of one per image
+    std::vector<struct dyld_image_info> image_infos(all_image_infos->infoArrayCount);
+
+    task->Read((xnu::mach::VmAddress)all_images.infoArray, image_infos.data(),
+               image_infos.size() * sizeof(struct dyld_image_info));
+
     for (UInt32 i = 0; i < all_image_infos->infoArrayCount; i++) {
         struct dyld_image_info* image_info =
             (struct dyld_image_info*)malloc(sizeof(struct dyld_image_info));
 
-        xnu::mach::VmAddress image_info_addr;
-
         xnu::mach::VmAddress image_load_addr;
         xnu::mach::VmAddress image_file_path;
 
         char* image_file;
 
-        image_info_addr = (xnu::mach::VmAddress)(all_images.infoArray + i);
-
-        task->Read(image_info_addr, image_info, sizeof(*image_info));
+        memcpy(image_info, &image_infos[i], sizeof(*image_info));
 
         image_load_addr = (xnu::mach::VmAddress)image_info->imageLoadAddress;
         image_file_path = (xnu::mach::VmAddress)image_info->imageFilePath;
@@ -154,6 +183,17 @@ xnu::mach::VmAddress Dyld::GetImageLoadedAt(char* image_name, char** image_path)
 
     dyld::shared_cache::AllImageInfos all_images;
 
+    if (cache) {
+        char* image_file;
+
+        where = cache->GetImageLoadedAt(image_name, &image_file);
+
+        if (image_path)
+            *image_path = image_file ? strdup(image_file) : nullptr;
+
+        return where;
+    }
+
     GetImageInfos();
 
     assert(all_image_info_addr && all_image_info_size);
@@ -167,20 +207,19 @@ xnu::mach::VmAddress Dyld::GetImageLoadedAt(char* image_name, char** image_path)
 
     memcpy(all_image_infos, &all_images, sizeof(struct dyld_all_image_infos));
 
-    for (UInt32 i = 0; i < all_image_infos->infoArrayCount; i++) {
-        dyld::shared_cache::ImageInfo image_info;
+    std::vector<dyld::shared_cache::ImageInfo> image_infos(all_image_infos->infoArrayCount);
 
-        xnu::mach::VmAddress image_info_addr;
+    task->Read((xnu::mach::VmAddress)all_image_infos->infoArray, image_infos.data(),
+               image_infos.size() * sizeof(dyld::shared_cache::ImageInfo));
+
+    for (UInt32 i = 0; i < all_image_infos->infoArrayCount; i++) {
+        dyld::shared_cache::ImageInfo& image_info = image_infos[i];
 
         xnu::mach::VmAddress image_load_addr;
         xnu::mach::VmAddress image_file_path;
 
         char* image_file;
 
-        image_info_addr = (xnu::mach::VmAddress)(all_image_infos->infoArray + i);
-
-        task->Read(image_info_addr, &image_info, sizeof(image_info));
-
         image_load_addr = (xnu::mach::VmAddress)image_info.imageLoadAddress;
         image_file_path = (xnu::mach::VmAddress)image_info.imageFilePath;
 
@@ -223,7 +262,7 @@ dyld::shared_cache::Header* Dyld::CacheGetHeader() {
     cache_header =
         reinterpret_cast<struct dyld_cache_header*>(malloc(sizeof(struct dyld_cache_header)));
 
-    task->Read(shared_cache_rx_base, cache_header, sizeof(struct dyld_cache_header));
+    Read(shared_cache_rx_base, cache_header, sizeof(struct dyld_cache_header));
 
     return cache_header;
 }
@@ -234,7 +273,7 @@ dyld::shared_cache::MappingInfo* Dyld::CacheGetMappings(struct dyld_cache_header
     mappings = reinterpret_cast<struct dyld_cache_mapping_info*>(
         malloc(sizeof(struct dyld_cache_mapping_info) * cache_header->mappingCount));
 
-    task->Read(dyld_shared_cache + cache_header->mappingOffset, mappings,
+    Read(dyld_shared_cache + cache_header->mappingOffset, mappings,
                sizeof(struct dyld_cache_mapping_info) * cache_header->mappingCount);
 
     return mappings;
@@ -246,7 +285,7 @@ dyld::shared_cache::MappingInfo* Dyld::CacheGetMapping(struct dyld_cache_header*
         struct dyld_cache_mapping_info* mapping =
             (struct dyld_cache_mapping_info*)malloc(sizeof(struct dyld_cache_mapping_info));
 
-        task->Read(dyld_shared_cache + cache_header->mappingOffset +
+        Read(dyld_shared_cache + cache_header->mappingOffset +
                        sizeof(struct dyld_cache_mapping_info) * i,
                    mapping, sizeof(struct dyld_cache_mapping_info));
 
@@ -357,7 +396,7 @@ xnu::mach::VmAddress Dyld::GetImageSlide(xnu::mach::VmAddress address) {
 
     hdr = reinterpret_cast<struct mach_header_64*>(malloc(sizeof(struct mach_header_64)));
 
-    ok = task->Read(address, hdr, sizeof(struct mach_header_64));
+    ok = Read(address, hdr, sizeof(struct mach_header_64));
 
     dylibInSharedCache = hdr->flags & MH_DYLIB_IN_CACHE;
 
@@ -366,7 +405,7 @@ xnu::mach::VmAddress Dyld::GetImageSlide(xnu::mach::VmAddress address) {
 
     cmds = reinterpret_cast<UInt8*>(malloc(sizeofcmds));
 
-    ok = task->Read(address + sizeof(struct mach_header_64), cmds, sizeofcmds);
+    ok = Read(address + sizeof(struct mach_header_64), cmds, sizeofcmds);
 
     cmd_offset = 0;
 
@@ -423,14 +462,14 @@ Size Dyld::GetAdjustedStrtabSize(struct symtab_command* symtab_command,
     symtab = linkedit + (symtab_command->symoff - linkedit_fileoff);
     strtab = linkedit + (symtab_command->stroff - linkedit_fileoff);
 
-    task->Read(symtab, syms, symsize);
+    Read(symtab, syms, symsize);
 
     new_strsize = 0;
 
     for (int i = 0; i < symtab_command->nsyms; i++) {
         struct nlist_64* nl = &syms[i];
 
-        char* sym = task->ReadString(strtab + nl->n_strx);
+        char* sym = ReadString(strtab + nl->n_strx);
 
         new_strsize += strlen(sym) + 1;
 
@@ -479,7 +518,7 @@ Size Dyld::GetAdjustedLinkeditSize(xnu::mach::VmAddress address) {
 
     hdr = reinterpret_cast<struct mach_header_64*>(malloc(sizeof(struct mach_header_64)));
 
-    bool ok = task->Read(address, hdr, sizeof(struct mach_header_64));
+    bool ok = Read(address, hdr, sizeof(struct mach_header_64));
 
     assert(ok);
 
@@ -488,7 +527,7 @@ Size Dyld::GetAdjustedLinkeditSize(xnu::mach::VmAddress address) {
 
     cmds = reinterpret_cast<UInt8*>(malloc(sizeofcmds));
 
-    ok = task->Read(address + sizeof(struct mach_header_64), cmds, sizeofcmds);
+    ok = Read(address + sizeof(struct mach_header_64), cmds, sizeofcmds);
 
     align = sizeof(struct mach_header_64) + hdr->sizeofcmds;
 
@@ -536,7 +575,7 @@ Size Dyld::GetAdjustedLinkeditSize(xnu::mach::VmAddress address) {
         } else if (load_cmd->cmd == LC_SYMTAB) {
             struct symtab_command* symtab_command = reinterpret_cast<struct symtab_command*>(q);
 
-            task->Read(address + sizeof(struct mach_header_64), cmds, sizeofcmds);
+            Read(address + sizeof(struct mach_header_64), cmds, sizeofcmds);
 
             UInt32 new_strsize = GetAdjustedStrtabSize(
                 symtab_command, linkedit_vmaddr + aslr_slide, linkedit_old_off);
@@ -693,7 +732,7 @@ void Dyld::RebuildSymtabStrtab(struct symtab_command* symtab_command, xnu::mach:
     for (int i = 0; i < symtab_command->nsyms; i++) {
         struct nlist_64* nl = &symtab[i];
 
-        char* sym = task->ReadString(linkedit + (stroff - linkedit_fileoff) + nl->n_strx);
+        char* sym = ReadString(linkedit + (stroff - linkedit_fileoff) + nl->n_strx);
 
         memcpy(strtab + idx, sym, strlen(sym));
 
@@ -733,7 +772,7 @@ Size Dyld::GetImageSize(xnu::mach::VmAddress address) {
 
     hdr = reinterpret_cast<struct mach_header_64*>(malloc(sizeof(struct mach_header_64)));
 
-    ok = task->Read(address, hdr, sizeof(struct mach_header_64));
+    ok = Read(address, hdr, sizeof(struct mach_header_64));
 
     assert(ok);
 
@@ -744,7 +783,7 @@ Size Dyld::GetImageSize(xnu::mach::VmAddress address) {
 
     cmds = reinterpret_cast<UInt8*>(malloc(sizeofcmds));
 
-    ok = task->Read(address + sizeof(struct mach_header_64), cmds, sizeofcmds);
+    ok = Read(address + sizeof(struct mach_header_64), cmds, sizeofcmds);
 
     assert(ok);
 
@@ -766,8 +805,8 @@ Size Dyld::GetImageSize(xnu::mach::VmAddress address) {
             UInt64 fileoff = segment->fileoff;
             UInt64 filesize = segment->filesize;
 
-            if (task->GetPid() == getpid()) {
-                filesz = max(filesz, fileoff + filesize);
+            if (task && task->GetPid() == getpid()) {
+                filesz = filesz > fileoff + filesize ? filesz : fileoff + filesize;
             } else {
                 if (dylibInSharedCache && strcmp(segment->segname, "__LINKEDIT") == 0) {
                     filesize = GetAdjustedLinkeditSize(address);
@@ -783,7 +822,7 @@ Size Dyld::GetImageSize(xnu::mach::VmAddress address) {
     free(hdr);
     free(cmds);
 
-    if (task->GetPid() == getpid()) {
+    if (task && task->GetPid() == getpid()) {
         return filesz;
     }
 
@@ -854,7 +893,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
 
         // printf("Dumping image at 0x%llx with size 0x%zx\n", (UInt64) image, size);
 
-        task->Read(address, image_dump, sizeof(struct mach_header_64));
+        Read(address, image_dump, sizeof(struct mach_header_64));
 
         hdr = reinterpret_cast<struct mach_header_64*>(image_dump);
 
@@ -865,7 +904,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
         if (!dylibInSharedCache)
             aslr_slide = 0;
 
-        task->Read(address + sizeof(struct mach_header_64),
+        Read(address + sizeof(struct mach_header_64),
                          image_dump + sizeof(struct mach_header_64), hdr->sizeofcmds);
 
         align = sizeof(struct mach_header_64) + hdr->sizeofcmds;
@@ -915,7 +954,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
                            vmaddr + aslr_slide, filesize, (UInt64)(image_dump + current_offset));
 
                     if (dylibInSharedCache &&
-                        !task->Read(vmaddr + aslr_slide, image_dump + current_offset,
+                        !Read(vmaddr + aslr_slide, image_dump + current_offset,
                                           filesize)) {
                         printf("Failed to dump segment %s\n", segment->segname);
 
@@ -923,7 +962,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     }
 
                     if (!dylibInSharedCache &&
-                        !task->Read(address + vmaddr + aslr_slide,
+                        !Read(address + vmaddr + aslr_slide,
                                           image_dump + current_offset, filesize)) {
                         printf("Failed to dump segment %s\n", segment->segname);
 
@@ -967,7 +1006,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt64 strtab =
                         (UInt64)(image_dump + linkedit_new_off + linkedit_off + symsize);
 
-                    task->Read(linkedit_vmaddr + aslr_slide +
+                    Read(linkedit_vmaddr + aslr_slide +
                                          (symtab_command->symoff - linkedit_old_off),
                                      image_dump + linkedit_new_off + linkedit_off, symsize);
 
@@ -987,14 +1026,14 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt64 symoff = symtab_command->symoff;
                     UInt64 stroff = symtab_command->stroff;
 
-                    task->Read(address + aslr_slide + symoff, image_dump + current_offset,
+                    Read(address + aslr_slide + symoff, image_dump + current_offset,
                                      symsize);
 
                     symtab_command->symoff = current_offset;
 
                     current_offset += symsize;
 
-                    task->Read(address + aslr_slide + stroff, image_dump + current_offset,
+                    Read(address + aslr_slide + stroff, image_dump + current_offset,
                                      strsize);
 
                     symtab_command->stroff = current_offset;
@@ -1027,42 +1066,42 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt32 locreloff = dysymtab_command->locreloff - linkedit_old_off;
                     UInt32 locrelsize = dysymtab_command->nlocrel * sizeof(struct relocation_info);
 
-                    task->Read(linkedit_vmaddr + aslr_slide + tocoff,
+                    Read(linkedit_vmaddr + aslr_slide + tocoff,
                                      image_dump + linkedit_new_off + linkedit_off, tocsize);
 
                     dysymtab_command->tocoff = linkedit_new_off + linkedit_off;
 
                     linkedit_off += tocsize;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + modtaboff,
+                    Read(linkedit_vmaddr + aslr_slide + modtaboff,
                                      image_dump + linkedit_new_off + linkedit_off, modtabsize);
 
                     dysymtab_command->modtaboff = linkedit_new_off + linkedit_off;
 
                     linkedit_off += modtabsize;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + extrefsymoff,
+                    Read(linkedit_vmaddr + aslr_slide + extrefsymoff,
                                      image_dump + linkedit_new_off + linkedit_off, extrefsize);
 
                     dysymtab_command->extrefsymoff = linkedit_new_off + linkedit_off;
 
                     linkedit_off += extrefsize;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + indirectsymoff,
+                    Read(linkedit_vmaddr + aslr_slide + indirectsymoff,
                                      image_dump + linkedit_new_off + linkedit_off, indirectsize);
 
                     dysymtab_command->indirectsymoff = linkedit_new_off + linkedit_off;
 
                     linkedit_off += indirectsize;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + extreloff,
+                    Read(linkedit_vmaddr + aslr_slide + extreloff,
                                      image_dump + linkedit_new_off + linkedit_off, extrelsize);
 
                     dysymtab_command->extreloff = linkedit_new_off + linkedit_off;
 
                     linkedit_off += extrelsize;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + locreloff,
+                    Read(linkedit_vmaddr + aslr_slide + locreloff,
                                      image_dump + linkedit_new_off + linkedit_off, locrelsize);
 
                     dysymtab_command->locreloff = linkedit_new_off + linkedit_off;
@@ -1089,42 +1128,42 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt32 locreloff = dysymtab_command->locreloff;
                     UInt32 locrelsize = dysymtab_command->nlocrel * sizeof(struct relocation_info);
 
-                    task->Read(address + aslr_slide + tocoff, image_dump + current_offset,
+                    Read(address + aslr_slide + tocoff, image_dump + current_offset,
                                      tocsize);
 
                     dysymtab_command->tocoff = current_offset;
 
                     current_offset += tocsize;
 
-                    task->Read(address + aslr_slide + modtaboff, image_dump + current_offset,
+                    Read(address + aslr_slide + modtaboff, image_dump + current_offset,
                                      modtabsize);
 
                     dysymtab_command->modtaboff = current_offset;
 
                     current_offset += modtabsize;
 
-                    task->Read(address + aslr_slide + extrefsymoff,
+                    Read(address + aslr_slide + extrefsymoff,
                                      image_dump + current_offset, extrefsize);
 
                     dysymtab_command->extrefsymoff = current_offset;
 
                     current_offset += extrefsize;
 
-                    task->Read(address + aslr_slide + indirectsymoff,
+                    Read(address + aslr_slide + indirectsymoff,
                                      image_dump + current_offset, indirectsize);
 
                     dysymtab_command->indirectsymoff = current_offset;
 
                     current_offset += indirectsize;
 
-                    task->Read(address + aslr_slide + extreloff, image_dump + current_offset,
+                    Read(address + aslr_slide + extreloff, image_dump + current_offset,
                                      extrelsize);
 
                     dysymtab_command->extreloff = current_offset;
 
                     current_offset += extrelsize;
 
-                    task->Read(address + aslr_slide + locreloff, image_dump + current_offset,
+                    Read(address + aslr_slide + locreloff, image_dump + current_offset,
                                      locrelsize);
 
                     dysymtab_command->locreloff = current_offset;
@@ -1152,35 +1191,35 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt32 export_off = dyld_info_command->export_off - linkedit_old_off;
                     UInt32 export_size = dyld_info_command->export_size;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + rebase_off,
+                    Read(linkedit_vmaddr + aslr_slide + rebase_off,
                                      image_dump + linkedit_new_off + linkedit_off, rebase_size);
 
                     dyld_info_command->rebase_off = linkedit_new_off + linkedit_off;
 
                     linkedit_off += rebase_size;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + bind_off,
+                    Read(linkedit_vmaddr + aslr_slide + bind_off,
                                      image_dump + linkedit_new_off + linkedit_off, bind_size);
 
                     dyld_info_command->bind_off = linkedit_new_off + linkedit_off;
 
                     linkedit_off += bind_size;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + weak_bind_off,
+                    Read(linkedit_vmaddr + aslr_slide + weak_bind_off,
                                      image_dump + linkedit_new_off + linkedit_off, weak_bind_size);
 
                     dyld_info_command->weak_bind_off = linkedit_new_off + linkedit_off;
 
                     linkedit_off += weak_bind_size;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + lazy_bind_off,
+                    Read(linkedit_vmaddr + aslr_slide + lazy_bind_off,
                                      image_dump + linkedit_new_off + linkedit_off, lazy_bind_size);
 
                     dyld_info_command->lazy_bind_off = linkedit_new_off + linkedit_off;
 
                     linkedit_off += lazy_bind_size;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + export_off,
+                    Read(linkedit_vmaddr + aslr_slide + export_off,
                                      image_dump + linkedit_new_off + linkedit_off, export_size);
 
                     dyld_info_command->export_off = linkedit_new_off + linkedit_off;
@@ -1202,35 +1241,35 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt32 export_off = dyld_info_command->export_off - linkedit_old_off;
                     UInt32 export_size = dyld_info_command->export_size;
 
-                    task->Read(address + aslr_slide + rebase_off, image_dump + current_offset,
+                    Read(address + aslr_slide + rebase_off, image_dump + current_offset,
                                      rebase_size);
 
                     dyld_info_command->rebase_off = current_offset;
 
                     current_offset += rebase_size;
 
-                    task->Read(address + aslr_slide + bind_off, image_dump + current_offset,
+                    Read(address + aslr_slide + bind_off, image_dump + current_offset,
                                      bind_size);
 
                     dyld_info_command->bind_off = current_offset;
 
                     current_offset += bind_size;
 
-                    task->Read(address + aslr_slide + weak_bind_off,
+                    Read(address + aslr_slide + weak_bind_off,
                                      image_dump + current_offset, weak_bind_size);
 
                     dyld_info_command->weak_bind_off = current_offset;
 
                     current_offset += weak_bind_size;
 
-                    task->Read(address + aslr_slide + lazy_bind_off,
+                    Read(address + aslr_slide + lazy_bind_off,
                                      image_dump + current_offset, lazy_bind_size);
 
                     dyld_info_command->lazy_bind_off = current_offset;
 
                     current_offset += lazy_bind_size;
 
-                    task->Read(address + aslr_slide + export_off, image_dump + current_offset,
+                    Read(address + aslr_slide + export_off, image_dump + current_offset,
                                      export_size);
 
                     dyld_info_command->export_off = current_offset;
@@ -1246,7 +1285,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt32 dataoff = linkedit_data_command->dataoff - linkedit_old_off;
                     UInt32 datasize = linkedit_data_command->datasize;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + dataoff,
+                    Read(linkedit_vmaddr + aslr_slide + dataoff,
                                      image_dump + linkedit_new_off + linkedit_off, datasize);
 
                     linkedit_data_command->dataoff = linkedit_new_off + linkedit_off;
@@ -1256,7 +1295,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt32 dataoff = linkedit_data_command->dataoff;
                     UInt32 datasize = linkedit_data_command->datasize;
 
-                    task->Read(address + aslr_slide + dataoff, image_dump + current_offset,
+                    Read(address + aslr_slide + dataoff, image_dump + current_offset,
                                      datasize);
 
                     linkedit_data_command->dataoff = current_offset;
@@ -1272,7 +1311,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt32 dataoff = linkedit_data_command->dataoff - linkedit_old_off;
                     UInt32 datasize = linkedit_data_command->datasize;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + dataoff,
+                    Read(linkedit_vmaddr + aslr_slide + dataoff,
                                      image_dump + linkedit_new_off + linkedit_off, datasize);
 
                     linkedit_data_command->dataoff = linkedit_new_off + linkedit_off;
@@ -1282,7 +1321,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt32 dataoff = linkedit_data_command->dataoff;
                     UInt32 datasize = linkedit_data_command->datasize;
 
-                    task->Read(address + aslr_slide + dataoff, image_dump + current_offset,
+                    Read(address + aslr_slide + dataoff, image_dump + current_offset,
                                      datasize);
 
                     linkedit_data_command->dataoff = current_offset;
@@ -1298,7 +1337,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt32 dataoff = linkedit_data_command->dataoff - linkedit_old_off;
                     UInt32 datasize = linkedit_data_command->datasize;
 
-                    task->Read(linkedit_vmaddr + aslr_slide + dataoff,
+                    Read(linkedit_vmaddr + aslr_slide + dataoff,
                                      image_dump + linkedit_new_off + linkedit_off, datasize);
 
                     linkedit_data_command->dataoff = linkedit_new_off + linkedit_off;
@@ -1308,7 +1347,7 @@ MachO* Dyld::CacheDumpImage(char* image) {
                     UInt32 dataoff = linkedit_data_command->dataoff;
                     UInt32 datasize = linkedit_data_command->datasize;
 
-                    task->Read(address + aslr_slide + dataoff, image_dump + current_offset,
+                    Read(address + aslr_slide + dataoff, image_dump + current_offset,
                                      datasize);
 
                     linkedit_data_command->dataoff = current_offset;
@@ -1377,5 +1416,23 @@ MachO* Dyld::CacheDumpImageToFile(char* image, char* path) {
     return macho;
 }
 
+UInt32 Dyld::CacheDumpAllImagesToDirectory(const char* directory) {
+    UInt32 extracted;
+
+    if (!cache) {
+        DARWIN_KIT_LOG("MacRK::bulk extraction requires a mapped shared cache!\n");
+
+        return 0;
+    }
+
+    SharedCacheExtractor extractor(cache);
+
+    extracted = extractor.ExtractAllImages(directory);
+
+    printf("Extracted %u of %u images to %s\n", extracted, cache->GetImageCount(), directory);
+
+    return extracted;
+}
+
+}
 }
-}
\ No newline at end of file
@@ -29,6 +29,8 @@ extern "C" {
 
 #include <types.h>
 
+#include "shared_cache.h"
+
 class MachO;
 class Segment;
 class Section;
@@ -44,20 +46,15 @@ namespace darwin {
 namespace dyld {
 class Library;
 
-namespace shared_cache {
-using Header = struct dyld_cache_header;
-using MappingInfo = struct dyld_cache_mapping_info;
-using AllImageInfos = struct dyld_all_image_infos;
-using ImageInfo = struct dyld_image_info;
-}; // namespace shared_cache
-
 class Dyld {
 public:
     explicit Dyld(xnu::Kernel* kernel, xnu::Task* task)
-                : kernel(kernel), task(task) {
+                : kernel(kernel), task(task), cache(nullptr) {
         IterateAllImages();
     }
 
+    explicit Dyld(SharedCache* cache);
+
     ~Dyld() = default;
 
     char* GetMainImagePath() {
@@ -68,6 +65,10 @@ public:
         return task;
     }
 
+    SharedCache* GetSharedCache() {
+        return cache;
+    }
+
     xnu::mach::VmAddress GetMainImageLoadBase() {
         return main_image_load_base;
     }
@@ -94,6 +95,10 @@ public:
 
     int EndsWith(const char* str, const char* suffix);
 
+    bool Read(xnu::mach::VmAddress address, void* data, Size size);
+
+    char* ReadString(xnu::mach::VmAddress address);
+
     void GetImageInfos();
 
     void IterateAllImages();
@@ -129,6 +134,8 @@ public:
     MachO* CacheDumpImage(char* image);
     MachO* CacheDumpImageToFile(char* image, char* path);
 
+    UInt32 CacheDumpAllImagesToDirectory(const char* directory);
+
     Library* InjectLibrary(const char* path);
 
 private:
@@ -138,6 +145,8 @@ private:
 
     xnu::Task* task;
 
+    SharedCache* cache;
+
     std::vector<Library*> libraries;
 
     xnu::mach::VmAddress main_image_load_base;
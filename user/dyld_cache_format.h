@@ -24,11 +24,21 @@
 #ifndef __DYLD_CACHE_FORMAT__
 #define __DYLD_CACHE_FORMAT__
 
+#ifdef __APPLE__
 #include <mach/vm_prot.h>
 #include <mach/vm_types.h>
+#include <uuid/uuid.h>
+#endif
 #include <stdint.h>
 #include <sys/types.h>
-#include <uuid/uuid.h>
+#ifndef __APPLE__
+// lets caches be read offline on hosts without the Mach headers
+typedef uint64_t mach_vm_address_t;
+typedef uint64_t mach_vm_size_t;
+typedef uint64_t mach_vm_offset_t;
+typedef int vm_prot_t;
+typedef unsigned char uuid_t[16];
+#endif
 
 struct shared_file_mapping_np {
     mach_vm_address_t address;
@@ -137,6 +147,18 @@ struct dyld_cache_image_info {
     uint32_t pad;
 };
 
+// Used in caches built before the subCache entries carried a file suffix
+struct dyld_subcache_entry_v1 {
+    uint8_t uuid[16];        // The UUID of the subCache file
+    uint64_t cacheVMOffset;  // The offset of this subcache from the main cache base address
+};
+
+struct dyld_subcache_entry {
+    uint8_t uuid[16];        // The UUID of the subCache file
+    uint64_t cacheVMOffset;  // The offset of this subcache from the main cache base address
+    char fileSuffix[32];     // The file name suffix of the subCache file e.g. ".25.data", ".03.development"
+};
+
 struct dyld_cache_image_info_extra {
     uint64_t exportsTrieAddr; // address of trie in unslid cache
     uint64_t weakBindingsAddr;
@@ -370,6 +392,12 @@ struct dyld_cache_local_symbols_entry {
     uint32_t nlistCount;      // number of local symbols for this dylib
 };
 
+struct dyld_cache_local_symbols_entry_64 {
+    uint64_t dylibOffset;     // offset in cache buffer of start of dylib
+    uint32_t nlistStartIndex; // start index of locals for this dylib
+    uint32_t nlistCount;      // number of local symbols for this dylib
+};
+
 struct dyld_cache_image_patches {
     uint32_t patchExportsStartIndex;
     uint32_t patchExportsCount;
@@ -215,25 +215,15 @@ struct RawBinary : public binary::BinaryFormat {
         template <LanguageType LangType>
             requires ManglableLang<LangType>
         char* GetDemangledName() {
-            if constexpr (LangType == LANG_TYPE_SWIFT) {
-                char* _swift_demangle = swift_demangle(GetName());
+            char* demangled = demangle(GetName());
 
-                if (_swift_demangle)
-                    return _swift_demangle;
-            }
+            bool cxx = strncmp(GetName(), "__Z", 3) == 0 || strncmp(GetName(), "_Z", 2) == 0;
 
-            if constexpr (LangType == LANG_TYPE_CXX) {
-                char* _cxx_demangle = cxx_demangle(GetName());
+            // owned by the demangle cache, which picks the demangler from the name's prefix
+            if (!demangled || cxx != (LangType == LANG_TYPE_CXX))
+                return const_cast<char*>("");
 
-                if (_cxx_demangle)
-                    return _cxx_demangle;
-            }
-
-            char* empty = new char[1];
-
-            *empty = '\0';
-
-            return empty;
+            return demangled;
         }
 
         xnu::mach::VmAddress GetAddress() const {
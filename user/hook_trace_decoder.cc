@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hook_trace_decoder.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace darwin {
+
+static bool DecodeVarint(const UInt8* data, Size size, Size* offset, UInt64* value) {
+    UInt64 result = 0;
+
+    for (UInt32 shift = 0; shift < 64; shift += 7) {
+        UInt8 byte;
+
+        if (*offset >= size)
+            return false;
+
+        byte = data[(*offset)++];
+
+        // the tenth byte only has room for the top bit
+        if (shift == 63 && byte > 1)
+            return false;
+
+        result |= (UInt64)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80)) {
+            *value = result;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+HookTraceDecoder::HookTraceDecoder() : cpu_count(0), dropped(0), decoded_size(0) {}
+
+bool HookTraceDecoder::Decode(const UInt8* data, Size size) {
+    HookTraceFileHeader header;
+
+    UInt64 timestamp;
+
+    Size offset;
+
+    records.clear();
+
+    cpu_count = 0;
+    dropped = 0;
+    decoded_size = 0;
+
+    if (!data || size < sizeof(HookTraceFileHeader))
+        return false;
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != kHookTraceMagic || header.version != kHookTraceVersion ||
+        !header.cpu_count || header.cpu_count > kHookTraceMaxCpus)
+        return false;
+
+    cpu_count = header.cpu_count;
+
+    timestamp = header.base_timestamp;
+
+    offset = sizeof(HookTraceFileHeader);
+
+    decoded_size = offset;
+
+    while (offset < size) {
+        HookTraceRecord record;
+
+        UInt64 delta;
+        UInt64 hook_id;
+        UInt64 cpu;
+
+        UInt8 flags = data[offset++];
+
+        memset(&record, 0, sizeof(record));
+
+        record.argument_count = flags >> 4;
+        record.flags = flags & 0xF;
+
+        if (record.argument_count > kHookTraceMaxArguments)
+            return false;
+
+        if (!DecodeVarint(data, size, &offset, &delta) ||
+            !DecodeVarint(data, size, &offset, &hook_id) ||
+            !DecodeVarint(data, size, &offset, &cpu))
+            return false;
+
+        if (hook_id > 0xFFFFFFFF || cpu >= cpu_count)
+            return false;
+
+        for (UInt32 i = 0; i < record.argument_count; i++) {
+            if (!DecodeVarint(data, size, &offset, &record.arguments[i]))
+                return false;
+        }
+
+        // undo the zigzag encoding of the signed delta
+        timestamp += (delta >> 1) ^ (0 - (delta & 1));
+
+        record.timestamp = timestamp;
+        record.hook_id = (UInt32)hook_id;
+        record.cpu = (UInt16)cpu;
+
+        if (record.flags & kHookTraceFlagDropped)
+            dropped += record.arguments[0];
+
+        records.push_back(record);
+
+        decoded_size = offset;
+    }
+
+    return true;
+}
+
+void HookTraceDecoder::SortByTimestamp() {
+    std::stable_sort(records.begin(), records.end(),
+                     [](const HookTraceRecord& a, const HookTraceRecord& b) {
+                         return a.timestamp < b.timestamp;
+                     });
+}
+
+} // namespace darwin
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+#include <vector>
+
+#include "hook_trace.h"
+
+namespace darwin {
+
+/**
+ *  Reads traces written by HookTraceEncoder back into HookTraceRecords on the host.
+ *
+ *  A trace that was cut off in the middle of a record, like one still being written, decodes up
+ *  to its last complete record and Decode() reports the truncation by returning false. Records
+ *  come out in the order they were drained; SortByTimestamp() merges the CPUs into one
+ *  timeline.
+ */
+class HookTraceDecoder {
+public:
+    explicit HookTraceDecoder();
+
+    ~HookTraceDecoder() = default;
+
+    bool Decode(const UInt8* data, Size size);
+
+    void SortByTimestamp();
+
+    std::vector<darwin::HookTraceRecord>& GetRecords() {
+        return records;
+    }
+
+    UInt32 GetCpuCount() {
+        return cpu_count;
+    }
+
+    // records the CPUs dropped, as reported by kHookTraceFlagDropped records
+    UInt64 GetDroppedCount() {
+        return dropped;
+    }
+
+    // bytes of the trace that were consumed by complete records
+    Size GetDecodedSize() {
+        return decoded_size;
+    }
+
+private:
+    std::vector<darwin::HookTraceRecord> records;
+
+    UInt32 cpu_count;
+
+    UInt64 dropped;
+
+    Size decoded_size;
+};
+
+} // namespace darwin
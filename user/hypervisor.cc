@@ -18,6 +18,7 @@
 
 #include "hypervisor.h"
 
+#include "device_tree_index.h"
 #include "kernel_macho.h"
 
 static inline int64_t get_clock(void) {
@@ -41,7 +42,12 @@ Hypervisor::Hypervisor(fuzzer::Harness* harness, xnu::mach::VmAddress virtualBas
         exit(-1);
     }
 
-    PrepareBootArgs("DeviceTree_vma2");
+    ret = PrepareBootArgs("DeviceTree_vma2");
+    if (ret != 0) {
+        printf("Failed to prepare Hypervisor's boot arguments!\n");
+        exit(-1);
+    }
+
     Configure();
     Start();
 }
@@ -716,30 +722,65 @@ int Hypervisor::SysregWrite(UInt32 reg, UInt64 val) {
     return 0;
 }
 
-void Hypervisor::PrepareBootArgs(const char* deviceTreePath) {
+int Hypervisor::PrepareBootArgs(const char* deviceTreePath) {
     int fd = open(deviceTreePath, O_RDONLY);
 
-    if (!fd) {
+    if (fd < 0) {
         fprintf(stderr, "Failed to open DeviceTree at path %s\n", deviceTreePath);
 
-        exit(-1);
+        return -errno;
     }
 
-    Size deviceTreeSize = lseek(fd, 0, SEEK_END);
+    off_t deviceTreeEnd = lseek(fd, 0, SEEK_END);
+
+    if (deviceTreeEnd <= 0 || lseek(fd, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Failed to size DeviceTree at path %s\n", deviceTreePath);
 
-    lseek(fd, 0, SEEK_SET);
+        close(fd);
+
+        return deviceTreeEnd < 0 ? -errno : -EINVAL;
+    }
+
+    Size deviceTreeSize = deviceTreeEnd;
 
     char* deviceTree = reinterpret_cast<char*>(malloc(deviceTreeSize));
 
-    Size bytes_read;
+    if (!deviceTree) {
+        close(fd);
+
+        return -ENOMEM;
+    }
+
+    ssize_t bytes_read;
 
-    bytes_read = read(fd, deviceTree, size);
+    bytes_read = read(fd, deviceTree, deviceTreeSize);
 
     close(fd);
 
+    if (bytes_read < 0 || (Size)bytes_read != deviceTreeSize) {
+        fprintf(stderr, "Failed to read DeviceTree at path %s\n", deviceTreePath);
+
+        free(deviceTree);
+
+        return bytes_read < 0 ? -errno : -EIO;
+    }
+
     printf("deviceTree = 0x%llx\n", (UInt64)deviceTree);
     printf("deviceTreeSize = 0x%llx\n", (UInt64)deviceTreeSize);
 
+    xnu::DeviceTreeIndex deviceTreeIndex(reinterpret_cast<UInt8*>(deviceTree), deviceTreeSize);
+
+    if (!deviceTreeIndex.Parse()) {
+        fprintf(stderr, "Failed to parse DeviceTree at path %s\n", deviceTreePath);
+
+        free(deviceTree);
+
+        return -EINVAL;
+    }
+
+    printf("deviceTree nodes = %u properties = %u\n", deviceTreeIndex.GetNodeCount(),
+           deviceTreeIndex.GetPropertyCount());
+
     char* CommandLineArguments = "-s";
 
     bootArgsOffset = size + 0x10000;
@@ -769,11 +810,15 @@ void Hypervisor::PrepareBootArgs(const char* deviceTreePath) {
     memcpy((void*)((UInt64)mainMemory + bootArgsOffset), (void*)&boot_args,
            sizeof(struct boot_args));
 
+    free(deviceTree);
+
     printf("deviceTreeP = 0x%llx\n", (UInt64)boot_args.deviceTreeP);
     printf("deviceTreeLength = 0x%llx\n", (UInt64)boot_args.deviceTreeLength);
 
     printf("virtBase = 0x%llx\n", boot_args.virtBase);
     printf("physBase = 0x%llx\n", boot_args.physBase);
+
+    return 0;
 }
 
 int Hypervisor::PrepareSystemMemory() {
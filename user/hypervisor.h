@@ -150,7 +150,7 @@ public:
 
     int PrepareSystemMemory();
 
-    void PrepareBootArgs(const char* deviceTreePath);
+    int PrepareBootArgs(const char* deviceTreePath);
 
     void Configure();
 
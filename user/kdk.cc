@@ -17,7 +17,7 @@
 #include "dwarf.h"
 #include "kernel.h"
 #include "kernel_machO.h"
-#include "machO.h"
+#include "macho.h"
 
 extern "C" {
 #include <sys/errno.h>
@@ -368,6 +368,104 @@ bool kernel_write64(mach_vm_address_t address, uint64_t value)
 	return kernel_write(address, &value, sizeof(uint64_t));
 }
 
+bool kernel_batch(const void *request, size_t request_size, void *response, size_t response_size)
+{
+	kern_return_t kr;
+
+	uint64_t input[] = { (uint64_t) request, (uint64_t) request_size, (uint64_t) response, (uint64_t) response_size };
+	uint64_t output[] = {};
+
+	uint32_t outputCnt = 0;
+
+	kr = IOConnectCallMethod(connection, kIOKernelDarwinKitKernelBatch, input, 4, 0, 0, output, &outputCnt, 0, 0);
+
+	if(kr != KERN_SUCCESS)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool create_shared_memory(size_t size)
+{
+	kern_return_t kr;
+
+	uint64_t input[] = { (uint64_t) size };
+	uint64_t output[] = {};
+
+	uint32_t outputCnt = 0;
+
+	kr = IOConnectCallMethod(connection, kIOKernelDarwinKitCreateSharedMemory, input, 1, 0, 0, output, &outputCnt, 0, 0);
+
+	if(kr != KERN_SUCCESS)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool map_shared_memory(mach_vm_address_t *address, size_t *size)
+{
+	kern_return_t kr;
+
+	uint64_t input[] = {};
+	uint64_t output[] = { (uint64_t) 0, (uint64_t) 0 };
+
+	uint32_t outputCnt = 2;
+
+	kr = IOConnectCallMethod(connection, kIOKernelDarwinKitMapSharedMemory, input, 0, 0, 0, output, &outputCnt, 0, 0);
+
+	if(kr != KERN_SUCCESS)
+	{
+		return false;
+	}
+
+	*address = (mach_vm_address_t) output[0];
+	*size = (size_t) output[1];
+
+	return true;
+}
+
+bool shared_memory_doorbell()
+{
+	kern_return_t kr;
+
+	uint64_t input[] = {};
+	uint64_t output[] = {};
+
+	uint32_t outputCnt = 0;
+
+	kr = IOConnectCallMethod(connection, kIOKernelDarwinKitSharedMemoryDoorbell, input, 0, 0, 0, output, &outputCnt, 0, 0);
+
+	if(kr != KERN_SUCCESS)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool shared_memory_wait(uint32_t timeout)
+{
+	kern_return_t kr;
+
+	uint64_t input[] = { (uint64_t) timeout };
+	uint64_t output[] = {};
+
+	uint32_t outputCnt = 0;
+
+	kr = IOConnectCallMethod(connection, kIOKernelDarwinKitSharedMemoryWait, input, 1, 0, 0, output, &outputCnt, 0, 0);
+
+	if(kr != KERN_SUCCESS)
+	{
+		return false;
+	}
+
+	return true;
+}
+
 mach_vm_address_t kernel_vm_allocate(size_t size)
 {
 	kern_return_t kr;
@@ -62,6 +62,19 @@ bool kernel_write16(mach_vm_address_t address, uint16_t value);
 bool kernel_write32(mach_vm_address_t address, uint32_t value);
 bool kernel_write64(mach_vm_address_t address, uint64_t value);
 
+// runs a request built by darwin::KernelBatch, see kernel_batch.h for the layout
+bool kernel_batch(const void* request, size_t request_size, void* response, size_t response_size);
+
+// the shared memory holds the rings from shared_ring.h
+bool create_shared_memory(size_t size);
+bool map_shared_memory(mach_vm_address_t* address, size_t* size);
+
+// runs every queued command before it returns
+bool shared_memory_doorbell();
+
+// sleeps until the event ring has records, a timeout of 0 waits forever
+bool shared_memory_wait(uint32_t timeout);
+
 mach_vm_address_t kernel_vm_allocate(size_t size);
 void kernel_vm_deallocate(mach_vm_address_t address, size_t size);
 
@@ -16,6 +16,8 @@
 
 #include "kernel.h"
 
+#include "hook_trace_decoder.h"
+
 namespace xnu {
 
 const char* GetKernelVersion() {
@@ -159,6 +161,10 @@ bool Kernel::ReadUnsafe(xnu::mach::VmAddress address, void* data, Size size) {
     return false;
 }
 
+bool Kernel::TryRead(xnu::mach::VmAddress address, void* data, Size size) {
+    return Read(address, data, size);
+}
+
 UInt8 Kernel::Read8(xnu::mach::VmAddress address) {
     return kernel_read8(address);
 }
@@ -183,6 +189,118 @@ bool Kernel::WriteUnsafe(xnu::mach::VmAddress address, void* data, Size size) {
     return false;
 }
 
+bool Kernel::Execute(darwin::KernelBatch* batch) {
+    bool shared;
+
+    if (!batch->Build())
+        return false;
+
+    shared = command_ring.IsAttached() &&
+             batch->GetRequestSize() <= command_ring.GetMaxRecordSize() &&
+             batch->GetResponseSize() <= result_ring.GetMaxRecordSize();
+
+    if (shared) {
+        if (!ExecuteShared(batch))
+            return false;
+    } else if (!kernel_batch(batch->GetRequest(), batch->GetRequestSize(), batch->GetResponse(),
+                             batch->GetResponseSize())) {
+        return false;
+    }
+
+    return batch->Decode();
+}
+
+bool Kernel::ExecuteShared(darwin::KernelBatch* batch) {
+    darwin::SharedRingRecord* result;
+
+    UInt64 id = ++command_id;
+
+    UInt32 size;
+
+    bool success;
+
+    if (!command_ring.Push(darwin::kSharedRingKernelBatch, id, batch->GetRequest(),
+                           batch->GetRequestSize(), nullptr))
+        return false;
+
+    // the kext only runs commands when rung and drains the ring before the doorbell returns
+    if (!shared_memory_doorbell())
+        return false;
+
+    result = result_ring.Peek(&size);
+
+    if (!result)
+        return false;
+
+    success = result->id == id && size == batch->GetResponseSize();
+
+    if (success)
+        memcpy(batch->GetResponse(), result + 1, size);
+
+    result_ring.Pop();
+
+    return success;
+}
+
+bool Kernel::OpenSharedMemory(Size size) {
+    xnu::mach::VmAddress address;
+
+    void* memory;
+
+    Size mapped_size;
+
+    if (command_ring.IsAttached())
+        return true;
+
+    if (!create_shared_memory(size) || !map_shared_memory(&address, &mapped_size))
+        return false;
+
+    memory = reinterpret_cast<void*>(address);
+
+    return darwin::OpenSharedRing(memory, mapped_size, darwin::kSharedRingCommands,
+                                  &command_ring) &&
+           darwin::OpenSharedRing(memory, mapped_size, darwin::kSharedRingResults,
+                                  &result_ring) &&
+           darwin::OpenSharedRing(memory, mapped_size, darwin::kSharedRingEvents, &event_ring);
+}
+
+bool Kernel::WaitForEvents(UInt32 timeout) {
+    if (!event_ring.IsAttached())
+        return false;
+
+    if (!event_ring.PrepareToWait())
+        return true;
+
+    return shared_memory_wait(timeout);
+}
+
+bool Kernel::ReadHookTrace(std::vector<darwin::HookTraceRecord>* records) {
+    darwin::SharedRingRecord* event;
+
+    darwin::HookTraceDecoder decoder;
+
+    UInt32 size;
+
+    bool read = false;
+
+    if (!event_ring.IsAttached())
+        return false;
+
+    while ((event = event_ring.Peek(&size)) && event->type == darwin::kSharedRingHookHit) {
+        // every event is a trace of its own, a malformed one still yields the records before it
+        decoder.Decode(reinterpret_cast<UInt8*>(event + 1), size);
+
+        records->insert(records->end(), decoder.GetRecords().begin(),
+                        decoder.GetRecords().end());
+
+        event_ring.Pop();
+
+        read = true;
+    }
+
+    return read;
+}
+
 void Kernel::Write8(xnu::mach::VmAddress address, UInt8 value) {
     kernel_write8(address, value);
 }
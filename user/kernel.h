@@ -27,6 +27,9 @@
 #include "macho_userspace.h"
 
 #include "disassembler.h"
+#include "hook_trace.h"
+#include "kernel_batch.h"
+#include "shared_ring.h"
 
 extern "C" {
 #include "kern_user.h"
@@ -84,6 +87,8 @@ public:
     virtual bool Read(xnu::mach::VmAddress address, void* data, Size size);
     virtual bool ReadUnsafe(xnu::mach::VmAddress address, void* data, Size size);
 
+    virtual bool TryRead(xnu::mach::VmAddress address, void* data, Size size);
+
     virtual UInt8 Read8(xnu::mach::VmAddress address);
     virtual UInt16 Read16(xnu::mach::VmAddress address);
     virtual UInt32 Read32(xnu::mach::VmAddress address);
@@ -97,6 +102,34 @@ public:
     virtual void Write32(xnu::mach::VmAddress address, UInt32 value);
     virtual void Write64(xnu::mach::VmAddress address, UInt64 value);
 
+    /**
+     *  Sends every operation of the batch to the kext in a single call and copies the reads
+     *  back. Returns false if the call failed or any operation in it did, Succeeded() on the
+     *  batch tells which.
+     */
+    bool Execute(darwin::KernelBatch* batch);
+
+    /**
+     *  Has the kext share a region of size bytes holding the command, result and event rings.
+     *  Once it is open, Execute() sends batches that fit through the command ring instead of
+     *  having the kext map the request and response buffers on every call.
+     */
+    bool OpenSharedMemory(Size size = darwin::kSharedRingMinimumRegionSize * 16);
+
+    darwin::SharedRing* GetEventRing() {
+        return &event_ring;
+    }
+
+    // sleeps in the kext until the event ring has records, unless it already has some
+    bool WaitForEvents(UInt32 timeout);
+
+    /**
+     *  Pops the hook trace events at the front of the event ring, decodes the compact trace each
+     *  of them carries and appends the records to records. Stops at the first event of another
+     *  type, so that it stays queued for whoever reads it.
+     */
+    bool ReadHookTrace(std::vector<darwin::HookTraceRecord>* records);
+
     virtual bool HookFunction(char* symname, xnu::mach::VmAddress hook, Size hook_size);
     virtual bool HookFunction(xnu::mach::VmAddress address, xnu::mach::VmAddress hook,
                               Size hook_size);
@@ -125,6 +158,14 @@ private:
     xnu::mach::VmAddress base;
 
     Offset slide;
+
+    darwin::SharedRing command_ring;
+    darwin::SharedRing result_ring;
+    darwin::SharedRing event_ring;
+
+    UInt64 command_id = 0;
+
+    bool ExecuteShared(darwin::KernelBatch* batch);
 };
 
 enum KDKKernelType {
@@ -21,6 +21,7 @@
 #include "macho_userspace.h"
 
 #include "dyld.h"
+#include "fixups.h"
 #include "task.h"
 
 namespace darwin {
@@ -195,149 +196,15 @@ UInt64 MachOUserspace::UntagPacPointer(xnu::mach::VmAddress base, enum dyld_fixu
 }
 
 bool MachOUserspace::PointerIsInPacFixupChain(xnu::mach::VmAddress ptr) {
-    struct mach_header_64* header;
+    darwin::dyld::Fixup fixup;
 
-    UInt8* q;
+    darwin::dyld::FixupDecoder decoder(reinterpret_cast<UInt8*>(GetMachHeader()), GetSize());
 
-    UInt64 ncmds;
+    if (!decoder.Parse())
+        return false;
 
-    UInt64 cmd_offset;
-
-    bool bind;
-
-    header = GetMachHeader();
-
-    ncmds = header->ncmds;
-
-    cmd_offset = sizeof(struct mach_header_64);
-
-    q = (UInt8*)header + cmd_offset;
-
-    for (int n = 0; n < ncmds; n++) {
-        struct load_command* load_cmd = (struct load_command*)q;
-
-        UInt32 cmdtype = load_cmd->cmd;
-        UInt32 cmdsize = load_cmd->cmdsize;
-
-        if (cmdtype == LC_SEGMENT_64) {
-            struct segment_command_64* segcmd = (struct segment_command_64*)load_cmd;
-
-            if (strcmp("__TEXT", segcmd->segname) == 0) {
-                UInt64 sect_offset = cmd_offset + sizeof(struct segment_command_64);
-
-                for (int j = 0; j < segcmd->nsects; j++) {
-                    struct section_64* section = (struct section_64*)(q + sect_offset);
-
-                    if (strcmp("__thread_starts", section->sectname) == 0) {
-                        UInt32* start = (UInt32*)((UIntPtr)((UInt8*)header + section->offset));
-                        UInt32* end = (UInt32*)((UIntPtr)start + section->size);
-
-                        if (end > start) {
-                            ++start;
-
-                            for (; start < end; ++start) {
-                                if (*start == 0xffffffff)
-                                    break;
-
-                                UInt64* mem = (UInt64*)((UInt8*)header + *start);
-
-                                Size skip = 0;
-
-                                do {
-                                    UInt64 ptr_tag = *mem;
-                                    UInt64 ptr_tag_ptr =
-                                        ((UInt64)mem - (UInt64)header) + GetBase();
-
-                                    ptr_tag = UntagPacPointer(
-                                        GetBase(), DYLD_CHAINED_PTR_ARM64E, ptr_tag, &bind,
-                                        nullptr, nullptr, &skip);
-
-                                    if (ptr_tag_ptr == ptr) {
-                                        return true;
-                                    }
-
-                                    mem = (UInt64*)((UInt64)mem + skip);
-
-                                } while (skip > 0);
-
-                                return false;
-                            }
-                        }
-
-                        sect_offset += sizeof(struct section_64);
-                    }
-                }
-            }
-        }
-
-        if (cmdtype == LC_DYLD_CHAINED_FIXUPS) {
-            struct linkedit_data_command* data = (struct linkedit_data_command*)q;
-
-            struct dyld_chained_fixups_header* fixup =
-                (struct dyld_chained_fixups_header*)(UInt8*)header + data->dataoff;
-            struct dyld_chained_starts_in_image* segs =
-                (struct dyld_chained_starts_in_image*)((UIntPtr)fixup + fixup->starts_offset);
-
-            for (UInt32 i = 0; i < segs->seg_count; ++i) {
-                if (segs->seg_info_offset[i] == 0) {
-                    continue;
-                }
-
-                struct dyld_chained_starts_in_segment* starts =
-                    (struct dyld_chained_starts_in_segment*)((UIntPtr)segs +
-                                                             segs->seg_info_offset[i]);
-
-                UInt64 off = (UIntPtr)ptr - (UIntPtr)buffer;
-
-                if (starts->pointer_format == DYLD_CHAINED_PTR_ARM64E_KERNEL) {
-                    off = OffsetToAddress(off) - base;
-                }
-
-                if (off < starts->segment_offset ||
-                    (off - starts->segment_offset) / starts->page_size >= starts->page_count) {
-                    continue;
-                }
-
-                UInt16 j = (off - starts->segment_offset) / starts->page_size;
-                UInt16 idx = starts->page_start[j];
-
-                if (idx == 0xffff) {
-                    continue;
-                }
-
-                Size where =
-                    (Size)starts->segment_offset + (Size)j * (Size)starts->page_size + (Size)idx;
-                Size skip = 0;
-
-                UInt64* mem =
-                    starts->pointer_format == DYLD_CHAINED_PTR_ARM64E_KERNEL
-                        ? reinterpret_cast<UInt64*>(AddressToPointer(base + where))
-                        : reinterpret_cast<UInt64*>(
-                              (reinterpret_cast<UIntPtr>(buffer) + where));
-
-                do {
-                    UInt64 ptr_tag = *mem;
-                    UInt64 ptr_tag_ptr = ((UInt64)mem - (UInt64)buffer) + base;
-
-                    ptr_tag = UntagPacPointer(base, DYLD_CHAINED_PTR_ARM64E, ptr_tag,
-                                                    &bind, nullptr, nullptr, &skip);
-
-                    if (ptr_tag_ptr == ptr) {
-                        return true;
-                    }
-
-                    mem = (UInt64*)((UIntPtr)mem + skip);
-
-                } while (skip > 0);
-            }
-
-            return false;
-        }
-
-        cmd_offset += cmdsize;
-    }
-
-    return false;
+    // fixups are reported at their unslid addresses
+    return decoder.FindFixup(ptr - (GetBase() - decoder.GetBase()), &fixup);
 }
 
 xnu::mach::VmAddress MachOUserspace::GetBufferAddress(xnu::mach::VmAddress address) {
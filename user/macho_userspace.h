@@ -49,14 +49,17 @@ class Task;
 };
 
 namespace darwin {
+class CodeDirectoryVerifier;
+
 class CodeSignature {
 public:
     explicit CodeSignature(MachOUserspace* macho, struct linkedit_data_command* cmd)
-        : macho(macho), cmd(cmd) {
+        : macho(macho), cmd(cmd), superBlob(nullptr), codeDirectory(nullptr),
+          entitlements(nullptr), codeVerifier(nullptr) {
         ParseCodeSignature();
     }
 
-    ~CodeSignature() = default;
+    ~CodeSignature();
 
     static CodeSignature* CodeSignatureWithLinkedit(MachOUserspace* macho,
                                                     struct linkedit_data_command* cmd);
@@ -81,11 +84,15 @@ public:
         return entitlements;
     }
 
+    CodeDirectoryVerifier* GetCodeDirectoryVerifier() {
+        return codeVerifier;
+    }
+
     bool VerifyCodeSlot(UInt8* blob, Size size, bool sha256, char* signature, Size sigsize);
 
     bool CompareHash(UInt8* hash1, UInt8* hash2, Size hashSize);
 
-    UInt8* ComputeHash(bool sha256, UInt8* blob, Size size);
+    void ComputeHash(bool sha256, UInt8* blob, Size size, UInt8* digest);
 
     bool ParseCodeSignature();
 
@@ -99,6 +106,8 @@ private:
     code_directory_t codeDirectory;
 
     char* entitlements;
+
+    CodeDirectoryVerifier* codeVerifier;
 };
 
 class MachOUserspace : public MachO {
@@ -181,8 +190,8 @@ public:
         codeSignature = CodeSignature::CodeSignatureWithLinkedit(this, cmd);
     }
 
-    inline void ParseObjC() {
-        objc = objc::ParseObjectiveC(this);
+    inline void ParseObjC(bool lazy = false) {
+        objc = objc::ParseObjectiveC(this, lazy);
     }
 
     inline void ParseSwift() {
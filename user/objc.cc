@@ -26,8 +26,8 @@
 
 namespace objc {
 
-ObjCData* ParseObjectiveC(darwin::MachOUserspace* macho) {
-    return new ObjCData(macho);
+ObjCData* ParseObjectiveC(darwin::MachOUserspace* macho, bool lazy) {
+    return new ObjCData(macho, lazy);
 }
 
 void ParseClassList(ObjCData* data, std::vector<ObjCClass*>& classes) {
@@ -293,9 +293,10 @@ void ParsePropertyList(ObjCData* metadata, ObjC* object, std::vector<Property*>&
 namespace objc {
 
 ObjCClass::ObjCClass(ObjCData* metadata, struct _objc_2_class* c, bool metaclass) {
-    metadata = metadata;
+    this->metadata = metadata;
+    this->metaclass = metaclass;
+
     macho = metadata->GetMachO();
-    metaclass = metaclass;
     cls = c;
     super = nullptr;
 
@@ -308,19 +309,19 @@ ObjCClass::ObjCClass(ObjCData* metadata, struct _objc_2_class* c, bool metaclass
                                        reinterpret_cast<UInt64>(macho->GetMachHeader()));
 
         if (macho->SectionForOffset(reinterpret_cast<UInt64>((data->name & 0xFFFFFFFF)))) {
-            if (metaclass)
-                printf("\t\t$OBJC_METACLASS_%s\n", name);
-            else
-                printf("\t\t$OBJC_CLASS_%s\n", name);
-
             isa = reinterpret_cast<UInt64>(c->isa);
             superclass = reinterpret_cast<UInt64>(c->superclass);
             cache = reinterpret_cast<UInt64>(c->cache);
             vtable = reinterpret_cast<UInt64>(c->vtable);
 
-            ParseMethods();
-            ParseIvars();
-            ParseProperties();
+            if (!metadata->IsLazy()) {
+                if (metaclass)
+                    printf("\t\t$OBJC_METACLASS_%s\n", name);
+                else
+                    printf("\t\t$OBJC_CLASS_%s\n", name);
+
+                Realize();
+            }
         }
 
     } else if (macho->SectionForAddress(reinterpret_cast<UInt64>(((UInt64)c->data & 0xFFFFFFFFF) -
@@ -330,19 +331,19 @@ ObjCClass::ObjCClass(ObjCData* metadata, struct _objc_2_class* c, bool metaclass
 
         name = reinterpret_cast<char*>(macho->GetBufferAddress(data->name - macho->GetAslrSlide()));
 
-        if (metaclass)
-            printf("\t\t$OBJC_METACLASS_%s\n", name);
-        else
-            printf("\t\t$OBJC_CLASS_%s\n", name);
-
         isa = reinterpret_cast<UInt64>(c->isa);
         superclass = reinterpret_cast<UInt64>(c->superclass);
         cache = reinterpret_cast<UInt64>(c->cache);
         vtable = reinterpret_cast<UInt64>(c->vtable);
 
-        ParseMethods();
-        ParseIvars();
-        ParseProperties();
+        if (!metadata->IsLazy()) {
+            if (metaclass)
+                printf("\t\t$OBJC_METACLASS_%s\n", name);
+            else
+                printf("\t\t$OBJC_CLASS_%s\n", name);
+
+            Realize();
+        }
     } else {
         name = nullptr;
         data = nullptr;
@@ -788,51 +789,76 @@ UInt64 FindSelectorsBase(darwin::MachOUserspace* macho) {
 }
 
 Protocol* ObjCClass::GetProtocol(char* protocolname) {
-    for (int i = 0; i < GetProtocols().size(); i++) {
-        Protocol* protocol = GetProtocols().at(i);
+    Realize();
 
-        if (strcmp(protocol->GetName(), protocolname) == 0) {
-            return protocol;
-        }
-    }
+    auto it = protocols_by_name.find(protocolname);
 
-    return nullptr;
+    return it != protocols_by_name.end() ? it->second : nullptr;
 }
 
 Method* ObjCClass::GetMethod(char* methodname) {
-    for (int i = 0; i < GetMethods().size(); i++) {
-        Method* method = GetMethods().at(i);
+    Realize();
 
-        if (strcmp(method->GetName(), methodname) == 0) {
-            return method;
-        }
-    }
+    auto it = methods_by_name.find(methodname);
 
-    return nullptr;
+    return it != methods_by_name.end() ? it->second : nullptr;
 }
 
 Ivar* ObjCClass::GetIvar(char* ivarname) {
-    for (int i = 0; i < GetIvars().size(); i++) {
-        Ivar* ivar = GetIvars().at(i);
+    Realize();
 
-        if (strcmp(ivar->GetName(), ivarname) == 0) {
-            return ivar;
-        }
-    }
+    auto it = ivars_by_name.find(ivarname);
 
-    return nullptr;
+    return it != ivars_by_name.end() ? it->second : nullptr;
 }
 
 Property* ObjCClass::GetProperty(char* propertyname) {
-    for (int i = 0; i < GetProperties().size(); i++) {
-        Property* property = GetProperties().at(i);
+    Realize();
 
-        if (strcmp(property->GetName(), propertyname) == 0) {
-            return property;
-        }
+    auto it = properties_by_name.find(propertyname);
+
+    return it != properties_by_name.end() ? it->second : nullptr;
+}
+
+void ObjCClass::Realize() {
+    std::call_once(realized, [this]() {
+        if (!data || !name)
+            return;
+
+        ParseMethods();
+        ParseIvars();
+        ParseProperties();
+
+        BuildIndexes();
+    });
+}
+
+void ObjCClass::BuildIndexes() {
+    methods_by_name.reserve(methods.size());
+    protocols_by_name.reserve(protocols.size());
+    ivars_by_name.reserve(ivars.size());
+    properties_by_name.reserve(properties.size());
+
+    // emplace keeps the first entry for a name, matching the order the linear scans returned
+    for (Method* method : methods) {
+        if (method->GetName())
+            methods_by_name.emplace(method->GetName(), method);
+    }
+
+    for (Protocol* protocol : protocols) {
+        if (protocol->GetName())
+            protocols_by_name.emplace(protocol->GetName(), protocol);
     }
 
-    return nullptr;
+    for (Ivar* ivar : ivars) {
+        if (ivar->GetName())
+            ivars_by_name.emplace(ivar->GetName(), ivar);
+    }
+
+    for (Property* property : properties) {
+        if (property->GetName())
+            properties_by_name.emplace(property->GetName(), property);
+    }
 }
 
 void ObjCClass::ParseMethods() {
@@ -1085,65 +1111,108 @@ void ObjCData::ParseObjC() {
 
     ParseClassList(this, classes);
 
-    if (protolist)
-        ParseProtocolList(this, protocols);
+    BuildClassIndexes();
 
-    if (catlist)
-        ParseCategoryList(this, categories);
+    if (lazy)
+        return;
+
+    ParseCategories();
 
     if (!macho->IsDyldCache()) {
         // do not Parse categories and protocols when dyld cache is being Parsed
         // all of the class pointers will be invalid because they will exist in other libraries
         // we aren't going to need categories during runtime anyways
     }
+
+    BuildImplementations();
 }
 
-ObjCClass* ObjCData::GetClassByName(char* classname) {
-    for (int i = 0; i < classes.size(); i++) {
-        ObjCClass* cls = classes.at(i);
+void ObjCData::ParseCategories() {
+    std::call_once(categories_parsed, [this]() {
+        if (protolist)
+            ParseProtocolList(this, protocols);
+
+        if (catlist)
+            ParseCategoryList(this, categories);
+
+        protocols_by_name.reserve(protocols.size());
+        categories_by_name.reserve(categories.size());
 
-        if (cls->GetName() && strcmp(cls->GetName(), classname) == 0) {
-            return cls;
+        for (Protocol* protocol : protocols) {
+            if (protocol->GetName())
+                protocols_by_name.emplace(protocol->GetName(), protocol);
         }
-    }
 
-    return nullptr;
+        for (Category* category : categories) {
+            if (category->GetName())
+                categories_by_name.emplace(category->GetName(), category);
+        }
+    });
 }
 
-ObjCClass* ObjCData::GetClassByIsa(UInt64 isa) {
-    for (int i = 0; i < classes.size(); i++) {
-        ObjCClass* cls = classes.at(i);
+void ObjCData::BuildClassIndexes() {
+    classes_by_name.reserve(classes.size());
+    classes_by_isa.reserve(classes.size());
 
-        if (reinterpret_cast<UInt64>(cls->GetClass()) == isa) {
-            return cls;
-        }
+    for (ObjCClass* cls : classes) {
+        if (cls->GetName())
+            classes_by_name.emplace(cls->GetName(), cls);
+
+        classes_by_isa.emplace(reinterpret_cast<UInt64>(cls->GetClass()), cls);
     }
+}
+
+void ObjCData::BuildImplementations() {
+    std::call_once(implementations_built, [this]() {
+        ParseCategories();
+
+        for (ObjCClass* cls : classes) {
+            for (Method* method : cls->GetMethods()) {
+                if (method->GetName())
+                    implementations[method->GetName()].push_back(method);
+            }
+        }
+
+        for (Category* category : categories) {
+            for (Method* method : category->GetInstanceMethods()) {
+                if (method->GetName())
+                    implementations[method->GetName()].push_back(method);
+            }
+
+            for (Method* method : category->GetClassMethods()) {
+                if (method->GetName())
+                    implementations[method->GetName()].push_back(method);
+            }
+        }
+    });
+}
 
-    return nullptr;
+ObjCClass* ObjCData::GetClassByName(char* classname) {
+    auto it = classes_by_name.find(classname);
+
+    return it != classes_by_name.end() ? it->second : nullptr;
+}
+
+ObjCClass* ObjCData::GetClassByIsa(UInt64 isa) {
+    auto it = classes_by_isa.find(isa);
+
+    return it != classes_by_isa.end() ? it->second : nullptr;
 }
 
 Protocol* ObjCData::GetProtocol(char* protoname) {
-    for (int i = 0; i < protocols.size(); i++) {
-        Protocol* protocol = protocols.at(i);
+    ParseCategories();
 
-        if (strcmp(protocol->GetName(), protoname) == 0) {
-            return protocol;
-        }
-    }
+    auto it = protocols_by_name.find(protoname);
 
-    return nullptr;
+    return it != protocols_by_name.end() ? it->second : nullptr;
 }
 
 Category* ObjCData::GetCategory(char* catname) {
-    for (int i = 0; i < categories.size(); i++) {
-        Category* category = categories.at(i);
+    ParseCategories();
 
-        if (strcmp(category->GetName(), catname) == 0) {
-            return category;
-        }
-    }
+    auto it = categories_by_name.find(catname);
 
-    return nullptr;
+    return it != categories_by_name.end() ? it->second : nullptr;
 }
 
 Method* ObjCData::GetMethod(char* classname, char* methodname) {
@@ -1164,4 +1233,12 @@ Property* ObjCData::GetProperty(char* classname, char* propertyname) {
     return cls ? cls->GetProperty(propertyname) : nullptr;
 }
 
+std::vector<Method*>* ObjCData::GetImplementations(char* selector) {
+    BuildImplementations();
+
+    auto it = implementations.find(selector);
+
+    return it != implementations.end() ? &it->second : nullptr;
+}
+
 } // namespace objc
\ No newline at end of file
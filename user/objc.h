@@ -18,6 +18,9 @@
 
 #include <mach/mach_types.h>
 
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include <types.h>
@@ -364,7 +367,7 @@ protected:
     ObjCData* metadata;
 };
 
-ObjCData* ParseObjectiveC(darwin::MachOUserspace* macho);
+ObjCData* ParseObjectiveC(darwin::MachOUserspace* macho, bool lazy = false);
 
 std::vector<ObjCClass*>* ParseClassList(ObjCData* data);
 std::vector<Category*>* ParseCategoryList(ObjCData* data);
@@ -596,18 +599,26 @@ public:
     Property* GetProperty(char* propertyname);
 
     std::vector<Method*>& GetMethods() {
+        Realize();
+
         return methods;
     }
 
     std::vector<Protocol*>& GetProtocols() {
+        Realize();
+
         return protocols;
     }
 
     std::vector<Ivar*>& GetIvars() {
+        Realize();
+
         return ivars;
     }
 
     std::vector<Property*>& GetProperties() {
+        Realize();
+
         return properties;
     }
 
@@ -615,6 +626,8 @@ public:
         return (name && isa);
     }
 
+    void Realize();
+
     void ParseMethods();
 
     void ParseProtocols();
@@ -623,6 +636,8 @@ public:
 
     void ParseProperties();
 
+    void BuildIndexes();
+
 private:
     darwin::MachOUserspace* macho;
 
@@ -648,11 +663,28 @@ private:
     std::vector<Ivar*> ivars;
 
     std::vector<Property*> properties;
+
+    std::once_flag realized;
+
+    std::unordered_map<std::string_view, Method*> methods_by_name;
+    std::unordered_map<std::string_view, Protocol*> protocols_by_name;
+    std::unordered_map<std::string_view, Ivar*> ivars_by_name;
+    std::unordered_map<std::string_view, Property*> properties_by_name;
 };
 
+/**
+ *  Lookup tables are keyed by views into the image's own string sections, so names are never
+ *  copied. The class tables are built as soon as the class list is parsed so that categories
+ *  can resolve their base class, everything else is built once at the end of ParseObjC().
+ *
+ *  In lazy mode only the class list is read up front. A class parses its methods, ivars and
+ *  properties the first time one of them is asked for, protocols and categories are parsed on
+ *  first access, and the selector table is built the first time it is queried. Each of these
+ *  runs exactly once even when several threads race for it.
+ */
 class ObjCData {
 public:
-    explicit ObjCData(darwin::MachOUserspace* macho) : macho(macho) {
+    explicit ObjCData(darwin::MachOUserspace* macho, bool lazy = false) : macho(macho), lazy(lazy) {
         ParseObjC();
     }
 
@@ -660,6 +692,10 @@ public:
         return macho;
     }
 
+    bool IsLazy() {
+        return lazy;
+    }
+
     Segment* GetDataSegment() {
         return data;
     }
@@ -712,13 +748,50 @@ public:
 
     Property* GetProperty(char* classname, char* propertyname);
 
+    std::vector<Method*>* GetImplementations(char* selector);
+
+    std::vector<ObjCClass*>& GetClasses() {
+        return classes;
+    }
+
+    std::vector<Category*>& GetCategories() {
+        ParseCategories();
+
+        return categories;
+    }
+
+    std::vector<Protocol*>& GetProtocols() {
+        ParseCategories();
+
+        return protocols;
+    }
+
+    void ParseCategories();
+
 private:
     darwin::MachOUserspace* macho;
 
+    bool lazy;
+
     std::vector<ObjCClass*> classes;
     std::vector<Category*> categories;
     std::vector<Protocol*> protocols;
 
+    std::unordered_map<std::string_view, ObjCClass*> classes_by_name;
+    std::unordered_map<UInt64, ObjCClass*> classes_by_isa;
+
+    std::unordered_map<std::string_view, Protocol*> protocols_by_name;
+    std::unordered_map<std::string_view, Category*> categories_by_name;
+
+    std::unordered_map<std::string_view, std::vector<Method*>> implementations;
+
+    std::once_flag categories_parsed;
+    std::once_flag implementations_built;
+
+    void BuildClassIndexes();
+
+    void BuildImplementations();
+
     Segment* data;
     Segment* data_const;
 
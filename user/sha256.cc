@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sha256.h"
+
+#include <string.h>
+
+#include <atomic>
+
+#if defined(__x86_64__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+
+#include <arm_neon.h>
+
+#endif
+
+namespace darwin {
+namespace crypto {
+
+alignas(64) static const UInt32 kSha256K[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static const UInt32 kSha256InitialState[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+using Sha256CompressFunc = void (*)(UInt32* state, const UInt8* data, Size blocks);
+
+static inline UInt32 LoadBigEndian32(const UInt8* p) {
+    return ((UInt32)p[0] << 24) | ((UInt32)p[1] << 16) | ((UInt32)p[2] << 8) | (UInt32)p[3];
+}
+
+static inline void StoreBigEndian32(UInt8* p, UInt32 value) {
+    p[0] = (UInt8)(value >> 24);
+    p[1] = (UInt8)(value >> 16);
+    p[2] = (UInt8)(value >> 8);
+    p[3] = (UInt8)value;
+}
+
+static inline UInt32 Rotr(UInt32 x, UInt32 n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+/**
+ *  Pads the last partial block of a message into tail and returns how many blocks it spans.
+ */
+static inline Size Sha256Pad(const UInt8* data, Size size, UInt8* tail) {
+    Size rest = size % kSha256BlockSize;
+    Size tail_size = rest < kSha256BlockSize - sizeof(UInt64) ? kSha256BlockSize
+                                                               : kSha256BlockSize * 2;
+
+    UInt64 bits = (UInt64)size * 8;
+
+    memset(tail, 0, tail_size);
+
+    if (rest)
+        memcpy(tail, data + size - rest, rest);
+
+    tail[rest] = 0x80;
+
+    StoreBigEndian32(tail + tail_size - 8, (UInt32)(bits >> 32));
+    StoreBigEndian32(tail + tail_size - 4, (UInt32)bits);
+
+    return tail_size / kSha256BlockSize;
+}
+
+static void Sha256CompressPortable(UInt32* state, const UInt8* data, Size blocks) {
+    UInt32 w[64];
+
+    for (Size block = 0; block < blocks; block++, data += kSha256BlockSize) {
+        UInt32 a = state[0], b = state[1], c = state[2], d = state[3];
+        UInt32 e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (UInt32 t = 0; t < 16; t++)
+            w[t] = LoadBigEndian32(data + t * 4);
+
+        for (UInt32 t = 16; t < 64; t++) {
+            UInt32 s0 = Rotr(w[t - 15], 7) ^ Rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            UInt32 s1 = Rotr(w[t - 2], 17) ^ Rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        for (UInt32 t = 0; t < 64; t++) {
+            UInt32 t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) +
+                        kSha256K[t] + w[t];
+            UInt32 t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sha,sse4.1"))) static void Sha256CompressShaNi(UInt32* state,
+                                                                      const UInt8* data,
+                                                                      Size blocks) {
+    const __m128i shuffle_mask =
+        _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+
+    __m128i state0, state1;
+    __m128i msg, tmp;
+    __m128i w[4];
+
+    // the SHA-NI instructions want the state as ABEF and CDGH
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (Size block = 0; block < blocks; block++, data += kSha256BlockSize) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+
+        for (UInt32 g = 0; g < 16; g++) {
+            if (g < 4)
+                w[g] = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + g * 16)),
+                    shuffle_mask);
+
+            msg = _mm_add_epi32(w[g % 4],
+                                _mm_load_si128(reinterpret_cast<const __m128i*>(&kSha256K[g * 4])));
+
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+            // finish the schedule of the next four rounds while this group is in flight
+            if (g >= 3 && g < 15) {
+                tmp = _mm_alignr_epi8(w[g % 4], w[(g + 3) % 4], 4);
+
+                w[(g + 1) % 4] = _mm_sha256msg2_epu32(_mm_add_epi32(w[(g + 1) % 4], tmp), w[g % 4]);
+            }
+
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+
+            if (g >= 1 && g < 13)
+                w[(g + 3) % 4] = _mm_sha256msg1_epu32(w[(g + 3) % 4], w[g % 4]);
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+template <int n>
+__attribute__((target("avx2"))) static inline __m256i Rotr8(__m256i x) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+/**
+ *  Runs the compression function over eight independent messages at once, one per 32-bit lane.
+ */
+__attribute__((target("avx2"))) static void Sha256CompressAvx2(__m256i* state,
+                                                               const UInt8* const* lanes,
+                                                               Size blocks) {
+    __m256i w[16];
+
+    for (Size block = 0; block < blocks; block++) {
+        Size offset = block * kSha256BlockSize;
+
+        __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+        __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (UInt32 t = 0; t < 16; t++) {
+            Size word = offset + t * 4;
+
+            w[t] = _mm256_set_epi32(
+                LoadBigEndian32(lanes[7] + word), LoadBigEndian32(lanes[6] + word),
+                LoadBigEndian32(lanes[5] + word), LoadBigEndian32(lanes[4] + word),
+                LoadBigEndian32(lanes[3] + word), LoadBigEndian32(lanes[2] + word),
+                LoadBigEndian32(lanes[1] + word), LoadBigEndian32(lanes[0] + word));
+        }
+
+        for (UInt32 t = 0; t < 64; t++) {
+            __m256i t1, t2;
+
+            if (t >= 16) {
+                __m256i w15 = w[(t - 15) & 15];
+                __m256i w2 = w[(t - 2) & 15];
+
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(Rotr8<7>(w15), Rotr8<18>(w15)),
+                                              _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(Rotr8<17>(w2), Rotr8<19>(w2)),
+                                              _mm256_srli_epi32(w2, 10));
+
+                w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0),
+                                             _mm256_add_epi32(w[(t - 7) & 15], s1));
+            }
+
+            t1 = _mm256_add_epi32(
+                _mm256_add_epi32(h, _mm256_xor_si256(_mm256_xor_si256(Rotr8<6>(e), Rotr8<11>(e)),
+                                                     Rotr8<25>(e))),
+                _mm256_add_epi32(
+                    _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)),
+                    _mm256_add_epi32(_mm256_set1_epi32((int)kSha256K[t]), w[t & 15])));
+
+            t2 = _mm256_add_epi32(
+                _mm256_xor_si256(_mm256_xor_si256(Rotr8<2>(a), Rotr8<13>(a)), Rotr8<22>(a)),
+                _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)),
+                                 _mm256_and_si256(b, c)));
+
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm256_add_epi32(t1, t2);
+        }
+
+        state[0] = _mm256_add_epi32(state[0], a);
+        state[1] = _mm256_add_epi32(state[1], b);
+        state[2] = _mm256_add_epi32(state[2], c);
+        state[3] = _mm256_add_epi32(state[3], d);
+        state[4] = _mm256_add_epi32(state[4], e);
+        state[5] = _mm256_add_epi32(state[5], f);
+        state[6] = _mm256_add_epi32(state[6], g);
+        state[7] = _mm256_add_epi32(state[7], h);
+    }
+}
+
+__attribute__((target("avx2"))) static void Sha256Avx2(const UInt8* const* lanes, Size size,
+                                                       UInt8* digests) {
+    __m256i state[8];
+
+    UInt8 tails[kSha256Lanes][kSha256BlockSize * 2];
+
+    const UInt8* tail_lanes[kSha256Lanes];
+
+    UInt32 words[kSha256Lanes];
+
+    Size tail_blocks = 0;
+
+    for (UInt32 i = 0; i < 8; i++)
+        state[i] = _mm256_set1_epi32((int)kSha256InitialState[i]);
+
+    if (size / kSha256BlockSize)
+        Sha256CompressAvx2(state, lanes, size / kSha256BlockSize);
+
+    for (UInt32 lane = 0; lane < kSha256Lanes; lane++) {
+        tail_blocks = Sha256Pad(lanes[lane], size, tails[lane]);
+
+        tail_lanes[lane] = tails[lane];
+    }
+
+    Sha256CompressAvx2(state, tail_lanes, tail_blocks);
+
+    for (UInt32 i = 0; i < 8; i++) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(words), state[i]);
+
+        for (UInt32 lane = 0; lane < kSha256Lanes; lane++)
+            StoreBigEndian32(digests + lane * kSha256DigestSize + i * 4, words[lane]);
+    }
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+
+static void Sha256CompressArmCrypto(UInt32* state, const UInt8* data, Size blocks) {
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+
+    uint32x4_t w[4];
+
+    for (Size block = 0; block < blocks; block++, data += kSha256BlockSize) {
+        uint32x4_t abcd = state0;
+        uint32x4_t efgh = state1;
+
+        for (UInt32 g = 0; g < 4; g++)
+            w[g] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + g * 16)));
+
+        for (UInt32 g = 0; g < 16; g++) {
+            uint32x4_t msg = vaddq_u32(w[g % 4], vld1q_u32(&kSha256K[g * 4]));
+            uint32x4_t tmp = state0;
+
+            // the schedule for group g + 4 only needs words this group has already consumed
+            if (g < 12)
+                w[g % 4] = vsha256su0q_u32(w[g % 4], w[(g + 1) % 4]);
+
+            state0 = vsha256hq_u32(state0, state1, msg);
+            state1 = vsha256h2q_u32(state1, tmp, msg);
+
+            if (g < 12)
+                w[g % 4] = vsha256su1q_u32(w[g % 4], w[(g + 2) % 4], w[(g + 3) % 4]);
+        }
+
+        state0 = vaddq_u32(state0, abcd);
+        state1 = vaddq_u32(state1, efgh);
+    }
+
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+#endif
+
+static UInt32 DetectSha256Implementations() {
+    UInt32 supported = 1 << kSha256Portable;
+
+#if defined(__x86_64__)
+
+    UInt32 eax, ebx, ecx, edx;
+
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool avx = false;
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        ssse3 = (ecx & bit_SSSE3) != 0;
+        sse41 = (ecx & bit_SSE4_1) != 0;
+
+        // AVX2 is only usable when the kernel saves the upper halves of the ymm registers
+        if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+            UInt32 xcr0_lo, xcr0_hi;
+
+            __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+
+            avx = (xcr0_lo & 0x6) == 0x6;
+        }
+    }
+
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        if ((ebx & bit_SHA) && ssse3 && sse41)
+            supported |= 1 << kSha256ShaNi;
+
+        if ((ebx & bit_AVX2) && avx)
+            supported |= 1 << kSha256Avx2;
+    }
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+
+    supported |= 1 << kSha256ArmCrypto;
+
+#endif
+
+    return supported;
+}
+
+static UInt32 GetSupportedSha256Implementations() {
+    static UInt32 supported = DetectSha256Implementations();
+
+    return supported;
+}
+
+static std::atomic<Sha256Implementation>& CurrentSha256Implementation() {
+    static std::atomic<Sha256Implementation> implementation = [] {
+        UInt32 supported = GetSupportedSha256Implementations();
+
+        if (supported & (1 << kSha256ShaNi))
+            return kSha256ShaNi;
+
+        if (supported & (1 << kSha256ArmCrypto))
+            return kSha256ArmCrypto;
+
+        if (supported & (1 << kSha256Avx2))
+            return kSha256Avx2;
+
+        return kSha256Portable;
+    }();
+
+    return implementation;
+}
+
+Sha256Implementation GetSha256Implementation() {
+    return CurrentSha256Implementation().load(std::memory_order_relaxed);
+}
+
+bool SetSha256Implementation(Sha256Implementation implementation) {
+    if (!(GetSupportedSha256Implementations() & (1 << implementation)))
+        return false;
+
+    CurrentSha256Implementation().store(implementation, std::memory_order_relaxed);
+
+    return true;
+}
+
+const char* GetSha256ImplementationName() {
+    switch (GetSha256Implementation()) {
+    case kSha256Avx2:
+        return "avx2";
+    case kSha256ShaNi:
+        return "sha-ni";
+    case kSha256ArmCrypto:
+        return "armv8-crypto";
+    default:
+        return "portable";
+    }
+}
+
+static Sha256CompressFunc GetSha256Compress(Sha256Implementation implementation) {
+    switch (implementation) {
+#if defined(__x86_64__)
+    case kSha256ShaNi:
+        return Sha256CompressShaNi;
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+    case kSha256ArmCrypto:
+        return Sha256CompressArmCrypto;
+#endif
+    default:
+        return Sha256CompressPortable;
+    }
+}
+
+static void Sha256WithCompress(Sha256CompressFunc compress, const UInt8* data, Size size,
+                               UInt8* digest) {
+    UInt32 state[8];
+
+    UInt8 tail[kSha256BlockSize * 2];
+
+    Size tail_blocks;
+
+    memcpy(state, kSha256InitialState, sizeof(state));
+
+    if (size / kSha256BlockSize)
+        compress(state, data, size / kSha256BlockSize);
+
+    tail_blocks = Sha256Pad(data, size, tail);
+
+    compress(state, tail, tail_blocks);
+
+    for (UInt32 i = 0; i < 8; i++)
+        StoreBigEndian32(digest + i * 4, state[i]);
+}
+
+void Sha256(const UInt8* data, Size size, UInt8* digest) {
+    // a single message gains nothing from the multi-buffer path
+    Sha256WithCompress(GetSha256Compress(GetSha256Implementation()), data, size, digest);
+}
+
+void Sha256Batch(const UInt8* const* data, Size size, UInt32 count, UInt8* digests) {
+    Sha256Implementation implementation = GetSha256Implementation();
+
+    UInt32 i = 0;
+
+#if defined(__x86_64__)
+
+    if (implementation == kSha256Avx2) {
+        const UInt8* lanes[kSha256Lanes];
+
+        UInt8 lane_digests[kSha256Lanes * kSha256DigestSize];
+
+        for (; i + kSha256Lanes <= count; i += kSha256Lanes)
+            Sha256Avx2(&data[i], size, digests + i * kSha256DigestSize);
+
+        // fill the unused lanes of the last group with copies and throw their digests away
+        if (i < count) {
+            for (UInt32 lane = 0; lane < kSha256Lanes; lane++)
+                lanes[lane] = data[i + lane < count ? i + lane : count - 1];
+
+            Sha256Avx2(lanes, size, lane_digests);
+
+            memcpy(digests + i * kSha256DigestSize, lane_digests,
+                   (count - i) * kSha256DigestSize);
+        }
+
+        return;
+    }
+
+#endif
+
+    Sha256CompressFunc compress = GetSha256Compress(implementation);
+
+    for (; i < count; i++)
+        Sha256WithCompress(compress, data[i], size, digests + i * kSha256DigestSize);
+}
+
+} // namespace crypto
+} // namespace darwin
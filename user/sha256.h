@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+namespace darwin {
+namespace crypto {
+
+static constexpr Size kSha256DigestSize = 32;
+static constexpr Size kSha256BlockSize = 64;
+
+// messages hashed side by side by the AVX2 multi-buffer implementation
+static constexpr UInt32 kSha256Lanes = 8;
+
+enum Sha256Implementation {
+    kSha256Portable,
+    kSha256Avx2,
+    kSha256ShaNi,
+    kSha256ArmCrypto,
+};
+
+/**
+ *  Picks the fastest SHA-256 implementation the CPU supports, once per process.
+ *
+ *  SHA-NI and the ARMv8 crypto extensions hash a single message faster than any multi-buffer
+ *  scheme, AVX2 is only used on x86_64 machines that lack SHA-NI and the portable version
+ *  everywhere else.
+ */
+Sha256Implementation GetSha256Implementation();
+
+/**
+ *  Overrides the automatic choice, mostly for tests and benchmarks. Fails when the CPU does not
+ *  support the requested implementation. Safe to call while other threads are hashing, they pick
+ *  up the new choice with their next digest.
+ */
+bool SetSha256Implementation(Sha256Implementation implementation);
+
+const char* GetSha256ImplementationName();
+
+void Sha256(const UInt8* data, Size size, UInt8* digest);
+
+/**
+ *  Hashes count messages that all have the same size, like the code pages of a binary.
+ *  Digests are written back to back into digests, which must hold count * kSha256DigestSize
+ *  bytes.
+ */
+void Sha256Batch(const UInt8* const* data, Size size, UInt32 count, UInt8* digests);
+
+} // namespace crypto
+} // namespace darwin
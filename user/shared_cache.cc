@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shared_cache.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log.h"
+
+namespace darwin {
+namespace dyld {
+
+SharedCache::SharedCache(const char* path)
+    : path(strdup(path)), main_cache(nullptr), symbols_cache(nullptr), base_address(0),
+      images(nullptr), image_count(0) {
+    dyld::shared_cache::Header* header;
+
+    UInt64 images_offset;
+    UInt32 images_count;
+
+    SharedCacheFile* file = MapCacheFile(path);
+
+    if (!file)
+        return;
+
+    header = file->header;
+
+    main_cache = file;
+
+    if (!MapSubCaches()) {
+        UnmapCacheFile(main_cache);
+
+        main_cache = nullptr;
+
+        return;
+    }
+
+    BuildRanges();
+
+    base_address = main_cache->mappings[0].address;
+
+    if (header->mappingOffset > offsetof(dyld::shared_cache::Header, imagesCount) &&
+        header->imagesOffset) {
+        images_offset = header->imagesOffset;
+        images_count = header->imagesCount;
+    } else {
+        images_offset = header->imagesOffsetOld;
+        images_count = header->imagesCountOld;
+    }
+
+    if (!IsInFile(main_cache, images_offset, images_count,
+                  sizeof(dyld::shared_cache::CacheImageInfo))) {
+        DARWIN_KIT_LOG("MacRK::shared cache %s has a truncated image list!\n", path);
+    } else {
+        images = reinterpret_cast<dyld::shared_cache::CacheImageInfo*>(main_cache->base +
+                                                                       images_offset);
+        image_count = images_count;
+    }
+
+    BuildImageIndex();
+}
+
+SharedCache::~SharedCache() {
+    for (SharedCacheFile* subcache : subcaches)
+        UnmapCacheFile(subcache);
+
+    if (symbols_cache)
+        UnmapCacheFile(symbols_cache);
+
+    if (main_cache)
+        UnmapCacheFile(main_cache);
+
+    free(path);
+}
+
+SharedCache* SharedCache::CacheWithPath(const char* path) {
+    SharedCache* cache = new SharedCache(path);
+
+    if (!cache->IsValid()) {
+        delete cache;
+
+        return nullptr;
+    }
+
+    return cache;
+}
+
+bool SharedCache::IsInFile(SharedCacheFile* file, UInt64 offset, UInt64 count, Size entry_size) {
+    // written so that nothing a hostile header holds can overflow
+    return offset <= file->size && count <= (file->size - offset) / entry_size;
+}
+
+SharedCacheFile* SharedCache::MapCacheFile(const char* file_path) {
+    SharedCacheFile* file;
+
+    dyld::shared_cache::Header* header;
+
+    struct stat st;
+
+    UInt8* base;
+
+    int fd = open(file_path, O_RDONLY);
+
+    if (fd == -1) {
+        DARWIN_KIT_LOG("MacRK::could not open shared cache file %s\n", file_path);
+
+        return nullptr;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(dyld::shared_cache::Header)) {
+        DARWIN_KIT_LOG("MacRK::shared cache file %s is too small!\n", file_path);
+
+        close(fd);
+
+        return nullptr;
+    }
+
+    base = reinterpret_cast<UInt8*>(mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+
+    if (base == MAP_FAILED) {
+        DARWIN_KIT_LOG("MacRK::mmap() failed for shared cache file %s\n", file_path);
+
+        close(fd);
+
+        return nullptr;
+    }
+
+    header = reinterpret_cast<dyld::shared_cache::Header*>(base);
+
+    if (strncmp(header->magic, "dyld_v1", strlen("dyld_v1")) != 0 ||
+        header->mappingOffset < offsetof(dyld::shared_cache::Header, imagesOffsetOld) ||
+        header->mappingOffset > (Size)st.st_size ||
+        header->mappingCount > ((Size)st.st_size - header->mappingOffset) /
+                                   sizeof(dyld::shared_cache::MappingInfo)) {
+        DARWIN_KIT_LOG("MacRK::%s is not a dyld shared cache!\n", file_path);
+
+        munmap(base, st.st_size);
+
+        close(fd);
+
+        return nullptr;
+    }
+
+    file = new SharedCacheFile;
+
+    file->path = strdup(file_path);
+    file->fd = fd;
+    file->base = base;
+    file->size = st.st_size;
+    file->header = header;
+    file->mappings =
+        reinterpret_cast<dyld::shared_cache::MappingInfo*>(base + header->mappingOffset);
+    file->mapping_count = header->mappingCount;
+
+    return file;
+}
+
+void SharedCache::UnmapCacheFile(SharedCacheFile* file) {
+    munmap(file->base, file->size);
+
+    close(file->fd);
+
+    free(file->path);
+
+    delete file;
+}
+
+bool SharedCache::MapSubCaches() {
+    dyld::shared_cache::Header* header = main_cache->header;
+
+    char subcache_path[PATH_MAX];
+
+    if (header->mappingOffset > offsetof(dyld::shared_cache::Header, subCacheArrayCount)) {
+        bool has_suffix;
+
+        UInt8* entries = main_cache->base + header->subCacheArrayOffset;
+
+        // caches that predate cacheSubType use the smaller entries without a file suffix
+        has_suffix = header->mappingOffset >
+                     offsetof(dyld::shared_cache::Header, imagesCount) + sizeof(UInt32);
+
+        if (!IsInFile(main_cache, header->subCacheArrayOffset, header->subCacheArrayCount,
+                      has_suffix ? sizeof(dyld::shared_cache::SubCacheEntry)
+                                 : sizeof(struct dyld_subcache_entry_v1))) {
+            DARWIN_KIT_LOG("MacRK::shared cache %s has a truncated subcache list!\n", path);
+
+            return false;
+        }
+
+        for (UInt32 i = 0; i < header->subCacheArrayCount; i++) {
+            SharedCacheFile* subcache;
+
+            if (has_suffix) {
+                dyld::shared_cache::SubCacheEntry* entry =
+                    reinterpret_cast<dyld::shared_cache::SubCacheEntry*>(entries) + i;
+
+                snprintf(subcache_path, sizeof(subcache_path), "%s%.*s", path,
+                         (int)sizeof(entry->fileSuffix), entry->fileSuffix);
+            } else {
+                snprintf(subcache_path, sizeof(subcache_path), "%s.%u", path, i + 1);
+            }
+
+            subcache = MapCacheFile(subcache_path);
+
+            if (!subcache) {
+                DARWIN_KIT_LOG("MacRK::missing shared cache subcache %s\n", subcache_path);
+
+                return false;
+            }
+
+            subcaches.push_back(subcache);
+        }
+    }
+
+    if (header->mappingOffset > offsetof(dyld::shared_cache::Header, symbolFileUUID)) {
+        static const UInt8 zero_uuid[sizeof(header->symbolFileUUID)] = {0};
+
+        if (memcmp(header->symbolFileUUID, zero_uuid, sizeof(zero_uuid)) != 0) {
+            snprintf(subcache_path, sizeof(subcache_path), "%s.symbols", path);
+
+            // the local symbols are optional, so dumping still works without them
+            symbols_cache = MapCacheFile(subcache_path);
+        }
+    }
+
+    return true;
+}
+
+void SharedCache::BuildRanges() {
+    std::vector<SharedCacheFile*> files;
+
+    files.push_back(main_cache);
+    files.insert(files.end(), subcaches.begin(), subcaches.end());
+
+    for (SharedCacheFile* file : files) {
+        for (UInt32 i = 0; i < file->mapping_count; i++) {
+            dyld::shared_cache::MappingInfo* mapping = &file->mappings[i];
+
+            if (!IsInFile(file, mapping->fileOffset, mapping->size, 1))
+                continue;
+
+            ranges.push_back({mapping->address, mapping->size, file,
+                              static_cast<Offset>(mapping->fileOffset)});
+        }
+    }
+
+    std::sort(ranges.begin(), ranges.end(),
+              [](const SharedCacheRange& a, const SharedCacheRange& b) {
+                  return a.address < b.address;
+              });
+}
+
+void SharedCache::BuildImageIndex() {
+    images_by_path.reserve(image_count);
+    images_by_name.reserve(image_count);
+
+    for (UInt32 i = 0; i < image_count; i++) {
+        dyld::shared_cache::CacheImageInfo* image = &images[i];
+
+        char* image_path = GetImagePath(image);
+
+        char* image_name;
+
+        if (!image_path)
+            continue;
+
+        image_name = strrchr(image_path, '/');
+
+        images_by_path.emplace(std::string_view(image_path), image);
+
+        images_by_name.emplace(std::string_view(image_name ? image_name + 1 : image_path), image);
+    }
+}
+
+char* SharedCache::GetImagePath(dyld::shared_cache::CacheImageInfo* image) {
+    char* image_path;
+
+    if (image->pathFileOffset >= main_cache->size)
+        return nullptr;
+
+    image_path = reinterpret_cast<char*>(main_cache->base + image->pathFileOffset);
+
+    // the path has to end inside the file
+    if (!memchr(image_path, '\0', main_cache->size - image->pathFileOffset))
+        return nullptr;
+
+    return image_path;
+}
+
+dyld::shared_cache::CacheImageInfo* SharedCache::GetImageByPath(const char* image_path) {
+    auto it = images_by_path.find(std::string_view(image_path));
+
+    if (it != images_by_path.end())
+        return it->second;
+
+    it = images_by_name.find(std::string_view(image_path));
+
+    if (it != images_by_name.end())
+        return it->second;
+
+    return nullptr;
+}
+
+xnu::mach::VmAddress SharedCache::GetImageLoadedAt(const char* image_name, char** image_path) {
+    dyld::shared_cache::CacheImageInfo* image = GetImageByPath(image_name);
+
+    if (!image) {
+        if (image_path)
+            *image_path = nullptr;
+
+        return 0;
+    }
+
+    if (image_path)
+        *image_path = GetImagePath(image);
+
+    return image->address;
+}
+
+SharedCacheRange* SharedCache::RangeForAddress(xnu::mach::VmAddress address) {
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), address,
+                               [](xnu::mach::VmAddress address, const SharedCacheRange& range) {
+                                   return address < range.address;
+                               });
+
+    if (it == ranges.begin())
+        return nullptr;
+
+    --it;
+
+    if (address >= it->address + it->size)
+        return nullptr;
+
+    return &*it;
+}
+
+UInt8* SharedCache::AddressToPointer(xnu::mach::VmAddress address) {
+    SharedCacheRange* range = RangeForAddress(address);
+
+    if (!range)
+        return nullptr;
+
+    return range->file->base + range->file_offset + (address - range->address);
+}
+
+bool SharedCache::AddressToFileOffset(xnu::mach::VmAddress address, SharedCacheFile** file,
+                                      Offset* offset) {
+    SharedCacheRange* range = RangeForAddress(address);
+
+    if (!range)
+        return false;
+
+    if (file)
+        *file = range->file;
+
+    if (offset)
+        *offset = range->file_offset + (address - range->address);
+
+    return true;
+}
+
+bool SharedCache::Read(xnu::mach::VmAddress address, void* data, Size size) {
+    UInt8* out = reinterpret_cast<UInt8*>(data);
+
+    while (size) {
+        SharedCacheRange* range = RangeForAddress(address);
+
+        Size available;
+        Size n;
+
+        if (!range)
+            return false;
+
+        available = range->address + range->size - address;
+
+        n = std::min(size, available);
+
+        memcpy(out, range->file->base + range->file_offset + (address - range->address), n);
+
+        out += n;
+        address += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+char* SharedCache::ReadString(xnu::mach::VmAddress address) {
+    SharedCacheRange* range = RangeForAddress(address);
+
+    char* s;
+    char* string;
+
+    Size available;
+    Size length;
+
+    if (!range)
+        return nullptr;
+
+    s = reinterpret_cast<char*>(range->file->base + range->file_offset +
+                                (address - range->address));
+
+    available = range->address + range->size - address;
+
+    length = strnlen(s, available);
+
+    string = reinterpret_cast<char*>(malloc(length + 1));
+
+    memcpy(string, s, length);
+
+    string[length] = '\0';
+
+    return string;
+}
+
+} // namespace dyld
+} // namespace darwin
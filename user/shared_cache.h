@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <types.h>
+
+// nothing beyond the cache format and types.h, so caches can be read on Linux hosts too
+extern "C" {
+#include <dyld_cache_format.h>
+}
+
+namespace darwin {
+namespace dyld {
+
+namespace shared_cache {
+using Header = struct dyld_cache_header;
+using MappingInfo = struct dyld_cache_mapping_info;
+using AllImageInfos = struct dyld_all_image_infos;
+using ImageInfo = struct dyld_image_info;
+using CacheImageInfo = struct dyld_cache_image_info;
+using SubCacheEntry = struct dyld_subcache_entry;
+using LocalSymbolsInfo = struct dyld_cache_local_symbols_info;
+using LocalSymbolsEntry = struct dyld_cache_local_symbols_entry;
+using LocalSymbolsEntry64 = struct dyld_cache_local_symbols_entry_64;
+}; // namespace shared_cache
+
+/**
+ *  A single file of a (possibly split) dyld shared cache mapped read-only into memory.
+ *  The header and mappings point directly into the mapped file.
+ */
+struct SharedCacheFile {
+    char* path;
+
+    int fd;
+
+    UInt8* base;
+    Size size;
+
+    dyld::shared_cache::Header* header;
+
+    dyld::shared_cache::MappingInfo* mappings;
+    UInt32 mapping_count;
+};
+
+/**
+ *  A contiguous range of the unslid shared region and the file that backs it.
+ */
+struct SharedCacheRange {
+    xnu::mach::VmAddress address;
+    Size size;
+
+    SharedCacheFile* file;
+
+    Offset file_offset;
+};
+
+/**
+ *  Reads a dyld shared cache from disk without requiring a live task.
+ *
+ *  The main cache file and all of its subcaches are mmap'd, so the header, mappings and image
+ *  list are parsed in place. Images can be looked up by full install path or by file name.
+ */
+class SharedCache {
+public:
+    explicit SharedCache(const char* path);
+
+    ~SharedCache();
+
+    static SharedCache* CacheWithPath(const char* path);
+
+    bool IsValid() {
+        return main_cache != nullptr;
+    }
+
+    char* GetPath() {
+        return path;
+    }
+
+    dyld::shared_cache::Header* GetHeader() {
+        return main_cache->header;
+    }
+
+    dyld::shared_cache::MappingInfo* GetMappings() {
+        return main_cache->mappings;
+    }
+
+    UInt32 GetMappingCount() {
+        return main_cache->mapping_count;
+    }
+
+    xnu::mach::VmAddress GetBaseAddress() {
+        return base_address;
+    }
+
+    SharedCacheFile* GetMainCache() {
+        return main_cache;
+    }
+
+    SharedCacheFile* GetSymbolsCache() {
+        return symbols_cache;
+    }
+
+    std::vector<SharedCacheFile*>& GetSubCaches() {
+        return subcaches;
+    }
+
+    dyld::shared_cache::CacheImageInfo* GetImages() {
+        return images;
+    }
+
+    UInt32 GetImageCount() {
+        return image_count;
+    }
+
+    // nullptr if the path does not lie within the main cache file
+    char* GetImagePath(dyld::shared_cache::CacheImageInfo* image);
+
+    dyld::shared_cache::CacheImageInfo* GetImageByPath(const char* image_path);
+
+    xnu::mach::VmAddress GetImageLoadedAt(const char* image_name, char** image_path);
+
+    SharedCacheRange* RangeForAddress(xnu::mach::VmAddress address);
+
+    UInt8* AddressToPointer(xnu::mach::VmAddress address);
+
+    bool AddressToFileOffset(xnu::mach::VmAddress address, SharedCacheFile** file,
+                             Offset* offset);
+
+    bool Read(xnu::mach::VmAddress address, void* data, Size size);
+
+    char* ReadString(xnu::mach::VmAddress address);
+
+private:
+    char* path;
+
+    SharedCacheFile* main_cache;
+    SharedCacheFile* symbols_cache;
+
+    std::vector<SharedCacheFile*> subcaches;
+
+    std::vector<SharedCacheRange> ranges;
+
+    xnu::mach::VmAddress base_address;
+
+    dyld::shared_cache::CacheImageInfo* images;
+    UInt32 image_count;
+
+    std::unordered_map<std::string_view, dyld::shared_cache::CacheImageInfo*> images_by_path;
+    std::unordered_map<std::string_view, dyld::shared_cache::CacheImageInfo*> images_by_name;
+
+    static bool IsInFile(SharedCacheFile* file, UInt64 offset, UInt64 count, Size entry_size);
+
+    SharedCacheFile* MapCacheFile(const char* file_path);
+
+    void UnmapCacheFile(SharedCacheFile* file);
+
+    bool MapSubCaches();
+
+    void BuildRanges();
+
+    void BuildImageIndex();
+};
+
+} // namespace dyld
+} // namespace darwin
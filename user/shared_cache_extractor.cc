@@ -0,0 +1,685 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shared_cache_extractor.h"
+#include "shared_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "log.h"
+
+namespace darwin {
+namespace dyld {
+
+static inline Size RoundPage(Size size) {
+    return (size + 0xFFF) & ~(Size)0xFFF;
+}
+
+static inline void AlignBuffer(std::vector<UInt8>& buffer, Size alignment) {
+    buffer.resize((buffer.size() + alignment - 1) & ~(alignment - 1), 0);
+}
+
+// every command has to lie within sizeofcmds and be large enough for the struct it is read as
+// same as SharedCache::IsInFile(), count entries of entry_size at offset fit in size bytes
+static inline bool IsInRange(UInt64 size, UInt64 offset, UInt64 count, Size entry_size) {
+    return offset <= size && count <= (size - offset) / entry_size;
+}
+
+static bool CheckLoadCommands(UInt8* commands, Size size, UInt32 ncmds) {
+    Size offset = sizeof(struct mach_header_64);
+
+    for (UInt32 i = 0; i < ncmds; i++) {
+        struct load_command* load_cmd;
+
+        Size minimum;
+
+        if (size - offset < sizeof(struct load_command))
+            return false;
+
+        load_cmd = reinterpret_cast<struct load_command*>(commands + offset);
+
+        if (load_cmd->cmdsize < sizeof(struct load_command) || load_cmd->cmdsize > size - offset)
+            return false;
+
+        switch (load_cmd->cmd) {
+        case LC_SEGMENT_64:
+            minimum = sizeof(struct segment_command_64);
+
+            if (load_cmd->cmdsize >= minimum)
+                minimum += (Size)reinterpret_cast<struct segment_command_64*>(load_cmd)->nsects *
+                           sizeof(struct section_64);
+
+            break;
+        case LC_SYMTAB:
+            minimum = sizeof(struct symtab_command);
+
+            break;
+        case LC_DYSYMTAB:
+            minimum = sizeof(struct dysymtab_command);
+
+            break;
+        case LC_DYLD_INFO:
+        case LC_DYLD_INFO_ONLY:
+            minimum = sizeof(struct dyld_info_command);
+
+            break;
+        case LC_FUNCTION_STARTS:
+        case LC_DATA_IN_CODE:
+        case LC_CODE_SIGNATURE:
+        case LC_SEGMENT_SPLIT_INFO:
+        case LC_DYLD_EXPORTS_TRIE:
+        case LC_DYLD_CHAINED_FIXUPS:
+            minimum = sizeof(struct linkedit_data_command);
+
+            break;
+        default:
+            minimum = sizeof(struct load_command);
+
+            break;
+        }
+
+        if (load_cmd->cmdsize < minimum)
+            return false;
+
+        offset += load_cmd->cmdsize;
+    }
+
+    return true;
+}
+
+SharedCacheExtractor::SharedCacheExtractor(SharedCache* cache, UInt32 num_threads)
+    : cache(cache), num_threads(num_threads), local_nlist(nullptr), local_nlist_count(0),
+      local_strings(nullptr), local_strings_size(0), local_symbols_by_vm_offset(false) {
+    if (!this->num_threads)
+        this->num_threads = std::max(std::thread::hardware_concurrency(), 1U);
+
+    BuildLocalSymbolsIndex();
+}
+
+void SharedCacheExtractor::BuildLocalSymbolsIndex() {
+    SharedCacheFile* file;
+
+    dyld::shared_cache::Header* header;
+    dyld::shared_cache::LocalSymbolsInfo* info;
+
+    UInt8* entries;
+
+    Size entry_size;
+
+    file = cache->GetSymbolsCache() ? cache->GetSymbolsCache() : cache->GetMainCache();
+
+    header = file->header;
+
+    if (!header->localSymbolsOffset ||
+        !IsInRange(file->size, header->localSymbolsOffset, header->localSymbolsSize, 1) ||
+        !IsInRange(header->localSymbolsSize, 0, 1, sizeof(dyld::shared_cache::LocalSymbolsInfo)))
+        return;
+
+    info = reinterpret_cast<dyld::shared_cache::LocalSymbolsInfo*>(file->base +
+                                                                   header->localSymbolsOffset);
+
+    // caches that carry a symbolFileUUID key their entries by VM offset from the cache base
+    local_symbols_by_vm_offset =
+        cache->GetHeader()->mappingOffset >
+        offsetof(dyld::shared_cache::Header, symbolFileUUID);
+
+    entry_size = local_symbols_by_vm_offset ? sizeof(dyld::shared_cache::LocalSymbolsEntry64)
+                                            : sizeof(dyld::shared_cache::LocalSymbolsEntry);
+
+    if (!IsInRange(header->localSymbolsSize, info->nlistOffset, info->nlistCount,
+                   sizeof(struct nlist_64)) ||
+        !IsInRange(header->localSymbolsSize, info->stringsOffset, info->stringsSize, 1) ||
+        !IsInRange(header->localSymbolsSize, info->entriesOffset, info->entriesCount,
+                   entry_size))
+        return;
+
+    local_nlist = reinterpret_cast<struct nlist_64*>(reinterpret_cast<UInt8*>(info) +
+                                                     info->nlistOffset);
+    local_nlist_count = info->nlistCount;
+
+    local_strings = reinterpret_cast<char*>(info) + info->stringsOffset;
+    local_strings_size = info->stringsSize;
+
+    entries = reinterpret_cast<UInt8*>(info) + info->entriesOffset;
+
+    local_symbols.reserve(info->entriesCount);
+
+    for (UInt32 i = 0; i < info->entriesCount; i++) {
+        UInt64 dylib_offset;
+
+        UInt32 start;
+        UInt32 count;
+
+        if (local_symbols_by_vm_offset) {
+            dyld::shared_cache::LocalSymbolsEntry64* entry =
+                reinterpret_cast<dyld::shared_cache::LocalSymbolsEntry64*>(entries) + i;
+
+            dylib_offset = entry->dylibOffset;
+            start = entry->nlistStartIndex;
+            count = entry->nlistCount;
+        } else {
+            dyld::shared_cache::LocalSymbolsEntry* entry =
+                reinterpret_cast<dyld::shared_cache::LocalSymbolsEntry*>(entries) + i;
+
+            dylib_offset = entry->dylibOffset;
+            start = entry->nlistStartIndex;
+            count = entry->nlistCount;
+        }
+
+        if ((UInt64)start + count > local_nlist_count)
+            continue;
+
+        local_symbols.emplace(dylib_offset, std::make_pair(start, count));
+    }
+}
+
+bool SharedCacheExtractor::GetLocalSymbols(dyld::shared_cache::CacheImageInfo* image,
+                                           LocalSymbols* locals) {
+    UInt64 dylib_offset;
+
+    if (local_symbols.empty())
+        return false;
+
+    if (local_symbols_by_vm_offset) {
+        dylib_offset = image->address - cache->GetBaseAddress();
+    } else {
+        Offset offset;
+
+        if (!cache->AddressToFileOffset(image->address, nullptr, &offset))
+            return false;
+
+        dylib_offset = offset;
+    }
+
+    auto it = local_symbols.find(dylib_offset);
+
+    if (it == local_symbols.end())
+        return false;
+
+    locals->nlist = local_nlist + it->second.first;
+    locals->count = it->second.second;
+    locals->strings = local_strings;
+    locals->strings_size = local_strings_size;
+
+    return true;
+}
+
+bool SharedCacheExtractor::DumpImage(dyld::shared_cache::CacheImageInfo* image,
+                                     std::vector<UInt8>& buffer) {
+    struct mach_header_64* hdr;
+
+    struct segment_command_64* linkedit;
+
+    SharedCacheRange* range;
+
+    struct symtab_command* symtab_command;
+    struct dysymtab_command* dysymtab_command;
+
+    UInt8* image_start;
+    UInt8* linkedit_start;
+
+    UInt8* q;
+
+    Size available;
+    Size header_size;
+
+    Offset linkedit_begin;
+
+    LocalSymbols locals;
+
+    bool has_locals;
+
+    std::vector<UInt8> commands;
+
+    std::vector<char> strtab;
+
+    range = cache->RangeForAddress(image->address);
+
+    if (!range)
+        return false;
+
+    image_start = cache->AddressToPointer(image->address);
+
+    available = range->address + range->size - image->address;
+
+    hdr = reinterpret_cast<struct mach_header_64*>(image_start);
+
+    if (available < sizeof(struct mach_header_64) || hdr->magic != MH_MAGIC_64 ||
+        hdr->sizeofcmds > available - sizeof(struct mach_header_64))
+        return false;
+
+    header_size = sizeof(struct mach_header_64) + hdr->sizeofcmds;
+
+    // the load commands are rewritten on the side and copied over the header page at the end
+    commands.assign(image_start, image_start + header_size);
+
+    hdr = reinterpret_cast<struct mach_header_64*>(commands.data());
+
+    if (!CheckLoadCommands(commands.data(), header_size, hdr->ncmds)) {
+        DARWIN_KIT_LOG("MacRK::image at 0x%llx has malformed load commands\n",
+                       (unsigned long long)image->address);
+
+        return false;
+    }
+
+    buffer.clear();
+    buffer.resize(RoundPage(header_size), 0);
+
+    linkedit = nullptr;
+
+    symtab_command = nullptr;
+    dysymtab_command = nullptr;
+
+    q = commands.data() + sizeof(struct mach_header_64);
+
+    for (UInt32 i = 0; i < hdr->ncmds; i++) {
+        struct load_command* load_cmd = reinterpret_cast<struct load_command*>(q);
+
+        if (load_cmd->cmd == LC_SEGMENT_64) {
+            struct segment_command_64* segment = reinterpret_cast<struct segment_command_64*>(q);
+
+            if (strncmp(segment->segname, "__LINKEDIT", sizeof(segment->segname)) == 0) {
+                linkedit = segment;
+            } else {
+                UInt64 old_fileoff = segment->fileoff;
+                UInt64 new_fileoff = buffer.size();
+
+                // both ends have to be mapped before the buffer grows to hold the segment
+                if (segment->filesize &&
+                    (segment->vmaddr + segment->filesize < segment->vmaddr ||
+                     !cache->RangeForAddress(segment->vmaddr) ||
+                     !cache->RangeForAddress(segment->vmaddr + segment->filesize - 1))) {
+                    DARWIN_KIT_LOG("MacRK::segment %.16s is not in the cache\n", segment->segname);
+
+                    return false;
+                }
+
+                buffer.resize(new_fileoff + segment->filesize, 0);
+
+                if (segment->filesize &&
+                    !cache->Read(segment->vmaddr, buffer.data() + new_fileoff, segment->filesize)) {
+                    DARWIN_KIT_LOG("MacRK::failed to dump segment %.16s\n", segment->segname);
+
+                    return false;
+                }
+
+                segment->fileoff = new_fileoff;
+
+                for (UInt32 j = 0; j < segment->nsects; j++) {
+                    struct section_64* section = reinterpret_cast<struct section_64*>(
+                        q + sizeof(struct segment_command_64) + sizeof(struct section_64) * j);
+
+                    if (section->offset)
+                        section->offset = new_fileoff + (section->offset - old_fileoff);
+                }
+            }
+        } else if (load_cmd->cmd == LC_SYMTAB) {
+            symtab_command = reinterpret_cast<struct symtab_command*>(q);
+        } else if (load_cmd->cmd == LC_DYSYMTAB) {
+            dysymtab_command = reinterpret_cast<struct dysymtab_command*>(q);
+        }
+
+        q += load_cmd->cmdsize;
+    }
+
+    if (!linkedit) {
+        memcpy(buffer.data(), commands.data(), header_size);
+
+        return true;
+    }
+
+    range = cache->RangeForAddress(linkedit->vmaddr);
+
+    // everything below is copied straight out of the mapping, so it must hold all of LINKEDIT
+    if (!range || linkedit->filesize > range->address + range->size - linkedit->vmaddr)
+        return false;
+
+    linkedit_start = cache->AddressToPointer(linkedit->vmaddr);
+
+    AlignBuffer(buffer, 0x1000);
+
+    linkedit_begin = buffer.size();
+
+    // copies a blob out of the cache's shared LINKEDIT and points the load command field at it
+    auto copy_linkedit = [&](UInt32* fileoff, UInt32 size) {
+        UInt64 new_fileoff;
+
+        if (!size || *fileoff < linkedit->fileoff ||
+            *fileoff - linkedit->fileoff + (UInt64)size > linkedit->filesize) {
+            *fileoff = 0;
+
+            return;
+        }
+
+        AlignBuffer(buffer, sizeof(UInt64));
+
+        new_fileoff = buffer.size();
+
+        buffer.insert(buffer.end(), linkedit_start + (*fileoff - linkedit->fileoff),
+                      linkedit_start + (*fileoff - linkedit->fileoff) + size);
+
+        *fileoff = (UInt32)new_fileoff;
+    };
+
+    q = commands.data() + sizeof(struct mach_header_64);
+
+    for (UInt32 i = 0; i < hdr->ncmds; i++) {
+        struct load_command* load_cmd = reinterpret_cast<struct load_command*>(q);
+
+        switch (load_cmd->cmd) {
+        case LC_DYLD_INFO:
+        case LC_DYLD_INFO_ONLY: {
+            struct dyld_info_command* dyld_info_command =
+                reinterpret_cast<struct dyld_info_command*>(q);
+
+            copy_linkedit(&dyld_info_command->rebase_off, dyld_info_command->rebase_size);
+            copy_linkedit(&dyld_info_command->bind_off, dyld_info_command->bind_size);
+            copy_linkedit(&dyld_info_command->weak_bind_off, dyld_info_command->weak_bind_size);
+            copy_linkedit(&dyld_info_command->lazy_bind_off, dyld_info_command->lazy_bind_size);
+            copy_linkedit(&dyld_info_command->export_off, dyld_info_command->export_size);
+
+            break;
+        }
+        case LC_FUNCTION_STARTS:
+        case LC_DATA_IN_CODE:
+        case LC_CODE_SIGNATURE:
+        case LC_SEGMENT_SPLIT_INFO:
+        case LC_DYLD_EXPORTS_TRIE:
+        case LC_DYLD_CHAINED_FIXUPS: {
+            struct linkedit_data_command* linkedit_data_command =
+                reinterpret_cast<struct linkedit_data_command*>(q);
+
+            copy_linkedit(&linkedit_data_command->dataoff, linkedit_data_command->datasize);
+
+            break;
+        }
+        }
+
+        q += load_cmd->cmdsize;
+    }
+
+    if (dysymtab_command) {
+        copy_linkedit(&dysymtab_command->tocoff,
+                      dysymtab_command->ntoc * sizeof(struct dylib_table_of_contents));
+        copy_linkedit(&dysymtab_command->modtaboff,
+                      dysymtab_command->nmodtab * sizeof(struct dylib_module_64));
+        copy_linkedit(&dysymtab_command->extrefsymoff,
+                      dysymtab_command->nextrefsyms * sizeof(struct dylib_reference));
+        copy_linkedit(&dysymtab_command->extreloff,
+                      dysymtab_command->nextrel * sizeof(struct relocation_info));
+        copy_linkedit(&dysymtab_command->locreloff,
+                      dysymtab_command->nlocrel * sizeof(struct relocation_info));
+    }
+
+    if (symtab_command && symtab_command->symoff >= linkedit->fileoff &&
+        symtab_command->stroff >= linkedit->fileoff &&
+        symtab_command->symoff - linkedit->fileoff +
+                (UInt64)symtab_command->nsyms * sizeof(struct nlist_64) <=
+            linkedit->filesize &&
+        symtab_command->stroff - linkedit->fileoff + (UInt64)symtab_command->strsize <=
+            linkedit->filesize &&
+        (!dysymtab_command || dysymtab_command->nlocalsym <= symtab_command->nsyms)) {
+        struct nlist_64* old_symtab;
+        struct nlist_64* new_symtab;
+
+        char* old_strtab;
+
+        Size old_strsize;
+
+        UInt32 old_nlocal;
+        UInt32 old_first_nonlocal;
+
+        UInt32 new_nlocal;
+        UInt32 new_nsyms;
+
+        UInt32 n;
+
+        Int64 delta;
+
+        Offset symtab_off;
+
+        old_symtab = reinterpret_cast<struct nlist_64*>(
+            linkedit_start + (symtab_command->symoff - linkedit->fileoff));
+        old_strtab = reinterpret_cast<char*>(linkedit_start +
+                                             (symtab_command->stroff - linkedit->fileoff));
+        old_strsize = symtab_command->strsize;
+
+        has_locals = dysymtab_command && dysymtab_command->ilocalsym == 0 &&
+                     GetLocalSymbols(image, &locals);
+
+        old_nlocal = has_locals ? dysymtab_command->nlocalsym : 0;
+        old_first_nonlocal = old_nlocal;
+
+        new_nlocal = has_locals ? locals.count : 0;
+        new_nsyms = symtab_command->nsyms - old_nlocal + new_nlocal;
+
+        delta = (Int64)new_nlocal - (Int64)old_nlocal;
+
+        AlignBuffer(buffer, sizeof(UInt64));
+
+        symtab_off = buffer.size();
+
+        buffer.resize(symtab_off + new_nsyms * sizeof(struct nlist_64), 0);
+
+        new_symtab = reinterpret_cast<struct nlist_64*>(buffer.data() + symtab_off);
+
+        strtab.clear();
+        strtab.push_back('\0');
+
+        n = 0;
+
+        // one pass over the nlists, pulling each name straight out of the shared string pool
+        auto append_symbol = [&](struct nlist_64* nl, char* strings, Size strings_size) {
+            struct nlist_64* sym = &new_symtab[n++];
+
+            *sym = *nl;
+
+            if (nl->n_strx && nl->n_strx < strings_size) {
+                char* name = strings + nl->n_strx;
+
+                Size length = strnlen(name, strings_size - nl->n_strx);
+
+                sym->n_strx = (UInt32)strtab.size();
+
+                strtab.insert(strtab.end(), name, name + length);
+                strtab.push_back('\0');
+            } else {
+                sym->n_strx = 0;
+            }
+        };
+
+        for (UInt32 i = 0; i < new_nlocal; i++)
+            append_symbol(&locals.nlist[i], locals.strings, locals.strings_size);
+
+        for (UInt32 i = old_first_nonlocal; i < symtab_command->nsyms; i++)
+            append_symbol(&old_symtab[i], old_strtab, old_strsize);
+
+        symtab_command->symoff = (UInt32)symtab_off;
+        symtab_command->nsyms = new_nsyms;
+
+        if (dysymtab_command) {
+            UInt32 nindirect = dysymtab_command->nindirectsyms;
+
+            if (has_locals) {
+                dysymtab_command->nlocalsym = new_nlocal;
+                dysymtab_command->iextdefsym += delta;
+                dysymtab_command->iundefsym += delta;
+            }
+
+            copy_linkedit(&dysymtab_command->indirectsymoff, nindirect * sizeof(UInt32));
+
+            if (delta && dysymtab_command->indirectsymoff) {
+                UInt32* indirect =
+                    reinterpret_cast<UInt32*>(buffer.data() + dysymtab_command->indirectsymoff);
+
+                for (UInt32 i = 0; i < nindirect; i++) {
+                    if (indirect[i] & (INDIRECT_SYMBOL_LOCAL | INDIRECT_SYMBOL_ABS))
+                        continue;
+
+                    if (indirect[i] < old_first_nonlocal)
+                        indirect[i] = INDIRECT_SYMBOL_LOCAL;
+                    else
+                        indirect[i] += delta;
+                }
+            }
+        }
+
+        AlignBuffer(buffer, sizeof(UInt64));
+
+        symtab_command->stroff = (UInt32)buffer.size();
+
+        strtab.resize((strtab.size() + sizeof(UInt64) - 1) & ~(sizeof(UInt64) - 1), '\0');
+
+        symtab_command->strsize = (UInt32)strtab.size();
+
+        buffer.insert(buffer.end(), strtab.begin(), strtab.end());
+    } else if (dysymtab_command) {
+        copy_linkedit(&dysymtab_command->indirectsymoff,
+                      dysymtab_command->nindirectsyms * sizeof(UInt32));
+    }
+
+    AlignBuffer(buffer, 0x1000);
+
+    linkedit->fileoff = linkedit_begin;
+    linkedit->filesize = buffer.size() - linkedit_begin;
+    linkedit->vmsize = linkedit->filesize;
+
+    memcpy(buffer.data(), commands.data(), header_size);
+
+    return true;
+}
+
+bool SharedCacheExtractor::WriteImage(const char* path, UInt8* data, Size size) {
+    char directory[PATH_MAX];
+
+    char* slash;
+
+    int fd;
+
+    snprintf(directory, sizeof(directory), "%s", path);
+
+    // create every missing parent directory of the image path
+    for (slash = strchr(directory + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+
+        if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+            DARWIN_KIT_LOG("MacRK::could not create directory %s\n", directory);
+
+            return false;
+        }
+
+        *slash = '/';
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1) {
+        DARWIN_KIT_LOG("MacRK::could not open %s for writing\n", path);
+
+        return false;
+    }
+
+    while (size) {
+        ssize_t written = write(fd, data, size);
+
+        if (written <= 0) {
+            if (written < 0 && errno == EINTR)
+                continue;
+
+            DARWIN_KIT_LOG("MacRK::failed to write %s\n", path);
+
+            close(fd);
+
+            return false;
+        }
+
+        data += written;
+        size -= written;
+    }
+
+    close(fd);
+
+    return true;
+}
+
+bool SharedCacheExtractor::ExtractImage(dyld::shared_cache::CacheImageInfo* image,
+                                        const char* directory, std::vector<UInt8>& buffer) {
+    char path[PATH_MAX];
+
+    char* image_path = cache->GetImagePath(image);
+
+    if (!image_path)
+        return false;
+
+    if (!DumpImage(image, buffer)) {
+        DARWIN_KIT_LOG("MacRK::failed to dump %s\n", image_path);
+
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "%s%s%s", directory, image_path[0] == '/' ? "" : "/",
+             image_path);
+
+    return WriteImage(path, buffer.data(), buffer.size());
+}
+
+UInt32 SharedCacheExtractor::ExtractAllImages(const char* directory) {
+    std::atomic<UInt32> next_image(0);
+    std::atomic<UInt32> extracted(0);
+
+    std::vector<std::thread> workers;
+
+    dyld::shared_cache::CacheImageInfo* images = cache->GetImages();
+
+    UInt32 image_count = cache->GetImageCount();
+
+    auto worker = [&]() {
+        std::vector<UInt8> buffer;
+
+        UInt32 i;
+
+        while ((i = next_image.fetch_add(1, std::memory_order_relaxed)) < image_count) {
+            if (ExtractImage(&images[i], directory, buffer))
+                extracted.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    for (UInt32 i = 1; i < num_threads && i < image_count; i++)
+        workers.emplace_back(worker);
+
+    worker();
+
+    for (std::thread& thread : workers)
+        thread.join();
+
+    return extracted.load();
+}
+
+} // namespace dyld
+} // namespace darwin
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <types.h>
+
+#include "shared_cache.h"
+
+namespace darwin {
+namespace dyld {
+
+/**
+ *  The unmapped local symbols of one image, as stored in the cache's local symbols region.
+ */
+struct LocalSymbols {
+    struct nlist_64* nlist;
+    UInt32 count;
+
+    char* strings;
+    Size strings_size;
+};
+
+/**
+ *  Extracts every image of a mapped shared cache into standalone Mach-O files.
+ *
+ *  Images are handed out to a fixed set of worker threads. Each worker builds its image in a
+ *  reusable buffer, copying segments straight out of the mapped cache and rebuilding the
+ *  LINKEDIT with the local symbols merged back in, then writes the file in one go.
+ *  The local symbols region is indexed once up front and shared by all workers.
+ */
+class SharedCacheExtractor {
+public:
+    explicit SharedCacheExtractor(SharedCache* cache, UInt32 num_threads = 0);
+
+    ~SharedCacheExtractor() = default;
+
+    SharedCache* GetSharedCache() {
+        return cache;
+    }
+
+    UInt32 GetThreadCount() {
+        return num_threads;
+    }
+
+    UInt32 ExtractAllImages(const char* directory);
+
+    bool ExtractImage(dyld::shared_cache::CacheImageInfo* image, const char* directory,
+                      std::vector<UInt8>& buffer);
+
+    bool DumpImage(dyld::shared_cache::CacheImageInfo* image, std::vector<UInt8>& buffer);
+
+    bool GetLocalSymbols(dyld::shared_cache::CacheImageInfo* image, LocalSymbols* locals);
+
+private:
+    SharedCache* cache;
+
+    UInt32 num_threads;
+
+    struct nlist_64* local_nlist;
+    UInt32 local_nlist_count;
+
+    char* local_strings;
+    Size local_strings_size;
+
+    bool local_symbols_by_vm_offset;
+
+    std::unordered_map<UInt64, std::pair<UInt32, UInt32>> local_symbols;
+
+    void BuildLocalSymbolsIndex();
+
+    bool WriteImage(const char* path, UInt8* data, Size size);
+};
+
+} // namespace dyld
+} // namespace darwin
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "string_arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace darwin {
+
+StringArena::~StringArena() {
+    for (Shard& shard : shards) {
+        for (char* chunk : shard.chunks)
+            free(chunk);
+    }
+}
+
+char* StringArena::Allocate(Shard* shard, Size size) {
+    char* string;
+
+    if (size > shard->remaining) {
+        // oversized strings get a chunk of their own so the current one keeps filling up
+        Size chunk_size = size > kStringArenaChunkSize / 4 ? size : kStringArenaChunkSize;
+
+        char* chunk = reinterpret_cast<char*>(malloc(chunk_size));
+
+        if (!chunk)
+            return nullptr;
+
+        shard->chunks.push_back(chunk);
+
+        if (chunk_size != kStringArenaChunkSize)
+            return chunk;
+
+        shard->cursor = chunk;
+        shard->remaining = chunk_size;
+    }
+
+    string = shard->cursor;
+
+    shard->cursor += size;
+    shard->remaining -= size;
+
+    return string;
+}
+
+char* StringArena::Intern(const char* string, Size length) {
+    std::string_view key(string, length);
+
+    Shard* shard = &shards[std::hash<std::string_view>()(key) % kStringArenaShards];
+
+    char* interned;
+
+    std::lock_guard<std::mutex> guard(shard->lock);
+
+    auto it = shard->strings.find(key);
+
+    if (it != shard->strings.end())
+        return const_cast<char*>(it->data());
+
+    interned = Allocate(shard, length + 1);
+
+    if (!interned)
+        return nullptr;
+
+    memcpy(interned, string, length);
+
+    interned[length] = '\0';
+
+    shard->strings.emplace(interned, length);
+
+    shard->bytes += length + 1;
+
+    return interned;
+}
+
+char* StringArena::Intern(const char* string) {
+    return Intern(string, strlen(string));
+}
+
+char* StringArena::Find(const char* string) {
+    std::string_view key(string);
+
+    Shard* shard = &shards[std::hash<std::string_view>()(key) % kStringArenaShards];
+
+    std::lock_guard<std::mutex> guard(shard->lock);
+
+    auto it = shard->strings.find(key);
+
+    return it != shard->strings.end() ? const_cast<char*>(it->data()) : nullptr;
+}
+
+Size StringArena::GetCount() {
+    Size count = 0;
+
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        count += shard.strings.size();
+    }
+
+    return count;
+}
+
+Size StringArena::GetBytes() {
+    Size bytes = 0;
+
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        bytes += shard.bytes;
+    }
+
+    return bytes;
+}
+
+} // namespace darwin
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include <types.h>
+
+namespace darwin {
+
+static constexpr Size kStringArenaChunkSize = 0x10000;
+static constexpr UInt32 kStringArenaShards = 16;
+
+/**
+ *  Thread-safe, append-only storage for interned strings.
+ *
+ *  Equal strings are stored once and always come back as the same pointer, which stays valid
+ *  for the lifetime of the arena. Strings are spread over a fixed number of shards by hash so
+ *  that threads interning different strings rarely contend on the same lock.
+ */
+class StringArena {
+public:
+    explicit StringArena() = default;
+
+    ~StringArena();
+
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    char* Intern(const char* string, Size length);
+
+    char* Intern(const char* string);
+
+    char* Find(const char* string);
+
+    Size GetCount();
+
+    Size GetBytes();
+
+private:
+    struct Shard {
+        std::mutex lock;
+
+        std::unordered_set<std::string_view> strings;
+
+        std::vector<char*> chunks;
+
+        char* cursor = nullptr;
+
+        Size remaining = 0;
+        Size bytes = 0;
+    };
+
+    Shard shards[kStringArenaShards];
+
+    char* Allocate(Shard* shard, Size size);
+};
+
+} // namespace darwin
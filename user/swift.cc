@@ -34,6 +34,9 @@
 #include <assert.h>
 #include <string.h>
 
+#include <atomic>
+#include <thread>
+
 namespace swift {
 
 static char kTextSegment[] = "__TEXT";
@@ -75,116 +78,474 @@ void SwiftABI::ParseSwift() {
     EnumerateTypes();
 }
 
+static constexpr UInt32 kMaxContextDepth = 16;
+
+static UInt8* ResolveRelativePointer(MachO* macho, void* field) {
+    Int32 offset;
+
+    UInt8* target;
+
+    memcpy(&offset, field, sizeof(offset));
+
+    if (!offset)
+        return nullptr;
+
+    target = reinterpret_cast<UInt8*>(field) + offset;
+
+    if (target < macho->GetOffset(0) || target >= macho->GetEnd())
+        return nullptr;
+
+    return target;
+}
+
+static bool IsNominalType(ContextDescriptorKind kind) {
+    return kind == ContextDescriptorKind::Class || kind == ContextDescriptorKind::Struct ||
+           kind == ContextDescriptorKind::Enum;
+}
+
+static char MangledKind(ContextDescriptorKind kind) {
+    switch (kind) {
+    case ContextDescriptorKind::Class:
+        return 'C';
+    case ContextDescriptorKind::Struct:
+        return 'V';
+    case ContextDescriptorKind::Enum:
+        return 'O';
+    case ContextDescriptorKind::Protocol:
+        return 'P';
+    default:
+        return 0;
+    }
+}
+
+// how much of a descriptor ParseTypeDescriptor copies for each kind
+static Size DescriptorSize(ContextDescriptorKind kind) {
+    return kind == ContextDescriptorKind::Protocol ? sizeof(struct ProtocolDescriptor)
+                                                   : sizeof(struct TypeDescriptor);
+}
+
+static void AppendIdentifier(std::string& mangled, char* identifier) {
+    mangled += std::to_string(strlen(identifier));
+    mangled += identifier;
+}
+
 void SwiftABI::EnumerateTypes() {
     Section* types = GetTypes();
+    Section* protos = GetProtos();
+
+    Size count = 0;
+
+    type_index.clear();
 
-    UInt8* swift_types_begin = (*macho)[types->GetOffset()];
-    UInt8* swift_types_end = (*macho)[types->GetOffset() + types->GetSize()];
+    types_by_name.clear();
+    types_by_mangled_name.clear();
+    types_by_descriptor.clear();
 
-    UInt32 swift_types_offset = 0;
+    swift_types.clear();
 
-    while (swift_types_offset < types->GetSize()) {
-        struct Type* type;
+    classes.clear();
+    structs.clear();
+    enums.clear();
+    protocols.clear();
 
-        UInt64 type_address;
+    count += types ? types->GetSize() / sizeof(Int32) : 0;
+    count += protos ? protos->GetSize() / sizeof(Int32) : 0;
 
-        Int64 type_offset;
+    type_index.reserve(count);
 
-        type_offset = *reinterpret_cast<Int32*>((*macho)[swift_types_offset]);
+    types_by_name.reserve(count * 2);
+    types_by_mangled_name.reserve(count);
+    types_by_descriptor.reserve(count);
 
-        type_address += type_offset;
+    // entries are relative pointers to the descriptors, the low bits mark an indirect reference
+    if (types) {
+        for (Offset off = types->GetOffset();
+             off + sizeof(Int32) <= types->GetOffset() + types->GetSize(); off += sizeof(Int32)) {
+            Int32* entry = reinterpret_cast<Int32*>((*macho)[off]);
 
-        struct TypeDescriptor* descriptor =
-            reinterpret_cast<struct TypeDescriptor*>((*macho)[type_offset]);
+            UInt8* descriptor;
 
-        type = ParseTypeDescriptor(descriptor);
+            if (*entry & 0x3)
+                continue;
 
-        swift_types_offset += sizeof(Int32);
+            descriptor = ResolveRelativePointer(macho, entry);
+
+            if (descriptor)
+                IndexTypeDescriptor(reinterpret_cast<struct TypeDescriptor*>(descriptor));
+        }
+    }
+
+    if (protos) {
+        for (Offset off = protos->GetOffset();
+             off + sizeof(Int32) <= protos->GetOffset() + protos->GetSize(); off += sizeof(Int32)) {
+            Int32* entry = reinterpret_cast<Int32*>((*macho)[off]);
+
+            UInt8* descriptor;
+
+            if (*entry & 0x1)
+                continue;
+
+            descriptor = ResolveRelativePointer(macho, entry);
+
+            if (descriptor)
+                IndexTypeDescriptor(reinterpret_cast<struct TypeDescriptor*>(descriptor));
+        }
     }
 }
 
-struct Type* SwiftABI::ParseTypeDescriptor(struct TypeDescriptor* typeDescriptor) {
+void SwiftABI::IndexTypeDescriptor(struct TypeDescriptor* typeDescriptor) {
+    TypeIndexEntry entry = {};
+
+    UInt8* header = macho->GetOffset(0);
+
+    char* components[kMaxContextDepth];
+    ContextDescriptorKind kinds[kMaxContextDepth];
+
+    UInt32 depth = 0;
+
+    char* module = nullptr;
+
+    struct TypeDescriptor* context;
+
+    UInt32 index;
+
+    if (reinterpret_cast<UInt8*>(typeDescriptor + 1) > macho->GetEnd())
+        return;
+
+    entry.descriptor = reinterpret_cast<UInt8*>(typeDescriptor) - header;
+    entry.kind = static_cast<ContextDescriptorKind>(typeDescriptor->flags & 0x1F);
+
+    if (reinterpret_cast<UInt8*>(typeDescriptor) + DescriptorSize(entry.kind) > macho->GetEnd())
+        return;
+    entry.name = reinterpret_cast<char*>(ResolveRelativePointer(macho, &typeDescriptor->name));
+
+    if (!entry.name || !MangledKind(entry.kind))
+        return;
+
+    if (IsNominalType(entry.kind)) {
+        UInt8* fieldDescriptor = ResolveRelativePointer(macho, &typeDescriptor->field_descriptor);
+
+        if (fieldDescriptor && fieldDescriptor + sizeof(struct FieldDescriptor) <= macho->GetEnd())
+            entry.field_descriptor = fieldDescriptor - header;
+    }
+
+    // walk out to the module, giving up on extensions and anonymous contexts
+    context = typeDescriptor;
+
+    while (depth < kMaxContextDepth) {
+        ContextDescriptorKind kind = static_cast<ContextDescriptorKind>(context->flags & 0x1F);
+
+        char* name = reinterpret_cast<char*>(ResolveRelativePointer(macho, &context->name));
+
+        UInt8* parent;
+
+        if (!name)
+            break;
+
+        if (kind == ContextDescriptorKind::Module) {
+            module = name;
+
+            break;
+        }
+
+        if (!MangledKind(kind) || context->parent & 0x1)
+            break;
+
+        components[depth] = name;
+        kinds[depth] = kind;
+
+        depth++;
+
+        parent = ResolveRelativePointer(macho, &context->parent);
+
+        if (!parent || parent + sizeof(struct ModuleDescriptor) > macho->GetEnd())
+            break;
+
+        context = reinterpret_cast<struct TypeDescriptor*>(parent);
+    }
+
+    if (module) {
+        std::string qualified = module;
+        std::string mangled;
+
+        if (strcmp(module, "Swift") == 0)
+            mangled = "s";
+        else if (strcmp(module, "__C") == 0)
+            mangled = "So";
+        else
+            AppendIdentifier(mangled, module);
+
+        for (UInt32 i = depth; i > 0; i--) {
+            qualified += ".";
+            qualified += components[i - 1];
+
+            AppendIdentifier(mangled, components[i - 1]);
+
+            mangled += MangledKind(kinds[i - 1]);
+        }
+
+        entry.qualified_name = strings.Intern(qualified.data(), qualified.size());
+        entry.mangled_name = strings.Intern(mangled.data(), mangled.size());
+
+        // top level Swift classes are registered with the Objective-C runtime as _TtC<module><name>
+        if (objc && entry.kind == ContextDescriptorKind::Class && depth == 1) {
+            std::string objc_name = "_TtC";
+
+            AppendIdentifier(objc_name, module);
+            AppendIdentifier(objc_name, entry.name);
+
+            entry.isa = objc->GetClassByName(objc_name.data());
+        }
+    }
+
+    index = type_index.size();
+
+    type_index.push_back(entry);
+
+    types_by_descriptor.emplace(entry.descriptor, index);
+
+    types_by_name.emplace(entry.name, index);
+
+    if (entry.qualified_name)
+        types_by_name.emplace(entry.qualified_name, index);
+
+    if (entry.mangled_name)
+        types_by_mangled_name.emplace(entry.mangled_name, index);
+
+    // reflection metadata may record the mangled name in plain text rather than as a
+    // symbolic reference, and that one may use substitutions we do not reproduce
+    if (entry.field_descriptor) {
+        struct FieldDescriptor* fieldDescriptor =
+            reinterpret_cast<struct FieldDescriptor*>(header + entry.field_descriptor);
+
+        char* mangled_type_name = reinterpret_cast<char*>(
+            ResolveRelativePointer(macho, &fieldDescriptor->mangled_type_name));
+
+        if (mangled_type_name && static_cast<UInt8>(*mangled_type_name) >= 0x20)
+            types_by_mangled_name.emplace(mangled_type_name, index);
+    }
+}
+
+TypeIndexEntry* SwiftABI::GetTypeIndexEntry(char* name) {
+    auto it = types_by_name.find(name);
+
+    return it != types_by_name.end() ? &type_index[it->second] : nullptr;
+}
+
+TypeIndexEntry* SwiftABI::GetTypeIndexEntryByMangledName(char* mangled_name) {
+    std::string_view mangled = mangled_name;
+
+    if (mangled.starts_with("_$s"))
+        mangled.remove_prefix(3);
+    else if (mangled.starts_with("$s"))
+        mangled.remove_prefix(2);
+
+    auto it = types_by_mangled_name.find(mangled);
+
+    return it != types_by_mangled_name.end() ? &type_index[it->second] : nullptr;
+}
+
+struct Type* SwiftABI::GetType(TypeIndexEntry* entry) {
     struct Type* type;
 
-    struct TypeDescriptor* descriptor;
+    if (entry->type)
+        return entry->type;
+
+    type = ParseTypeDescriptor(
+        reinterpret_cast<struct TypeDescriptor*>(macho->GetOffset(entry->descriptor)));
+
+    if (!type)
+        return nullptr;
+
+    type->name = entry->name;
+
+    if (entry->field_descriptor)
+        type->field_descriptor =
+            reinterpret_cast<struct FieldDescriptor*>(macho->GetOffset(entry->field_descriptor));
+
+    switch (entry->kind) {
+    case ContextDescriptorKind::Class: {
+        struct Class* cls = static_cast<struct Class*>(type);
+
+        cls->isa = entry->isa;
+
+        if (cls->isa)
+            ParseClassMetadata(cls);
+
+        classes.push_back(cls);
 
-    struct FieldDescriptor* fieldDescriptor;
+        break;
+    }
+    case ContextDescriptorKind::Struct:
+        structs.push_back(static_cast<struct Struct*>(type));
+
+        break;
+    case ContextDescriptorKind::Enum:
+        enums.push_back(static_cast<struct Enum*>(type));
+
+        break;
+    case ContextDescriptorKind::Protocol:
+        static_cast<struct Protocol*>(type)->name = entry->name;
+
+        protocols.push_back(static_cast<struct Protocol*>(type));
 
-    descriptor = typeDescriptor;
+        break;
+    default:
+        break;
+    }
 
-    Int32 field_descriptor_offset = *reinterpret_cast<Int32*>(&typeDescriptor->field_descriptor);
+    swift_types.push_back(type);
 
-    UInt64 field_descriptor_address =
-        reinterpret_cast<UInt64>(&typeDescriptor->field_descriptor) + field_descriptor_offset;
+    entry->type = type;
+
+    return type;
+}
 
-    fieldDescriptor = reinterpret_cast<struct FieldDescriptor*>(field_descriptor_address);
+struct Type* SwiftABI::GetTypeByMangledName(char* mangled_name) {
+    TypeIndexEntry* entry = GetTypeIndexEntryByMangledName(mangled_name);
+
+    return entry ? GetType(entry) : nullptr;
+}
+
+std::vector<Type*>* SwiftABI::GetAllTypes() {
+    for (TypeIndexEntry& entry : type_index)
+        GetType(&entry);
+
+    return &swift_types;
+}
+
+struct Class* SwiftABI::GetClass(char* cl) {
+    TypeIndexEntry* entry = GetTypeIndexEntry(cl);
+
+    if (!entry || entry->kind != ContextDescriptorKind::Class)
+        return nullptr;
+
+    return static_cast<struct Class*>(GetType(entry));
+}
+
+struct Struct* SwiftABI::GetStruct(char* st) {
+    TypeIndexEntry* entry = GetTypeIndexEntry(st);
+
+    if (!entry || entry->kind != ContextDescriptorKind::Struct)
+        return nullptr;
+
+    return static_cast<struct Struct*>(GetType(entry));
+}
+
+struct Enum* SwiftABI::GetEnum(char* en) {
+    TypeIndexEntry* entry = GetTypeIndexEntry(en);
+
+    if (!entry || entry->kind != ContextDescriptorKind::Enum)
+        return nullptr;
+
+    return static_cast<struct Enum*>(GetType(entry));
+}
+
+struct Protocol* SwiftABI::GetProtocol(char* p) {
+    TypeIndexEntry* entry = GetTypeIndexEntry(p);
+
+    if (!entry || entry->kind != ContextDescriptorKind::Protocol)
+        return nullptr;
+
+    return static_cast<struct Protocol*>(GetType(entry));
+}
+
+struct Fields* SwiftABI::GetFields(struct Type* type) {
+    if (!type->fields && type->field_descriptor)
+        ParseFieldDescriptor(type, type->field_descriptor);
+
+    return type->fields;
+}
+
+struct Type* SwiftABI::ParseTypeDescriptor(struct TypeDescriptor* typeDescriptor) {
+    struct Type* type;
+
+    ContextDescriptorKind kind;
+
+    UInt8* start = reinterpret_cast<UInt8*>(typeDescriptor);
 
     type = nullptr;
 
-    switch (fieldDescriptor->kind) {
-    case FDK_Struct: {
-        struct Struct* structure = new Struct;
+    if (start < macho->GetOffset(0) || start + sizeof(typeDescriptor->flags) > macho->GetEnd())
+        return nullptr;
+
+    kind = static_cast<ContextDescriptorKind>(typeDescriptor->flags & 0x1F);
+
+    // protocol descriptors are larger than the type descriptor they are read through
+    if (start + DescriptorSize(kind) > macho->GetEnd())
+        return nullptr;
+
+    switch (kind) {
+    case ContextDescriptorKind::Struct: {
+        struct Struct* structure = new Struct();
 
         memcpy(&structure->descriptor, typeDescriptor, sizeof(struct TypeDescriptor));
 
-        type = dynamic_cast<struct Type*>(structure);
+        structure->kind = MK_Struct;
+
+        type = structure;
     }
 
     break;
-    case FDK_Class: {
-        struct Class* cls = new Class;
+    case ContextDescriptorKind::Class: {
+        struct Class* cls = new Class();
 
         memcpy(&cls->descriptor, typeDescriptor, sizeof(struct TypeDescriptor));
 
-        type = dynamic_cast<struct Type*>(cls);
-
-        UInt64 typeMetadata = GetTypeMetadata(typeDescriptor);
-
-        if (typeMetadata) {
-            objc::ObjCClass* objc_class = objc->GetClassByIsa(typeMetadata);
-
-            if (objc_class) {
-                cls->isa = objc_class;
+        cls->kind = MK_Class;
 
-                ParseClassMetadata(cls);
-            }
-        }
+        type = cls;
     }
 
     break;
-    case FDK_Enum: {
-        struct Enum* enumeration = new Enum;
+    case ContextDescriptorKind::Enum: {
+        struct Enum* enumeration = new Enum();
 
         memcpy(&enumeration->descriptor, typeDescriptor, sizeof(struct TypeDescriptor));
 
-        type = dynamic_cast<struct Type*>(enumeration);
+        enumeration->kind = MK_Enum;
+
+        type = enumeration;
     }
 
     break;
-    case FDK_MultiPayloadEnum:
-        break;
-    case FDK_Protocol: {
-        struct Protocol* protocol = new Protocol;
+    case ContextDescriptorKind::Protocol: {
+        struct Protocol* protocol = new Protocol();
+
+        struct ProtocolDescriptor* descriptor =
+            reinterpret_cast<struct ProtocolDescriptor*>(typeDescriptor);
+
+        UInt64 trailing;
+
+        memcpy(&protocol->descriptor, typeDescriptor, sizeof(struct ProtocolDescriptor));
 
-        memcpy(&protocol->descriptor, typeDescriptor, sizeof(struct TypeDescriptor));
+        protocol->kind = MK_Existential;
 
-        type = dynamic_cast<struct Type*>(protocol);
+        protocol->associated_type_names = reinterpret_cast<char*>(
+            ResolveRelativePointer(macho, &descriptor->associated_type_names));
+
+        trailing = (UInt64)descriptor->num_requirements_in_signature *
+                       sizeof(struct GenericRequirementDescriptor) +
+                   (UInt64)descriptor->num_requirements * sizeof(struct ProtocolRequirement);
+
+        if (trailing <= (UInt64)(macho->GetEnd() - start) - sizeof(struct ProtocolDescriptor)) {
+            protocol->requirements_in_signature =
+                reinterpret_cast<struct GenericRequirementDescriptor*>(
+                    start + sizeof(struct ProtocolDescriptor));
+
+            protocol->requirements = reinterpret_cast<struct ProtocolRequirement*>(
+                protocol->requirements_in_signature +
+                descriptor->num_requirements_in_signature);
+        }
+
+        type = protocol;
     }
 
     break;
-    case FDK_ClassProtocol:
-        break;
-    case FDK_ObjCProtocol:
-        break;
-    case FDK_ObjCClass:
-        break;
     default:
         break;
     }
 
-    if (type)
-        ParseFieldDescriptor(type, fieldDescriptor);
-
     return type;
 }
 
@@ -225,30 +586,184 @@ UInt64 SwiftABI::GetTypeMetadata(struct TypeDescriptor* typeDescriptor) {
 #endif
 }
 
-void SwiftABI::ParseFieldDescriptor(struct Type* type,
-                                         struct FieldDescriptor* fieldDescriptor) {
+void SwiftABI::ParseFieldDescriptor(struct Type* type, struct FieldDescriptor* fieldDescriptor) {
     struct Fields* fields = new Fields;
 
-    UInt64 field_start = reinterpret_cast<UInt64>(fieldDescriptor) + sizeof(struct FieldDescriptor);
+    UInt8* field_start = reinterpret_cast<UInt8*>(fieldDescriptor) + sizeof(struct FieldDescriptor);
+
+    Size record_size = fieldDescriptor->field_record_size ? fieldDescriptor->field_record_size
+                                                          : sizeof(struct FieldRecord);
 
     fields->descriptor = fieldDescriptor;
 
+    if (field_start + record_size * fieldDescriptor->num_fields > macho->GetEnd()) {
+        type->fields = fields;
+
+        return;
+    }
+
+    fields->records.reserve(fieldDescriptor->num_fields);
+
     for (int i = 0; i < fieldDescriptor->num_fields; i++) {
+        struct FieldRecord* record =
+            reinterpret_cast<struct FieldRecord*>(field_start + record_size * i);
+
         struct Field* field = new Field;
 
-        memcpy(&field->record, reinterpret_cast<struct FieldRecord*>(field_start) + i,
-               sizeof(struct FieldRecord));
+        char* name;
+        char* mangled_name;
+
+        memcpy(&field->record, record, sizeof(struct FieldRecord));
+
+        name = reinterpret_cast<char*>(ResolveRelativePointer(macho, &record->field_name));
+        mangled_name =
+            reinterpret_cast<char*>(ResolveRelativePointer(macho, &record->mangled_type_name));
+
+        field->name = name ? name : "";
+        field->mangled_name = mangled_name ? mangled_name : "";
+        field->demangled_name = mangled_name ? DemangleTypeName(mangled_name) : nullptr;
 
-        field->name = "";
-        field->mangled_name = "";
-        field->demangled_name = "";
+        if (!field->demangled_name)
+            field->demangled_name = "";
 
         fields->records.push_back(field);
 
         type->field = field;
     }
+
+    type->fields = fields;
 }
 
 void SwiftABI::ParseClassMetadata(Class* cls) {}
 
+bool SwiftABI::ResolveSymbolicReferences(char* mangled_name, std::string& resolved) {
+    UInt8* p = reinterpret_cast<UInt8*>(mangled_name);
+    UInt8* end = macho->GetEnd();
+
+    resolved.clear();
+
+    // 0x01-0x17 are followed by a relative reference, 0x18-0x1f by an absolute pointer
+    while (p < end && *p) {
+        if (*p >= 0x01 && *p <= 0x17) {
+            UInt8* target;
+
+            // only direct references to context descriptors can be followed without a loader
+            if (*p != 0x01 || p + 1 + sizeof(Int32) > end)
+                return false;
+
+            target = ResolveRelativePointer(macho, p + 1);
+
+            if (!target)
+                return false;
+
+            auto it = types_by_descriptor.find(target - macho->GetOffset(0));
+
+            if (it == types_by_descriptor.end() || !type_index[it->second].mangled_name)
+                return false;
+
+            resolved += type_index[it->second].mangled_name;
+
+            p += 1 + sizeof(Int32);
+        } else if (*p >= 0x18 && *p <= 0x1F) {
+            return false;
+        } else {
+            resolved += static_cast<char>(*p++);
+        }
+    }
+
+    return true;
+}
+
+char* SwiftABI::DemangleTypeName(char* mangled_name) {
+    std::string resolved;
+
+    char* demangled;
+    char* interned;
+
+    if (!mangled_name || !*mangled_name)
+        return nullptr;
+
+    // a lone reference to a type in this image is already known by name
+    if (mangled_name[0] == 0x01 &&
+        reinterpret_cast<UInt8*>(mangled_name) + 1 + sizeof(Int32) < macho->GetEnd() &&
+        mangled_name[1 + sizeof(Int32)] == '\0') {
+        UInt8* target = ResolveRelativePointer(macho, mangled_name + 1);
+
+        auto it = target ? types_by_descriptor.find(target - macho->GetOffset(0))
+                         : types_by_descriptor.end();
+
+        if (it != types_by_descriptor.end()) {
+            TypeIndexEntry* entry = &type_index[it->second];
+
+            return entry->qualified_name ? entry->qualified_name : entry->name;
+        }
+    }
+
+    if (!ResolveSymbolicReferences(mangled_name, resolved))
+        return nullptr;
+
+    resolved.insert(0, "$s");
+
+    demangled = swift_demangle(resolved.data());
+
+    if (!demangled)
+        return nullptr;
+
+    interned = strings.Intern(demangled);
+
+    free(demangled);
+
+    return interned;
+}
+
+static constexpr Size kDecodeBatchSize = 64;
+
+UInt32 SwiftABI::DecodeTypes(UInt32 num_threads) {
+    std::atomic<Size> next_type(0);
+    std::atomic<UInt32> decoded(0);
+
+    std::vector<std::thread> workers;
+
+    Size count = type_index.size();
+
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+
+    if (!num_threads)
+        num_threads = 1;
+
+    // building a Type appends to the shared type lists, so that part stays on this thread
+    for (TypeIndexEntry& entry : type_index)
+        GetType(&entry);
+
+    auto worker = [&]() {
+        Size begin;
+
+        while ((begin = next_type.fetch_add(kDecodeBatchSize, std::memory_order_relaxed)) < count) {
+            Size end = begin + kDecodeBatchSize < count ? begin + kDecodeBatchSize : count;
+
+            for (Size i = begin; i < end; i++) {
+                struct Type* type = type_index[i].type;
+
+                if (!type)
+                    continue;
+
+                GetFields(type);
+
+                decoded.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    for (UInt32 i = 1; i < num_threads && i * kDecodeBatchSize < count; i++)
+        workers.emplace_back(worker);
+
+    worker();
+
+    for (std::thread& thread : workers)
+        thread.join();
+
+    return decoded.load();
+}
+
 } // namespace swift
\ No newline at end of file
@@ -16,13 +16,16 @@
 
 #pragma once
 
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include <types.h>
 
 #include "objc.h"
 
-#include "dictionary.h"
+#include "string_arena.h"
 
 class MachO;
 
@@ -115,6 +118,10 @@ struct Type {
     char* name;
 
     struct Field* field;
+
+    struct FieldDescriptor* field_descriptor;
+
+    struct Fields* fields;
 };
 
 struct TypeDescriptor {
@@ -138,12 +145,27 @@ struct ModuleDescriptor {
 
 struct ProtocolDescriptor {
     UInt32 flags;
+    Int32 parent;
     Int32 name;
     UInt32 num_requirements_in_signature;
     UInt32 num_requirements;
     Int32 associated_type_names;
 };
 
+static_assert(sizeof(ProtocolDescriptor) == 24);
+
+// the requirements in the signature follow a ProtocolDescriptor, then its ProtocolRequirements
+struct GenericRequirementDescriptor {
+    UInt32 flags;
+    Int32 param;
+    Int32 type_or_protocol;
+};
+
+struct ProtocolRequirement {
+    UInt32 flags;
+    Int32 default_implementation;
+};
+
 struct ProtocolConformanceDescriptor {
     Int32 protocol_descriptor;
     Int32 nominal_type_descriptor;
@@ -155,6 +177,13 @@ struct Protocol : Type {
     struct ProtocolDescriptor descriptor;
 
     char* name;
+
+    // space separated, nullptr if the protocol has no associated types
+    char* associated_type_names;
+
+    // trailing the descriptor in the image, nullptr if they run past its end
+    struct GenericRequirementDescriptor* requirements_in_signature;
+    struct ProtocolRequirement* requirements;
 };
 
 struct ClassDescriptor {
@@ -301,9 +330,31 @@ struct CaptureDescriptor {
 
 #pragma options align = reset
 
+/**
+ *  One entry per nominal type or protocol descriptor in __swift5_types and __swift5_protos.
+ *
+ *  Offsets are from the start of the image. Names point into the image or into the index's
+ *  interned strings. The Type itself, and its field records, are only built when asked for.
+ */
+struct TypeIndexEntry {
+    UInt32 descriptor;
+    UInt32 field_descriptor;
+
+    ContextDescriptorKind kind;
+
+    char* name;
+    char* qualified_name;
+    char* mangled_name;
+
+    objc::ObjCClass* isa;
+
+    struct Type* type;
+};
+
 class SwiftABI {
 public:
-    explicit SwiftABI(MachO* macho, objc::ObjCData* objc) : macho(macho), objc(objc) {
+    explicit SwiftABI(MachO* macho, objc::ObjCData* objc)
+        : macho(macho), objc(objc), text(nullptr) {
         PopulateSections();
         ParseSwift();
     }
@@ -313,8 +364,28 @@ public:
         ParseSwift();
     }
 
-    std::vector<Type*>* GetAllTypes() {
-        return &swift_types;
+    std::vector<Type*>* GetAllTypes();
+
+    std::vector<TypeIndexEntry>& GetTypeIndex() {
+        return type_index;
+    }
+
+    TypeIndexEntry* GetTypeIndexEntry(char* name);
+
+    TypeIndexEntry* GetTypeIndexEntryByMangledName(char* mangled_name);
+
+    struct Type* GetType(TypeIndexEntry* entry);
+
+    struct Type* GetTypeByMangledName(char* mangled_name);
+
+    struct Fields* GetFields(struct Type* type);
+
+    UInt32 DecodeTypes(UInt32 num_threads = 0);
+
+    char* DemangleTypeName(char* mangled_name);
+
+    darwin::StringArena* GetStringArena() {
+        return &strings;
     }
 
     objc::ObjCData* GetObjCMetaData() {
@@ -387,6 +458,8 @@ public:
 
     void EnumerateTypes();
 
+    void IndexTypeDescriptor(struct TypeDescriptor* typeDescriptor);
+
     UInt64 GetTypeMetadata(struct TypeDescriptor* typeDescriptor);
 
     struct Type* ParseTypeDescriptor(struct TypeDescriptor* typeDescriptor);
@@ -411,6 +484,16 @@ private:
     std::vector<struct Enum*> enums;
     std::vector<struct Protocol*> protocols;
 
+    std::vector<TypeIndexEntry> type_index;
+
+    std::unordered_map<std::string_view, UInt32> types_by_name;
+    std::unordered_map<std::string_view, UInt32> types_by_mangled_name;
+    std::unordered_map<UInt32, UInt32> types_by_descriptor;
+
+    darwin::StringArena strings;
+
+    bool ResolveSymbolicReferences(char* mangled_name, std::string& resolved);
+
     Section* typeref;
     Section* entry;
     Section* builtin;
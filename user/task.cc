@@ -17,6 +17,7 @@
 #include <assert.h>
 
 #include <mach/mach.h>
+#include <mach/mach_vm.h>
 
 #include "disassembler.h"
 #include "kernel.h"
@@ -309,6 +310,8 @@ xnu::mach::VmAddress Task::VmAllocate(Size size, UInt32 flags, xnu::mach::VmProt
 void Task::VmDeallocate(xnu::mach::VmAddress address, Size size) {
     kern_return_t ret;
 
+    InvalidateCaches(address, size);
+
     ret = vm_deallocate(task_port, address, size);
 
     if (ret != KERN_SUCCESS) {
@@ -325,6 +328,8 @@ void Task::VmDeallocate(xnu::mach::VmAddress address, Size size) {
 bool Task::VmProtect(xnu::mach::VmAddress address, Size size, xnu::mach::VmProtection prot) {
     kern_return_t ret;
 
+    InvalidateCaches(address, size);
+
     ret = vm_protect(task_port, address, size, FALSE, prot);
 
     if (ret == KERN_SUCCESS) {
@@ -341,9 +346,14 @@ bool Task::VmProtect(xnu::mach::VmAddress address, Size size, xnu::mach::VmProte
 void* Task::VmRemap(xnu::mach::VmAddress address, Size size) {
     kern_return_t ret;
 
-    xnu::mach::VmAddress remap = 0;
+    mach_vm_address_t remap = 0;
+
+    vm_prot_t cur_protection;
+    vm_prot_t max_protection;
 
-    // ret = vm_remap(task_port, address, size, &remap);
+    // a second mapping of the same pages, it starts out with their current protection
+    ret = mach_vm_remap(task_port, &remap, size, 0, VM_FLAGS_ANYWHERE, task_port, address, false,
+                        &cur_protection, &max_protection, VM_INHERIT_NONE);
 
     if (ret == KERN_SUCCESS) {
         return reinterpret_cast<void*>(remap);
@@ -363,10 +373,12 @@ UInt64 Task::VirtualToPhysical(xnu::mach::VmAddress address) {
 bool Task::Read(xnu::mach::VmAddress address, void* data, Size size) {
     kern_return_t ret;
 
-    mach_msg_type_number_t dataCount = size;
+    mach_vm_size_t dataCount = 0;
+
+    if (page_cache && ReadCached(address, data, size))
+        return true;
 
-    ret = vm_read_overwrite(task_port, address, size, (mach_vm_address_t)data,
-                            (vm_size_t*)&dataCount);
+    ret = mach_vm_read_overwrite(task_port, address, size, (mach_vm_address_t)data, &dataCount);
 
     if (ret == KERN_SUCCESS) {
         return true;
@@ -383,71 +395,17 @@ bool Task::ReadUnsafe(xnu::mach::VmAddress address, void* data, Size size) {
     return false;
 }
 
-UInt8 Task::Read8(xnu::mach::VmAddress address) {
-    bool success;
-
-    UInt8 read;
-
-    success = this->Read(address, reinterpret_cast<void*>(&read), sizeof(UInt8));
-
-    if (!success) {
-        DARWIN_KIT_LOG("Task::Read8() failed!\n");
-    }
-
-    assert(success);
-
-    return read;
-}
-
-UInt16 Task::Read16(xnu::mach::VmAddress address) {
-    bool success;
-
-    UInt16 read;
-
-    success = this->Read(address, reinterpret_cast<void*>(&read), sizeof(UInt16));
-
-    if (!success) {
-        DARWIN_KIT_LOG("Task::Read16() failed!\n");
-    }
-
-    assert(success);
-
-    return read;
-}
-
-UInt32 Task::Read32(xnu::mach::VmAddress address) {
-    bool success;
-
-    UInt32 read;
-
-    success = this->Read(address, reinterpret_cast<void*>(&read), sizeof(UInt32));
-
-    if (!success) {
-        DARWIN_KIT_LOG("Task::Read32() failed!\n");
-    }
-
-    assert(success);
-
-    return read;
-}
-
-UInt64 Task::Read64(xnu::mach::VmAddress address) {
-    bool success;
-
-    UInt64 read;
-
-    success = this->Read(address, reinterpret_cast<void*>(&read), sizeof(UInt64));
-
-    if (!success) {
-        DARWIN_KIT_LOG("Task::Read64() failed!\n");
-    }
-
-    assert(success);
+bool Task::TryRead(xnu::mach::VmAddress address, void* data, Size size) {
+    mach_vm_size_t dataCount = 0;
 
-    return read;
+    return mach_vm_read_overwrite(task_port, address, size, (mach_vm_address_t)data,
+                                  &dataCount) == KERN_SUCCESS &&
+           dataCount == size;
 }
 
 bool Task::Write(xnu::mach::VmAddress address, void* data, Size size) {
+    InvalidateCaches(address, size);
+
     return task_vm_write(task_port, address, data, size);
 }
 
@@ -455,74 +413,6 @@ bool Task::WriteUnsafe(xnu::mach::VmAddress address, void* data, Size size) {
     return false;
 }
 
-void Task::Write8(xnu::mach::VmAddress address, UInt8 value) {
-    bool success;
-
-    success = Write(address, reinterpret_cast<void*>(&value), sizeof(UInt8));
-
-    if (!success) {
-        DARWIN_KIT_LOG("Task::Write8() failed!\n");
-    }
-
-    assert(success);
-}
-
-void Task::Write16(xnu::mach::VmAddress address, UInt16 value) {
-    bool success;
-
-    success = Write(address, reinterpret_cast<void*>(&value), sizeof(UInt16));
-
-    if (!success) {
-        DARWIN_KIT_LOG("Task::Write16() failed!\n");
-    }
-
-    assert(success);
-}
-
-void Task::Write32(xnu::mach::VmAddress address, UInt32 value) {
-    bool success;
-
-    success = Write(address, reinterpret_cast<void*>(&value), sizeof(UInt32));
-
-    if (!success) {
-        DARWIN_KIT_LOG("Task::Write32() failed!\n");
-    }
-
-    assert(success);
-}
-
-void Task::Write64(xnu::mach::VmAddress address, UInt64 value) {
-    bool success;
-
-    success = Write(address, reinterpret_cast<void*>(&value), sizeof(UInt64));
-
-    if (!success) {
-        DARWIN_KIT_LOG("Task::Write64() failed!\n");
-    }
-
-    assert(success);
-}
-
-char* Task::ReadString(xnu::mach::VmAddress address) {
-    char* string;
-
-    UInt8 value;
-
-    Size size = 0;
-
-    do {
-        Read(address + size++, &value, sizeof(value));
-    } while (value);
-
-    assert(size > 0);
-
-    string = (char*)malloc(size + 1);
-
-    Read(address, string, size + 1);
-
-    return string;
-}
-
 Symbol* Task::GetSymbolByName(char* symname) {
     return macho->GetSymbolByName(symname);
 }
@@ -21,10 +21,10 @@
 #include <stdint.h>
 #include <string.h>
 
-#include <mach/mach_types.h>
 #include <sys/types.h>
 
 #include "disassembler.h"
+#include "task_page_cache.h"
 
 namespace xnu {
 class Kernel;
@@ -53,6 +53,30 @@ class MachOUserspace;
 using namespace darwin;
 
 namespace xnu {
+
+// ranges of a ReadV() closer than this are read in one call and the bytes between them dropped
+static constexpr Size kTaskIoCoalesceGap = 0x1000;
+
+// upper bound for a single coalesced read
+static constexpr Size kTaskIoMaxSpan = 0x100000;
+
+// ReadAhead() pulls remote memory in windows of this size, aligned to it
+static constexpr Size kTaskReadAheadSize = 0x4000;
+
+// used instead when the full window is not entirely mapped
+static constexpr Size kTaskReadAheadMinimum = 0x1000;
+
+/**
+ *  One range of a vectored ReadV() or WriteV(), copied between address in the task and data.
+ */
+struct TaskIoVector {
+    xnu::mach::VmAddress address;
+
+    Size size;
+
+    void* data;
+};
+
 class Task {
 public:
     explicit Task() : disassembler(new Disassembler(this)) {}
@@ -64,7 +88,7 @@ public:
     explicit Task(Kernel* kernel, xnu::mach::Port task_port)
                 : kernel(kernel), task_port(task_port) {}
 
-    ~Task() = default;
+    ~Task();
 
     xnu::Kernel* GetKernel();
 
@@ -140,6 +164,9 @@ public:
     virtual bool Read(xnu::mach::VmAddress address, void* data, Size size);
     virtual bool ReadUnsafe(xnu::mach::VmAddress address, void* data, Size size);
 
+    // like Read() but quiet on failure, for speculative reads that may touch unmapped memory
+    virtual bool TryRead(xnu::mach::VmAddress address, void* data, Size size);
+
     virtual UInt8 Read8(xnu::mach::VmAddress address);
     virtual UInt16 Read16(xnu::mach::VmAddress address);
     virtual UInt32 Read32(xnu::mach::VmAddress address);
@@ -155,6 +182,31 @@ public:
 
     virtual char* ReadString(xnu::mach::VmAddress address);
 
+    bool ReadV(xnu::TaskIoVector* vectors, Size count);
+    bool WriteV(xnu::TaskIoVector* vectors, Size count);
+
+    bool ReadAhead(xnu::mach::VmAddress address, void* data, Size size);
+
+    void InvalidateReadAhead();
+
+    /**
+     *  Serves Read() from an LRU cache of remote pages, for repeated walks over the metadata of
+     *  a stopped process. Writes, protection changes, deallocations and hook installs through
+     *  this task invalidate the pages they touch. Memory changed behind the task's back, by the
+     *  process itself for example, needs an explicit InvalidateCaches().
+     */
+    void EnablePageCache(UInt32 pages = kTaskPageCacheDefaultPages);
+
+    void DisablePageCache();
+
+    xnu::TaskPageCache* GetPageCache() {
+        return page_cache;
+    }
+
+    void InvalidateCaches(xnu::mach::VmAddress address, Size size);
+
+    void InvalidateCaches();
+
     virtual Symbol* GetSymbolByName(char* symname);
     virtual Symbol* GetSymbolByAddress(xnu::mach::VmAddress address);
 
@@ -194,5 +246,19 @@ protected:
     xnu::mach::VmAddress dyld_shared_cache;
 
     darwin::dyld::Dyld* dyld;
+
+    // the last window read by ReadAhead(), dropped by every write through this task and, unless
+    // the page cache is enabled, at the start of every ReadString()
+    UInt8* read_ahead = nullptr;
+
+    xnu::mach::VmAddress read_ahead_address = 0;
+
+    Size read_ahead_size = 0;
+
+    bool FillReadAhead(xnu::mach::VmAddress address, Size size);
+
+    xnu::TaskPageCache* page_cache = nullptr;
+
+    bool ReadCached(xnu::mach::VmAddress address, void* data, Size size);
 };
 }; // namespace xnu
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Hosts without Mach have no remote tasks. This gives Task the members task.cc implements with
+// Mach calls, all failing, so subclasses backed by local memory such as BufferTask can be built
+// and tested there.
+#ifndef __APPLE__
+
+#include "task.h"
+
+namespace xnu {
+
+xnu::mach::VmAddress Task::GetBase() {
+    return 0;
+}
+
+Offset Task::GetSlide() {
+    return 0;
+}
+
+char* Task::GetTaskName() {
+    return nullptr;
+}
+
+UInt64 Task::Call(char* symbolname, UInt64* arguments, Size argCount) {
+    return 0;
+}
+
+UInt64 Task::Call(xnu::mach::VmAddress func, UInt64* arguments, Size argCount) {
+    return 0;
+}
+
+xnu::mach::VmAddress Task::VmAllocate(Size size) {
+    return 0;
+}
+
+xnu::mach::VmAddress Task::VmAllocate(Size size, UInt32 flags, xnu::mach::VmProtection prot) {
+    return 0;
+}
+
+void Task::VmDeallocate(xnu::mach::VmAddress address, Size size) {
+    InvalidateCaches(address, size);
+}
+
+bool Task::VmProtect(xnu::mach::VmAddress address, Size size, xnu::mach::VmProtection prot) {
+    InvalidateCaches(address, size);
+
+    return false;
+}
+
+void* Task::VmRemap(xnu::mach::VmAddress address, Size size) {
+    return nullptr;
+}
+
+UInt64 Task::VirtualToPhysical(xnu::mach::VmAddress address) {
+    return 0;
+}
+
+bool Task::Read(xnu::mach::VmAddress address, void* data, Size size) {
+    return false;
+}
+
+bool Task::ReadUnsafe(xnu::mach::VmAddress address, void* data, Size size) {
+    return false;
+}
+
+bool Task::TryRead(xnu::mach::VmAddress address, void* data, Size size) {
+    return false;
+}
+
+bool Task::Write(xnu::mach::VmAddress address, void* data, Size size) {
+    InvalidateCaches(address, size);
+
+    return false;
+}
+
+bool Task::WriteUnsafe(xnu::mach::VmAddress address, void* data, Size size) {
+    return false;
+}
+
+Symbol* Task::GetSymbolByName(char* symname) {
+    return nullptr;
+}
+
+Symbol* Task::GetSymbolByAddress(xnu::mach::VmAddress address) {
+    return nullptr;
+}
+
+xnu::mach::VmAddress Task::GetSymbolAddressByName(char* symbolname) {
+    return 0;
+}
+
+void Task::PrintLoadedImages() {}
+
+} // namespace xnu
+
+#endif
@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "log.h"
+
+#include "task.h"
+
+namespace xnu {
+
+Task::~Task() {
+    if (read_ahead)
+        delete[] read_ahead;
+
+    if (page_cache)
+        delete page_cache;
+}
+
+UInt8 Task::Read8(xnu::mach::VmAddress address) {
+    bool success;
+
+    UInt8 read;
+
+    success = this->Read(address, reinterpret_cast<void*>(&read), sizeof(UInt8));
+
+    if (!success) {
+        DARWIN_KIT_LOG("Task::Read8() failed!\n");
+    }
+
+    assert(success);
+
+    return read;
+}
+
+UInt16 Task::Read16(xnu::mach::VmAddress address) {
+    bool success;
+
+    UInt16 read;
+
+    success = this->Read(address, reinterpret_cast<void*>(&read), sizeof(UInt16));
+
+    if (!success) {
+        DARWIN_KIT_LOG("Task::Read16() failed!\n");
+    }
+
+    assert(success);
+
+    return read;
+}
+
+UInt32 Task::Read32(xnu::mach::VmAddress address) {
+    bool success;
+
+    UInt32 read;
+
+    success = this->Read(address, reinterpret_cast<void*>(&read), sizeof(UInt32));
+
+    if (!success) {
+        DARWIN_KIT_LOG("Task::Read32() failed!\n");
+    }
+
+    assert(success);
+
+    return read;
+}
+
+UInt64 Task::Read64(xnu::mach::VmAddress address) {
+    bool success;
+
+    UInt64 read;
+
+    success = this->Read(address, reinterpret_cast<void*>(&read), sizeof(UInt64));
+
+    if (!success) {
+        DARWIN_KIT_LOG("Task::Read64() failed!\n");
+    }
+
+    assert(success);
+
+    return read;
+}
+
+void Task::Write8(xnu::mach::VmAddress address, UInt8 value) {
+    bool success;
+
+    success = Write(address, reinterpret_cast<void*>(&value), sizeof(UInt8));
+
+    if (!success) {
+        DARWIN_KIT_LOG("Task::Write8() failed!\n");
+    }
+
+    assert(success);
+}
+
+void Task::Write16(xnu::mach::VmAddress address, UInt16 value) {
+    bool success;
+
+    success = Write(address, reinterpret_cast<void*>(&value), sizeof(UInt16));
+
+    if (!success) {
+        DARWIN_KIT_LOG("Task::Write16() failed!\n");
+    }
+
+    assert(success);
+}
+
+void Task::Write32(xnu::mach::VmAddress address, UInt32 value) {
+    bool success;
+
+    success = Write(address, reinterpret_cast<void*>(&value), sizeof(UInt32));
+
+    if (!success) {
+        DARWIN_KIT_LOG("Task::Write32() failed!\n");
+    }
+
+    assert(success);
+}
+
+void Task::Write64(xnu::mach::VmAddress address, UInt64 value) {
+    bool success;
+
+    success = Write(address, reinterpret_cast<void*>(&value), sizeof(UInt64));
+
+    if (!success) {
+        DARWIN_KIT_LOG("Task::Write64() failed!\n");
+    }
+
+    assert(success);
+}
+
+char* Task::ReadString(xnu::mach::VmAddress address) {
+    char* string;
+
+    char value;
+
+    Size size = 0;
+
+    // a window left by an earlier call is only trusted while the page cache is, which has the
+    // same invalidation rules, otherwise the process may have changed it since
+    if (!page_cache)
+        InvalidateReadAhead();
+
+    // every byte comes out of the read ahead window, so a string costs a call per window
+    do {
+        if (!ReadAhead(address + size, &value, sizeof(value)))
+            return nullptr;
+
+        size++;
+    } while (value);
+
+    string = (char*)malloc(size);
+
+    if (!string)
+        return nullptr;
+
+    // the window may have moved past the start of a long string and the refill can fail
+    if (!ReadAhead(address, string, size)) {
+        free(string);
+
+        return nullptr;
+    }
+
+    return string;
+}
+
+bool Task::ReadV(TaskIoVector* vectors, Size count) {
+    std::vector<TaskIoVector*> sorted;
+
+    std::vector<UInt8> span;
+
+    bool success = true;
+
+    for (Size i = 0; i < count; i++) {
+        if (vectors[i].size)
+            sorted.push_back(&vectors[i]);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](TaskIoVector* a, TaskIoVector* b) {
+        return a->address < b->address;
+    });
+
+    for (Size first = 0, last; first < sorted.size(); first = last) {
+        xnu::mach::VmAddress start = sorted[first]->address;
+        xnu::mach::VmAddress end = start + sorted[first]->size;
+
+        // grow the span while the next range starts close enough to the end of this one
+        for (last = first + 1; last < sorted.size(); last++) {
+            xnu::mach::VmAddress next_end = sorted[last]->address + sorted[last]->size;
+
+            if (sorted[last]->address > end + kTaskIoCoalesceGap ||
+                std::max(end, next_end) - start > kTaskIoMaxSpan)
+                break;
+
+            end = std::max(end, next_end);
+        }
+
+        if (last - first == 1) {
+            success &= Read(start, sorted[first]->data, sorted[first]->size);
+
+            continue;
+        }
+
+        span.resize(end - start);
+
+        // a hole in the gaps fails the whole span, the ranges themselves may still be mapped
+        if (!TryRead(start, span.data(), span.size())) {
+            for (Size i = first; i < last; i++)
+                success &= Read(sorted[i]->address, sorted[i]->data, sorted[i]->size);
+
+            continue;
+        }
+
+        for (Size i = first; i < last; i++)
+            memcpy(sorted[i]->data, &span[sorted[i]->address - start], sorted[i]->size);
+    }
+
+    return success;
+}
+
+bool Task::WriteV(TaskIoVector* vectors, Size count) {
+    std::vector<TaskIoVector*> sorted;
+
+    std::vector<UInt8> span;
+
+    bool success = true;
+
+    for (Size i = 0; i < count; i++) {
+        if (vectors[i].size)
+            sorted.push_back(&vectors[i]);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](TaskIoVector* a, TaskIoVector* b) {
+        return a->address < b->address;
+    });
+
+    for (Size first = 0, last; first < sorted.size(); first = last) {
+        xnu::mach::VmAddress start = sorted[first]->address;
+        xnu::mach::VmAddress end = start + sorted[first]->size;
+
+        // unlike reads, gaps cannot be filled in, so only touching ranges are merged
+        for (last = first + 1; last < sorted.size(); last++) {
+            xnu::mach::VmAddress next_end = sorted[last]->address + sorted[last]->size;
+
+            if (sorted[last]->address > end || std::max(end, next_end) - start > kTaskIoMaxSpan)
+                break;
+
+            end = std::max(end, next_end);
+        }
+
+        if (last - first == 1) {
+            success &= Write(start, sorted[first]->data, sorted[first]->size);
+
+            continue;
+        }
+
+        span.resize(end - start);
+
+        // overlapping ranges land in the order they were given, which is their order in vectors
+        std::sort(sorted.begin() + first, sorted.begin() + last);
+
+        for (Size i = first; i < last; i++)
+            memcpy(&span[sorted[i]->address - start], sorted[i]->data, sorted[i]->size);
+
+        success &= Write(start, span.data(), span.size());
+    }
+
+    return success;
+}
+
+bool Task::FillReadAhead(xnu::mach::VmAddress address, Size size) {
+    if (!read_ahead)
+        read_ahead = new UInt8[kTaskReadAheadSize];
+
+    read_ahead_size = 0;
+
+    if (!TryRead(address, read_ahead, size))
+        return false;
+
+    read_ahead_address = address;
+    read_ahead_size = size;
+
+    return true;
+}
+
+bool Task::ReadAhead(xnu::mach::VmAddress address, void* data, Size size) {
+    xnu::mach::VmAddress window;
+    xnu::mach::VmAddress window_end;
+
+    if (size > kTaskReadAheadMinimum)
+        return Read(address, data, size);
+
+    if (!read_ahead_size || address < read_ahead_address ||
+        address + size > read_ahead_address + read_ahead_size) {
+        window = address & ~(kTaskReadAheadSize - 1);
+
+        // a request crossing the end of the aligned window gets one starting at its own page
+        if (address + size > window + kTaskReadAheadSize)
+            window = address & ~(kTaskReadAheadMinimum - 1);
+
+        if (!FillReadAhead(window, kTaskReadAheadSize)) {
+            // the pages around the request may not be mapped, settle for the ones it touches
+            window = address & ~(kTaskReadAheadMinimum - 1);
+            window_end = (address + size + kTaskReadAheadMinimum - 1) & ~(kTaskReadAheadMinimum - 1);
+
+            if (!FillReadAhead(window, window_end - window))
+                return Read(address, data, size);
+        }
+    }
+
+    memcpy(data, read_ahead + (address - read_ahead_address), size);
+
+    return true;
+}
+
+void Task::InvalidateReadAhead() {
+    read_ahead_size = 0;
+}
+
+void Task::EnablePageCache(UInt32 pages) {
+    DisablePageCache();
+
+    page_cache = new TaskPageCache(pages);
+
+    if (!page_cache->IsValid())
+        DisablePageCache();
+}
+
+void Task::DisablePageCache() {
+    if (page_cache)
+        delete page_cache;
+
+    page_cache = nullptr;
+}
+
+void Task::InvalidateCaches(xnu::mach::VmAddress address, Size size) {
+    InvalidateReadAhead();
+
+    if (page_cache)
+        page_cache->Invalidate(address, size);
+}
+
+void Task::InvalidateCaches() {
+    InvalidateReadAhead();
+
+    if (page_cache)
+        page_cache->InvalidateAll();
+}
+
+bool Task::ReadCached(xnu::mach::VmAddress address, void* data, Size size) {
+    UInt8* out = reinterpret_cast<UInt8*>(data);
+
+    Size page_size = page_cache->GetPageSize();
+
+    xnu::mach::VmAddress first = address & ~(page_size - 1);
+    xnu::mach::VmAddress end = address + size;
+
+    // big reads would flush most of the cache for pages that are rarely read twice
+    if (!size || (end - first) / page_size > page_cache->GetCapacity() / 4)
+        return false;
+
+    for (xnu::mach::VmAddress page = first; page < end; page += page_size) {
+        UInt8* cached = page_cache->Lookup(page);
+
+        xnu::mach::VmAddress from = page < address ? address : page;
+        xnu::mach::VmAddress to = page + page_size < end ? page + page_size : end;
+
+        if (!cached) {
+            cached = page_cache->Insert(page);
+
+            // the caller falls back to an uncached read, which reports the failure
+            if (!TryRead(page, cached, page_size)) {
+                page_cache->Remove(page);
+
+                return false;
+            }
+        }
+
+        memcpy(out, cached + (from - page), to - from);
+
+        out += to - from;
+    }
+
+    return true;
+}
+
+} // namespace xnu
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "task_page_cache.h"
+
+#include <string.h>
+
+namespace xnu {
+
+static inline UInt32 HashPage(xnu::mach::VmAddress page) {
+    return (UInt32)((page * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+TaskPageCache::TaskPageCache(UInt32 capacity, Size page_size)
+    : capacity(capacity), page_size(page_size), data(nullptr), entries(nullptr),
+      slots(nullptr), slot_mask(0), count(0), head(kTaskPageCacheNone),
+      tail(kTaskPageCacheNone), free_head(kTaskPageCacheNone), generation(0), stats() {
+    UInt32 table_size = 1;
+
+    if (!capacity || !page_size || (page_size & (page_size - 1)))
+        return;
+
+    // keep the load factor at or below one half
+    while (table_size < capacity * 2)
+        table_size <<= 1;
+
+    data = new UInt8[capacity * page_size];
+    entries = new TaskPageCacheEntry[capacity];
+    slots = new UInt32[table_size];
+
+    slot_mask = table_size - 1;
+
+    Clear();
+}
+
+TaskPageCache::~TaskPageCache() {
+    if (data)
+        delete[] data;
+
+    if (entries)
+        delete[] entries;
+
+    if (slots)
+        delete[] slots;
+}
+
+void TaskPageCache::ResetStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+UInt32 TaskPageCache::FindSlot(xnu::mach::VmAddress page) {
+    UInt32 slot = HashPage(page) & slot_mask;
+
+    while (slots[slot]) {
+        if (entries[slots[slot] - 1].page == page)
+            return slot;
+
+        slot = (slot + 1) & slot_mask;
+    }
+
+    return kTaskPageCacheNone;
+}
+
+void TaskPageCache::RemoveSlot(UInt32 slot) {
+    UInt32 hole = slot;
+
+    // shift later members of the probe sequence back so that lookups never stop early
+    while (true) {
+        UInt32 home;
+
+        slot = (slot + 1) & slot_mask;
+
+        if (!slots[slot])
+            break;
+
+        home = HashPage(entries[slots[slot] - 1].page) & slot_mask;
+
+        if (((slot - home) & slot_mask) >= ((slot - hole) & slot_mask)) {
+            slots[hole] = slots[slot];
+
+            hole = slot;
+        }
+    }
+
+    slots[hole] = 0;
+}
+
+void TaskPageCache::Unlink(UInt32 entry) {
+    TaskPageCacheEntry* e = &entries[entry];
+
+    if (e->prev != kTaskPageCacheNone)
+        entries[e->prev].next = e->next;
+    else
+        head = e->next;
+
+    if (e->next != kTaskPageCacheNone)
+        entries[e->next].prev = e->prev;
+    else
+        tail = e->prev;
+}
+
+void TaskPageCache::PushFront(UInt32 entry) {
+    entries[entry].prev = kTaskPageCacheNone;
+    entries[entry].next = head;
+
+    if (head != kTaskPageCacheNone)
+        entries[head].prev = entry;
+    else
+        tail = entry;
+
+    head = entry;
+}
+
+void TaskPageCache::Release(UInt32 slot) {
+    UInt32 entry = slots[slot] - 1;
+
+    RemoveSlot(slot);
+
+    Unlink(entry);
+
+    entries[entry].next = free_head;
+
+    free_head = entry;
+
+    count--;
+}
+
+UInt8* TaskPageCache::Lookup(xnu::mach::VmAddress page) {
+    UInt32 slot;
+    UInt32 entry;
+
+    if (!data || !count || (slot = FindSlot(page)) == kTaskPageCacheNone) {
+        stats.misses++;
+
+        return nullptr;
+    }
+
+    entry = slots[slot] - 1;
+
+    if (entry != head) {
+        Unlink(entry);
+
+        PushFront(entry);
+    }
+
+    stats.hits++;
+
+    return data + entry * page_size;
+}
+
+UInt8* TaskPageCache::Insert(xnu::mach::VmAddress page) {
+    UInt32 slot;
+    UInt32 entry;
+
+    if (!data)
+        return nullptr;
+
+    if ((slot = FindSlot(page)) != kTaskPageCacheNone)
+        Release(slot);
+
+    if (free_head == kTaskPageCacheNone) {
+        Release(FindSlot(entries[tail].page));
+
+        stats.evictions++;
+    }
+
+    entry = free_head;
+
+    free_head = entries[entry].next;
+
+    entries[entry].page = page;
+
+    slot = HashPage(page) & slot_mask;
+
+    while (slots[slot])
+        slot = (slot + 1) & slot_mask;
+
+    slots[slot] = entry + 1;
+
+    PushFront(entry);
+
+    count++;
+
+    return data + entry * page_size;
+}
+
+void TaskPageCache::Remove(xnu::mach::VmAddress page) {
+    UInt32 slot;
+
+    if (!data || !count)
+        return;
+
+    if ((slot = FindSlot(page)) != kTaskPageCacheNone)
+        Release(slot);
+}
+
+void TaskPageCache::Invalidate(xnu::mach::VmAddress address, Size size) {
+    xnu::mach::VmAddress first;
+    xnu::mach::VmAddress last;
+
+    if (!data || !size)
+        return;
+
+    generation++;
+
+    stats.invalidations++;
+
+    if (!count)
+        return;
+
+    first = address & ~(page_size - 1);
+    last = (address + size - 1) & ~(page_size - 1);
+
+    // a range larger than the cache is cheaper to drop wholesale than page by page
+    if ((last - first) / page_size >= count) {
+        Clear();
+
+        return;
+    }
+
+    for (xnu::mach::VmAddress page = first; page <= last; page += page_size)
+        Remove(page);
+}
+
+void TaskPageCache::InvalidateAll() {
+    if (!data)
+        return;
+
+    Clear();
+
+    generation++;
+
+    stats.invalidations++;
+}
+
+void TaskPageCache::Clear() {
+    memset(slots, 0, (slot_mask + 1) * sizeof(UInt32));
+
+    for (UInt32 i = 0; i < capacity; i++)
+        entries[i].next = i + 1 < capacity ? i + 1 : kTaskPageCacheNone;
+
+    free_head = 0;
+
+    head = kTaskPageCacheNone;
+    tail = kTaskPageCacheNone;
+
+    count = 0;
+}
+
+} // namespace xnu
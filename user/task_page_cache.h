@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) YungRaj
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <types.h>
+
+namespace xnu {
+
+static constexpr Size kTaskPageCachePageSize = 0x1000;
+
+static constexpr UInt32 kTaskPageCacheDefaultPages = 256;
+
+// marks the ends of the LRU and free lists
+static constexpr UInt32 kTaskPageCacheNone = 0xFFFFFFFF;
+
+struct TaskPageCacheStats {
+    UInt64 hits;
+    UInt64 misses;
+
+    UInt64 evictions;
+
+    UInt64 invalidations;
+};
+
+struct TaskPageCacheEntry {
+    xnu::mach::VmAddress page;
+
+    // neighbours in the LRU list, or the next free entry
+    UInt32 prev;
+    UInt32 next;
+};
+
+/**
+ *  A fixed number of remote pages kept in local memory, evicted least recently used first.
+ *
+ *  Pages are found through an open-addressed table of entry indices with linear probing and
+ *  backward shift deletion, recency is tracked with a doubly linked list threaded through the
+ *  entries, so lookups, insertions and evictions are all constant time and nothing is
+ *  allocated after construction.
+ *
+ *  Every invalidation bumps the generation, so code that derived something from cached pages
+ *  can cheaply tell whether the task's memory may have changed since. The cache only stores
+ *  bytes, Task decides what to read into it and when to invalidate it.
+ */
+class TaskPageCache {
+public:
+    explicit TaskPageCache(UInt32 capacity = kTaskPageCacheDefaultPages,
+                           Size page_size = kTaskPageCachePageSize);
+
+    ~TaskPageCache();
+
+    bool IsValid() {
+        return data != nullptr;
+    }
+
+    Size GetPageSize() {
+        return page_size;
+    }
+
+    UInt32 GetCapacity() {
+        return capacity;
+    }
+
+    UInt32 GetCount() {
+        return count;
+    }
+
+    UInt64 GetGeneration() {
+        return generation;
+    }
+
+    TaskPageCacheStats& GetStats() {
+        return stats;
+    }
+
+    void ResetStats();
+
+    // the cached bytes of a page aligned address, or nullptr if the page is not cached
+    UInt8* Lookup(xnu::mach::VmAddress page);
+
+    // storage for a page that is about to be read in, evicting the oldest page when full
+    UInt8* Insert(xnu::mach::VmAddress page);
+
+    void Remove(xnu::mach::VmAddress page);
+
+    void Invalidate(xnu::mach::VmAddress address, Size size);
+
+    void InvalidateAll();
+
+private:
+    UInt32 capacity;
+
+    Size page_size;
+
+    UInt8* data;
+
+    TaskPageCacheEntry* entries;
+
+    // entry index plus one, zero for an empty slot
+    UInt32* slots;
+    UInt32 slot_mask;
+
+    UInt32 count;
+
+    UInt32 head;
+    UInt32 tail;
+
+    UInt32 free_head;
+
+    UInt64 generation;
+
+    TaskPageCacheStats stats;
+
+    UInt32 FindSlot(xnu::mach::VmAddress page);
+
+    void RemoveSlot(UInt32 slot);
+
+    void Unlink(UInt32 entry);
+
+    void PushFront(UInt32 entry);
+
+    void Release(UInt32 slot);
+
+    void Clear();
+};
+
+} // namespace xnu
@@ -16,11 +16,58 @@
 
 #include "user_patcher.h"
 
+#include <string.h>
+
+#include "code_directory_verifier.h"
 #include "hook.h"
 #include "payload.h"
 
+using namespace darwin;
+
 void UserPatcher::FindAndReplace(void* data, Size dataSize, const void* find, Size findSize,
                                  const void* replace, Size replaceSize) {
+    UInt8* p = reinterpret_cast<UInt8*>(data);
+    UInt8* end = p + dataSize;
+
+    if (!findSize || findSize != replaceSize || findSize > dataSize)
+        return;
+
+    while (p + findSize <= end) {
+        UInt8* match = reinterpret_cast<UInt8*>(memchr(p, *(const UInt8*)find, end - p));
+
+        if (!match || match + findSize > end)
+            break;
+
+        if (memcmp(match, find, findSize) == 0) {
+            memcpy(match, replace, replaceSize);
+
+            MarkPatched(match, replaceSize);
+
+            p = match + findSize;
+        } else {
+            p = match + 1;
+        }
+    }
+}
+
+void UserPatcher::TrackCodeDirectory(CodeDirectoryVerifier* verifier, UInt8* image) {
+    code_directory = verifier;
+
+    this->image = image;
+}
+
+void UserPatcher::MarkPatched(void* address, Size size) {
+    UInt8* patched = reinterpret_cast<UInt8*>(address);
+
+    // patches outside of the tracked image do not affect its signature
+    if (!code_directory || patched < image)
+        return;
+
+    code_directory->MarkDirty(patched - image, size);
+}
+
+UInt32 UserPatcher::ResignPatchedPages(UInt32 num_threads) {
+    return code_directory ? code_directory->Resign(num_threads) : 0;
 }
 
 void UserPatcher::RouteFunction(Hook* hook) {
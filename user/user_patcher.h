@@ -21,12 +21,13 @@
 #include "patcher.h"
 
 namespace darwin {
+class CodeDirectoryVerifier;
 class Hook;
 class Payload;
 
 class UserPatcher : Patcher {
 public:
-    explicit UserPatcher() = default;
+    explicit UserPatcher() : code_directory(nullptr), image(nullptr) {}
 
     ~UserPatcher() = default;
 
@@ -46,6 +47,20 @@ public:
 
     Size MapAddresses(const char* mapBuf);
 
+    /**
+     *  Keeps the code directory of image in sync with the patches applied to it. Every patch
+     *  that lands inside image marks its pages dirty, ResignPatchedPages() then rehashes just
+     *  those pages.
+     */
+    void TrackCodeDirectory(CodeDirectoryVerifier* verifier, UInt8* image);
+
+    void MarkPatched(void* address, Size size);
+
+    UInt32 ResignPatchedPages(UInt32 num_threads = 0);
+
 private:
+    CodeDirectoryVerifier* code_directory;
+
+    UInt8* image;
 };
 } // namespace darwin